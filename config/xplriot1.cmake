@@ -27,4 +27,20 @@ endif()
 if (EXT_FS)
   list(APPEND CONF_FILE ${CMAKE_CURRENT_LIST_DIR}/ext_fs.conf)
   list(APPEND DTC_OVERLAY_FILE ${CMAKE_CURRENT_LIST_DIR}/ext_fs.overlay)
+  if (EXT_FS_PROFILE)
+    list(APPEND CONF_FILE ${CMAKE_CURRENT_LIST_DIR}/ext_fs_${EXT_FS_PROFILE}.conf)
+    list(APPEND DTC_OVERLAY_FILE ${CMAKE_CURRENT_LIST_DIR}/ext_fs_${EXT_FS_PROFILE}.overlay)
+  endif()
+endif()
+if (OTA)
+  if (NOT DEFINED ENV{USE_BL})
+    message(WARNING "OTA requires the bootloader")
+  endif()
+  list(APPEND CONF_FILE ${CMAKE_CURRENT_LIST_DIR}/ota.conf)
+  list(APPEND DTC_OVERLAY_FILE ${CMAKE_CURRENT_LIST_DIR}/ota.overlay)
+  # For the download checkpoints
+  set(COUNTERS 1)
+endif()
+if (COUNTERS)
+  list(APPEND CONF_FILE ${CMAKE_CURRENT_LIST_DIR}/counters.conf)
 endif()
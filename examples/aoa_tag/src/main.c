@@ -20,27 +20,104 @@
  * by u-connectLocate https://www.u-blox.com/en/product/u-connectlocate
  * Version 2.0 or later of u-connectLocate is required.
  *
+ * A compact sensor record with battery level, motion and temperature is
+ * sent as manufacturer data in the periodic advertisements, so that the
+ * locators get the telemetry without any connection to the tag.
+ *
  */
 
 #include <stdio.h>
 
+#include <kernel.h>
+
 #include "buttons.h"
 #include "leds.h"
+#include "sensors.h"
 #include "ble_aoa.h"
 
 #define ADV_IND_LED BLUE_LED
 
-static uint16_t advIntervals[] = { 50, 100, 1000 };
-static int currInt = -1;
-static bool doAdvertise = true;
+// Sensors are read this often, the payload is only updated on changes
+#define SENSOR_INTERVAL_MS 10000
+#define PAYLOAD_MIN_INTERVAL_MS 1000
+// 0xFFFF is reserved for testing, replace with your own company id
+#define COMPANY_ID 0xFFFF
+#define PAYLOAD_VERSION 1
+#define PAYLOAD_FLAG_MOVING 0x01
+
+// Sensor record, little endian
+typedef struct __attribute__((packed)) {
+    uint16_t companyId;
+    uint8_t version;
+    uint8_t flags;
+    uint8_t batteryPercent;  // 0xFF when not available
+    int16_t temperatureDeciC;  // 0x8000 when not available
+} sensorRecord_t;
+
+// Woken up on sensor, motion and button events
+K_SEM_DEFINE(gEventSem, 0, 1);
+
+// Interval 0 means adaptive, fast while moving and slow when still
+#define ADAPTIVE 0
+#define ADAPTIVE_FAST_MS 100
+#define ADAPTIVE_SLOW_MS 1000
+// Time without motion before slowing down. Motion speeds up at once,
+// so short pauses don't make the interval go back and forth. Each
+// change makes the locators sync to the periodic advertising again.
+// The accelerometer has no interrupt, it is polled 10 times a second
+// whatever the interval. While still that is ten times as many wake
+// ups as the slow advertising, the measured time per poll is printed
+// so that the cost can be weighed against the saved air time.
+#define ADAPTIVE_STILL_MS 30000
+
+// CTE settings, shorter and fewer CTEs give more tags per second
+// at each locator at the cost of less samples per tag
+static const bleAoaCte_t gCte = {
+    .length = 20,  // 160 us
+    .count = 1,
+    .type = BLE_AOA_CTE_AOA
+};
+// Set to non zero to step through CTE settings at start, printing
+// the air time of each. Each setting is kept for this many ms.
+#define CTE_SWEEP_DWELL_MS 0
 
-void updateInterval()
+static uint16_t advIntervals[] = { 50, 100, 1000, ADAPTIVE };
+static volatile int currInt = 0;
+static volatile bool doAdvertise = true;
+static uint16_t gAppliedInterval = 0;
+
+static void applyInterval()
 {
-    currInt = (currInt + 1) % (sizeof(advIntervals) / sizeof(advIntervals[0]));
     uint16_t interval = advIntervals[currInt];
-    bleAoaAdvertise(interval, interval, true);
+    if (interval == ADAPTIVE) {
+        interval = sensorsIsMoving() ? ADAPTIVE_FAST_MS : ADAPTIVE_SLOW_MS;
+    }
+    if (!doAdvertise) {
+        interval = 0;
+    }
+    if (interval == gAppliedInterval) {
+        return;
+    }
+    bool ok;
+    if (interval == 0) {
+        ok = bleAoaAdvertise(0, 0, false);
+        printf("Turning off advertising\n");
+    } else if (gAppliedInterval == 0) {
+        ok = bleAoaAdvertise(interval, interval, true);
+        printf("Advertising with interval %d ms%s\n", interval,
+               advIntervals[currInt] == ADAPTIVE ? " (adaptive)" : "");
+    } else {
+        // Only the periodic advertising is restarted, but the locators
+        // must sync to it again
+        ok = bleAoaSetInterval(interval, interval);
+        printf("New advertisment interval %d ms%s\n", interval,
+               advIntervals[currInt] == ADAPTIVE ? " (adaptive)" : "");
+    }
+    if (!ok) {
+        printf("* Failed to change advertising\n");
+    }
+    gAppliedInterval = interval;
     ledBlink(ADV_IND_LED, interval, interval);
-    printf("New advertisment interval %d ms\n", interval);
 }
 
 void button_pressed(int buttonNo, uint32_t holdTime)
@@ -48,25 +125,70 @@ void button_pressed(int buttonNo, uint32_t holdTime)
     if (!holdTime) {
         if (buttonNo == 0) {
             if (doAdvertise) {
-                updateInterval();
+                currInt = (currInt + 1) % (sizeof(advIntervals) / sizeof(advIntervals[0]));
             }
         } else {
             doAdvertise = !doAdvertise;
-            uint16_t interval = doAdvertise ? advIntervals[currInt] : 0;
-            bleAoaAdvertise(interval, interval, doAdvertise);
-            ledBlink(ADV_IND_LED, interval, interval);
-            printf("Turning %s advertising\n", doAdvertise ? "on" : "off");
         }
+        k_sem_give(&gEventSem);
     }
 }
 
+void motionChanged(bool moving)
+{
+    // Send the new motion state without waiting for the next reading
+    k_sem_give(&gEventSem);
+}
+
+static void updatePayload()
+{
+    uint8_t battery = 0xFF;
+    int16_t temperature = INT16_MIN;
+    getBatteryLevel(&battery);
+    getTemperature(&temperature);
+    sensorRecord_t record = {
+        .companyId = COMPANY_ID,
+        .version = PAYLOAD_VERSION,
+        .flags = sensorsIsMoving() ? PAYLOAD_FLAG_MOVING : 0,
+        .batteryPercent = battery,
+        .temperatureDeciC = temperature
+    };
+    bleAoaSetAdvData((const uint8_t *)&record, sizeof(record));
+}
+
 void main(void)
 {
     buttonsInit(button_pressed);
     ledsInit();
+    sensorsInit();
     if (bleAoaInit(NULL)) {
-        updateInterval();
+        bleAoaSetAdvDataMinInterval(PAYLOAD_MIN_INTERVAL_MS);
+        updatePayload();
+        applyInterval();
+        if (!bleAoaSetCte(&gCte)) {
+            printf("* Failed to set CTE parameters\n");
+        }
+        printf("CTE air time %u us per event\n", bleAoaCteAirTimeUs(&gCte));
+#if CTE_SWEEP_DWELL_MS
+        bleAoaCteSweep(CTE_SWEEP_DWELL_MS);
+        bleAoaSetCte(&gCte);
+#endif
+        if (!sensorsMotionStart(50, ADAPTIVE_STILL_MS, motionChanged)) {
+            printf("* Failed to start motion detection\n");
+        }
         printf("AoA tag started\n");
+        bool costPrinted = false;
+        while (true) {
+            k_sem_take(&gEventSem, K_MSEC(SENSOR_INTERVAL_MS));
+            applyInterval();
+            updatePayload();
+            uint32_t pollUs = sensorsMotionPollUs();
+            if (!costPrinted && pollUs > 0) {
+                printf("Motion polling takes %u us every %d ms\n", pollUs,
+                       SENSORS_MOTION_POLL_MS);
+                costPrinted = true;
+            }
+        }
     } else {
         printf("* Failed to start Bluetooth\n");
     }
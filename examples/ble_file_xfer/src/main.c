@@ -0,0 +1,264 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *
+ * Download of files from the external flash file system over BLE SPS,
+ * using the protocol in common/file_xfer.h.
+ *
+ * At start a loopback test is made where the files are listed and a
+ * log file is downloaded without any radio involved. Every 7th frame
+ * is corrupted in the loopback so that the resends are tested too.
+ * Then a SPS server is started to which a client can connect and
+ * download files.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ubxlib.h"
+#include "u_ringbuffer.h"
+
+#include "ext_fs.h"
+#include "file_xfer.h"
+
+#define LOG_FILE_NAME "log.txt"
+#define LOG_FILE_LINES 2000
+#define LOOPBACK_WINDOW 4
+#define LOOPBACK_CORRUPT_EVERY 7
+#define RX_BUFFER_SIZE 2048
+
+static uDeviceType_t gDeviceType = U_DEVICE_TYPE_SHORT_RANGE;
+static const uNetworkCfgBle_t gNetworkCfg = {
+    .type = U_NETWORK_TYPE_BLE,
+    .role = U_BLE_CFG_ROLE_PERIPHERAL,
+    .spsServer = true
+};
+uDeviceCfg_t gDeviceCfg;
+uDeviceHandle_t gDeviceHandle;
+
+static uRingBuffer_t gRxRing;
+static char gRxRingBuffer[RX_BUFFER_SIZE];
+static uPortMutexHandle_t gRxMutex;
+static uPortSemaphoreHandle_t gRxSem;
+static volatile int32_t gChannel = -1;
+
+static fileXferLoopback_t gLoopback;
+static fileXferTransport_t gLoopbackServer;
+static volatile bool gLoopbackDone = false;
+
+// Serve the loopback client until the test is done
+static void loopbackServerThread()
+{
+    while (!gLoopbackDone) {
+        fileXferServe(&gLoopbackServer, 500, NULL);
+    }
+}
+
+K_THREAD_DEFINE(loopbackServer_id, 2048, loopbackServerThread, NULL, NULL, NULL, 7, 0, K_TICKS_FOREVER);
+
+static void createLogFile()
+{
+    const char *path = extFsPath(LOG_FILE_NAME);
+    if (extFsFileExists(path)) {
+        return;
+    }
+    // Written through ext_fs so the free space estimate follows
+    static extFsWriter_t writer;
+    if (extFsWriterOpen(&writer, path, true)) {
+        char line[64];
+        for (int i = 0; i < LOG_FILE_LINES; i++) {
+            int len = snprintf(line, sizeof(line), "%05d Log line with some data\n", i);
+            extFsWriterAppend(&writer, line, len);
+        }
+        extFsWriterClose(&writer);
+    }
+}
+
+static void listCallback(const char *pName, uint32_t size, void *pParam)
+{
+    printf("  %-30s %8u\n", pName, size);
+}
+
+// Compare the downloaded data with the file read locally
+static bool compareCallback(uint32_t offset, const uint8_t *pData, size_t len, void *pParam)
+{
+    struct fs_file_t *pFile = (struct fs_file_t *)pParam;
+    uint8_t buffer[64];
+    while (len > 0) {
+        size_t size = MIN(len, sizeof(buffer));
+        if (fs_read(pFile, buffer, size) != (ssize_t)size || memcmp(buffer, pData, size) != 0) {
+            printf("* Mismatch at offset %u\n", offset);
+            return false;
+        }
+        pData += size;
+        offset += size;
+        len -= size;
+    }
+    return true;
+}
+
+static void loopbackTest()
+{
+    fileXferTransport_t client;
+    fileXferStats_t stats = {0};
+    fileXferLoopbackInit(&gLoopback, &gLoopbackServer, &client, LOOPBACK_CORRUPT_EVERY);
+    k_thread_start(loopbackServer_id);
+
+    printf("Files:\n");
+    int32_t cnt = fileXferList(&client, listCallback, NULL);
+    printf("%d files\n", (int)cnt);
+
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    if (fs_open(&file, extFsPath(LOG_FILE_NAME), FS_O_READ) == 0) {
+        uint32_t offset = 0;
+        uint32_t start = k_uptime_get_32();
+        int32_t errorCode = fileXferGet(&client, LOG_FILE_NAME, &offset, LOOPBACK_WINDOW,
+                                        compareCallback, &file, &stats);
+        uint32_t time = MAX(k_uptime_get_32() - start, 1);
+        fs_close(&file);
+        if (errorCode == 0) {
+            printf("Loopback download of %u bytes ok, %u kB/s, %u crc errors\n",
+                   offset, offset / time, stats.crcErrors);
+        } else {
+            printf("* Loopback download failed at %u: %d\n", offset, (int)errorCode);
+        }
+    }
+    gLoopbackDone = true;
+}
+
+static void connectionCallback(int32_t connHandle, char *address, int32_t status,
+                               int32_t channel, int32_t mtu, void *pParameters)
+{
+    if (status == (int32_t)U_BLE_SPS_CONNECTED) {
+        gChannel = channel;
+        printf("Connected to: %s\n", address);
+    } else if (status == (int32_t)U_BLE_SPS_DISCONNECTED) {
+        gChannel = -1;
+        printf("Diconnected\n");
+    }
+}
+
+// Only reads from ubxlib when there is room in the ring buffer, data
+// left there holds back the credits of the client
+static void pullReceived()
+{
+    char buffer[128];
+    int32_t length = 1;
+    // Held while reading too, to keep the order of the data
+    uPortMutexLock(gRxMutex);
+    while (length > 0 && gChannel >= 0 &&
+           RX_BUFFER_SIZE - uRingBufferDataSize(&gRxRing) > sizeof(buffer)) {
+        length = uBleSpsReceive(gDeviceHandle, gChannel, buffer, sizeof(buffer));
+        if (length > 0) {
+            uRingBufferAdd(&gRxRing, buffer, length);
+        }
+    }
+    uPortMutexUnlock(gRxMutex);
+}
+
+static void dataAvailableCallback(int32_t channel, void *pParameters)
+{
+    pullReceived();
+    uPortSemaphoreGive(gRxSem);
+}
+
+static int32_t spsSend(void *pCtx, const uint8_t *pData, size_t len)
+{
+    while (len > 0) {
+        if (gChannel < 0) {
+            return U_ERROR_COMMON_NOT_FOUND;
+        }
+        // Waits for credits from the client
+        int32_t sent = uBleSpsSend(gDeviceHandle, gChannel, (const char *)pData, len);
+        if (sent < 0) {
+            return sent;
+        }
+        pData += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+static int32_t spsReceive(void *pCtx, uint8_t *pData, size_t len, int32_t timeoutMs)
+{
+    size_t read = 0;
+    for (int i = 0; i < 2 && read == 0; i++) {
+        pullReceived();
+        uPortMutexLock(gRxMutex);
+        read = uRingBufferRead(&gRxRing, (char *)pData, len);
+        uPortMutexUnlock(gRxMutex);
+        if (read == 0 && i == 0) {
+            uPortSemaphoreTryTake(gRxSem, timeoutMs);
+        }
+    }
+    return read;
+}
+
+static const fileXferTransport_t gSpsTransport = {
+    .send = spsSend,
+    .receive = spsReceive,
+    .pCtx = NULL
+};
+
+void main()
+{
+    if (!extFsInit()) {
+        printf("* Failed to mount the file system\n");
+        return;
+    }
+    createLogFile();
+    loopbackTest();
+
+    // Remove the line below if you want the log printouts from ubxlib
+    uPortLogOff();
+    // Initiate ubxlib
+    uPortInit();
+    uDeviceInit();
+    // And the U-blox module
+    int32_t errorCode;
+    uDeviceGetDefaults(gDeviceType, &gDeviceCfg);
+    printf("\nInitiating the module...\n");
+    errorCode = uDeviceOpen(&gDeviceCfg, &gDeviceHandle);
+    if (errorCode == 0) {
+        printf("Bringing up the ble network...\n");
+        errorCode = uNetworkInterfaceUp(gDeviceHandle, gNetworkCfg.type, &gNetworkCfg);
+        if (errorCode == 0) {
+            uRingBufferCreate(&gRxRing, gRxRingBuffer, sizeof(gRxRingBuffer));
+            uPortMutexCreate(&gRxMutex);
+            uPortSemaphoreCreate(&gRxSem, 0, 1);
+            uBleSpsSetCallbackConnectionStatus(gDeviceHandle, connectionCallback, NULL);
+            uBleSpsSetDataAvailableCallback(gDeviceHandle, dataAvailableCallback, NULL);
+            printf("Waiting for file transfer clients...\n");
+            fileXferStats_t stats = {0};
+            while (1) {
+                fileXferServe(&gSpsTransport, 1000, &stats);
+                if (stats.frames > 0) {
+                    printf("Sent %u bytes in %u frames, %u crc errors, %u resends\n",
+                           stats.bytes, stats.frames, stats.crcErrors, stats.resends);
+                    memset(&stats, 0, sizeof(stats));
+                }
+            }
+        } else {
+            printf("* Failed to bring up the network: %d\n", errorCode);
+        }
+        uDeviceClose(gDeviceHandle, true);
+    } else {
+        printf("* Failed to initiate the module: %d\n", errorCode);
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "batch.h"
+
+#define ADDR_SIZE 7
+#define TAG_ADDR_REF 0x80
+// Tag, address, time, rssi and length, worst case
+#define MAX_RECORD_OVERHEAD (1 + ADDR_SIZE + 5 + 1 + 3)
+
+static size_t putVarint(uint8_t *pBuf, uint32_t value)
+{
+    size_t cnt = 0;
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        pBuf[cnt++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return cnt;
+}
+
+static void putU16(uint8_t *pBuf, uint16_t value)
+{
+    pBuf[0] = value & 0xFF;
+    pBuf[1] = value >> 8;
+}
+
+static void putU32(uint8_t *pBuf, uint32_t value)
+{
+    putU16(pBuf, value & 0xFFFF);
+    putU16(pBuf + 2, value >> 16);
+}
+
+void batchInit(batch_t *pBatch, uint16_t seq, uint32_t nowMs)
+{
+    pBatch->data[0] = BATCH_VERSION;
+    putU16(&pBatch->data[1], seq);
+    putU32(&pBatch->data[3], nowMs);
+    putU16(&pBatch->data[7], 0);
+    pBatch->len = BATCH_HEADER_SIZE;
+    pBatch->recordCnt = 0;
+    pBatch->firstMs = nowMs;
+    pBatch->lastMs = nowMs;
+    pBatch->ageSumMs = 0;
+    pBatch->rawBytes = 0;
+    pBatch->addrCnt = 0;
+}
+
+bool batchAdd(batch_t *pBatch, const uint8_t *pAddr, int8_t rssi,
+              const uint8_t *pData, size_t len, uint32_t nowMs)
+{
+    if (pBatch->len + MAX_RECORD_OVERHEAD + len > sizeof(pBatch->data)) {
+        return false;
+    }
+    uint8_t *pPos = &pBatch->data[pBatch->len];
+    int ref = -1;
+    for (int i = 0; i < pBatch->addrCnt; i++) {
+        if (memcmp(&pBatch->data[pBatch->addrOffset[i]], pAddr, ADDR_SIZE) == 0) {
+            ref = i;
+            break;
+        }
+    }
+    if (ref >= 0) {
+        *pPos++ = TAG_ADDR_REF | ref;
+    } else {
+        *pPos++ = 0;
+        if (pBatch->addrCnt < BATCH_MAX_ADDRESSES) {
+            pBatch->addrOffset[pBatch->addrCnt++] = pPos - pBatch->data;
+        }
+        memcpy(pPos, pAddr, ADDR_SIZE);
+        pPos += ADDR_SIZE;
+    }
+    pPos += putVarint(pPos, nowMs - pBatch->lastMs);
+    *pPos++ = (uint8_t)rssi;
+    pPos += putVarint(pPos, len);
+    memcpy(pPos, pData, len);
+    pPos += len;
+    pBatch->len = pPos - pBatch->data;
+    pBatch->lastMs = nowMs;
+    pBatch->ageSumMs += nowMs - pBatch->firstMs;
+    pBatch->recordCnt++;
+    putU16(&pBatch->data[7], pBatch->recordCnt);
+    // Address, rssi, length, time stamp and data without compaction
+    pBatch->rawBytes += ADDR_SIZE + 1 + 1 + sizeof(uint32_t) + len;
+    return true;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compact binary frames with batches of BLE advertisements.
+ *
+ * Frame header, little endian:
+ *   version (1), sequence number (2), base time ms (4), record count (2)
+ * Each record:
+ *   tag (1)         0x00: a new address follows,
+ *                   0x80 | n: same address as the n:th address in the frame
+ *   address (7)     Type and address, only when tag is 0x00
+ *   time (varint)   Milliseconds since the previous record or the base time
+ *   rssi (1)
+ *   length (varint) Length of the advertising data
+ *   data            The advertising data
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BATCH_VERSION 1
+#define BATCH_HEADER_SIZE 9
+// Keep within the max mqtt message size of the cellular module
+#define BATCH_FRAME_SIZE 512
+#define BATCH_MAX_ADDRESSES 128
+
+typedef struct {
+    uint8_t data[BATCH_FRAME_SIZE];
+    size_t len;
+    uint16_t recordCnt;
+    uint32_t firstMs;   // Time of the oldest record
+    uint32_t lastMs;    // Time of the latest record
+    uint32_t ageSumMs;  // Sum of the record times after the oldest
+    uint32_t rawBytes;  // Size of the records without compaction
+    uint16_t addrOffset[BATCH_MAX_ADDRESSES];
+    uint8_t addrCnt;
+} batch_t;
+
+/**
+ * Start a new empty frame.
+ * @param   pBatch  The frame.
+ * @param   seq     Sequence number.
+ * @param   nowMs   Base time.
+ */
+void batchInit(batch_t *pBatch, uint16_t seq, uint32_t nowMs);
+
+/**
+ * Add an advertisement.
+ * @param   pBatch  The frame.
+ * @param   pAddr   Address type and address, 7 bytes.
+ * @param   rssi    Received signal strength.
+ * @param   pData   Advertising data.
+ * @param   len     Length of the advertising data.
+ * @param   nowMs   Time of reception.
+ * @return          False if there is no room left in the frame.
+ */
+bool batchAdd(batch_t *pBatch, const uint8_t *pAddr, int8_t rssi,
+              const uint8_t *pData, size_t len, uint32_t nowMs);
@@ -0,0 +1,332 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *
+ * A demo application using the XPLR-IOT-1 as a BLE to cellular
+ * gateway. Advertisements are scanned continuously using the
+ * host cpu, filtered, deduplicated and batched into compact binary
+ * frames which are then published using mqtt over cellular.
+ *
+ * When the uplink is slower than the incoming advertisements the
+ * deduplication window is extended, and when all frame buffers are
+ * waiting for the uplink new advertisements are dropped and counted.
+ *
+ * Please note thats this examples needs that the network cpu
+ * is flashed with the correct firmware. Accomplished by using the command:
+ *
+ * do flash_net
+ *
+ * after a successful build of this example. This is only needed to be done once.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include <bluetooth/bluetooth.h>
+
+#include "ubxlib.h"
+
+#include "ble_adv_filter.h"
+#include "ble_scan_agg.h"
+#include "batch.h"
+
+#define BROKER_NAME "test.mosquitto.org"
+
+#define MAX_DEVICES 256
+// Max time an advertisement waits in a frame before being published
+#define BATCH_MAX_AGE_MS 2000
+// A device with unchanged data is forwarded once per window
+#define DEDUP_WINDOW_MS 10000
+#define FRAME_POOL_CNT 8
+#define STATS_INTERVAL_MS 10000
+
+// Filter settings, replace with what your site needs.
+// Empty id and uuid lists means that all devices pass.
+static const uint16_t gCompanyIds[] = {
+    0x004C,  // Apple, iBeacon
+    0x0059,  // Nordic Semiconductor
+};
+static const uint16_t gUuid16s[] = {
+    0xFEAA,  // Eddystone
+};
+static const bleAdvFilter_t gFilter = {
+    .minRssi = -90,
+    .pCompanyIds = gCompanyIds,
+    .companyIdCnt = sizeof(gCompanyIds) / sizeof(gCompanyIds[0]),
+    .pUuid16s = gUuid16s,
+    .uuid16Cnt = sizeof(gUuid16s) / sizeof(gUuid16s[0]),
+};
+
+static uDeviceType_t gDeviceType = U_DEVICE_TYPE_CELL;
+static const uNetworkCfgCell_t gNetworkCfg = {
+    .type = U_NETWORK_TYPE_CELL,
+    .pApn = "tsiot",       // Thingstream SIM, use NULL for default
+    .timeoutSeconds = 240  // Connection timeout in seconds
+};
+static const uNetworkType_t gNetworkType = U_NETWORK_TYPE_CELL;
+
+uDeviceCfg_t gDeviceCfg;
+
+BLE_SCAN_AGG_DEFINE(gAgg, MAX_DEVICES);
+static bleScanAggEntry_t gSnapshot[MAX_DEVICES];
+
+// Frame buffers are passed between the scan callback and
+// the uplink through these queues.
+static batch_t gBatches[FRAME_POOL_CNT];
+K_MSGQ_DEFINE(gFreeQ, sizeof(batch_t *), FRAME_POOL_CNT, 4);
+K_MSGQ_DEFINE(gReadyQ, sizeof(batch_t *), FRAME_POOL_CNT, 4);
+
+// Protects the aggregator, the current frame and the statistics.
+// Advertisements are reported in the Bluetooth receive thread, not
+// in an interrupt, so a mutex can be used and the snapshot copy of
+// the aggregator doesn't hold off interrupts.
+static K_MUTEX_DEFINE(gLock);
+static batch_t *gpCurrent = NULL;
+static uint16_t gSeq = 0;
+
+static struct {
+    uint32_t adverts;
+    uint32_t filtered;
+    uint32_t deduplicated;
+    uint32_t forwarded;
+    uint32_t dropped;
+    uint32_t frames;
+    uint32_t records;
+    uint32_t bytes;
+    uint32_t rawBytes;
+    uint32_t latencySumMs;  // Over all published records
+    uint32_t latencyMaxMs;
+} gStats;
+
+// Move the current frame to the uplink, call with the lock held
+static void flushLocked()
+{
+    if (gpCurrent != NULL && gpCurrent->recordCnt > 0) {
+        k_msgq_put(&gReadyQ, &gpCurrent, K_NO_WAIT);
+        gpCurrent = NULL;
+    }
+}
+
+static bool addLocked(const uint8_t *pAddr, int8_t rssi,
+                      const uint8_t *pData, size_t len, uint32_t now)
+{
+    for (int tries = 0; tries < 2; tries++) {
+        if (gpCurrent == NULL) {
+            if (k_msgq_get(&gFreeQ, &gpCurrent, K_NO_WAIT) != 0) {
+                // All frames are waiting for the uplink
+                gpCurrent = NULL;
+                return false;
+            }
+            batchInit(gpCurrent, gSeq++, now);
+        }
+        if (batchAdd(gpCurrent, pAddr, rssi, pData, len, now)) {
+            return true;
+        }
+        flushLocked();
+    }
+    return false;
+}
+
+// Called in the Bluetooth receive thread for every advertisement
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+                         struct net_buf_simple *ad)
+{
+    uint32_t now = k_uptime_get_32();
+    // Filter before anything else, works on the data in place
+    bool pass = bleAdvFilterMatch(&gFilter, rssi, ad->data, ad->len);
+    k_mutex_lock(&gLock, K_FOREVER);
+    gStats.adverts++;
+    if (pass) {
+        const uint8_t *pAddr = (const uint8_t *)addr;
+        const bleScanAggEntry_t *pEntry = bleScanAggFind(&gAgg, pAddr);
+        uint32_t prevHash = pEntry ? pEntry->payloadHash : 0;
+        pEntry = bleScanAggAdd(&gAgg, pAddr, rssi, ad->data, ad->len, now);
+        // Forward the first advert in the window and changed data
+        if (pEntry->windowCount == 1 || pEntry->payloadHash != prevHash) {
+            if (addLocked(pAddr, rssi, ad->data, ad->len, now)) {
+                gStats.forwarded++;
+            } else {
+                gStats.dropped++;
+            }
+        } else {
+            gStats.deduplicated++;
+        }
+    } else {
+        gStats.filtered++;
+    }
+    k_mutex_unlock(&gLock);
+}
+
+static void printStats(uint32_t intervalMs)
+{
+    k_mutex_lock(&gLock, K_FOREVER);
+    typeof(gStats) stats = gStats;
+    memset(&gStats, 0, sizeof(gStats));
+    size_t devices = gAgg.used;
+    k_mutex_unlock(&gLock);
+    printf("Adverts in: %u/s, filtered %u, deduplicated %u, forwarded %u, dropped %u\n",
+           stats.adverts * 1000 / intervalMs, stats.filtered,
+           stats.deduplicated, stats.forwarded, stats.dropped);
+    printf("Frames out: %u, %u bytes (%u%% of raw), devices %u\n",
+           stats.frames, stats.bytes,
+           stats.rawBytes ? stats.bytes * 100 / stats.rawBytes : 0,
+           (unsigned)devices);
+    if (stats.frames > 0) {
+        printf("Latency advert to published: avg %u ms, max %u ms\n",
+               stats.latencySumMs / stats.records, stats.latencyMaxMs);
+    }
+}
+
+static void publish(uMqttClientContext_t *pContext, const char *pTopic, batch_t *pBatch)
+{
+    int32_t errorCode = uMqttClientPublish(pContext, pTopic,
+                                           (const char *)pBatch->data, pBatch->len,
+                                           U_MQTT_QOS_AT_MOST_ONCE, false);
+    // The oldest record has waited the longest, the others
+    // correspondingly less
+    uint32_t latency = k_uptime_get_32() - pBatch->firstMs;
+    k_mutex_lock(&gLock, K_FOREVER);
+    if (errorCode == 0) {
+        gStats.frames++;
+        gStats.bytes += pBatch->len;
+        gStats.rawBytes += pBatch->rawBytes;
+        gStats.records += pBatch->recordCnt;
+        gStats.latencySumMs += latency * pBatch->recordCnt - pBatch->ageSumMs;
+        if (latency > gStats.latencyMaxMs) {
+            gStats.latencyMaxMs = latency;
+        }
+    } else {
+        gStats.dropped += pBatch->recordCnt;
+    }
+    k_mutex_unlock(&gLock);
+    k_msgq_put(&gFreeQ, &pBatch, K_NO_WAIT);
+}
+
+static void uplink(uMqttClientContext_t *pContext, const char *pTopic)
+{
+    uint32_t nextWindow = k_uptime_get_32() + DEDUP_WINDOW_MS;
+    uint32_t nextStats = k_uptime_get_32() + STATS_INTERVAL_MS;
+    while (true) {
+        batch_t *pBatch;
+        if (k_msgq_get(&gReadyQ, &pBatch, K_MSEC(BATCH_MAX_AGE_MS / 4)) == 0) {
+            publish(pContext, pTopic, pBatch);
+        }
+        uint32_t now = k_uptime_get_32();
+        k_mutex_lock(&gLock, K_FOREVER);
+        if (gpCurrent != NULL && now - gpCurrent->firstMs >= BATCH_MAX_AGE_MS) {
+            flushLocked();
+        }
+        // Under backpressure, keep the window open to forward less
+        if ((int32_t)(now - nextWindow) >= 0 &&
+            k_msgq_num_used_get(&gReadyQ) < FRAME_POOL_CNT / 2) {
+            bleScanAggSnapshot(&gAgg, gSnapshot, MAX_DEVICES, now);
+            nextWindow = now + DEDUP_WINDOW_MS;
+        }
+        k_mutex_unlock(&gLock);
+        if ((int32_t)(now - nextStats) >= 0) {
+            printStats(STATS_INTERVAL_MS);
+            nextStats += STATS_INTERVAL_MS;
+        }
+    }
+}
+
+static bool startScan()
+{
+    struct bt_le_scan_param scan_param = {
+        .type = BT_LE_SCAN_TYPE_PASSIVE,
+        // Deduplication is made here to catch changed data
+        .options = BT_LE_SCAN_OPT_NONE,
+        .interval = BT_GAP_SCAN_FAST_INTERVAL,
+        .window = BT_GAP_SCAN_FAST_WINDOW,
+    };
+    bleScanAggInit(&gAgg);
+    for (int i = 0; i < FRAME_POOL_CNT; i++) {
+        batch_t *pBatch = &gBatches[i];
+        k_msgq_put(&gFreeQ, &pBatch, K_NO_WAIT);
+    }
+    int err = bt_enable(NULL);
+    if (err) {
+        printf("* Bluetooth init failed (err %d)\n", err);
+    } else {
+        err = bt_le_scan_start(&scan_param, device_found);
+        if (err) {
+            printf("* Failed to start scanning %d\n", err);
+        }
+    }
+    return err == 0;
+}
+
+void main()
+{
+    // Remove the line below if you want the log printouts from ubxlib
+    uPortLogOff();
+    // Initiate ubxlib
+    uPortInit();
+    uDeviceInit();
+    // And the U-blox module
+    int32_t errorCode;
+    uDeviceHandle_t deviceHandle;
+    uDeviceGetDefaults(gDeviceType, &gDeviceCfg);
+    printf("\nInitiating the module...\n");
+    errorCode = uDeviceOpen(&gDeviceCfg, &deviceHandle);
+    if (errorCode == 0) {
+        printf("Bringing up the network...\n");
+        errorCode = uNetworkInterfaceUp(deviceHandle, gNetworkType, &gNetworkCfg);
+        if (errorCode == 0) {
+            uMqttClientContext_t *pContext = pUMqttClientOpen(deviceHandle, NULL);
+            if (pContext != NULL) {
+                uMqttClientConnection_t connection = U_MQTT_CLIENT_CONNECTION_DEFAULT;
+                char topic[40];
+
+                connection.pBrokerNameStr = BROKER_NAME;
+                if (uMqttClientConnect(pContext, &connection) == 0) {
+                    // Get a unique topic name for this gateway
+                    uSecurityGetSerialNumber(deviceHandle, topic);
+                    if (topic[0] == '"') {
+                        // Remove quotes
+                        size_t len = strlen(topic);
+                        memmove(topic, topic + 1, len);
+                        topic[len - 2] = 0;
+                    }
+                    strncat(topic, "/ble", sizeof(topic) - strlen(topic) - 1);
+                    printf("To view the binary frames from this gateway use:\n");
+                    printf("mosquitto_sub -h %s -t %s -v\n", BROKER_NAME, topic);
+                    if (startScan()) {
+                        printf("Scanning started\n");
+                        uplink(pContext, topic);
+                    }
+                    uMqttClientDisconnect(pContext);
+                } else {
+                    printf("* Failed to connect to the mqtt broker\n");
+                }
+            } else {
+                printf("* Failed to create mqtt instance !\n ");
+            }
+
+            printf("Closing down the network...\n");
+            uNetworkInterfaceDown(deviceHandle, gNetworkType);
+        } else {
+            printf("* Failed to bring up the network: %d\n", errorCode);
+        }
+        uDeviceClose(deviceHandle, true);
+    } else {
+        printf("* Failed to initiate the module: %d\n", errorCode);
+    }
+
+    printf("\n== All done ==\n");
+}
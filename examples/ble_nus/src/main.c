@@ -21,6 +21,14 @@
  *
  * IMPORTANT! ubxlib version 1.2 or later is required.
  *
+ * The server accepts several clients at the same time. Incoming
+ * messages are queued and handled as soon as they arrive, and the
+ * responses are queued and sent by a separate task.
+ *
+ * The NUS service of ubxlib doesn't tell which client a message comes
+ * from, so the responses are notified to all clients. See the
+ * ble_nus_z example for a server with state for each client.
+ *
  */
 
 #include <stdio.h>
@@ -34,12 +42,25 @@
 #define SOLID_LED  RED_LED
 #define BLINK_LED  BLUE_LED
 
+#define MAX_CLIENTS 4
+#define MAX_MSG_SIZE 244
+#define QUEUE_LENGTH 8
+
 // This application can run as either server (peripheral) or client (central).
 // Choose here which to run.
 bool gActAsServer = true;
 
 static char gPeerMac[U_SHORT_RANGE_BT_ADDRESS_SIZE] = {0};
-static char gPeerResponse[100] = {0};
+
+typedef struct {
+    uint32_t timeMs;
+    uint8_t size;
+    char data[MAX_MSG_SIZE + 1];
+} message_t;
+
+// Incoming messages and outgoing responses
+static uPortQueueHandle_t gRxQueue;
+static uPortQueueHandle_t gTxQueue;
 
 char gLocalMac[U_SHORT_RANGE_BT_ADDRESS_SIZE] = {0};
 
@@ -72,14 +93,40 @@ static bool scanResponseCb(uBleScanResult_t *pScanResult)
 }
 
 // Callback for incoming NUS messages from client or server.
+// Only copies the message to the queue, handled elsewhere.
+// Please note that the callback doesn't tell which client sent
+// the message, so the responses are notified to all clients.
 static void peerIncomingCb(uint8_t *pValue, uint8_t valueSize)
 {
-    uint8_t maxSize = sizeof(gPeerResponse) - 1;
-    if (valueSize > maxSize) {
-        valueSize = maxSize;
+    message_t msg;
+    if (valueSize > MAX_MSG_SIZE) {
+        valueSize = MAX_MSG_SIZE;
+    }
+    msg.timeMs = uPortGetTickTimeMs();
+    msg.size = valueSize;
+    memcpy(msg.data, pValue, valueSize);
+    msg.data[valueSize] = 0;
+    if (uPortQueueSend(gRxQueue, &msg) != 0) {
+        printf("* Incoming message dropped\n");
+    }
+}
+
+// Send the queued responses, the NUS service of ubxlib installs its
+// own connection callback so the clients aren't tracked here
+static void txTask(void *pParameters)
+{
+    message_t msg;
+    while (true) {
+        if (uPortQueueReceive(gTxQueue, &msg) == 0) {
+            uBleNusWrite(msg.data, msg.size);
+        }
     }
-    memcpy(gPeerResponse, pValue, valueSize);
-    gPeerResponse[valueSize] = 0;
+}
+
+static bool queuesInit()
+{
+    return uPortQueueCreate(QUEUE_LENGTH, sizeof(message_t), &gRxQueue) == 0 &&
+           uPortQueueCreate(QUEUE_LENGTH, sizeof(message_t), &gTxQueue) == 0;
 }
 
 // Run as a NUS server.
@@ -92,20 +139,22 @@ static void server()
         .minIntervalMs = 200,
         .maxIntervalMs = 200,
         .connectable = true,
-        .maxClients = 1,
+        .maxClients = MAX_CLIENTS,
         .pRespData = respData,
         .pAdvData = advData
     };
+    uPortTaskHandle_t taskHandle;
     advCfg.respDataLength = uBleNusSetAdvData(respData, sizeof(respData));
     advCfg.advDataLength = uBleGapSetAdvData(SERVER_NAME,
                                              NULL, 0,
                                              advData, sizeof(advData));
-    if (advCfg.respDataLength > 0) {
+    if (advCfg.respDataLength > 0 &&
+        uPortTaskCreate(txTask, "nusTx", 2048, NULL, 5, &taskHandle) == 0) {
         printf("Server initiated.\n");
         printf("Connect using e.g. the nRf toolbox app in a phone,\n");
         printf("  using the \"Utils services UART\".\n");
         printf("Server address is: %s (%s)\n", gLocalMac, colonMac(gLocalMac));
-        printf("Waiting for connections....\n");
+        printf("Waiting for up to %d connections....\n", MAX_CLIENTS);
         uBleGapAdvertiseStart(gDeviceHandle, &advCfg);
         uBleNusInit(gDeviceHandle, NULL, peerIncomingCb);
     } else {
@@ -116,37 +165,44 @@ static void server()
     bool ledIsOn = true;
     bool ledBlinking = false;
     ledSet(SOLID_LED, ledIsOn);
+    message_t msg;
+    message_t response;
     while (true) {
-        char response[20] = {0};
-        if (gPeerResponse[0] != 0) {
-            // Client sent a message, see if it is recognizable.
-            printf("Incoming command: %s\n", gPeerResponse);
-            if (strstr(gPeerResponse, "hello")) {
-                snprintf(response, sizeof(response), "Hello from server!");
-            } else if (strstr(gPeerResponse, "led")) {
-                if (ledBlinking) {
-                    ledBlink(BLINK_LED, 0, 0);
-                    ledBlinking = false;
-                }
-                ledIsOn = !ledIsOn;
+        // Wait for the next message, no polling
+        if (uPortQueueReceive(gRxQueue, &msg) != 0) {
+            continue;
+        }
+        // Client sent a message, see if it is recognizable.
+        char *pResponse = response.data;
+        size_t maxSize = sizeof(response.data);
+        if (strstr(msg.data, "hello")) {
+            snprintf(pResponse, maxSize, "Hello from server!");
+        } else if (strstr(msg.data, "led")) {
+            if (ledBlinking) {
+                ledBlink(BLINK_LED, 0, 0);
+                ledBlinking = false;
+            }
+            ledIsOn = !ledIsOn;
+            ledSet(SOLID_LED, ledIsOn);
+            snprintf(pResponse, maxSize, "Led is %s", ledIsOn ? "on" : "off");
+        } else if (strstr(msg.data, "blink")) {
+            if (ledIsOn) {
+                ledIsOn = false;
                 ledSet(SOLID_LED, ledIsOn);
-                snprintf(response, sizeof(response), "Led is %s", ledIsOn ? "on" : "off");
-            } else if (strstr(gPeerResponse, "blink")) {
-                if (ledIsOn) {
-                    ledIsOn = false;
-                    ledSet(SOLID_LED, ledIsOn);
-                }
-                ledBlinking = !ledBlinking;
-                ledBlink(BLINK_LED, ledBlinking ? 250 : 0, 250);
-                snprintf(response, sizeof(response), "Led is %s", ledBlinking ? "blinking" : "off");
-            } else {
-                snprintf(response, sizeof(response), "Unknown command");
             }
-            uBleNusWrite(response, strlen(response) + 1);
-            gPeerResponse[0] = 0;
+            ledBlinking = !ledBlinking;
+            ledBlink(BLINK_LED, ledBlinking ? 250 : 0, 250);
+            snprintf(pResponse, maxSize, "Led is %s", ledBlinking ? "blinking" : "off");
         } else {
-            uPortTaskBlock(1000);
+            snprintf(pResponse, maxSize, "Unknown command");
         }
+        response.size = strlen(pResponse) + 1;
+        response.timeMs = uPortGetTickTimeMs();
+        if (uPortQueueSend(gTxQueue, &response) != 0) {
+            printf("* Response dropped\n");
+        }
+        printf("Incoming command: %s, handled in %d ms\n", msg.data,
+               (int)(response.timeMs - msg.timeMs));
     }
 }
 
@@ -169,9 +225,9 @@ static void client()
                 uPortTaskBlock(2000);
                 const char *com = "blink";
                 uBleNusWrite(com, strlen(com) + 1);
-                uPortTaskBlock(1000);
-                if (gPeerResponse[0] != 0) {
-                    printf("Server response: %s\n", gPeerResponse);
+                message_t msg;
+                if (uPortQueueTryReceive(gRxQueue, 1000, &msg) == 0) {
+                    printf("Server response: %s\n", msg.data);
                 }
                 printf("Disconnecting\n");
                 uBleNusDeInit();
@@ -200,6 +256,9 @@ void main()
     uDeviceGetDefaults(U_DEVICE_TYPE_SHORT_RANGE, &gDeviceCfg);
     printf("\nInitiating the module...\n");
     errorCode = uDeviceOpen(&gDeviceCfg, &gDeviceHandle);
+    if (errorCode == 0 && !queuesInit()) {
+        errorCode = U_ERROR_COMMON_NO_MEMORY;
+    }
     if (errorCode == 0) {
         printf("Starting BLE...\n");
         networkCfg.role = gActAsServer ? U_BLE_CFG_ROLE_PERIPHERAL : U_BLE_CFG_ROLE_CENTRAL;
@@ -0,0 +1,299 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *
+ * A NUS (Nordic Uart Service) server serving several clients at the
+ * same time, using the Zephyr BLE functionality in the Nora host cpu
+ * of the XPLR-IOT-1. Accepts the same commands as the ble_nus example.
+ *
+ * Unlike the NUS service of ubxlib, the Nordic one tells which
+ * connection each message comes from. Every client has its own
+ * receive queue and statistics, and the responses are only sent to
+ * the client that sent the command. The clients are served in turn,
+ * so a client sending many commands doesn't hold up the others.
+ *
+ * Please note thats this examples needs that the network cpu
+ * is flashed with the correct firmware. Accomplished by using the command:
+ *
+ * do flash_net
+ *
+ * after a successful build of this example. This is only needed to be done once.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <kernel.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/services/nus.h>
+
+#include "leds.h"
+
+#define SOLID_LED  RED_LED
+#define BLINK_LED  BLUE_LED
+
+#define MAX_CLIENTS CONFIG_BT_MAX_CONN
+#define MAX_MSG_SIZE 244
+#define RX_QUEUE_LENGTH 4
+#define TX_QUEUE_LENGTH 8
+// 200 ms in units of 0.625 ms
+#define ADV_INTERVAL 320
+
+typedef struct {
+    uint32_t timeMs;
+    uint8_t size;
+    char data[MAX_MSG_SIZE + 1];
+} message_t;
+
+typedef struct {
+    struct bt_conn *pConn;       // Holds a reference until sent
+    uint8_t size;
+    char data[MAX_MSG_SIZE];
+} response_t;
+
+typedef struct {
+    struct bt_conn *pConn;       // NULL if the slot is free
+    char address[BT_ADDR_LE_STR_LEN];
+    uint32_t connectedMs;
+    uint32_t commands;
+    uint32_t dropped;            // Received while the queue was full
+    struct k_msgq rxQueue;
+    char rxBuffer[RX_QUEUE_LENGTH * sizeof(message_t)] __aligned(4);
+} client_t;
+
+static client_t gClients[MAX_CLIENTS];
+static int gClientCnt = 0;
+K_MUTEX_DEFINE(gClientsLock);
+// Given when any client has a new message
+K_SEM_DEFINE(gRxSem, 0, 1);
+K_MSGQ_DEFINE(gTxQueue, sizeof(response_t), TX_QUEUE_LENGTH, 4);
+
+static void txThread(void);
+K_THREAD_DEFINE(txThread_id, 1024, txThread, NULL, NULL, NULL, 7, 0, K_TICKS_FOREVER);
+
+static const struct bt_data gAdvData[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+    BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME, sizeof(CONFIG_BT_DEVICE_NAME) - 1),
+};
+
+static const struct bt_data gRespData[] = {
+    BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_NUS_VAL),
+};
+
+// Call with the lock held
+static client_t *findClient(struct bt_conn *pConn)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (gClients[i].pConn == pConn) {
+            return &gClients[i];
+        }
+    }
+    return NULL;
+}
+
+static void connected(struct bt_conn *pConn, uint8_t err)
+{
+    if (err) {
+        printf("* Connection failed: %u\n", err);
+        return;
+    }
+    k_mutex_lock(&gClientsLock, K_FOREVER);
+    client_t *pClient = findClient(NULL);
+    if (pClient != NULL) {
+        pClient->pConn = bt_conn_ref(pConn);
+        bt_addr_le_to_str(bt_conn_get_dst(pConn), pClient->address, sizeof(pClient->address));
+        pClient->connectedMs = k_uptime_get_32();
+        pClient->commands = 0;
+        pClient->dropped = 0;
+        k_msgq_purge(&pClient->rxQueue);
+        gClientCnt++;
+        printf("Client %s connected, %d of %d clients\n", pClient->address,
+               gClientCnt, MAX_CLIENTS);
+    }
+    k_mutex_unlock(&gClientsLock);
+}
+
+static void disconnected(struct bt_conn *pConn, uint8_t reason)
+{
+    k_mutex_lock(&gClientsLock, K_FOREVER);
+    client_t *pClient = findClient(pConn);
+    if (pClient != NULL) {
+        printf("Client %s disconnected after %u s, %u commands, %u dropped\n",
+               pClient->address, (k_uptime_get_32() - pClient->connectedMs) / 1000,
+               pClient->commands, pClient->dropped);
+        bt_conn_unref(pClient->pConn);
+        pClient->pConn = NULL;
+        gClientCnt--;
+    }
+    k_mutex_unlock(&gClientsLock);
+    // Advertising is resumed by the host when a connection is free
+}
+
+BT_CONN_CB_DEFINE(gConnCallbacks) = {
+    .connected = connected,
+    .disconnected = disconnected,
+};
+
+// Only copies the message to the queue of the client, handled elsewhere
+static void received(struct bt_conn *pConn, const uint8_t *const pData, uint16_t len)
+{
+    message_t msg;
+    msg.timeMs = k_uptime_get_32();
+    msg.size = MIN(len, MAX_MSG_SIZE);
+    memcpy(msg.data, pData, msg.size);
+    msg.data[msg.size] = 0;
+    k_mutex_lock(&gClientsLock, K_FOREVER);
+    client_t *pClient = findClient(pConn);
+    if (pClient != NULL) {
+        if (k_msgq_put(&pClient->rxQueue, &msg, K_NO_WAIT) == 0) {
+            k_sem_give(&gRxSem);
+        } else {
+            pClient->dropped++;
+        }
+    }
+    k_mutex_unlock(&gClientsLock);
+}
+
+static struct bt_nus_cb gNusCallbacks = {
+    .received = received,
+};
+
+// Send the queued responses, each to its own client.
+static void txThread(void)
+{
+    response_t response;
+    while (true) {
+        k_msgq_get(&gTxQueue, &response, K_FOREVER);
+        // Fails if the client has disconnected meanwhile
+        bt_nus_send(response.pConn, (uint8_t *)response.data, response.size);
+        bt_conn_unref(response.pConn);
+    }
+}
+
+// Details of the client copied when its message was taken, the slot
+// can be reused if it disconnects meanwhile
+typedef struct {
+    struct bt_conn *pConn;
+    char address[BT_ADDR_LE_STR_LEN];
+    uint32_t commands;
+} sender_t;
+
+static void handle(const sender_t *pSender, const message_t *pMsg)
+{
+    static bool ledIsOn = true;
+    static bool ledBlinking = false;
+    response_t response;
+    char *pResponse = response.data;
+    size_t maxSize = sizeof(response.data);
+    if (strstr(pMsg->data, "hello")) {
+        snprintf(pResponse, maxSize, "Hello %s from server!", pSender->address);
+    } else if (strstr(pMsg->data, "led")) {
+        if (ledBlinking) {
+            ledBlink(BLINK_LED, 0, 0);
+            ledBlinking = false;
+        }
+        ledIsOn = !ledIsOn;
+        ledSet(SOLID_LED, ledIsOn);
+        snprintf(pResponse, maxSize, "Led is %s", ledIsOn ? "on" : "off");
+    } else if (strstr(pMsg->data, "blink")) {
+        if (ledIsOn) {
+            ledIsOn = false;
+            ledSet(SOLID_LED, ledIsOn);
+        }
+        ledBlinking = !ledBlinking;
+        ledBlink(BLINK_LED, ledBlinking ? 250 : 0, 250);
+        snprintf(pResponse, maxSize, "Led is %s", ledBlinking ? "blinking" : "off");
+    } else if (strstr(pMsg->data, "clients")) {
+        k_mutex_lock(&gClientsLock, K_FOREVER);
+        int clientCnt = gClientCnt;
+        k_mutex_unlock(&gClientsLock);
+        snprintf(pResponse, maxSize, "%d clients, %u commands from you",
+                 clientCnt, pSender->commands);
+    } else {
+        snprintf(pResponse, maxSize, "Unknown command");
+    }
+    response.size = strlen(pResponse) + 1;
+    response.pConn = bt_conn_ref(pSender->pConn);
+    if (k_msgq_put(&gTxQueue, &response, K_NO_WAIT) != 0) {
+        bt_conn_unref(pSender->pConn);
+        printf("* Response to %s dropped\n", pSender->address);
+    }
+    printf("Incoming command from %s: %s, handled in %u ms\n", pSender->address,
+           pMsg->data, k_uptime_get_32() - pMsg->timeMs);
+}
+
+// Handle one message from each client in turn until all queues are empty
+static void serveClients()
+{
+    bool more = true;
+    while (more) {
+        more = false;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            client_t *pClient = &gClients[i];
+            message_t msg;
+            sender_t sender = {NULL};
+            k_mutex_lock(&gClientsLock, K_FOREVER);
+            if (pClient->pConn != NULL && k_msgq_get(&pClient->rxQueue, &msg, K_NO_WAIT) == 0) {
+                sender.pConn = bt_conn_ref(pClient->pConn);
+                strcpy(sender.address, pClient->address);
+                sender.commands = ++pClient->commands;
+            }
+            k_mutex_unlock(&gClientsLock);
+            if (sender.pConn != NULL) {
+                handle(&sender, &msg);
+                bt_conn_unref(sender.pConn);
+                more = true;
+            }
+        }
+    }
+}
+
+void main(void)
+{
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        k_msgq_init(&gClients[i].rxQueue, gClients[i].rxBuffer, sizeof(message_t),
+                    RX_QUEUE_LENGTH);
+    }
+    int err = bt_enable(NULL);
+    if (err == 0) {
+        err = bt_nus_init(&gNusCallbacks);
+    }
+    if (err == 0) {
+        // Connectable advertising continues while there are free connections
+        err = bt_le_adv_start(BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE, ADV_INTERVAL,
+                                              ADV_INTERVAL, NULL),
+                              gAdvData, ARRAY_SIZE(gAdvData), gRespData, ARRAY_SIZE(gRespData));
+    }
+    if (err) {
+        printf("* Failed to start NUS server: %d\n", err);
+        return;
+    }
+    k_thread_start(txThread_id);
+    printf("Server initiated.\n");
+    printf("Connect using e.g. the nRf toolbox app in a phone,\n");
+    printf("  using the \"Utils services UART\".\n");
+    printf("Waiting for up to %d connections....\n", MAX_CLIENTS);
+    ledsInit();
+    ledSet(SOLID_LED, true);
+    while (true) {
+        // Wait for the next message, no polling
+        k_sem_take(&gRxSem, K_FOREVER);
+        serveClients();
+    }
+}
@@ -23,23 +23,65 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "ubxlib.h"
 
+#include "ble_scan_agg.h"
+
+#define MAX_DEVICES 256
+#define SNAPSHOT_INTERVAL_MS 5000
 
 uDeviceHandle_t gDeviceHandle;
 uDeviceCfg_t gDeviceCfg;
 
-static bool scanResponseCb(uBleScanResult_t *pScanResult)
+BLE_SCAN_AGG_DEFINE(gAgg, MAX_DEVICES);
+static bleScanAggEntry_t gSnapshot[MAX_DEVICES];
+
+// Convert ubxlib address string, e.g. "0123456789ABp", to type and bytes
+static void addrFromStr(const char *pStr, uint8_t *pAddr)
 {
-    printf("%s;%s;", pScanResult->address, pScanResult->name);
-    for (int i = 0; i < pScanResult->dataLength; i++) {
-        printf("%02X", pScanResult->data[i]);
+    char hex[3] = {0};
+    pAddr[0] = pStr[12] == 'r' ? 1 : 0;
+    for (int i = 0; i < 6; i++) {
+        hex[0] = pStr[i * 2];
+        hex[1] = pStr[i * 2 + 1];
+        pAddr[i + 1] = (uint8_t)strtol(hex, NULL, 16);
     }
-    printf(";%d\n", pScanResult->rssi);
+}
+
+// Called for every advertisement during the scan. Only aggregate
+// here, printing every single one can't keep up at a busy site.
+static bool scanResponseCb(uBleScanResult_t *pScanResult)
+{
+    uint8_t addr[BLE_SCAN_AGG_ADDR_SIZE];
+    addrFromStr(pScanResult->address, addr);
+    bleScanAggAdd(&gAgg, addr, pScanResult->rssi, pScanResult->data,
+                  pScanResult->dataLength, uPortGetTickTimeMs());
     return true;
 }
 
+static void printSnapshot()
+{
+    static uint32_t lastAdverts = 0;
+    uint32_t now = uPortGetTickTimeMs();
+    size_t cnt = bleScanAggSnapshot(&gAgg, gSnapshot, MAX_DEVICES, now);
+    printf("--- %u devices, %u adverts/s, %u evicted ---\n", (unsigned)cnt,
+           (gAgg.adverts - lastAdverts) * 1000 / SNAPSHOT_INTERVAL_MS,
+           gAgg.evictions);
+    lastAdverts = gAgg.adverts;
+    for (size_t i = 0; i < cnt; i++) {
+        bleScanAggEntry_t *pEntry = &gSnapshot[i];
+        for (int j = 1; j < BLE_SCAN_AGG_ADDR_SIZE; j++) {
+            printf("%02X", pEntry->addr[j]);
+        }
+        printf("%c;%u;%d;%d;%d;%u;%08X\n", pEntry->addr[0] ? 'r' : 'p',
+               pEntry->windowCount, pEntry->rssiMin,
+               pEntry->rssiEwmaX16 / 16, pEntry->rssiMax,
+               now - pEntry->lastSeenMs, pEntry->payloadHash);
+    }
+}
+
 void main()
 {
     static uNetworkCfgBle_t networkCfg = {
@@ -62,13 +104,18 @@ void main()
         printf("Starting BLE...\n");
         errorCode = uNetworkInterfaceUp(gDeviceHandle, networkCfg.type, &networkCfg);
         if (errorCode == 0) {
-            errorCode = uBleGapScan(gDeviceHandle,
-                                    U_BLE_GAP_SCAN_DISCOVER_ALL_ONCE,
-                                    true, 10000,
-                                    scanResponseCb);
-            if (errorCode != 0) {
-                printf("* Failed to start scanning: %d", errorCode);
+            bleScanAggInit(&gAgg);
+            printf("address;count;rssi min;rssi avg;rssi max;age ms;data hash\n");
+            // The scan blocks for the given time so the snapshot is
+            // printed between the scans, no locking needed.
+            while (errorCode == 0) {
+                errorCode = uBleGapScan(gDeviceHandle,
+                                        U_BLE_GAP_SCAN_DISCOVER_ALL,
+                                        true, SNAPSHOT_INTERVAL_MS,
+                                        scanResponseCb);
+                printSnapshot();
             }
+            printf("* Failed to start scanning: %d", errorCode);
         } else {
             printf("* Failed to bring up the network: %d\n", errorCode);
         }
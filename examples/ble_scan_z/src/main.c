@@ -27,40 +27,249 @@
  *
  * after a successful build of this example. This is only needed to be done once.
  *
+ * The advertisements are aggregated per device and a summary of the
+ * devices seen is printed periodically, which keeps up with busy sites.
+ *
+ * Filtering is made as early as possible. Known devices can be put on
+ * the accept list of the controller in the network cpu, so that other
+ * adverts never reach the host cpu. The remaining adverts can be matched
+ * on their advertising data in place before anything is copied, see
+ * USE_AD_FILTER below. The number
+ * of scan callbacks per second, i.e. host cpu wakeups, is printed to
+ * show the effect of the settings.
+ *
+ * Extended advertising is scanned on both the 1M and the Coded PHY,
+ * the latter giving about four times the range. The Bluetooth host
+ * reassembles chained advertising PDUs, the complete adverts are then
+ * copied into a fixed pool of buffers and handed over to a worker
+ * thread. The network cpu firmware is configured for this by the
+ * child_image/hci_rpmsg.conf file, so "do flash_net" is needed.
+ *
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <bluetooth/bluetooth.h>
 
-static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
-                         struct net_buf_simple *ad)
+#include "ble_adv_filter.h"
+#include "ble_scan_agg.h"
+
+#define MAX_DEVICES 256
+#define SNAPSHOT_INTERVAL_MS 5000
+
+// Scan interval and window in units of 0.625 ms. A smaller window
+// compared to the interval gives less adverts and less power.
+#define SCAN_INTERVAL BT_GAP_SCAN_FAST_INTERVAL
+#define SCAN_WINDOW BT_GAP_SCAN_FAST_WINDOW
+
+// Set to 1 to only let the controller report the devices below
+#define USE_ACCEPT_LIST 0
+// Set to 1 to only pass the adverts with the company ids or 16 bit
+// service uuids below, and at least the minimum rssi. By default all
+// devices are shown, as before the filter was added.
+#define USE_AD_FILTER 0
+// Set to 0 to only scan on the 1M PHY
+#define USE_CODED_PHY 1
+
+// Buffers for complete adverts waiting for the worker thread
+#define ADV_POOL_CNT 16
+#define ADV_MAX_DATA_LEN CONFIG_BT_EXT_SCAN_BUF_SIZE
+
+typedef struct {
+    void *fifoReserved;
+    bt_addr_le_t addr;
+    int8_t rssi;
+    uint8_t phy;
+    uint32_t timeMs;
+    uint16_t len;
+    uint8_t data[ADV_MAX_DATA_LEN];
+} advBuf_t;
+
+K_MEM_SLAB_DEFINE(gAdvSlab, sizeof(advBuf_t), ADV_POOL_CNT, 4);
+K_FIFO_DEFINE(gAdvFifo);
+
+#if USE_ACCEPT_LIST
+static const struct {
+    const char *pAddr;
+    const char *pType;  // "public" or "random"
+} gKnownDevices[] = {
+    {"D4:CA:6E:00:00:01", "random"},
+};
+#endif
+
+#if USE_AD_FILTER
+// Replace with the devices of interest. Empty lists passes all
+// devices with at least the minimum rssi.
+static const uint16_t gCompanyIds[] = {
+    0x0059,  // Nordic Semiconductor
+    0x004C,  // Apple, iBeacon
+};
+static const uint16_t gUuid16s[] = {
+    0xFEAA,  // Eddystone
+};
+static const bleAdvFilter_t gFilter = {
+    .minRssi = -90,
+    .pCompanyIds = gCompanyIds,
+    .companyIdCnt = sizeof(gCompanyIds) / sizeof(gCompanyIds[0]),
+    .pUuid16s = gUuid16s,
+    .uuid16Cnt = sizeof(gUuid16s) / sizeof(gUuid16s[0]),
+};
+#endif
+
+BLE_SCAN_AGG_DEFINE(gAgg, MAX_DEVICES);
+static struct k_spinlock gAggLock;
+static bleScanAggEntry_t gSnapshot[MAX_DEVICES];
+// Every callback means that the host cpu was woken up by the controller
+static atomic_t gCallbacks;
+static atomic_t gFiltered;
+static atomic_t gDropped;
+static atomic_t gCoded;
+static atomic_t gExtended;
+static atomic_t gMaxLen;
+
+static void scan_recv(const struct bt_le_scan_recv_info *info,
+                      struct net_buf_simple *ad)
+{
+    atomic_inc(&gCallbacks);
+#if USE_AD_FILTER
+    if (!bleAdvFilterMatch(&gFilter, info->rssi, ad->data, ad->len)) {
+        atomic_inc(&gFiltered);
+        return;
+    }
+#endif
+    advBuf_t *pBuf;
+    if (ad->len > ADV_MAX_DATA_LEN ||
+        k_mem_slab_alloc(&gAdvSlab, (void **)&pBuf, K_NO_WAIT) != 0) {
+        // The worker can't keep up, don't block the Bluetooth rx thread
+        atomic_inc(&gDropped);
+        return;
+    }
+    bt_addr_le_copy(&pBuf->addr, info->addr);
+    pBuf->rssi = info->rssi;
+    pBuf->phy = info->primary_phy;
+    pBuf->timeMs = k_uptime_get_32();
+    pBuf->len = ad->len;
+    memcpy(pBuf->data, ad->data, ad->len);
+    if (info->adv_props & BT_GAP_ADV_PROP_EXT_ADV) {
+        atomic_inc(&gExtended);
+    }
+    k_fifo_put(&gAdvFifo, pBuf);
+}
+
+static struct bt_le_scan_cb gScanCallbacks = {
+    .recv = scan_recv,
+};
+
+static void advWorker()
+{
+    while (true) {
+        advBuf_t *pBuf = k_fifo_get(&gAdvFifo, K_FOREVER);
+        if (pBuf->phy == BT_GAP_LE_PHY_CODED) {
+            atomic_inc(&gCoded);
+        }
+        if (pBuf->len > atomic_get(&gMaxLen)) {
+            atomic_set(&gMaxLen, pBuf->len);
+        }
+        k_spinlock_key_t key = k_spin_lock(&gAggLock);
+        bleScanAggAdd(&gAgg, (const uint8_t *)&pBuf->addr, pBuf->rssi,
+                      pBuf->data, pBuf->len, pBuf->timeMs);
+        k_spin_unlock(&gAggLock, key);
+        k_mem_slab_free(&gAdvSlab, (void **)&pBuf);
+    }
+}
+
+K_THREAD_DEFINE(advWorker_id, 1024, advWorker, NULL, NULL, NULL, 7, 0, K_TICKS_FOREVER);
+
+static void printSnapshot()
 {
-    char addr_str[BT_ADDR_LE_STR_LEN];
+    static uint32_t lastAdverts = 0;
+    uint32_t now = k_uptime_get_32();
+    k_spinlock_key_t key = k_spin_lock(&gAggLock);
+    size_t cnt = bleScanAggSnapshot(&gAgg, gSnapshot, MAX_DEVICES, now);
+    uint32_t adverts = gAgg.adverts;
+    uint32_t evictions = gAgg.evictions;
+    k_spin_unlock(&gAggLock, key);
+    uint32_t callbacks = atomic_clear(&gCallbacks);
+    uint32_t filtered = atomic_clear(&gFiltered);
 
-    bt_addr_le_to_str(addr, addr_str, sizeof(addr_str));
-    printf("%s (RSSI %d), type %u, AD data len %u\n",
-           addr_str, rssi, type, ad->len);
+    printf("--- %u devices, %u adverts/s, %u evicted ---\n", (unsigned)cnt,
+           (adverts - lastAdverts) * 1000 / SNAPSHOT_INTERVAL_MS, evictions);
+    printf("Host cpu wakeups: %u/s, filtered out %u/s\n",
+           callbacks * 1000 / SNAPSHOT_INTERVAL_MS,
+           filtered * 1000 / SNAPSHOT_INTERVAL_MS);
+    printf("Extended %u, coded PHY %u, max length %u, dropped %u\n",
+           (uint32_t)atomic_clear(&gExtended), (uint32_t)atomic_clear(&gCoded),
+           (uint32_t)atomic_get(&gMaxLen), (uint32_t)atomic_clear(&gDropped));
+    lastAdverts = adverts;
+    for (size_t i = 0; i < cnt; i++) {
+        bleScanAggEntry_t *pEntry = &gSnapshot[i];
+        char addr_str[BT_ADDR_LE_STR_LEN];
+        bt_addr_le_to_str((const bt_addr_le_t *)pEntry->addr, addr_str, sizeof(addr_str));
+        printf("%s cnt %u rssi %d/%d/%d age %u ms data %08x\n",
+               addr_str, pEntry->windowCount, pEntry->rssiMin,
+               pEntry->rssiEwmaX16 / 16, pEntry->rssiMax,
+               now - pEntry->lastSeenMs, pEntry->payloadHash);
+    }
 }
 
+#if USE_ACCEPT_LIST
+static bool setupAcceptList()
+{
+    size_t added = 0;
+    for (size_t i = 0; i < sizeof(gKnownDevices) / sizeof(gKnownDevices[0]); i++) {
+        bt_addr_le_t addr;
+        int err = bt_addr_le_from_str(gKnownDevices[i].pAddr, gKnownDevices[i].pType, &addr);
+        if (err == 0) {
+            err = bt_le_filter_accept_list_add(&addr);
+        }
+        if (err == 0) {
+            added++;
+        } else {
+            printf("* Failed to add %s to the accept list: %d\n", gKnownDevices[i].pAddr, err);
+        }
+    }
+    printf("%u devices on the accept list\n", (unsigned)added);
+    return added > 0;
+}
+#endif
+
 void main(void)
 {
     struct bt_le_scan_param scan_param = {
         .type = BT_LE_SCAN_TYPE_PASSIVE,
-        .options = BT_LE_SCAN_OPT_FILTER_DUPLICATE,
-        .interval = BT_GAP_SCAN_FAST_INTERVAL,
-        .window = BT_GAP_SCAN_FAST_WINDOW,
+        // All adverts are needed for the statistics
+#if USE_CODED_PHY
+        // Scan on both the 1M and the Coded PHY
+        .options = BT_LE_SCAN_OPT_CODED,
+#else
+        .options = BT_LE_SCAN_OPT_NONE,
+#endif
+        .interval = SCAN_INTERVAL,
+        .window = SCAN_WINDOW,
     };
 
     int err;
+    bleScanAggInit(&gAgg);
     err = bt_enable(NULL);
     if (err) {
         printf("* Bluetooth init failed (err %d)\n", err);
     } else {
-        err = bt_le_scan_start(&scan_param, device_found);
+#if USE_ACCEPT_LIST
+        if (setupAcceptList()) {
+            scan_param.options |= BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST;
+        }
+#endif
+        bt_le_scan_cb_register(&gScanCallbacks);
+        k_thread_start(advWorker_id);
+        err = bt_le_scan_start(&scan_param, NULL);
         if (err) {
             printf("* Failed to start scanning %d\n", err);
         } else {
-            printf("iBeacon advertising started\n");
+            printf("Scanning started\n");
+            while (true) {
+                k_msleep(SNAPSHOT_INTERVAL_MS);
+                printSnapshot();
+            }
         }
     }
 }
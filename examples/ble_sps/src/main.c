@@ -25,11 +25,31 @@
  * A typical client can be the "U-blox Bluetooth Low Energy"
  * application available for Android and IOS.
  *
+ * Sending "bulk <kB>" makes the server stream that amount, up to
+ * BULK_MAX_KB, of generated log data to the client as fast as
+ * possible. The throughput in both directions is printed after each
+ * transfer.
+ * Received data is only read from ubxlib when there is room for it,
+ * so the client is held back by the SPS flow control meanwhile.
+ *
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "ubxlib.h"
+#include "u_ringbuffer.h"
+
+// Max SPS payload with the largest MTU, 247 - 3 bytes ATT header
+#define MAX_CHUNK_SIZE 244
+#define RX_BUFFER_SIZE 4096
+#define TX_BUFFER_SIZE 2048
+// A transfer is regarded as done after this time without data
+#define IDLE_MS 1000
+#define BULK_COMMAND "bulk "
+// Largest bulk transfer accepted, in kB
+#define BULK_MAX_KB (16 * 1024)
 
 static uDeviceType_t gDeviceType = U_DEVICE_TYPE_SHORT_RANGE;
 static const uNetworkCfgBle_t gNetworkCfg = {
@@ -38,14 +58,36 @@ static const uNetworkCfgBle_t gNetworkCfg = {
     .spsServer = true
 };
 uDeviceCfg_t gDeviceCfg;
+uDeviceHandle_t gDeviceHandle;
+
+// Received data is put here by the callback and handled in main
+static uRingBuffer_t gRxRing;
+static char gRxRingBuffer[RX_BUFFER_SIZE];
+static uPortMutexHandle_t gRxMutex;
+static uPortSemaphoreHandle_t gRxSem;
+// Data to send is streamed from here
+static uRingBuffer_t gTxRing;
+static char gTxRingBuffer[TX_BUFFER_SIZE];
 
+static volatile int32_t gChannel = -1;
+static volatile int32_t gMtu = 23;
+
+static struct {
+    uint32_t bytes;
+    int32_t firstMs;
+    int32_t lastMs;
+} gRxStats;
 
 static void connectionCallback(int32_t connHandle, char *address, int32_t status,
                                int32_t channel, int32_t mtu, void *pParameters)
 {
     if (status == (int32_t)U_BLE_SPS_CONNECTED) {
-        printf("Connected to: %s\n", address);
+        // The MTU is negotiated by the client, use what we got
+        gChannel = channel;
+        gMtu = mtu;
+        printf("Connected to: %s, MTU %d\n", address, (int)mtu);
     } else if (status == (int32_t)U_BLE_SPS_DISCONNECTED) {
+        gChannel = -1;
         if (connHandle != U_BLE_SPS_INVALID_HANDLE) {
             printf("Diconnected\n");
         } else {
@@ -54,22 +96,166 @@ static void connectionCallback(int32_t connHandle, char *address, int32_t status
     }
 }
 
+// Move received data to the ring buffer while it has room for a
+// chunk. Data left unread in ubxlib holds back the credits to the
+// client, which then waits instead of data being dropped here.
+static void pullReceived()
+{
+    char buffer[MAX_CHUNK_SIZE];
+    int32_t length = 1;
+    // Held while reading too, to keep the order of the data
+    uPortMutexLock(gRxMutex);
+    while (length > 0 && gChannel >= 0 &&
+           RX_BUFFER_SIZE - uRingBufferDataSize(&gRxRing) > sizeof(buffer)) {
+        length = uBleSpsReceive(gDeviceHandle, gChannel, buffer, sizeof(buffer));
+        if (length > 0) {
+            int32_t now = uPortGetTickTimeMs();
+            uRingBufferAdd(&gRxRing, buffer, length);
+            if (gRxStats.bytes == 0) {
+                gRxStats.firstMs = now;
+            }
+            gRxStats.bytes += length;
+            gRxStats.lastMs = now;
+        }
+    }
+    uPortMutexUnlock(gRxMutex);
+}
+
+// Only moves the data to the ring buffer, keeping the callback short
 static void dataAvailableCallback(int32_t channel, void *pParameters)
 {
-    char buffer[100];
-    int32_t length;
-    uDeviceHandle_t *pDeviceHandle = (uDeviceHandle_t *)pParameters;
+    pullReceived();
+    uPortSemaphoreGive(gRxSem);
+}
+
+static void printThroughput(const char *pDirection, uint32_t bytes, int32_t timeMs)
+{
+    if (timeMs <= 0) {
+        timeMs = 1;
+    }
+    printf("%s: %u bytes in %d ms, %u.%02u kB/s\n", pDirection, bytes, (int)timeMs,
+           bytes / timeMs, (bytes % timeMs) * 100 / timeMs);
+}
+
+// Send all of a chunk, uBleSpsSend waits for credits from the client
+static bool sendChunk(const char *pData, int32_t size)
+{
+    while (size > 0 && gChannel >= 0) {
+        int32_t sent = uBleSpsSend(gDeviceHandle, gChannel, pData, size);
+        if (sent < 0) {
+            printf("* Failed to send: %d\n", (int)sent);
+            return false;
+        }
+        pData += sent;
+        size -= sent;
+    }
+    return size == 0;
+}
+
+// Generate log lines into the transmit ring buffer
+static size_t produceLogData(uint32_t *pLineNo, size_t maxSize)
+{
+    char line[64];
+    size_t added = 0;
+    while (added < maxSize) {
+        int len = snprintf(line, sizeof(line), "%08u %10d Log line with some data\n",
+                           *pLineNo, (int)uPortGetTickTimeMs());
+        if (added + len > maxSize) {
+            // Cut the last line to get the exact size
+            len = maxSize - added;
+        }
+        if (!uRingBufferAdd(&gTxRing, line, len)) {
+            break;
+        }
+        (*pLineNo)++;
+        added += len;
+    }
+    return added;
+}
+
+// Stream generated data to the client in MTU sized chunks
+static void bulkSend(uint32_t size)
+{
+    char chunk[MAX_CHUNK_SIZE];
+    size_t chunkSize = gMtu - 3;
+    if (chunkSize > sizeof(chunk)) {
+        chunkSize = sizeof(chunk);
+    }
+    uint32_t lineNo = 0;
+    uint32_t remaining = size;
+    uint32_t produced = 0;
+    int32_t maxChunkMs = 0;
+    int32_t start = uPortGetTickTimeMs();
+    printf("Sending %u bytes in %u byte chunks\n", size, (unsigned)chunkSize);
+    while (remaining > 0 && gChannel >= 0) {
+        if (produced < size) {
+            size_t space = TX_BUFFER_SIZE - uRingBufferDataSize(&gTxRing);
+            if (space > size - produced) {
+                space = size - produced;
+            }
+            produced += produceLogData(&lineNo, space);
+        }
+        size_t len = uRingBufferRead(&gTxRing, chunk,
+                                     remaining < chunkSize ? remaining : chunkSize);
+        int32_t chunkStart = uPortGetTickTimeMs();
+        if (len == 0 || !sendChunk(chunk, len)) {
+            break;
+        }
+        int32_t chunkMs = uPortGetTickTimeMs() - chunkStart;
+        if (chunkMs > maxChunkMs) {
+            maxChunkMs = chunkMs;
+        }
+        remaining -= len;
+    }
+    printThroughput("Sent", size - remaining, uPortGetTickTimeMs() - start);
+    printf("Max chunk send time: %d ms\n", (int)maxChunkMs);
+    uRingBufferReset(&gTxRing);
+}
+
+// Echo or handle commands for everything received
+static void handleReceived()
+{
+    char buffer[MAX_CHUNK_SIZE + 1];
+    size_t length;
     do {
-        length = uBleSpsReceive(*pDeviceHandle, channel, buffer, sizeof(buffer) - 1);
+        // Continue with any data left in ubxlib when the ring was full
+        pullReceived();
+        uPortMutexLock(gRxMutex);
+        length = uRingBufferRead(&gRxRing, buffer, sizeof(buffer) - 1);
+        int32_t lastMs = gRxStats.lastMs;
+        uPortMutexUnlock(gRxMutex);
         if (length > 0) {
             buffer[length] = 0;
-            printf("Received: %s\n", buffer);
-            // Echo the received data
-            uBleSpsSend(*pDeviceHandle, channel, buffer, length);
+            if (strncmp(buffer, BULK_COMMAND, strlen(BULK_COMMAND)) == 0) {
+                const char *pSize = buffer + strlen(BULK_COMMAND);
+                unsigned long kb = strtoul(pSize, NULL, 10);
+                // Checked before multiplying so the size can't wrap
+                if (*pSize >= '0' && *pSize <= '9' && kb > 0 && kb <= BULK_MAX_KB) {
+                    bulkSend(kb * 1024);
+                } else {
+                    printf("* Invalid bulk size, 1 to %d kB\n", BULK_MAX_KB);
+                }
+            } else if (sendChunk(buffer, length)) {
+                // Echo the received data
+                printf("Echoed %u bytes, latency %d ms\n", (unsigned)length,
+                       (int)(uPortGetTickTimeMs() - lastMs));
+            }
         }
     } while (length > 0);
 }
 
+static void reportReceived()
+{
+    uPortMutexLock(gRxMutex);
+    uint32_t bytes = gRxStats.bytes;
+    int32_t timeMs = gRxStats.lastMs - gRxStats.firstMs;
+    memset(&gRxStats, 0, sizeof(gRxStats));
+    uPortMutexUnlock(gRxMutex);
+    if (bytes > 0) {
+        printThroughput("Received", bytes, timeMs);
+    }
+}
+
 void main()
 {
     // Remove the line below if you want the log printouts from ubxlib
@@ -79,29 +265,37 @@ void main()
     uDeviceInit();
     // And the U-blox module
     int32_t errorCode;
-    uDeviceHandle_t deviceHandle;
     uDeviceGetDefaults(gDeviceType, &gDeviceCfg);
     printf("\nInitiating the module...\n");
-    errorCode = uDeviceOpen(&gDeviceCfg, &deviceHandle);
+    errorCode = uDeviceOpen(&gDeviceCfg, &gDeviceHandle);
     if (errorCode == 0) {
         printf("Bringing up the ble network...\n");
-        errorCode = uNetworkInterfaceUp(deviceHandle, gNetworkCfg.type, &gNetworkCfg);
+        errorCode = uNetworkInterfaceUp(gDeviceHandle, gNetworkCfg.type, &gNetworkCfg);
         if (errorCode == 0) {
-            uBleSpsSetCallbackConnectionStatus(deviceHandle,
+            uRingBufferCreate(&gRxRing, gRxRingBuffer, sizeof(gRxRingBuffer));
+            uRingBufferCreate(&gTxRing, gTxRingBuffer, sizeof(gTxRingBuffer));
+            uPortMutexCreate(&gRxMutex);
+            uPortSemaphoreCreate(&gRxSem, 0, 1);
+            uBleSpsSetCallbackConnectionStatus(gDeviceHandle,
                                                connectionCallback,
-                                               &deviceHandle);
-            uBleSpsSetDataAvailableCallback(deviceHandle,
+                                               NULL);
+            uBleSpsSetDataAvailableCallback(gDeviceHandle,
                                             dataAvailableCallback,
-                                            &deviceHandle);
+                                            NULL);
             printf("\n== Start a SPS client e.g. in a phone ==\n\n");
+            printf("Send \"%s<kB>\" to test the throughput\n", BULK_COMMAND);
             printf("Waiting for connections...\n");
             while (1) {
-                uPortTaskBlock(1000);
+                if (uPortSemaphoreTryTake(gRxSem, IDLE_MS) == 0) {
+                    handleReceived();
+                } else {
+                    reportReceived();
+                }
             }
         } else {
             printf("* Failed to bring up the network: %d\n", errorCode);
         }
-        uDeviceClose(deviceHandle, true);
+        uDeviceClose(gDeviceHandle, true);
     } else {
         printf("* Failed to initiate the module: %d\n", errorCode);
     }
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ble_adv_filter.h"
+
+const uint8_t *bleAdvFind(const uint8_t *pData, size_t len, uint8_t type,
+                          size_t *pLen)
+{
+    size_t pos = 0;
+    // Each AD structure: length, type, data[length - 1]
+    while (pos + 1 < len) {
+        size_t adLen = pData[pos];
+        if (adLen == 0 || pos + 1 + adLen > len) {
+            break;
+        }
+        if (pData[pos + 1] == type) {
+            *pLen = adLen - 1;
+            return &pData[pos + 2];
+        }
+        pos += 1 + adLen;
+    }
+    return NULL;
+}
+
+bool bleAdvCompanyId(const uint8_t *pData, size_t len, uint16_t *pCompanyId)
+{
+    size_t adLen;
+    const uint8_t *pAd = bleAdvFind(pData, len, BLE_AD_MANUFACTURER, &adLen);
+    bool found = pAd != NULL && adLen >= 2;
+    if (found) {
+        *pCompanyId = pAd[0] | (pAd[1] << 8);
+    }
+    return found;
+}
+
+static bool uuid16Listed(const bleAdvFilter_t *pFilter, const uint8_t *pUuid)
+{
+    uint16_t uuid = pUuid[0] | (pUuid[1] << 8);
+    for (size_t i = 0; i < pFilter->uuid16Cnt; i++) {
+        if (pFilter->pUuid16s[i] == uuid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool uuid16Match(const bleAdvFilter_t *pFilter, const uint8_t *pData, size_t len)
+{
+    static const uint8_t types[] = { BLE_AD_UUID16_SOME, BLE_AD_UUID16_ALL };
+    size_t adLen;
+    for (size_t t = 0; t < sizeof(types); t++) {
+        const uint8_t *pAd = bleAdvFind(pData, len, types[t], &adLen);
+        for (size_t i = 0; pAd != NULL && i + 1 < adLen; i += 2) {
+            if (uuid16Listed(pFilter, &pAd[i])) {
+                return true;
+            }
+        }
+    }
+    // Service data, e.g. Eddystone, starts with the uuid
+    const uint8_t *pAd = bleAdvFind(pData, len, BLE_AD_SVC_DATA16, &adLen);
+    return pAd != NULL && adLen >= 2 && uuid16Listed(pFilter, pAd);
+}
+
+static bool uuid128Match(const bleAdvFilter_t *pFilter, const uint8_t *pData, size_t len)
+{
+    static const uint8_t types[] = { BLE_AD_UUID128_SOME, BLE_AD_UUID128_ALL };
+    size_t adLen;
+    for (size_t t = 0; t < sizeof(types); t++) {
+        const uint8_t *pAd = bleAdvFind(pData, len, types[t], &adLen);
+        for (size_t i = 0; pAd != NULL && i + 15 < adLen; i += 16) {
+            for (size_t j = 0; j < pFilter->uuid128Cnt; j++) {
+                if (memcmp(&pAd[i], pFilter->pUuid128s[j], 16) == 0) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool bleAdvFilterMatch(const bleAdvFilter_t *pFilter, int8_t rssi,
+                       const uint8_t *pData, size_t len)
+{
+    if (rssi < pFilter->minRssi) {
+        return false;
+    }
+    if (pFilter->companyIdCnt == 0 && pFilter->uuid16Cnt == 0 &&
+        pFilter->uuid128Cnt == 0) {
+        return true;
+    }
+    uint16_t companyId;
+    if (pFilter->companyIdCnt > 0 && bleAdvCompanyId(pData, len, &companyId)) {
+        for (size_t i = 0; i < pFilter->companyIdCnt; i++) {
+            if (pFilter->pCompanyIds[i] == companyId) {
+                return true;
+            }
+        }
+    }
+    return (pFilter->uuid16Cnt > 0 && uuid16Match(pFilter, pData, len)) ||
+           (pFilter->uuid128Cnt > 0 && uuid128Match(pFilter, pData, len));
+}
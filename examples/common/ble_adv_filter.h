@@ -0,0 +1,77 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Filtering of BLE advertising data. Works directly on the raw
+ * advertising data bytes without copying them so it can be used
+ * early in the scan callback. No dependencies to Zephyr or ubxlib.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define BLE_AD_UUID16_SOME      0x02
+#define BLE_AD_UUID16_ALL       0x03
+#define BLE_AD_UUID128_SOME     0x06
+#define BLE_AD_UUID128_ALL      0x07
+#define BLE_AD_SVC_DATA16       0x16
+#define BLE_AD_MANUFACTURER     0xFF
+
+/**
+ * Filter settings. An advertisement passes when the rssi is at least
+ * minRssi and, if any ids or uuids are given, at least one of them matches.
+ */
+typedef struct {
+    int8_t minRssi;
+    const uint16_t *pCompanyIds;
+    size_t companyIdCnt;
+    const uint16_t *pUuid16s;
+    size_t uuid16Cnt;
+    const uint8_t (*pUuid128s)[16];  // Little endian as in the advertisement
+    size_t uuid128Cnt;
+} bleAdvFilter_t;
+
+/**
+ * Find an AD structure of a given type.
+ * @param   pData  Advertising data.
+ * @param   len    Length of the advertising data.
+ * @param   type   AD type to look for.
+ * @param   pLen   Place to put the length of the AD data found.
+ * @return         Pointer to the AD data, after the type byte, or NULL.
+ */
+const uint8_t *bleAdvFind(const uint8_t *pData, size_t len, uint8_t type,
+                          size_t *pLen);
+
+/**
+ * Get the company id of the manufacturer specific data.
+ * @param   pData       Advertising data.
+ * @param   len         Length of the advertising data.
+ * @param   pCompanyId  Place to put the company id.
+ * @return              True if found.
+ */
+bool bleAdvCompanyId(const uint8_t *pData, size_t len, uint16_t *pCompanyId);
+
+/**
+ * Check if an advertisement passes a filter.
+ * @param   pFilter  The filter.
+ * @param   rssi     Received signal strength.
+ * @param   pData    Advertising data.
+ * @param   len      Length of the advertising data.
+ * @return           True if it passes.
+ */
+bool bleAdvFilterMatch(const bleAdvFilter_t *pFilter, int8_t rssi,
+                       const uint8_t *pData, size_t len);
@@ -15,18 +15,32 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
+#include <kernel.h>
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
 #include <bluetooth/direction.h>
 
 #include "ble_aoa.h"
 
-// Length of CTE in unit of 8 [us]
+// Default length of CTE in unit of 8 [us]
 #define CTE_LEN (0x14U)
-// Number of CTE send in single periodic advertising train
+// Default number of CTE send in single periodic advertising train
 #define PER_ADV_EVENT_CTE_COUNT 1
 #define PER_ADV_DATA_LEN 200
+// Limits from the Bluetooth core specification
+#define CTE_LEN_MIN 2
+#define CTE_LEN_MAX 20
+#define CTE_COUNT_MAX 16
+#define CTE_ANT_IDS_MAX 38
+// Air time on the 1M PHY: preamble, access address, header and crc
+#define AIR_US_PER_BYTE 8
+#define AIR_PDU_OVERHEAD_BYTES (1 + 4 + 2 + 3)
+// Extended header length and flags, CTEInfo
+#define AIR_EXT_HEADER_BYTES 3
+// Time between chained packets
+#define AIR_MAFS_US 300
 // Eddystone
 #define EDDYSTONE_INSTANCE_ID_LEN 6
 #define EDDYSTONE_NAMESPACE_LENGTH 10
@@ -47,6 +61,9 @@ static struct bt_le_ext_adv_start_param m_ext_adv_start_param = {
     .num_events = 0,
 };
 
+static uint8_t m_ant_ids[CTE_ANT_IDS_MAX];
+static uint16_t m_per_adv_interval_ms = 100;
+
 struct bt_df_adv_cte_tx_param m_cte_params = {
     .cte_len = CTE_LEN,
     .cte_count = PER_ADV_EVENT_CTE_COUNT,
@@ -77,6 +94,53 @@ static struct bt_data m_adv_data[] = {
 
 static bool gIsAdvertising = false;
 
+// Periodic advertising data is double buffered. New data is put in the
+// back buffer and handed to the controller while the train is running,
+// the controller keeps sending the old data until the new is complete.
+K_MUTEX_DEFINE(gPerAdvDataMutex);
+static uint8_t gPerAdvData[2][PER_ADV_DATA_LEN];
+static uint8_t gPerAdvDataLen[2];
+static uint8_t gPerAdvDataActive = 0;
+static bool gPerAdvDataPending = false;
+static uint32_t gPerAdvDataMinIntervalMs = 0;
+static uint32_t gPerAdvDataLastUpdate = 0;
+
+static void perAdvDataUpdate(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(gPerAdvDataWork, perAdvDataUpdate);
+
+static void perAdvDataUpdate(struct k_work *work)
+{
+    k_mutex_lock(&gPerAdvDataMutex, K_FOREVER);
+    if (gPerAdvDataPending && gIsAdvertising) {
+        uint8_t back = !gPerAdvDataActive;
+        struct bt_data adData = {
+            .type = BT_DATA_MANUFACTURER_DATA,
+            .data = gPerAdvData[back],
+            .data_len = gPerAdvDataLen[back]
+        };
+        if (bt_le_per_adv_set_data(m_ext_adv, &adData, 1) == 0) {
+            gPerAdvDataActive = back;
+            gPerAdvDataPending = false;
+            gPerAdvDataLastUpdate = k_uptime_get_32();
+        } else {
+            printf("* Failed to update periodic advertising data\n");
+        }
+    }
+    k_mutex_unlock(&gPerAdvDataMutex);
+}
+
+// Call with gPerAdvDataMutex held
+static void schedulePerAdvDataUpdate()
+{
+    uint32_t elapsed = k_uptime_get_32() - gPerAdvDataLastUpdate;
+    uint32_t delay = 0;
+    if (gPerAdvDataLastUpdate != 0 && elapsed < gPerAdvDataMinIntervalMs) {
+        delay = gPerAdvDataMinIntervalMs - elapsed;
+    }
+    // Does nothing if already scheduled, the latest data is sent then
+    k_work_schedule(&gPerAdvDataWork, K_MSEC(delay));
+}
+
 static bool set_adv_params(uint16_t min_ms, uint16_t max_ms)
 {
     struct bt_le_per_adv_param per_adv_param = {
@@ -84,6 +148,7 @@ static bool set_adv_params(uint16_t min_ms, uint16_t max_ms)
         .interval_max = max_ms / 1.25,
         .options = BT_LE_ADV_OPT_USE_TX_POWER | BT_LE_ADV_OPT_NO_2M,
     };
+    m_per_adv_interval_ms = min_ms;
     return bt_le_per_adv_set_param(m_ext_adv, &per_adv_param) == 0;
 }
 
@@ -130,15 +195,140 @@ bool bleAoaAdvertise(uint16_t min, uint16_t max, bool on)
              bt_le_per_adv_start(m_ext_adv) == 0 &&
              bt_le_ext_adv_start(m_ext_adv, &m_ext_adv_start_param) == 0;
     }
+    k_mutex_lock(&gPerAdvDataMutex, K_FOREVER);
     gIsAdvertising = on && ok;
+    if (gIsAdvertising && gPerAdvDataPending) {
+        schedulePerAdvDataUpdate();
+    }
+    k_mutex_unlock(&gPerAdvDataMutex);
+    return ok;
+}
+
+bool bleAoaSetInterval(uint16_t min_ms, uint16_t max_ms)
+{
+    k_mutex_lock(&gPerAdvDataMutex, K_FOREVER);
+    bool isAdvertising = gIsAdvertising;
+    k_mutex_unlock(&gPerAdvDataMutex);
+    if (!isAdvertising) {
+        return bleAoaAdvertise(min_ms, max_ms, true);
+    }
+    // The periodic parameters can't be changed while it is enabled, but
+    // the extended advertising carrying the sync info can keep running.
+    // A new interval breaks the sync of every locator, which must scan
+    // for the sync info and sync again before it gets any more CTEs.
+    bool ok = bt_le_per_adv_stop(m_ext_adv) == 0 &&
+              set_adv_params(min_ms, max_ms) &&
+              bt_le_per_adv_start(m_ext_adv) == 0;
+    if (!ok) {
+        bleAoaAdvertise(0, 0, false);
+    }
     return ok;
 }
 
 bool bleAoaSetAdvData(const uint8_t *data, uint8_t len)
 {
-    struct bt_data adData;
-    adData.type = BT_DATA_MANUFACTURER_DATA;
-    adData.data = data;
-    adData.data_len = len;
-    return (gIsAdvertising && (bt_le_per_adv_set_data(m_ext_adv, &adData, 1) == 0));
-}
\ No newline at end of file
+    if (len > PER_ADV_DATA_LEN) {
+        return false;
+    }
+    k_mutex_lock(&gPerAdvDataMutex, K_FOREVER);
+    uint8_t active = gPerAdvDataActive;
+    uint8_t back = !active;
+    if (gPerAdvDataLen[active] == len && memcmp(gPerAdvData[active], data, len) == 0) {
+        // Same as what is on air, drop any pending change
+        gPerAdvDataPending = false;
+    } else {
+        memcpy(gPerAdvData[back], data, len);
+        gPerAdvDataLen[back] = len;
+        gPerAdvDataPending = true;
+        if (gIsAdvertising) {
+            schedulePerAdvDataUpdate();
+        }
+    }
+    k_mutex_unlock(&gPerAdvDataMutex);
+    return true;
+}
+
+void bleAoaSetAdvDataMinInterval(uint32_t minIntervalMs)
+{
+    gPerAdvDataMinIntervalMs = minIntervalMs;
+}
+
+bool bleAoaSetCte(const bleAoaCte_t *pCte)
+{
+    static const uint8_t types[] = {
+        [BLE_AOA_CTE_AOA] = BT_DF_CTE_TYPE_AOA,
+        [BLE_AOA_CTE_AOD_1US] = BT_DF_CTE_TYPE_AOD_1US,
+        [BLE_AOA_CTE_AOD_2US] = BT_DF_CTE_TYPE_AOD_2US,
+    };
+    bool isAod = pCte->type != BLE_AOA_CTE_AOA;
+    if (pCte->length < CTE_LEN_MIN || pCte->length > CTE_LEN_MAX ||
+        pCte->count < 1 || pCte->count > CTE_COUNT_MAX ||
+        pCte->type >= sizeof(types) ||
+        (isAod && (pCte->antIdCnt < 2 || pCte->antIdCnt > CTE_ANT_IDS_MAX))) {
+        return false;
+    }
+    // The parameters can't be changed while CTE is enabled. The
+    // periodic advertising continues without CTE in between.
+    bt_df_adv_cte_tx_disable(m_ext_adv);
+    m_cte_params.cte_len = pCte->length;
+    m_cte_params.cte_count = pCte->count;
+    m_cte_params.cte_type = types[pCte->type];
+    if (isAod) {
+        memcpy(m_ant_ids, pCte->pAntIds, pCte->antIdCnt);
+        m_cte_params.num_ant_ids = pCte->antIdCnt;
+        m_cte_params.ant_ids = m_ant_ids;
+    } else {
+        m_cte_params.num_ant_ids = 0;
+        m_cte_params.ant_ids = NULL;
+    }
+    bool ok = bt_df_set_adv_cte_tx_param(m_ext_adv, &m_cte_params) == 0;
+    // Always try to enable, with the previous parameters on failure
+    return bt_df_adv_cte_tx_enable(m_ext_adv) == 0 && ok;
+}
+
+uint32_t bleAoaCteAirTimeUs(const bleAoaCte_t *pCte)
+{
+    // The first packet carries the advertising data, the chained ones
+    // only the headers. All of them carry a CTE.
+    k_mutex_lock(&gPerAdvDataMutex, K_FOREVER);
+    uint32_t dataLen = gPerAdvDataLen[gPerAdvDataActive];
+    k_mutex_unlock(&gPerAdvDataMutex);
+    if (dataLen > 0) {
+        // AD length and type
+        dataLen += 2;
+    }
+    uint32_t packetUs = (AIR_PDU_OVERHEAD_BYTES + AIR_EXT_HEADER_BYTES) * AIR_US_PER_BYTE +
+                        pCte->length * 8;
+    return pCte->count * packetUs + dataLen * AIR_US_PER_BYTE +
+           (pCte->count - 1) * AIR_MAFS_US;
+}
+
+void bleAoaCteSweep(uint32_t dwellMs)
+{
+    static const uint8_t lengths[] = { CTE_LEN_MIN, 5, 10, CTE_LEN_MAX };
+    static const uint8_t counts[] = { 1, 2, 4, 8 };
+    bleAoaCte_t cte = { .type = BLE_AOA_CTE_AOA };
+    printf("CTE sweep, periodic interval %u ms\n", m_per_adv_interval_ms);
+    printf("length(us) count air(us/event) duty(%%) events/s/channel\n");
+    for (size_t l = 0; l < sizeof(lengths); l++) {
+        for (size_t c = 0; c < sizeof(counts); c++) {
+            cte.length = lengths[l];
+            cte.count = counts[c];
+            if (!bleAoaSetCte(&cte)) {
+                printf("* Failed to set CTE length %u count %u\n", cte.length, cte.count);
+                continue;
+            }
+            uint32_t airUs = bleAoaCteAirTimeUs(&cte);
+            printf("%10u %5u %14u %7u.%02u %16u\n",
+                   cte.length * 8, cte.count, airUs,
+                   airUs / (m_per_adv_interval_ms * 10),
+                   airUs % (m_per_adv_interval_ms * 10) * 100 / (m_per_adv_interval_ms * 10),
+                   1000000 / airUs);
+            k_msleep(dwellMs);
+        }
+    }
+    // Back to the defaults
+    cte.length = CTE_LEN;
+    cte.count = PER_ADV_EVENT_CTE_COUNT;
+    bleAoaSetCte(&cte);
+}
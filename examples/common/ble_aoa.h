@@ -17,6 +17,21 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+typedef enum {
+    BLE_AOA_CTE_AOA,
+    BLE_AOA_CTE_AOD_1US,  // Antenna switching in 1 us slots
+    BLE_AOA_CTE_AOD_2US   // Antenna switching in 2 us slots
+} bleAoaCteType_t;
+
+/** Constant tone extension settings */
+typedef struct {
+    uint8_t length;          // Length in units of 8 us, 2 to 20
+    uint8_t count;           // CTEs per periodic advertising event, 1 to 16
+    bleAoaCteType_t type;
+    uint8_t antIdCnt;        // Antenna switching pattern length, AoD only
+    const uint8_t *pAntIds;  // Antenna switching pattern, AoD only
+} bleAoaCte_t;
+
 /** Initiate BLE for angle of arrival advertisements
  * @param pBleId String to receive the 12 character BLE id (mac).
  *               Can be set to NULL.
@@ -32,9 +47,53 @@ bool bleAoaInit(char *pBleId);
  */
 bool bleAoaAdvertise(uint16_t min_ms, uint16_t max_ms, bool on);
 
-/** Set or update the periodic advertising data.
- * Advertising must be initialized before calling.
- * @param data  Advertising data.
+/** Change the interval of ongoing angle of arrival advertisements.
+ * Only the periodic advertising is restarted, the extended advertising
+ * keeps running. Locators lose the sync to the periodic advertising and
+ * miss the tag until they have scanned and synced again, so don't change
+ * the interval more often than needed. Starts advertising if not already
+ * started.
+ * @param min_ms Minimum advertisement time in milliseconds.
+ * @param max_ms Maximum advertisement time in milliseconds.
+ * @return       Success or failure.
+ */
+bool bleAoaSetInterval(uint16_t min_ms, uint16_t max_ms);
+
+/** Set or update the periodic advertising data, sent as manufacturer data.
+ * Advertising must be initialized before calling. The data is copied and
+ * only sent to the controller when changed, at most once per the minimum
+ * interval. The periodic train and its CTEs keep running during updates.
+ * Data set while not advertising is sent when advertising is started.
+ * @param data  Advertising data, starting with the company id.
  * @param len   Advertising data length.
+ * @return      False if the data is too long.
+ */
+bool bleAoaSetAdvData(const uint8_t *data, uint8_t len);
+
+/** Set the minimum time between updates of the periodic advertising data.
+ * @param minIntervalMs Minimum interval in milliseconds, 0 for no limit.
+ */
+void bleAoaSetAdvDataMinInterval(uint32_t minIntervalMs);
+
+/** Change the constant tone extension settings.
+ * The CTE is disabled during the change while the periodic
+ * advertising keeps running. AoD requires antenna switching
+ * support in the network cpu firmware.
+ * @param pCte   The new settings.
+ * @return       Success or failure.
+ */
+bool bleAoaSetCte(const bleAoaCte_t *pCte);
+
+/** Estimate the air time of one periodic advertising event.
+ * @param pCte   CTE settings.
+ * @return       Air time in microseconds, including the current
+ *               periodic advertising data.
+ */
+uint32_t bleAoaCteAirTimeUs(const bleAoaCte_t *pCte);
+
+/** Step through a range of AoA CTE lengths and counts and print the
+ * air time and duty cycle for each. Advertising must be started.
+ * Restores the default settings when done.
+ * @param dwellMs Time to keep each setting in milliseconds.
  */
-bool bleAoaSetAdvData(const uint8_t *data, uint8_t len);
\ No newline at end of file
+void bleAoaCteSweep(uint32_t dwellMs);
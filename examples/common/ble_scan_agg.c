@@ -0,0 +1,190 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ble_scan_agg.h"
+
+#define NONE 0xFFFF
+
+uint32_t bleScanAggHash(const uint8_t *pData, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ pData[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static size_t homeSlot(const bleScanAgg_t *pAgg, const uint8_t *pAddr)
+{
+    return bleScanAggHash(pAddr, BLE_SCAN_AGG_ADDR_SIZE) % pAgg->tableSize;
+}
+
+// Table slot holding the address or the empty slot where it should go
+static size_t findSlot(const bleScanAgg_t *pAgg, const uint8_t *pAddr)
+{
+    size_t slot = homeSlot(pAgg, pAddr);
+    while (pAgg->pTable[slot] != NONE &&
+           memcmp(pAgg->pEntries[pAgg->pTable[slot]].addr, pAddr,
+                  BLE_SCAN_AGG_ADDR_SIZE) != 0) {
+        slot = (slot + 1) % pAgg->tableSize;
+    }
+    return slot;
+}
+
+// Remove from the table using backward shift, no tombstones needed
+static void tableRemove(bleScanAgg_t *pAgg, size_t slot)
+{
+    size_t next = slot;
+    while (true) {
+        next = (next + 1) % pAgg->tableSize;
+        uint16_t index = pAgg->pTable[next];
+        if (index == NONE) {
+            break;
+        }
+        size_t home = homeSlot(pAgg, pAgg->pEntries[index].addr);
+        // Move the entry back if its home is not between the hole and it
+        bool between = slot <= next ? (home > slot && home <= next) :
+                       (home > slot || home <= next);
+        if (!between) {
+            pAgg->pTable[slot] = index;
+            slot = next;
+        }
+    }
+    pAgg->pTable[slot] = NONE;
+}
+
+static void lruUnlink(bleScanAgg_t *pAgg, uint16_t index)
+{
+    bleScanAggEntry_t *pEntry = &pAgg->pEntries[index];
+    if (pEntry->lruPrev != NONE) {
+        pAgg->pEntries[pEntry->lruPrev].lruNext = pEntry->lruNext;
+    } else {
+        pAgg->lruHead = pEntry->lruNext;
+    }
+    if (pEntry->lruNext != NONE) {
+        pAgg->pEntries[pEntry->lruNext].lruPrev = pEntry->lruPrev;
+    } else {
+        pAgg->lruTail = pEntry->lruPrev;
+    }
+}
+
+static void lruPushFront(bleScanAgg_t *pAgg, uint16_t index)
+{
+    bleScanAggEntry_t *pEntry = &pAgg->pEntries[index];
+    pEntry->lruPrev = NONE;
+    pEntry->lruNext = pAgg->lruHead;
+    if (pAgg->lruHead != NONE) {
+        pAgg->pEntries[pAgg->lruHead].lruPrev = index;
+    } else {
+        pAgg->lruTail = index;
+    }
+    pAgg->lruHead = index;
+}
+
+void bleScanAggInit(bleScanAgg_t *pAgg)
+{
+    memset(pAgg->pTable, 0xFF, pAgg->tableSize * sizeof(pAgg->pTable[0]));
+    pAgg->used = 0;
+    pAgg->lruHead = NONE;
+    pAgg->lruTail = NONE;
+    pAgg->lastSnapshotMs = 0;
+    pAgg->windowCnt = 0;
+    pAgg->adverts = 0;
+    pAgg->evictions = 0;
+}
+
+const bleScanAggEntry_t *bleScanAggAdd(bleScanAgg_t *pAgg, const uint8_t *pAddr,
+                                       int8_t rssi, const uint8_t *pData,
+                                       size_t len, uint32_t nowMs)
+{
+    pAgg->adverts++;
+    size_t slot = findSlot(pAgg, pAddr);
+    uint16_t index = pAgg->pTable[slot];
+    bleScanAggEntry_t *pEntry;
+    if (index != NONE) {
+        pEntry = &pAgg->pEntries[index];
+        lruUnlink(pAgg, index);
+    } else {
+        if (pAgg->used < pAgg->capacity) {
+            index = pAgg->used++;
+        } else {
+            // Reuse the least recently seen entry
+            index = pAgg->lruTail;
+            if (pAgg->pEntries[index].windowCount > 0) {
+                pAgg->windowCnt--;
+            }
+            lruUnlink(pAgg, index);
+            tableRemove(pAgg, findSlot(pAgg, pAgg->pEntries[index].addr));
+            pAgg->evictions++;
+            // The removal may have moved the slot for the new address
+            slot = findSlot(pAgg, pAddr);
+        }
+        pAgg->pTable[slot] = index;
+        pEntry = &pAgg->pEntries[index];
+        memcpy(pEntry->addr, pAddr, BLE_SCAN_AGG_ADDR_SIZE);
+        pEntry->rssiMin = rssi;
+        pEntry->rssiMax = rssi;
+        pEntry->rssiEwmaX16 = rssi * 16;
+        pEntry->firstSeenMs = nowMs;
+        pEntry->count = 0;
+        pEntry->windowCount = 0;
+    }
+    lruPushFront(pAgg, index);
+    if (rssi < pEntry->rssiMin) {
+        pEntry->rssiMin = rssi;
+    }
+    if (rssi > pEntry->rssiMax) {
+        pEntry->rssiMax = rssi;
+    }
+    // Weight 1/8 for the new value
+    pEntry->rssiEwmaX16 += (rssi * 16 - pEntry->rssiEwmaX16) / 8;
+    pEntry->lastSeenMs = nowMs;
+    pEntry->count++;
+    if (pEntry->windowCount++ == 0) {
+        pAgg->windowCnt++;
+    }
+    pEntry->payloadHash = bleScanAggHash(pData, len);
+    return pEntry;
+}
+
+const bleScanAggEntry_t *bleScanAggFind(const bleScanAgg_t *pAgg,
+                                        const uint8_t *pAddr)
+{
+    uint16_t index = pAgg->pTable[findSlot(pAgg, pAddr)];
+    return index != NONE ? &pAgg->pEntries[index] : NULL;
+}
+
+size_t bleScanAggSnapshot(bleScanAgg_t *pAgg, bleScanAggEntry_t *pOut,
+                          size_t maxCnt, uint32_t nowMs)
+{
+    size_t cnt = 0;
+    // The list is in order of last seen, the entries in the window are
+    // first except for any left by an earlier truncated snapshot
+    for (uint16_t index = pAgg->lruHead;
+         index != NONE && cnt < maxCnt && pAgg->windowCnt > 0;
+         index = pAgg->pEntries[index].lruNext) {
+        bleScanAggEntry_t *pEntry = &pAgg->pEntries[index];
+        if (pEntry->windowCount > 0) {
+            pOut[cnt++] = *pEntry;
+            pEntry->windowCount = 0;
+            pAgg->windowCnt--;
+        }
+    }
+    pAgg->lastSnapshotMs = nowMs;
+    return cnt;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Aggregation of BLE scan results. Keeps statistics per device in a
+ * fixed capacity open addressing hash table keyed by the BLE address.
+ * When full, the least recently seen device is evicted. Instead of
+ * printing every advertisement, compact snapshots of the devices seen
+ * since the last snapshot can be emitted periodically.
+ *
+ * The module has no dependencies to Zephyr or ubxlib. It does no
+ * locking, the caller must serialize calls from different threads.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Address type byte followed by the 6 address bytes, same as bt_addr_le_t
+#define BLE_SCAN_AGG_ADDR_SIZE 7
+
+typedef struct {
+    uint8_t addr[BLE_SCAN_AGG_ADDR_SIZE];
+    int8_t rssiMin;
+    int8_t rssiMax;
+    int16_t rssiEwmaX16;  // Exponentially weighted average, times 16
+    uint32_t firstSeenMs;
+    uint32_t lastSeenMs;
+    uint32_t count;       // Total number of adverts
+    uint32_t windowCount; // Adverts since the last snapshot
+    uint32_t payloadHash; // Hash of the latest advertising data
+    // Internal
+    uint16_t lruPrev;
+    uint16_t lruNext;
+} bleScanAggEntry_t;
+
+typedef struct {
+    bleScanAggEntry_t *pEntries;
+    uint16_t *pTable;
+    size_t capacity;
+    size_t tableSize;
+    size_t used;
+    uint16_t lruHead;  // Most recently seen
+    uint16_t lruTail;  // Least recently seen
+    uint32_t lastSnapshotMs;
+    size_t windowCnt;  // Entries with a non zero windowCount
+    // Statistics
+    uint32_t adverts;
+    uint32_t evictions;
+} bleScanAgg_t;
+
+/**
+ * Define an aggregator with static storage.
+ * bleScanAggInit() must be called before use.
+ * @param name      Name of the bleScanAgg_t variable.
+ * @param maxCnt    Max number of devices, less than 32768.
+ */
+#define BLE_SCAN_AGG_DEFINE(name, maxCnt)                          \
+    static bleScanAggEntry_t name##_entries[maxCnt];               \
+    static uint16_t name##_table[2 * (maxCnt)];                    \
+    static bleScanAgg_t name = {                                   \
+        .pEntries = name##_entries,                                \
+        .pTable = name##_table,                                    \
+        .capacity = maxCnt,                                        \
+        .tableSize = 2 * (maxCnt)                                  \
+    }
+
+/**
+ * Initiate or clear an aggregator.
+ * @param   pAgg  The aggregator.
+ */
+void bleScanAggInit(bleScanAgg_t *pAgg);
+
+/**
+ * Add an advertisement.
+ * @param   pAgg     The aggregator.
+ * @param   pAddr    Address type and address, BLE_SCAN_AGG_ADDR_SIZE bytes.
+ * @param   rssi     Received signal strength.
+ * @param   pData    Advertising data, used for the payload hash.
+ * @param   len      Length of the advertising data.
+ * @param   nowMs    Current time.
+ * @return           Pointer to the device entry.
+ */
+const bleScanAggEntry_t *bleScanAggAdd(bleScanAgg_t *pAgg, const uint8_t *pAddr,
+                                       int8_t rssi, const uint8_t *pData,
+                                       size_t len, uint32_t nowMs);
+
+/**
+ * Find a device.
+ * @param   pAgg     The aggregator.
+ * @param   pAddr    Address type and address, BLE_SCAN_AGG_ADDR_SIZE bytes.
+ * @return           Pointer to the device entry or NULL if not found.
+ */
+const bleScanAggEntry_t *bleScanAggFind(const bleScanAgg_t *pAgg,
+                                        const uint8_t *pAddr);
+
+/**
+ * Copy the devices seen since the last snapshot, most recent first,
+ * and start a new snapshot window. Meant to be called with the lock
+ * held, the copies can then be processed after releasing it.
+ * Only the copied entries start a new window. If maxCnt is reached
+ * the remaining ones, windowCnt after the call, are kept with their
+ * counts for the next snapshot.
+ * @param   pAgg     The aggregator.
+ * @param   pOut     Array to receive the entries.
+ * @param   maxCnt   Size of the array.
+ * @param   nowMs    Current time.
+ * @return           Number of entries copied.
+ */
+size_t bleScanAggSnapshot(bleScanAgg_t *pAgg, bleScanAggEntry_t *pOut,
+                          size_t maxCnt, uint32_t nowMs);
+
+/**
+ * Calculate a 32 bit FNV-1a hash.
+ * @param   pData  Data to hash.
+ * @param   len    Length of the data.
+ * @return         The hash.
+ */
+uint32_t bleScanAggHash(const uint8_t *pData, size_t len);
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <kernel.h>
+#include <drivers/flash.h>
+#include <storage/flash_map.h>
+#include <fs/nvs.h>
+
+#include "counters.h"
+
+typedef struct {
+    uint16_t id;
+    bool dirty;
+    uint32_t value;
+} counter_t;
+
+static struct nvs_fs gNvs;
+static bool gMounted = false;
+static counter_t gCounters[COUNTERS_MAX];
+static uint32_t gWriteDelayMs = 0;
+K_MUTEX_DEFINE(gCountersLock);
+
+static void flushWork(struct k_work *pWork)
+{
+    countersFlush();
+}
+
+K_WORK_DELAYABLE_DEFINE(gFlushWork, flushWork);
+
+int32_t countersInit()
+{
+    k_mutex_lock(&gCountersLock, K_FOREVER);
+    memset(gCounters, 0, sizeof(gCounters));
+    k_mutex_unlock(&gCountersLock);
+#ifdef PM_SETTINGS_STORAGE_ID
+    const struct flash_area *pArea;
+    int32_t errorCode = flash_area_open(PM_SETTINGS_STORAGE_ID, &pArea);
+    if (errorCode != 0) {
+        return errorCode;
+    }
+    struct flash_pages_info info;
+    gNvs.flash_device = pArea->fa_dev;
+    gNvs.offset = pArea->fa_off;
+    errorCode = flash_get_page_info_by_offs(gNvs.flash_device, gNvs.offset, &info);
+    if (errorCode == 0) {
+        gNvs.sector_size = info.size;
+        gNvs.sector_count = pArea->fa_size / info.size;
+        errorCode = nvs_mount(&gNvs);
+    }
+    flash_area_close(pArea);
+    gMounted = errorCode == 0;
+    return errorCode;
+#else
+    // No settings_storage partition, see config/counters.conf
+    return -ENODEV;
+#endif
+}
+
+// Find a counter in the cache, reading it from the flash the first time
+static counter_t *getCounter(uint16_t id)
+{
+    counter_t *pFree = NULL;
+    for (int i = 0; i < COUNTERS_MAX; i++) {
+        if (gCounters[i].id == id) {
+            return &gCounters[i];
+        }
+        if (gCounters[i].id == 0 && pFree == NULL) {
+            pFree = &gCounters[i];
+        }
+    }
+    if (pFree != NULL && id != 0) {
+        pFree->id = id;
+        pFree->dirty = false;
+        pFree->value = 0;
+        if (gMounted) {
+            nvs_read(&gNvs, id, &pFree->value, sizeof(pFree->value));
+        }
+    }
+    return pFree;
+}
+
+static int32_t writeCounter(counter_t *pCounter)
+{
+    if (!gMounted) {
+        return -ENODEV;
+    }
+    // Returns zero when the value is already stored
+    ssize_t len = nvs_write(&gNvs, pCounter->id, &pCounter->value, sizeof(pCounter->value));
+    if (len >= 0) {
+        pCounter->dirty = false;
+        return 0;
+    }
+    return len;
+}
+
+static int32_t changed(counter_t *pCounter)
+{
+    if (gWriteDelayMs == 0) {
+        return writeCounter(pCounter);
+    }
+    pCounter->dirty = true;
+    // Doesn't postpone an already scheduled write
+    k_work_schedule(&gFlushWork, K_MSEC(gWriteDelayMs));
+    return 0;
+}
+
+uint32_t counterGet(uint16_t id)
+{
+    k_mutex_lock(&gCountersLock, K_FOREVER);
+    counter_t *pCounter = getCounter(id);
+    uint32_t value = pCounter != NULL ? pCounter->value : 0;
+    k_mutex_unlock(&gCountersLock);
+    return value;
+}
+
+int32_t counterSet(uint16_t id, uint32_t value)
+{
+    int32_t errorCode = -ENOMEM;
+    k_mutex_lock(&gCountersLock, K_FOREVER);
+    counter_t *pCounter = getCounter(id);
+    if (pCounter != NULL) {
+        pCounter->value = value;
+        errorCode = changed(pCounter);
+    }
+    k_mutex_unlock(&gCountersLock);
+    return errorCode;
+}
+
+uint32_t counterAdd(uint16_t id, int32_t delta)
+{
+    uint32_t value = 0;
+    k_mutex_lock(&gCountersLock, K_FOREVER);
+    counter_t *pCounter = getCounter(id);
+    if (pCounter != NULL) {
+        pCounter->value += delta;
+        if (changed(pCounter) == 0) {
+            value = pCounter->value;
+        }
+    }
+    k_mutex_unlock(&gCountersLock);
+    return value;
+}
+
+void countersSetWriteDelay(uint32_t delayMs)
+{
+    gWriteDelayMs = delayMs;
+    if (delayMs == 0) {
+        countersFlush();
+    }
+}
+
+int32_t countersFlush()
+{
+    int32_t errorCode = 0;
+    k_mutex_lock(&gCountersLock, K_FOREVER);
+    for (int i = 0; i < COUNTERS_MAX; i++) {
+        if (gCounters[i].id != 0 && gCounters[i].dirty) {
+            int32_t res = writeCounter(&gCounters[i]);
+            errorCode = errorCode == 0 ? res : errorCode;
+        }
+    }
+    k_mutex_unlock(&gCountersLock);
+    return errorCode;
+}
+
+int32_t counterBlobSet(uint16_t id, const void *pData, size_t len)
+{
+    if (!gMounted) {
+        return -ENODEV;
+    }
+    k_mutex_lock(&gCountersLock, K_FOREVER);
+    ssize_t res = nvs_write(&gNvs, id, pData, len);
+    k_mutex_unlock(&gCountersLock);
+    return res < 0 ? res : 0;
+}
+
+int32_t counterBlobGet(uint16_t id, void *pData, size_t len)
+{
+    if (!gMounted) {
+        return -ENODEV;
+    }
+    k_mutex_lock(&gCountersLock, K_FOREVER);
+    ssize_t res = nvs_read(&gNvs, id, pData, len);
+    k_mutex_unlock(&gCountersLock);
+    return res == -ENOENT ? 0 : res;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Persistent 32 bit counters, e.g. boot counts, sequence numbers and
+ * error counters.
+ *
+ * The counters are stored using NVS in the settings_storage partition
+ * of the internal flash. Each update is appended as a record with crc,
+ * so an interrupted write leaves the previous value, and the records
+ * are spread over all sectors of the partition for wear leveling.
+ * Values are cached in RAM so reads don't touch the flash.
+ *
+ * Values which must change together, e.g. a checkpoint, are stored
+ * as one record with counterBlobSet so they are never mixed up with
+ * older values after a reset.
+ *
+ * Requires set(COUNTERS 1) in the CMakeLists.txt of the example.
+ * The partition is used only by the counters, so the Zephyr settings
+ * subsystem, e.g. CONFIG_BT_SETTINGS, must not be used at the same time.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Max number of different counters used
+#define COUNTERS_MAX 16
+
+// Counter ids, any other non zero values can be used by the examples
+#define COUNTER_BOOT 1
+#define COUNTER_UPLOAD_SEQ 2
+#define COUNTER_ERRORS 3
+// Update checkpoint and pending update records in ota.c, see counterBlobSet
+#define COUNTER_OTA_CHECKPOINT 16
+#define COUNTER_OTA_PENDING 17
+// Id of the last completed update
+#define COUNTER_OTA_INSTALLED 23
+
+/**
+ * Mount the counter storage.
+ * @return  Zero on success or negative error code.
+ */
+int32_t countersInit();
+
+/**
+ * Get a counter value.
+ * @param   id      Counter id.
+ * @return          The value, zero if never set.
+ */
+uint32_t counterGet(uint16_t id);
+
+/**
+ * Set a counter value.
+ * @param   id      Counter id.
+ * @param   value   New value.
+ * @return          Zero on success or negative error code.
+ */
+int32_t counterSet(uint16_t id, uint32_t value);
+
+/**
+ * Add to a counter.
+ * @param   id      Counter id.
+ * @param   delta   Value to add.
+ * @return          The new value or zero on error.
+ */
+uint32_t counterAdd(uint16_t id, int32_t delta);
+
+/**
+ * Delay the writes of counter changes to the flash, so that frequent
+ * changes only make one write per delay period. Changes made within
+ * the period are lost on a reset.
+ * @param   delayMs  Max delay, zero to write each change at once
+ *                   which is the default.
+ */
+void countersSetWriteDelay(uint32_t delayMs);
+
+/**
+ * Write any delayed changes to the flash.
+ * @return          Zero on success or negative error code.
+ */
+int32_t countersFlush();
+
+/**
+ * Store several values as one record, which is replaced as a whole.
+ * Records are not cached and share the ids with the counters.
+ * @param   id      Record id, not used for a counter.
+ * @param   pData   The record.
+ * @param   len     Size of the record.
+ * @return          Zero on success or negative error code.
+ */
+int32_t counterBlobSet(uint16_t id, const void *pData, size_t len);
+
+/**
+ * Get a record stored with counterBlobSet.
+ * @param   id      Record id.
+ * @param   pData   Place to put the record.
+ * @param   len     Size of the record.
+ * @return          Size of the stored record, zero if never set, or
+ *                  negative error code.
+ */
+int32_t counterBlobGet(uint16_t id, void *pData, size_t len);
@@ -15,6 +15,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "ext_fs.h"
 
@@ -22,6 +23,35 @@
 FS_FSTAB_DECLARE_ENTRY(PARTITION_NODE);
 struct fs_mount_t *gMountPoint;
 
+// Free space estimate in bytes, updated on writes and deletes
+// and corrected by the exact value from fs_statvfs
+static atomic_t gFreeBytes = ATOMIC_INIT(0);
+static volatile bool gFreeKnown = false;
+static extFsStats_t gStats;
+static uint32_t gRefreshPeriodMs;
+
+// Protects the statistics and the handle cache
+K_MUTEX_DEFINE(gLock);
+
+typedef struct {
+    extFsPath_t path;
+    fs_mode_t flags;
+    struct fs_file_t file;
+    bool open;
+    bool inUse;
+    uint32_t lastUse;
+} handle_t;
+
+static handle_t gHandles[EXT_FS_HANDLE_CACHE_SIZE];
+static uint32_t gHandleUseCnt;
+
+static extFsIndex_t *gIndexes;
+
+// Created on first use, so examples not using it don't pull in
+// fs_statvfs and the stack
+static struct k_thread gRefreshThread;
+K_THREAD_STACK_DEFINE(gRefreshStack, 1024);
+
 bool extFsInit()
 {
     gMountPoint = &FS_FSTAB_ENTRY(PARTITION_NODE);
@@ -29,7 +59,11 @@ bool extFsInit()
     // Fix for error in partition manager
     gMountPoint->storage_dev = 0;
 #endif
-    return fs_mount(gMountPoint) == 0;
+    uint32_t start = k_cycle_get_32();
+    bool ok = fs_mount(gMountPoint) == 0;
+    gStats.mountUs = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    gFreeKnown = false;
+    return ok;
 }
 
 struct fs_mount_t *extFsMountPoint()
@@ -39,33 +73,115 @@ struct fs_mount_t *extFsMountPoint()
 
 const char *extFsPath(const char *fileName)
 {
-    static char path[100];
-    snprintf(path, sizeof(path), "%s/%s", gMountPoint->mnt_point, fileName);
+    static extFsPath_t path;
+    return extFsPathMake(fileName, path);
+}
+
+const char *extFsPathMake(const char *fileName, extFsPath_t path)
+{
+    snprintf(path, EXT_FS_PATH_MAX, "%s/%s", gMountPoint->mnt_point, fileName);
     return path;
 }
 
-int32_t extFsFree()
+int32_t extFsFreeExact()
 {
     int32_t errorOrSize;
     struct fs_statvfs sbuf;
+    uint32_t start = k_cycle_get_32();
     errorOrSize = fs_statvfs(gMountPoint->mnt_point, &sbuf);
+    uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    k_mutex_lock(&gLock, K_FOREVER);
+    gStats.statvfsUs = us;
+    gStats.statvfsMaxUs = MAX(gStats.statvfsMaxUs, us);
+    gStats.statvfsCnt++;
     if (errorOrSize == 0) {
-        errorOrSize = sbuf.f_frsize * sbuf.f_bfree / 1024;
+        int32_t bytes = sbuf.f_frsize * sbuf.f_bfree;
+        if (gFreeKnown) {
+            gStats.driftKb = (atomic_get(&gFreeBytes) - bytes) / 1024;
+        }
+        atomic_set(&gFreeBytes, bytes);
+        gFreeKnown = true;
+        errorOrSize = bytes / 1024;
     }
+    k_mutex_unlock(&gLock);
     return errorOrSize;
 }
 
+int32_t extFsFree()
+{
+    if (!gFreeKnown) {
+        return extFsFreeExact();
+    }
+    return MAX(atomic_get(&gFreeBytes), 0) / 1024;
+}
+
+void extFsFreeAdjust(int32_t bytes)
+{
+    atomic_add(&gFreeBytes, bytes);
+}
+
+static void refreshThread(void *p1, void *p2, void *p3)
+{
+    while (true) {
+        extFsFreeExact();
+        k_msleep(gRefreshPeriodMs);
+    }
+}
+
+void extFsFreeRefreshStart(uint32_t periodMs)
+{
+    static bool started = false;
+    gRefreshPeriodMs = periodMs;
+    if (!started) {
+        started = true;
+        k_thread_create(&gRefreshThread, gRefreshStack, K_THREAD_STACK_SIZEOF(gRefreshStack),
+                        refreshThread, NULL, NULL, NULL, 7, 0, K_NO_WAIT);
+    }
+}
+
+void extFsGetStats(extFsStats_t *pStats)
+{
+    k_mutex_lock(&gLock, K_FOREVER);
+    *pStats = gStats;
+    k_mutex_unlock(&gLock);
+}
+
+bool extFsDelete(const char *filePath)
+{
+    if (!extFsHandleDrop(filePath)) {
+        printf("* Failed to delete %s, it is in use\n", filePath);
+        return false;
+    }
+    size_t size;
+    bool exists = extFsFileSize(filePath, &size);
+    bool ok = fs_unlink(filePath) == 0;
+    if (ok && exists) {
+        extFsFreeAdjust(size);
+    }
+    if (ok) {
+        extFsIndexUpdate(filePath);
+    }
+    return ok;
+}
+
+// The dirent is large, so one is shared under the lock
+// instead of having it on the stack of each caller
+static struct fs_dirent gDirent;
+
 bool extFsFileExists(const char *fileName)
 {
-    static struct fs_dirent dirent;
-    return fs_stat(fileName, &dirent) == 0;
+    k_mutex_lock(&gLock, K_FOREVER);
+    bool ok = fs_stat(fileName, &gDirent) == 0;
+    k_mutex_unlock(&gLock);
+    return ok;
 }
 
 bool extFsFileSize(const char *fileName, size_t *size)
 {
-    static struct fs_dirent dirent;
-    bool ok = fs_stat(fileName, &dirent) == 0;
-    *size = ok ? dirent.size : 0;
+    k_mutex_lock(&gLock, K_FOREVER);
+    bool ok = fs_stat(fileName, &gDirent) == 0;
+    *size = ok ? gDirent.size : 0;
+    k_mutex_unlock(&gLock);
     return ok;
 }
 
@@ -73,6 +189,7 @@ void extFSList()
 {
     struct fs_dir_t dirp;
     static struct fs_dirent entry;
+    extFsPath_t path;
 
     struct fs_statvfs sbuf;
     if (fs_statvfs(extFsMountPoint()->mnt_point, &sbuf) == 0) {
@@ -80,19 +197,441 @@ void extFSList()
         printf("File system size: %4lu kB\n", sbuf.f_frsize * sbuf.f_blocks / 1024);
         printf("Free space:       %4lu kB\n", sbuf.f_frsize * sbuf.f_bfree / 1024);
     }
+    k_mutex_lock(&gLock, K_FOREVER);
     fs_dir_t_init(&dirp);
     if (fs_opendir(&dirp, extFsMountPoint()->mnt_point) != 0) {
+        k_mutex_unlock(&gLock);
         return;
     }
     printf("\nDirectory listing:\n");
     printf("--------------------------------\n");
+    // The entry from readdir has the size, no need to stat each file
     while (fs_readdir(&dirp, &entry) == 0 && entry.name[0] != 0) {
-        const char *path = extFsPath(entry.name);
-        static struct fs_dirent dirent;
-        if (fs_stat(path, &dirent) != 0) {
+        extFsPathMake(entry.name, path);
+        if (entry.type == FS_DIR_ENTRY_DIR) {
+            printf("%-25s %6s\n", path, "<dir>");
+        } else {
+            printf("%-25s %6u\n", path, entry.size);
         }
-        printf("%-25s %6u\n", path, dirent.size);
     }
     fs_closedir(&dirp);
+    k_mutex_unlock(&gLock);
     printf("--------------------------------\n");
 }
+
+struct fs_file_t *extFsHandleOpen(const char *filePath, fs_mode_t flags)
+{
+    handle_t *pHandle = NULL;
+    k_mutex_lock(&gLock, K_FOREVER);
+    for (int i = 0; i < EXT_FS_HANDLE_CACHE_SIZE; i++) {
+        handle_t *p = &gHandles[i];
+        if (p->open && !p->inUse && p->flags == flags && strcmp(p->path, filePath) == 0) {
+            pHandle = p;
+            break;
+        }
+    }
+    if (pHandle != NULL) {
+        if (fs_seek(&pHandle->file, 0, FS_SEEK_SET) != 0) {
+            fs_close(&pHandle->file);
+            pHandle->open = false;
+        }
+    } else {
+        // Reuse a closed handle or else the least recently used one
+        for (int i = 0; i < EXT_FS_HANDLE_CACHE_SIZE; i++) {
+            handle_t *p = &gHandles[i];
+            if (!p->inUse &&
+                (pHandle == NULL || (pHandle->open && (!p->open || p->lastUse < pHandle->lastUse)))) {
+                pHandle = p;
+            }
+        }
+        if (pHandle != NULL && pHandle->open) {
+            fs_close(&pHandle->file);
+            pHandle->open = false;
+        }
+    }
+    if (pHandle != NULL && !pHandle->open) {
+        strncpy(pHandle->path, filePath, EXT_FS_PATH_MAX - 1);
+        pHandle->path[EXT_FS_PATH_MAX - 1] = 0;
+        pHandle->flags = flags;
+        fs_file_t_init(&pHandle->file);
+        pHandle->open = fs_open(&pHandle->file, filePath, flags) == 0;
+    }
+    if (pHandle != NULL && pHandle->open) {
+        pHandle->inUse = true;
+        pHandle->lastUse = ++gHandleUseCnt;
+    } else {
+        pHandle = NULL;
+    }
+    k_mutex_unlock(&gLock);
+    return pHandle != NULL ? &pHandle->file : NULL;
+}
+
+void extFsHandleRelease(struct fs_file_t *pFile)
+{
+    handle_t *pHandle = CONTAINER_OF(pFile, handle_t, file);
+    k_mutex_lock(&gLock, K_FOREVER);
+    if (pHandle->flags & FS_O_WRITE) {
+        fs_sync(&pHandle->file);
+    }
+    pHandle->inUse = false;
+    k_mutex_unlock(&gLock);
+}
+
+bool extFsHandleDrop(const char *filePath)
+{
+    bool ok = true;
+    k_mutex_lock(&gLock, K_FOREVER);
+    for (int i = 0; i < EXT_FS_HANDLE_CACHE_SIZE; i++) {
+        handle_t *p = &gHandles[i];
+        if (p->open && (filePath == NULL || strcmp(p->path, filePath) == 0)) {
+            if (p->inUse) {
+                ok = false;
+            } else {
+                fs_close(&p->file);
+                p->open = false;
+            }
+        }
+    }
+    k_mutex_unlock(&gLock);
+    return ok;
+}
+
+bool extFsCreate(const char *filePath)
+{
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    bool ok = fs_open(&file, filePath, FS_O_CREATE | FS_O_WRITE) == 0;
+    if (ok) {
+        fs_close(&file);
+        extFsIndexUpdate(filePath);
+    }
+    return ok;
+}
+
+bool extFsRename(const char *fromPath, const char *toPath)
+{
+    if (!extFsHandleDrop(fromPath) || !extFsHandleDrop(toPath)) {
+        printf("* Failed to rename %s to %s, a file is in use\n", fromPath, toPath);
+        return false;
+    }
+    // LittleFS replaces the target, so do the same for the free space
+    // estimate once the rename is done
+    size_t size;
+    bool replaced = extFsFileSize(toPath, &size);
+    bool ok = fs_rename(fromPath, toPath) == 0;
+    if (ok) {
+        if (replaced) {
+            extFsFreeAdjust(size);
+        }
+        extFsIndexUpdate(fromPath);
+        extFsIndexUpdate(toPath);
+    }
+    return ok;
+}
+
+// Entry number i counted from the oldest
+static extFsIndexEntry_t *indexEntry(extFsIndex_t *pIndex, size_t i)
+{
+    return &pIndex->pEntries[(pIndex->first + i) % pIndex->maxCnt];
+}
+
+// Binary search, giving the position of the entry or where to insert it
+static bool indexSearch(extFsIndex_t *pIndex, uint32_t seq, size_t *pPos)
+{
+    size_t low = 0;
+    size_t high = pIndex->cnt;
+    // Appending and removing the oldest are the common cases
+    if (high > 0 && seq > indexEntry(pIndex, high - 1)->seq) {
+        low = high;
+    }
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        uint32_t midSeq = indexEntry(pIndex, mid)->seq;
+        if (midSeq == seq) {
+            *pPos = mid;
+            return true;
+        } else if (midSeq < seq) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *pPos = low;
+    return false;
+}
+
+// Set the size of a file, or remove it from the index if it is gone
+static void indexSet(extFsIndex_t *pIndex, uint32_t seq, bool exists, uint32_t size)
+{
+    size_t pos;
+    bool found = indexSearch(pIndex, seq, &pos);
+    if (found && exists) {
+        pIndex->totalSize += size - indexEntry(pIndex, pos)->size;
+        indexEntry(pIndex, pos)->size = size;
+    } else if (found) {
+        pIndex->totalSize -= indexEntry(pIndex, pos)->size;
+        if (pos == 0) {
+            pIndex->first = (pIndex->first + 1) % pIndex->maxCnt;
+        } else {
+            for (size_t i = pos; i + 1 < pIndex->cnt; i++) {
+                *indexEntry(pIndex, i) = *indexEntry(pIndex, i + 1);
+            }
+        }
+        pIndex->cnt--;
+    } else if (exists) {
+        if (pIndex->cnt == pIndex->maxCnt) {
+            // Keep the newest files, older ones are left out
+            pIndex->overflow = true;
+            if (pos == 0) {
+                return;
+            }
+            pIndex->totalSize -= indexEntry(pIndex, 0)->size;
+            pIndex->first = (pIndex->first + 1) % pIndex->maxCnt;
+            pIndex->cnt--;
+            pos--;
+        }
+        if (pos == 0) {
+            pIndex->first = (pIndex->first + pIndex->maxCnt - 1) % pIndex->maxCnt;
+        } else {
+            for (size_t i = pIndex->cnt; i > pos; i--) {
+                *indexEntry(pIndex, i) = *indexEntry(pIndex, i - 1);
+            }
+        }
+        indexEntry(pIndex, pos)->seq = seq;
+        indexEntry(pIndex, pos)->size = size;
+        pIndex->cnt++;
+        pIndex->totalSize += size;
+    }
+}
+
+// Get the sequence number from a name like <prefix>00000123<suffix>
+static bool indexParseName(extFsIndex_t *pIndex, const char *pName, uint32_t *pSeq)
+{
+    size_t prefixLen = strlen(pIndex->pPrefix);
+    if (strncmp(pName, pIndex->pPrefix, prefixLen) != 0) {
+        return false;
+    }
+    pName += prefixLen;
+    uint32_t seq = 0;
+    for (int i = 0; i < EXT_FS_INDEX_SEQ_DIGITS; i++) {
+        if (pName[i] < '0' || pName[i] > '9') {
+            return false;
+        }
+        seq = seq * 10 + (pName[i] - '0');
+    }
+    *pSeq = seq;
+    return strcmp(pName + EXT_FS_INDEX_SEQ_DIGITS, pIndex->pSuffix) == 0;
+}
+
+// Find the index and sequence number of a file path
+static extFsIndex_t *indexOf(const char *filePath, uint32_t *pSeq)
+{
+    for (extFsIndex_t *pIndex = gIndexes; pIndex != NULL; pIndex = pIndex->pNext) {
+        size_t dirLen = strlen(pIndex->dir);
+        if (strncmp(filePath, pIndex->dir, dirLen) == 0 && filePath[dirLen] == '/' &&
+            indexParseName(pIndex, &filePath[dirLen + 1], pSeq)) {
+            return pIndex;
+        }
+    }
+    return NULL;
+}
+
+bool extFsIndexInit(extFsIndex_t *pIndex, const char *dirName, const char *pPrefix,
+                    const char *pSuffix, extFsIndexEntry_t *pEntries, size_t maxCnt)
+{
+    extFsPathMake(dirName, pIndex->dir);
+    pIndex->pPrefix = pPrefix;
+    pIndex->pSuffix = pSuffix;
+    pIndex->pEntries = pEntries;
+    pIndex->maxCnt = maxCnt;
+    pIndex->first = 0;
+    pIndex->cnt = 0;
+    pIndex->totalSize = 0;
+    pIndex->overflow = false;
+    k_mutex_lock(&gLock, K_FOREVER);
+    if (fs_stat(pIndex->dir, &gDirent) != 0) {
+        fs_mkdir(pIndex->dir);
+    }
+    struct fs_dir_t dirp;
+    fs_dir_t_init(&dirp);
+    bool ok = fs_opendir(&dirp, pIndex->dir) == 0;
+    if (ok) {
+        // LittleFS lists the names in order, so this is mostly appending
+        uint32_t seq;
+        while (fs_readdir(&dirp, &gDirent) == 0 && gDirent.name[0] != 0) {
+            if (gDirent.type == FS_DIR_ENTRY_FILE &&
+                indexParseName(pIndex, gDirent.name, &seq)) {
+                indexSet(pIndex, seq, true, gDirent.size);
+            }
+        }
+        fs_closedir(&dirp);
+        ok = !pIndex->overflow;
+    }
+    if (ok) {
+        pIndex->pNext = gIndexes;
+        gIndexes = pIndex;
+    }
+    k_mutex_unlock(&gLock);
+    return ok;
+}
+
+void extFsIndexDeinit(extFsIndex_t *pIndex)
+{
+    k_mutex_lock(&gLock, K_FOREVER);
+    for (extFsIndex_t **ppIndex = &gIndexes; *ppIndex != NULL; ppIndex = &(*ppIndex)->pNext) {
+        if (*ppIndex == pIndex) {
+            *ppIndex = pIndex->pNext;
+            break;
+        }
+    }
+    k_mutex_unlock(&gLock);
+}
+
+static bool indexGet(extFsIndex_t *pIndex, size_t i, extFsIndexEntry_t *pEntry)
+{
+    bool ok = i < pIndex->cnt;
+    if (ok) {
+        *pEntry = *indexEntry(pIndex, i);
+    }
+    return ok;
+}
+
+bool extFsIndexOldest(extFsIndex_t *pIndex, extFsIndexEntry_t *pEntry)
+{
+    k_mutex_lock(&gLock, K_FOREVER);
+    bool ok = indexGet(pIndex, 0, pEntry);
+    k_mutex_unlock(&gLock);
+    return ok;
+}
+
+bool extFsIndexNewest(extFsIndex_t *pIndex, extFsIndexEntry_t *pEntry)
+{
+    k_mutex_lock(&gLock, K_FOREVER);
+    bool ok = indexGet(pIndex, pIndex->cnt - 1, pEntry);
+    k_mutex_unlock(&gLock);
+    return ok;
+}
+
+bool extFsIndexFind(extFsIndex_t *pIndex, uint32_t seq, extFsIndexEntry_t *pEntry)
+{
+    size_t pos;
+    k_mutex_lock(&gLock, K_FOREVER);
+    bool ok = indexSearch(pIndex, seq, &pos) && indexGet(pIndex, pos, pEntry);
+    k_mutex_unlock(&gLock);
+    return ok;
+}
+
+const char *extFsIndexPath(extFsIndex_t *pIndex, uint32_t seq, extFsPath_t path)
+{
+    snprintf(path, EXT_FS_PATH_MAX, "%s/%s%0*u%s", pIndex->dir, pIndex->pPrefix,
+             EXT_FS_INDEX_SEQ_DIGITS, seq, pIndex->pSuffix);
+    return path;
+}
+
+void extFsIndexUpdate(const char *filePath)
+{
+    uint32_t seq;
+    k_mutex_lock(&gLock, K_FOREVER);
+    extFsIndex_t *pIndex = indexOf(filePath, &seq);
+    if (pIndex != NULL) {
+        bool exists = fs_stat(filePath, &gDirent) == 0;
+        indexSet(pIndex, seq, exists, exists ? gDirent.size : 0);
+    }
+    k_mutex_unlock(&gLock);
+}
+
+static bool writerWrite(extFsWriter_t *pWriter, const void *pData, size_t len)
+{
+    bool ok = fs_write(&pWriter->file, pData, len) == (ssize_t)len;
+    if (ok) {
+        pWriter->writes++;
+        pWriter->writtenBytes += len;
+        pWriter->position += len;
+        extFsFreeAdjust(-(int32_t)len);
+    }
+    return ok;
+}
+
+// Room left in the buffer before the next multiple of the buffer size
+// in the file
+static size_t writerRoom(extFsWriter_t *pWriter)
+{
+    return EXT_FS_WRITER_BUFFER_SIZE - (pWriter->position % EXT_FS_WRITER_BUFFER_SIZE) -
+           pWriter->used;
+}
+
+bool extFsWriterOpen(extFsWriter_t *pWriter, const char *filePath, bool truncate)
+{
+    pWriter->used = 0;
+    pWriter->position = 0;
+    pWriter->appends = 0;
+    pWriter->appendedBytes = 0;
+    pWriter->writes = 0;
+    pWriter->writtenBytes = 0;
+    pWriter->syncs = 0;
+    fs_file_t_init(&pWriter->file);
+    strncpy(pWriter->path, filePath, EXT_FS_PATH_MAX - 1);
+    pWriter->path[EXT_FS_PATH_MAX - 1] = 0;
+    fs_mode_t flags = FS_O_CREATE | FS_O_WRITE | (truncate ? 0 : FS_O_APPEND);
+    if (truncate) {
+        extFsDelete(filePath);
+    }
+    bool ok = fs_open(&pWriter->file, filePath, flags) == 0;
+    if (ok) {
+        // Start from the end, the writes are aligned to the file offset
+        off_t end = fs_seek(&pWriter->file, 0, FS_SEEK_END) == 0 ?
+                    fs_tell(&pWriter->file) : 0;
+        pWriter->position = end > 0 ? end : 0;
+        extFsIndexUpdate(filePath);
+    }
+    return ok;
+}
+
+bool extFsWriterAppend(extFsWriter_t *pWriter, const void *pData, size_t len)
+{
+    const uint8_t *pBytes = pData;
+    bool ok = true;
+    pWriter->appends++;
+    pWriter->appendedBytes += len;
+    while (ok && len > 0) {
+        size_t room = writerRoom(pWriter);
+        if (pWriter->used == 0 && len >= room) {
+            // Up to the next boundary directly from the caller
+            ok = writerWrite(pWriter, pBytes, room);
+        } else {
+            size_t size = MIN(len, room);
+            memcpy(&pWriter->buffer[pWriter->used], pBytes, size);
+            pWriter->used += size;
+            room = size;
+            if (writerRoom(pWriter) == 0) {
+                ok = writerWrite(pWriter, pWriter->buffer, pWriter->used);
+                pWriter->used = 0;
+            }
+        }
+        pBytes += room;
+        len -= room;
+    }
+    return ok;
+}
+
+bool extFsWriterSync(extFsWriter_t *pWriter)
+{
+    bool ok = true;
+    if (pWriter->used > 0) {
+        ok = writerWrite(pWriter, pWriter->buffer, pWriter->used);
+        pWriter->used = 0;
+    }
+    if (ok) {
+        ok = fs_sync(&pWriter->file) == 0;
+        pWriter->syncs++;
+    }
+    return ok;
+}
+
+bool extFsWriterClose(extFsWriter_t *pWriter)
+{
+    bool ok = extFsWriterSync(pWriter);
+    ok = fs_close(&pWriter->file) == 0 && ok;
+    extFsIndexUpdate(pWriter->path);
+    return ok;
+}
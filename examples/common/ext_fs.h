@@ -29,18 +29,80 @@ bool extFsInit();
  */
 struct fs_mount_t *extFsMountPoint();
 
+// Max length of a full path including the terminator
+#define EXT_FS_PATH_MAX 100
+typedef char extFsPath_t[EXT_FS_PATH_MAX];
+
 /**
  * Get the full file system path including mount point name.
+ * The path is kept in a static buffer so this must not be used
+ * from more than one thread, use extFsPathMake instead.
  * @return  Pointer to the full path.
  */
 const char *extFsPath(const char *fileName);
 
+/**
+ * Put the full file system path including mount point name
+ * in a caller provided buffer.
+ * @param   fileName  Name of the file.
+ * @param   path      Place to put the path.
+ * @return            Pointer to the path.
+ */
+const char *extFsPathMake(const char *fileName, extFsPath_t path);
+
 /**
  * Get the size of the free space on the file system in kB.
- * @return Actual free size or possible negative error code
+ * This is a fast estimate, updated on writes made with the
+ * writer below and on extFsDelete, and corrected each time
+ * the exact value is read.
+ * @return Estimated free size or possible negative error code
  */
 int32_t extFsFree();
 
+/**
+ * Get the exact size of the free space on the file system in kB.
+ * Traverses the whole file system which can take long when it is
+ * close to full. Updates the estimate returned by extFsFree.
+ * @return Actual free size or possible negative error code
+ */
+int32_t extFsFreeExact();
+
+/**
+ * Adjust the free space estimate for file system changes
+ * made without this module.
+ * @param   bytes  Bytes freed, negative for bytes used.
+ */
+void extFsFreeAdjust(int32_t bytes);
+
+/**
+ * Start a background thread that periodically reads the exact
+ * free space. Can be called again to change the period.
+ * @param   periodMs  Time between reads in milliseconds.
+ */
+void extFsFreeRefreshStart(uint32_t periodMs);
+
+typedef struct {
+    uint32_t mountUs;        // Time for the last mount
+    uint32_t statvfsUs;      // Time for the last exact free space read
+    uint32_t statvfsMaxUs;
+    uint32_t statvfsCnt;
+    int32_t driftKb;         // Estimate minus exact at the last exact read
+} extFsStats_t;
+
+/**
+ * Get timing statistics.
+ * @param   pStats  Place to put the statistics.
+ */
+void extFsGetStats(extFsStats_t *pStats);
+
+/**
+ * Delete a file and update the free space estimate. Fails if the
+ * file is held from the handle cache, see extFsHandleDrop.
+ * @param   filePath  Complete file name path.
+ * @return            Success or failure.
+ */
+bool extFsDelete(const char *filePath);
+
 /**
  * Check if a file exists
  * @param   filePath  Complete file name path.
@@ -61,4 +123,201 @@ bool extFsFileSize(const char *fileName, size_t *size);
  * Print a simple listing of the file system contents
  * to the console.
  */
-void extFSList();
\ No newline at end of file
+void extFSList();
+
+/**
+ * Create an empty file if it doesn't exist.
+ * @param   filePath  Complete file name path.
+ * @return            Success or failure.
+ */
+bool extFsCreate(const char *filePath);
+
+/**
+ * Rename a file, replacing any existing file with the new name.
+ * Fails if either file is held from the handle cache.
+ * @param   fromPath  Complete path of the file.
+ * @param   toPath    Complete new path.
+ * @return            Success or failure.
+ */
+bool extFsRename(const char *fromPath, const char *toPath);
+
+// Digits of the sequence number in indexed file names
+#define EXT_FS_INDEX_SEQ_DIGITS 8
+
+typedef struct {
+    uint32_t seq;
+    uint32_t size;
+} extFsIndexEntry_t;
+
+/**
+ * Directory index. Keeps the sequence numbers and sizes of the files
+ * named <prefix><sequence number><suffix> in one directory, ordered
+ * by sequence number, so that rotated files can be found without
+ * reading the directory. The names are not stored as they are given
+ * by the sequence number. The index is kept up to date by
+ * extFsCreate, extFsDelete, extFsRename, extFsWriterClose and
+ * extFsIndexUpdate. When the entries are full the oldest file is
+ * left out of the index to make room for a newer one.
+ */
+typedef struct extFsIndex {
+    extFsPath_t dir;
+    const char *pPrefix;
+    const char *pSuffix;
+    extFsIndexEntry_t *pEntries;  // Ring of entries, oldest first
+    size_t maxCnt;
+    size_t first;
+    size_t cnt;
+    uint32_t totalSize;
+    bool overflow;           // Older files left out since the entries are full
+    struct extFsIndex *pNext;
+} extFsIndex_t;
+
+/**
+ * Create the index of a directory, creating the directory if needed.
+ * @param   pIndex    The index.
+ * @param   dirName   Name of the directory below the mount point.
+ * @param   pPrefix   File name before the sequence number, must be kept.
+ * @param   pSuffix   File name after the sequence number, must be kept.
+ * @param   pEntries  Space for the entries.
+ * @param   maxCnt    Number of entries.
+ * @return            False if the directory couldn't be read or had
+ *                    more files than there is space for. The index
+ *                    is then not kept up to date.
+ */
+bool extFsIndexInit(extFsIndex_t *pIndex, const char *dirName, const char *pPrefix,
+                    const char *pSuffix, extFsIndexEntry_t *pEntries, size_t maxCnt);
+
+/**
+ * Stop keeping an index up to date.
+ * @param   pIndex    The index.
+ */
+void extFsIndexDeinit(extFsIndex_t *pIndex);
+
+/**
+ * Get the file with the lowest sequence number.
+ * @param   pIndex    The index.
+ * @param   pEntry    Place to put the entry.
+ * @return            False if the directory is empty.
+ */
+bool extFsIndexOldest(extFsIndex_t *pIndex, extFsIndexEntry_t *pEntry);
+
+/**
+ * Get the file with the highest sequence number.
+ * @param   pIndex    The index.
+ * @param   pEntry    Place to put the entry.
+ * @return            False if the directory is empty.
+ */
+bool extFsIndexNewest(extFsIndex_t *pIndex, extFsIndexEntry_t *pEntry);
+
+/**
+ * Find a file by sequence number.
+ * @param   pIndex    The index.
+ * @param   seq       Sequence number.
+ * @param   pEntry    Place to put the entry.
+ * @return            False if there is no such file.
+ */
+bool extFsIndexFind(extFsIndex_t *pIndex, uint32_t seq, extFsIndexEntry_t *pEntry);
+
+/**
+ * Get the complete path of an indexed file.
+ * @param   pIndex    The index.
+ * @param   seq       Sequence number.
+ * @param   path      Place to put the path.
+ * @return            Pointer to the path.
+ */
+const char *extFsIndexPath(extFsIndex_t *pIndex, uint32_t seq, extFsPath_t path);
+
+/**
+ * Update the indexes for a file changed without the functions
+ * of this module.
+ * @param   filePath  Complete file name path.
+ */
+void extFsIndexUpdate(const char *filePath);
+
+// Number of open files kept by the handle cache
+#define EXT_FS_HANDLE_CACHE_SIZE 4
+
+/**
+ * Get an open file from the handle cache, opening it only if there
+ * is no cached handle with the same path and flags. The handle is
+ * owned by the caller, positioned at the start of the file, until
+ * it is given back with extFsHandleRelease.
+ * @param   filePath  Complete file name path.
+ * @param   flags     Flags for fs_open.
+ * @return            The open file or NULL if it could not be opened
+ *                    or all cached handles are in use.
+ */
+struct fs_file_t *extFsHandleOpen(const char *filePath, fs_mode_t flags);
+
+/**
+ * Give back a handle from extFsHandleOpen. The file is synced but
+ * kept open for the next user.
+ * @param   pFile  The file.
+ */
+void extFsHandleRelease(struct fs_file_t *pFile);
+
+/**
+ * Close all cached handles for a file. Must be done before removing
+ * or renaming it, which extFsDelete does.
+ * @param   filePath  Complete file name path, or NULL for all files.
+ * @return            False if a handle for the file is in use.
+ */
+bool extFsHandleDrop(const char *filePath);
+
+// Size of the writer buffer and of its writes
+#define EXT_FS_WRITER_BUFFER_SIZE 4096
+
+/**
+ * Streaming file writer. Small appends are collected and written to
+ * the file system in fs_write calls of EXT_FS_WRITER_BUFFER_SIZE bytes
+ * at file offsets which are multiples of that size. This saves calls
+ * and partial programs, but LittleFS keeps pointers at the start of
+ * each of its data blocks, so a file offset doesn't map to a flash
+ * sector and the writes are not sector aligned on the flash.
+ */
+typedef struct {
+    struct fs_file_t file;
+    extFsPath_t path;
+    uint8_t buffer[EXT_FS_WRITER_BUFFER_SIZE];
+    size_t used;
+    uint32_t position;       // File offset of the start of the buffer
+    // Counters for the write amplification
+    uint32_t appends;        // Number of append calls
+    uint32_t appendedBytes;
+    uint32_t writes;         // Number of file system writes
+    uint32_t writtenBytes;
+    uint32_t syncs;          // Number of file system syncs
+} extFsWriter_t;
+
+/**
+ * Open a file for streaming appends.
+ * @param   pWriter   The writer.
+ * @param   filePath  Complete file name path.
+ * @param   truncate  Remove any existing content of the file.
+ * @return            Success or failure.
+ */
+bool extFsWriterOpen(extFsWriter_t *pWriter, const char *filePath, bool truncate);
+
+/**
+ * Append data to the file. Data is buffered until it reaches the next
+ * file offset which is a multiple of EXT_FS_WRITER_BUFFER_SIZE.
+ * @param   pWriter   The writer.
+ * @param   pData     Data to append.
+ * @param   len       Length of the data.
+ * @return            Success or failure.
+ */
+bool extFsWriterAppend(extFsWriter_t *pWriter, const void *pData, size_t len);
+
+/**
+ * Write any buffered data and commit it to the file system.
+ * @param   pWriter   The writer.
+ * @return            Success or failure.
+ */
+bool extFsWriterSync(extFsWriter_t *pWriter);
+
+/**
+ * Sync and close the file, updating any index of its directory.
+ * @param   pWriter   The writer.
+ * @return            Success or failure.
+ */
+bool extFsWriterClose(extFsWriter_t *pWriter);
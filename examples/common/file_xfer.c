@@ -0,0 +1,474 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fs/fs.h>
+
+#include "ext_fs.h"
+#include "file_xfer.h"
+
+#define SYNC 0xFA
+#define HEADER_SIZE 4
+#define CRC_SIZE 4
+#define MAX_PAYLOAD (4 + FILE_XFER_CHUNK_SIZE)
+#define MAX_FRAME (HEADER_SIZE + MAX_PAYLOAD + CRC_SIZE)
+
+#define TYPE_LIST 0x01
+#define TYPE_GET 0x02
+#define TYPE_ACK 0x03
+#define TYPE_ENTRY 0x81
+#define TYPE_DATA 0x82
+#define TYPE_END 0x83
+#define TYPE_ERROR 0x84
+
+// Can be shortened for a loopback, where nothing is delayed
+#ifndef FILE_XFER_ACK_TIMEOUT_MS
+#define FILE_XFER_ACK_TIMEOUT_MS 2000
+#endif
+#define MAX_RESENDS 5
+
+typedef struct {
+    uint8_t type;
+    uint16_t len;
+    uint8_t *pPayload;
+} frame_t;
+
+static uint32_t crc32(uint32_t crc, const uint8_t *pData, size_t len)
+{
+    // Nibble table for the standard reflected crc32
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc >> 4) ^ table[(crc ^ pData[i]) & 0x0F];
+        crc = (crc >> 4) ^ table[(crc ^ (pData[i] >> 4)) & 0x0F];
+    }
+    return ~crc;
+}
+
+static void putU32(uint8_t *pBuf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        pBuf[i] = value >> (8 * i);
+    }
+}
+
+static uint32_t getU32(const uint8_t *pBuf)
+{
+    return pBuf[0] | (pBuf[1] << 8) | (pBuf[2] << 16) | ((uint32_t)pBuf[3] << 24);
+}
+
+static void updateStats(fileXferStats_t *pStats, size_t bytes)
+{
+    if (pStats) {
+        pStats->frames++;
+        pStats->bytes += bytes;
+    }
+}
+
+// The payload is expected to already be at pBuf + HEADER_SIZE,
+// so that data can be read directly into the transmit buffer
+static int32_t sendFrame(const fileXferTransport_t *pTransport, uint8_t *pBuf,
+                         uint8_t type, uint16_t len)
+{
+    pBuf[0] = SYNC;
+    pBuf[1] = type;
+    pBuf[2] = len & 0xFF;
+    pBuf[3] = len >> 8;
+    putU32(pBuf + HEADER_SIZE + len, crc32(0, pBuf + 1, HEADER_SIZE - 1 + len));
+    return pTransport->send(pTransport->pCtx, pBuf, HEADER_SIZE + len + CRC_SIZE);
+}
+
+static int32_t sendU32(const fileXferTransport_t *pTransport, uint8_t type, uint32_t value)
+{
+    uint8_t buf[HEADER_SIZE + 4 + CRC_SIZE];
+    putU32(buf + HEADER_SIZE, value);
+    return sendFrame(pTransport, buf, type, 4);
+}
+
+static int32_t receiveAll(const fileXferTransport_t *pTransport, uint8_t *pData,
+                          size_t len, uint32_t deadline)
+{
+    size_t got = 0;
+    while (got < len) {
+        int32_t timeout = (int32_t)(deadline - k_uptime_get_32());
+        if (timeout <= 0) {
+            return -ETIMEDOUT;
+        }
+        int32_t res = pTransport->receive(pTransport->pCtx, pData + got, len - got, timeout);
+        if (res < 0) {
+            return res;
+        }
+        got += res;
+    }
+    return 0;
+}
+
+// Receive the next frame, skipping anything not looking like one
+static int32_t receiveFrame(const fileXferTransport_t *pTransport, uint8_t *pBuf,
+                            frame_t *pFrame, int32_t timeoutMs, fileXferStats_t *pStats)
+{
+    uint32_t deadline = k_uptime_get_32() + timeoutMs;
+    int32_t res;
+    while (true) {
+        res = receiveAll(pTransport, pBuf, 1, deadline);
+        if (res < 0) {
+            return res;
+        }
+        if (pBuf[0] != SYNC) {
+            continue;
+        }
+        // The timeout is for the start of a frame, a frame which has
+        // started is not cut off by it but given time to complete
+        uint32_t frameDeadline = k_uptime_get_32() + FILE_XFER_ACK_TIMEOUT_MS;
+        if ((int32_t)(frameDeadline - deadline) < 0) {
+            frameDeadline = deadline;
+        }
+        res = receiveAll(pTransport, pBuf + 1, HEADER_SIZE - 1, frameDeadline);
+        if (res < 0) {
+            return res;
+        }
+        uint16_t len = pBuf[2] | (pBuf[3] << 8);
+        if (len > MAX_PAYLOAD) {
+            // Corrupt or false sync, hunt for the next one
+            continue;
+        }
+        res = receiveAll(pTransport, pBuf + HEADER_SIZE, len + CRC_SIZE, frameDeadline);
+        if (res < 0) {
+            return res;
+        }
+        if (crc32(0, pBuf + 1, HEADER_SIZE - 1 + len) != getU32(pBuf + HEADER_SIZE + len)) {
+            if (pStats) {
+                pStats->crcErrors++;
+            }
+            return -EBADMSG;
+        }
+        pFrame->type = pBuf[1];
+        pFrame->len = len;
+        pFrame->pPayload = pBuf + HEADER_SIZE;
+        return 0;
+    }
+}
+
+static int32_t serveList(const fileXferTransport_t *pTransport, uint8_t *pBuf)
+{
+    struct fs_dir_t dir;
+    struct fs_dirent entry;
+    int32_t cnt = 0;
+    fs_dir_t_init(&dir);
+    int32_t res = fs_opendir(&dir, extFsMountPoint()->mnt_point);
+    if (res != 0) {
+        return sendU32(pTransport, TYPE_ERROR, res);
+    }
+    while (res == 0 && fs_readdir(&dir, &entry) == 0 && entry.name[0] != 0) {
+        if (entry.type != FS_DIR_ENTRY_FILE) {
+            continue;
+        }
+        size_t nameLen = strnlen(entry.name, FILE_XFER_MAX_NAME_LEN);
+        putU32(pBuf + HEADER_SIZE, entry.size);
+        memcpy(pBuf + HEADER_SIZE + 4, entry.name, nameLen);
+        res = sendFrame(pTransport, pBuf, TYPE_ENTRY, 4 + nameLen);
+        cnt++;
+    }
+    fs_closedir(&dir);
+    return res == 0 ? sendU32(pTransport, TYPE_END, cnt) : res;
+}
+
+static int32_t serveGet(const fileXferTransport_t *pTransport, uint8_t *pBuf,
+                        const frame_t *pRequest, fileXferStats_t *pStats)
+{
+    if (pRequest->len < 6 || pRequest->len > 5 + FILE_XFER_MAX_NAME_LEN) {
+        return sendU32(pTransport, TYPE_ERROR, -EINVAL);
+    }
+    uint32_t offset = getU32(pRequest->pPayload);
+    uint8_t window = pRequest->pPayload[4];
+    if (window < 1 || window > FILE_XFER_MAX_WINDOW) {
+        window = 1;
+    }
+    char name[FILE_XFER_MAX_NAME_LEN + 1];
+    extFsPath_t path;
+    snprintf(name, sizeof(name), "%.*s", pRequest->len - 5,
+             (const char *)&pRequest->pPayload[5]);
+    extFsPathMake(name, path);
+
+    // Resumed downloads reopen the same file, so take it from the cache
+    size_t size = 0;
+    struct fs_file_t *pFile = NULL;
+    int32_t res = extFsFileSize(path, &size) ? 0 : -ENOENT;
+    if (res == 0) {
+        pFile = extFsHandleOpen(path, FS_O_READ);
+        res = pFile != NULL ? 0 : -EBUSY;
+    }
+    if (res == 0 && offset > size) {
+        res = -EINVAL;
+        extFsHandleRelease(pFile);
+    }
+    if (res != 0) {
+        return sendU32(pTransport, TYPE_ERROR, res);
+    }
+    uint32_t sent = offset;
+    uint32_t acked = offset;
+    int resends = 0;
+    res = fs_seek(pFile, offset, FS_SEEK_SET);
+    while (res == 0 && acked < size) {
+        // Fill the window
+        while (res == 0 && sent < size &&
+               sent - acked < window * FILE_XFER_CHUNK_SIZE) {
+            // Read directly into the frame after the header and offset
+            ssize_t len = fs_read(pFile, pBuf + HEADER_SIZE + 4, FILE_XFER_CHUNK_SIZE);
+            if (len <= 0) {
+                res = len < 0 ? len : -EIO;
+                break;
+            }
+            putU32(pBuf + HEADER_SIZE, sent);
+            res = sendFrame(pTransport, pBuf, TYPE_DATA, 4 + len);
+            sent += len;
+            updateStats(pStats, len);
+        }
+        if (res != 0) {
+            break;
+        }
+        frame_t ack;
+        res = receiveFrame(pTransport, pBuf, &ack, FILE_XFER_ACK_TIMEOUT_MS, pStats);
+        if (res == 0 && ack.type == TYPE_ACK && ack.len == 5) {
+            uint32_t ackOffset = getU32(ack.pPayload);
+            bool nack = ack.pPayload[4] != 0;
+            if (ackOffset > acked && ackOffset <= sent) {
+                acked = ackOffset;
+                resends = 0;
+            }
+            if (nack && ackOffset >= acked && ackOffset < sent) {
+                // Go back and resend from where the client is
+                sent = ackOffset;
+                res = fs_seek(pFile, sent, FS_SEEK_SET);
+                if (pStats) {
+                    pStats->resends++;
+                }
+            }
+        } else if (res == -ETIMEDOUT || res == -EBADMSG) {
+            // Lost or corrupt ack, resend the unacked part
+            res = ++resends > MAX_RESENDS ? -ETIMEDOUT : 0;
+            sent = acked;
+            if (res == 0) {
+                res = fs_seek(pFile, sent, FS_SEEK_SET);
+                if (pStats) {
+                    pStats->resends++;
+                }
+            }
+        } else if (res == 0 && (ack.type == TYPE_GET || ack.type == TYPE_LIST)) {
+            // Client gave up and started over
+            res = -ECANCELED;
+        }
+    }
+    extFsHandleRelease(pFile);
+    return res == 0 ? sendU32(pTransport, TYPE_END, size) : res;
+}
+
+int32_t fileXferServe(const fileXferTransport_t *pTransport, int32_t timeoutMs,
+                      fileXferStats_t *pStats)
+{
+    static uint8_t buf[MAX_FRAME];
+    frame_t request;
+    int32_t res = receiveFrame(pTransport, buf, &request, timeoutMs, pStats);
+    if (res == 0) {
+        // Copy the request, the buffer is used for the response
+        static uint8_t payload[5 + FILE_XFER_MAX_NAME_LEN];
+        if (request.len > sizeof(payload)) {
+            return sendU32(pTransport, TYPE_ERROR, -EINVAL);
+        }
+        memcpy(payload, request.pPayload, request.len);
+        request.pPayload = payload;
+        switch (request.type) {
+            case TYPE_LIST:
+                res = serveList(pTransport, buf);
+                break;
+            case TYPE_GET:
+                res = serveGet(pTransport, buf, &request, pStats);
+                break;
+            case TYPE_ACK:
+                // Late ack from an earlier transfer
+                break;
+            default:
+                res = sendU32(pTransport, TYPE_ERROR, -ENOTSUP);
+                break;
+        }
+    }
+    return res;
+}
+
+int32_t fileXferList(const fileXferTransport_t *pTransport,
+                     fileXferListCb_t cb, void *pParam)
+{
+    uint8_t buf[MAX_FRAME];
+    frame_t frame;
+    char name[FILE_XFER_MAX_NAME_LEN + 1];
+    int32_t res = sendFrame(pTransport, buf, TYPE_LIST, 0);
+    while (res == 0) {
+        res = receiveFrame(pTransport, buf, &frame, FILE_XFER_ACK_TIMEOUT_MS, NULL);
+        if (res != 0) {
+            break;
+        }
+        if (frame.type == TYPE_ENTRY && frame.len > 4) {
+            size_t nameLen = MIN(frame.len - 4, FILE_XFER_MAX_NAME_LEN);
+            memcpy(name, frame.pPayload + 4, nameLen);
+            name[nameLen] = 0;
+            cb(name, getU32(frame.pPayload), pParam);
+        } else if (frame.type == TYPE_END && frame.len == 4) {
+            return getU32(frame.pPayload);
+        } else if (frame.type == TYPE_ERROR && frame.len == 4) {
+            return (int32_t)getU32(frame.pPayload);
+        }
+    }
+    return res;
+}
+
+static int32_t sendAck(const fileXferTransport_t *pTransport, uint32_t offset, bool nack)
+{
+    uint8_t buf[HEADER_SIZE + 5 + CRC_SIZE];
+    putU32(buf + HEADER_SIZE, offset);
+    buf[HEADER_SIZE + 4] = nack;
+    return sendFrame(pTransport, buf, TYPE_ACK, 5);
+}
+
+static int32_t sendGet(const fileXferTransport_t *pTransport, uint8_t *pBuf,
+                       const char *pName, size_t nameLen, uint32_t offset, uint8_t window)
+{
+    putU32(pBuf + HEADER_SIZE, offset);
+    pBuf[HEADER_SIZE + 4] = window;
+    memcpy(pBuf + HEADER_SIZE + 5, pName, nameLen);
+    return sendFrame(pTransport, pBuf, TYPE_GET, 5 + nameLen);
+}
+
+int32_t fileXferGet(const fileXferTransport_t *pTransport, const char *pName,
+                    uint32_t *pOffset, uint8_t window,
+                    fileXferDataCb_t cb, void *pParam, fileXferStats_t *pStats)
+{
+    static uint8_t buf[MAX_FRAME];
+    size_t nameLen = strlen(pName);
+    if (nameLen == 0 || nameLen > FILE_XFER_MAX_NAME_LEN ||
+        window < 1 || window > FILE_XFER_MAX_WINDOW) {
+        return -EINVAL;
+    }
+    int32_t res = sendGet(pTransport, buf, pName, nameLen, *pOffset, window);
+    // Only ask for a resend once per offset
+    uint32_t nackedOffset = UINT32_MAX;
+    int retries = 0;
+    while (res == 0) {
+        frame_t frame;
+        res = receiveFrame(pTransport, buf, &frame, FILE_XFER_ACK_TIMEOUT_MS * 2, pStats);
+        if (res == -ETIMEDOUT && ++retries <= MAX_RESENDS) {
+            // The request or the end was lost, resume from where we are
+            nackedOffset = UINT32_MAX;
+            res = sendGet(pTransport, buf, pName, nameLen, *pOffset, window);
+            continue;
+        }
+        if (res == -EBADMSG) {
+            res = 0;
+            if (nackedOffset != *pOffset) {
+                nackedOffset = *pOffset;
+                res = sendAck(pTransport, *pOffset, true);
+            }
+            continue;
+        }
+        if (res != 0) {
+            break;
+        }
+        if (frame.type == TYPE_DATA && frame.len > 4) {
+            uint32_t offset = getU32(frame.pPayload);
+            size_t len = frame.len - 4;
+            if (offset == *pOffset) {
+                if (!cb(offset, frame.pPayload + 4, len, pParam)) {
+                    return -ECANCELED;
+                }
+                *pOffset += len;
+                retries = 0;
+                updateStats(pStats, len);
+                res = sendAck(pTransport, *pOffset, false);
+            } else if (offset > *pOffset) {
+                if (nackedOffset != *pOffset) {
+                    // A chunk is missing
+                    nackedOffset = *pOffset;
+                    res = sendAck(pTransport, *pOffset, true);
+                }
+            } else {
+                // Resent after a lost ack, tell where we are
+                res = sendAck(pTransport, *pOffset, false);
+            }
+        } else if (frame.type == TYPE_END && frame.len == 4) {
+            return *pOffset == getU32(frame.pPayload) ? 0 : -EIO;
+        } else if (frame.type == TYPE_ERROR && frame.len == 4) {
+            return (int32_t)getU32(frame.pPayload);
+        }
+    }
+    return res;
+}
+
+static int32_t loopbackSend(void *pCtx, const uint8_t *pData, size_t len)
+{
+    fileXferLoopbackEnd_t *pEnd = pCtx;
+    size_t written;
+    int32_t res;
+    pEnd->sendCnt++;
+    if (pEnd->corruptEvery > 0 && (pEnd->sendCnt % pEnd->corruptEvery) == 0 && len > 1) {
+        // Flip a bit in the last byte, i.e. the crc
+        uint8_t last = pData[len - 1] ^ 0x01;
+        res = k_pipe_put(pEnd->pTx, (void *)pData, len - 1, &written, len - 1, K_FOREVER);
+        if (res == 0) {
+            res = k_pipe_put(pEnd->pTx, &last, 1, &written, 1, K_FOREVER);
+        }
+    } else {
+        res = k_pipe_put(pEnd->pTx, (void *)pData, len, &written, len, K_FOREVER);
+    }
+    return res;
+}
+
+static int32_t loopbackReceive(void *pCtx, uint8_t *pData, size_t len, int32_t timeoutMs)
+{
+    fileXferLoopbackEnd_t *pEnd = pCtx;
+    size_t read = 0;
+    int32_t res = k_pipe_get(pEnd->pRx, pData, len, &read, 1, K_MSEC(timeoutMs));
+    if (res == -EAGAIN) {
+        res = 0;
+    }
+    return res == 0 ? (int32_t)read : res;
+}
+
+void fileXferLoopbackInit(fileXferLoopback_t *pLoop,
+                          fileXferTransport_t *pServer,
+                          fileXferTransport_t *pClient,
+                          uint32_t corruptEvery)
+{
+    fileXferTransport_t *pTransports[2] = { pServer, pClient };
+    for (int i = 0; i < 2; i++) {
+        k_pipe_init(&pLoop->pipes[i], pLoop->buffers[i], sizeof(pLoop->buffers[i]));
+    }
+    for (int i = 0; i < 2; i++) {
+        pLoop->ends[i].pTx = &pLoop->pipes[i];
+        pLoop->ends[i].pRx = &pLoop->pipes[!i];
+        pLoop->ends[i].corruptEvery = corruptEvery;
+        pLoop->ends[i].sendCnt = 0;
+        pTransports[i]->send = loopbackSend;
+        pTransports[i]->receive = loopbackReceive;
+        pTransports[i]->pCtx = &pLoop->ends[i];
+    }
+}
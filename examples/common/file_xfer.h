@@ -0,0 +1,169 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A simple protocol for listing and downloading files from the
+ * external flash file system over any byte stream, e.g. BLE SPS.
+ *
+ * Frame, little endian:
+ *   sync 0xFA (1), type (1), payload length (2), payload, crc32 (4)
+ * The crc covers type, length and payload.
+ *
+ * Requests from the client:
+ *   LIST                     List all files
+ *   GET   offset (4), window (1), name
+ *                            Download a file from an offset
+ *   ACK   offset (4), nack (1)
+ *                            Next offset expected, nack when resending
+ *                            from that offset is requested
+ * Responses from the server:
+ *   ENTRY size (4), name     One per file
+ *   DATA  offset (4), data   Up to window chunks sent before an ack
+ *   END   size or count (4)
+ *   ERROR error code (4)
+ *
+ * A failed download can be resumed by a new GET from the last offset.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <kernel.h>
+
+#define FILE_XFER_CHUNK_SIZE 512
+#define FILE_XFER_MAX_WINDOW 8
+#define FILE_XFER_MAX_NAME_LEN 64
+#define FILE_XFER_LOOPBACK_BUFFER_SIZE 4096
+
+/**
+ * A transport for the protocol. Any reliable or unreliable byte
+ * stream can be used, errors are detected by the crc.
+ */
+typedef struct {
+    /**
+     * Send data.
+     * @param   pCtx  The context below.
+     * @param   pData Data to send.
+     * @param   len   Length of the data.
+     * @return        Zero on success or negative error code.
+     */
+    int32_t (*send)(void *pCtx, const uint8_t *pData, size_t len);
+    /**
+     * Receive available data.
+     * @param   pCtx      The context below.
+     * @param   pData     Place to put the data.
+     * @param   len       Max length to receive.
+     * @param   timeoutMs Max time to wait for data.
+     * @return            Length received, zero on timeout, or negative
+     *                    error code.
+     */
+    int32_t (*receive)(void *pCtx, uint8_t *pData, size_t len, int32_t timeoutMs);
+    void *pCtx;
+} fileXferTransport_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t crcErrors;
+    uint32_t resends;
+} fileXferStats_t;
+
+/**
+ * File list callback.
+ * @param   pName   File name.
+ * @param   size    File size.
+ * @param   pParam  Parameter given to fileXferList.
+ */
+typedef void (*fileXferListCb_t)(const char *pName, uint32_t size, void *pParam);
+
+/**
+ * File data callback, called in offset order.
+ * @param   offset  Offset of the data in the file.
+ * @param   pData   The data.
+ * @param   len     Length of the data.
+ * @param   pParam  Parameter given to fileXferGet.
+ * @return          False to abort the download.
+ */
+typedef bool (*fileXferDataCb_t)(uint32_t offset, const uint8_t *pData,
+                                 size_t len, void *pParam);
+
+/**
+ * A loopback connection between a server and a client
+ * transport, for testing without any radio.
+ */
+typedef struct {
+    struct k_pipe *pTx;
+    struct k_pipe *pRx;
+    uint32_t corruptEvery;  // Corrupt every n:th frame sent, 0 for never
+    uint32_t sendCnt;
+} fileXferLoopbackEnd_t;
+
+typedef struct {
+    struct k_pipe pipes[2];
+    uint8_t buffers[2][FILE_XFER_LOOPBACK_BUFFER_SIZE];
+    fileXferLoopbackEnd_t ends[2];
+} fileXferLoopback_t;
+
+/**
+ * Wait for and handle one request from a client.
+ * @param   pTransport  The transport to use.
+ * @param   timeoutMs   Max time to wait for a request.
+ * @param   pStats      Statistics to update, can be NULL.
+ * @return              Zero if a request was handled or negative error code.
+ */
+int32_t fileXferServe(const fileXferTransport_t *pTransport, int32_t timeoutMs,
+                      fileXferStats_t *pStats);
+
+/**
+ * List the files on the server.
+ * @param   pTransport  The transport to use.
+ * @param   cb          Called for each file.
+ * @param   pParam      Parameter for the callback.
+ * @return              Number of files or negative error code.
+ */
+int32_t fileXferList(const fileXferTransport_t *pTransport,
+                     fileXferListCb_t cb, void *pParam);
+
+/**
+ * Download a file from the server.
+ * @param   pTransport  The transport to use.
+ * @param   pName       File name, without mount point.
+ * @param   pOffset     Offset to start from. Updated with the offset
+ *                      received so far, to be used for resuming.
+ * @param   window      Chunks the server may send before an ack,
+ *                      1 to FILE_XFER_MAX_WINDOW.
+ * @param   cb          Called with the data.
+ * @param   pParam      Parameter for the callback.
+ * @param   pStats      Statistics to update, can be NULL.
+ * @return              Zero when complete or negative error code.
+ */
+int32_t fileXferGet(const fileXferTransport_t *pTransport, const char *pName,
+                    uint32_t *pOffset, uint8_t window,
+                    fileXferDataCb_t cb, void *pParam, fileXferStats_t *pStats);
+
+/**
+ * Set up a loopback connection.
+ * @param   pLoop         The loopback.
+ * @param   pServer       Place to put the server end transport.
+ * @param   pClient       Place to put the client end transport.
+ * @param   corruptEvery  Corrupt every n:th frame sent in both directions,
+ *                        for testing the error recovery. 0 for never.
+ */
+void fileXferLoopbackInit(fileXferLoopback_t *pLoop,
+                          fileXferTransport_t *pServer,
+                          fileXferTransport_t *pClient,
+                          uint32_t corruptEvery);
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+
+#include "geofence.h"
+
+// Meters per 1e-7 degree latitude
+#define METERS_PER_UNIT (6371000.0f * 3.14159265f / 180.0f / 10000000.0f)
+#define DEG_TO_RAD (3.14159265f / 180.0f / 10000000.0f)
+
+// Fences are small compared to the earth so an equirectangular
+// projection around the position is accurate enough.
+typedef struct {
+    float x;
+    float y;
+} localPoint_t;
+
+static localPoint_t project(const geoPoint_t *pOrigin, float lonScale,
+                            const geoPoint_t *pPoint)
+{
+    localPoint_t p = {
+        .x = (float)(pPoint->longitudeX1e7 - pOrigin->longitudeX1e7) * lonScale,
+        .y = (float)(pPoint->latitudeX1e7 - pOrigin->latitudeX1e7) * METERS_PER_UNIT
+    };
+    return p;
+}
+
+// Distance from origin to the segment a-b
+static float segmentDistance(localPoint_t a, localPoint_t b)
+{
+    float dx = b.x - a.x;
+    float dy = b.y - a.y;
+    float lenSq = dx * dx + dy * dy;
+    float t = 0;
+    if (lenSq > 0) {
+        t = -(a.x * dx + a.y * dy) / lenSq;
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    }
+    float px = a.x + t * dx;
+    float py = a.y + t * dy;
+    return sqrtf(px * px + py * py);
+}
+
+static float polygonDistance(const geofence_t *pFence, const geoPoint_t *pPos)
+{
+    float lonScale = METERS_PER_UNIT * cosf(pPos->latitudeX1e7 * DEG_TO_RAD);
+    float minDist = INFINITY;
+    bool inside = false;
+    localPoint_t prev = project(pPos, lonScale, &pFence->pVertices[pFence->vertexCnt - 1]);
+    for (size_t i = 0; i < pFence->vertexCnt; i++) {
+        localPoint_t curr = project(pPos, lonScale, &pFence->pVertices[i]);
+        // Ray casting along positive x from the origin
+        if ((curr.y > 0) != (prev.y > 0) &&
+            (curr.x - curr.y * (prev.x - curr.x) / (prev.y - curr.y)) > 0) {
+            inside = !inside;
+        }
+        float dist = segmentDistance(prev, curr);
+        if (dist < minDist) {
+            minDist = dist;
+        }
+        prev = curr;
+    }
+    return inside ? -minDist : minDist;
+}
+
+float geofenceDistance(const geofence_t *pFence, const geoPoint_t *pPos)
+{
+    if (pFence->type == GEOFENCE_CIRCLE) {
+        float lonScale = METERS_PER_UNIT * cosf(pPos->latitudeX1e7 * DEG_TO_RAD);
+        localPoint_t c = project(pPos, lonScale, &pFence->center);
+        return sqrtf(c.x * c.x + c.y * c.y) - pFence->radiusM;
+    }
+    if (pFence->vertexCnt < 3) {
+        return INFINITY;
+    }
+    return polygonDistance(pFence, pPos);
+}
+
+int geofenceUpdate(geofence_t *pFences, size_t fenceCnt,
+                   const geoPoint_t *pPos, uint32_t accuracyM,
+                   geofence_cb_t cb)
+{
+    int transitions = 0;
+    for (size_t i = 0; i < fenceCnt; i++) {
+        geofence_t *pFence = &pFences[i];
+        float dist = geofenceDistance(pFence, pPos);
+        bool changed = false;
+        if (dist < -(float)accuracyM) {
+            changed = !pFence->stateKnown || !pFence->inside;
+            pFence->inside = true;
+        } else if (dist > (float)accuracyM) {
+            changed = !pFence->stateKnown || pFence->inside;
+            pFence->inside = false;
+        } else if (!pFence->stateKnown) {
+            // Too close to the border to tell, use the best guess
+            // as the initial state
+            pFence->inside = dist < 0;
+            changed = true;
+        }
+        if (changed) {
+            pFence->stateKnown = true;
+            transitions++;
+            if (cb) {
+                cb(pFence, pFence->inside);
+            }
+        }
+    }
+    return transitions;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** A position in the same format as used by ubxlib uLocation_t. */
+typedef struct {
+    int32_t latitudeX1e7;
+    int32_t longitudeX1e7;
+} geoPoint_t;
+
+typedef enum {
+    GEOFENCE_CIRCLE,
+    GEOFENCE_POLYGON
+} geofenceType_t;
+
+/** Geofence definition. Use the macros below for initiation. */
+typedef struct {
+    const char *pName;
+    geofenceType_t type;
+    geoPoint_t center;            // Circle only
+    uint32_t radiusM;             // Circle only
+    const geoPoint_t *pVertices;  // Polygon only
+    size_t vertexCnt;             // Polygon only
+    // Current state, maintained by geofenceUpdate()
+    bool stateKnown;
+    bool inside;
+} geofence_t;
+
+#define GEOFENCE_CIRCLE_INIT(name, lat, lon, radius) \
+    { .pName = name, .type = GEOFENCE_CIRCLE,        \
+      .center = { lat, lon }, .radiusM = radius }
+
+#define GEOFENCE_POLYGON_INIT(name, vertices)          \
+    { .pName = name, .type = GEOFENCE_POLYGON,         \
+      .pVertices = vertices,                           \
+      .vertexCnt = sizeof(vertices) / sizeof(vertices[0]) }
+
+/**
+ * Geofence transition callback function.
+ * @param   pFence  The fence which was entered or exited.
+ * @param   inside  True when entering, false when exiting.
+ */
+typedef void (*geofence_cb_t)(const geofence_t *pFence, bool inside);
+
+/**
+ * Evaluate a new position against a set of geofences.
+ * A transition is only reported when the whole uncertainty circle
+ * of the position is on the other side of the fence border, this
+ * prevents a poor fix close to the border from toggling the state.
+ * The first position evaluated for a fence sets the initial state
+ * and is reported as a transition.
+ * @param   pFences    Array of fences.
+ * @param   fenceCnt   Number of fences in the array.
+ * @param   pPos       The new position.
+ * @param   accuracyM  Radius of the position uncertainty in meters.
+ * @param   cb         Callback called for each transition, can be NULL.
+ * @return             Number of transitions.
+ */
+int geofenceUpdate(geofence_t *pFences, size_t fenceCnt,
+                   const geoPoint_t *pPos, uint32_t accuracyM,
+                   geofence_cb_t cb);
+
+/**
+ * Get the signed distance between a position and a fence border.
+ * @param   pFence  The fence.
+ * @param   pPos    The position.
+ * @return          Distance in meters, negative when inside the fence.
+ */
+float geofenceDistance(const geofence_t *pFence, const geoPoint_t *pPos);
@@ -0,0 +1,414 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <kernel.h>
+
+#include "link_mgr.h"
+
+#define BACKOFF_MIN_MS 5000
+#define BACKOFF_MAX_MS (5 * 60 * 1000)
+// Consecutive failed health checks before the link is regarded as down
+#define CHECK_FAILURES_DOWN 2
+#define LINK_MGR_STACK_SIZE 4096
+
+typedef struct {
+    uDeviceType_t deviceType;
+    uNetworkType_t networkType;
+    const void *pNetworkCfg;
+    const char *pName;
+} bearer_t;
+
+static const linkMgrCfg_t *gpCfg;
+static bearer_t gBearers[LINK_BEARER_CNT];
+static linkStats_t gStats[LINK_BEARER_CNT];
+static uint64_t gUptimeMs[LINK_BEARER_CNT];
+static uint64_t gRttSumMs[LINK_BEARER_CNT];
+static uint64_t gTransferMs[LINK_BEARER_CNT];
+static uDeviceCfg_t gDeviceCfg;
+static uDeviceHandle_t gDevHandle = NULL;
+static linkBearer_t gCurrent;
+static volatile bool gUp = false;
+static volatile bool gSuspect = false;   // Failure reported, not checked yet
+static volatile bool gReleaseWanted = false;
+static int64_t gUpSince;
+static int64_t gFailbackFrom;            // Start of the time before failing back
+static uint32_t gRandom;
+// Held while the link is used and while it is changed
+static K_MUTEX_DEFINE(gLinkLock);
+// Protects the statistics, which are updated by the users too
+static K_MUTEX_DEFINE(gStatsLock);
+static K_SEM_DEFINE(gCheckSem, 0, 1);
+static struct k_thread gThread;
+static K_THREAD_STACK_DEFINE(gStack, LINK_MGR_STACK_SIZE);
+
+// Only for jitter, doesn't need to be a good random generator
+static uint32_t jitter()
+{
+    gRandom ^= gRandom << 13;
+    gRandom ^= gRandom >> 17;
+    gRandom ^= gRandom << 5;
+    return gRandom;
+}
+
+static void statusCallback(uDeviceHandle_t devHandle, uNetworkType_t netType,
+                           bool isUp, uNetworkStatus_t *pStatus, void *pParameter)
+{
+    if (!isUp) {
+        k_sem_give(&gCheckSem);
+    }
+}
+
+// Open the device of a bearer and bring up its network
+static uDeviceHandle_t openBearer(linkBearer_t bearer)
+{
+    const bearer_t *pBearer = &gBearers[bearer];
+    printf("Link: bringing up %s\n", pBearer->pName);
+    int64_t start = k_uptime_get();
+    uint32_t upMs = 0;
+    uDeviceHandle_t devHandle = NULL;
+    uDeviceGetDefaults(pBearer->deviceType, &gDeviceCfg);
+    int32_t errorCode = uDeviceOpen(&gDeviceCfg, &devHandle);
+    if (errorCode == 0) {
+        errorCode = uNetworkInterfaceUp(devHandle, pBearer->networkType, pBearer->pNetworkCfg);
+        if (errorCode == 0) {
+            uNetworkSetStatusCallback(devHandle, pBearer->networkType, statusCallback, NULL);
+        } else {
+            uDeviceClose(devHandle, true);
+        }
+    }
+    k_mutex_lock(&gStatsLock, K_FOREVER);
+    linkStats_t *pStats = &gStats[bearer];
+    if (errorCode == 0) {
+        upMs = k_uptime_get() - start;
+        pStats->lastUpMs = upMs;
+        pStats->ups++;
+    } else {
+        pStats->upFailures++;
+    }
+    k_mutex_unlock(&gStatsLock);
+    if (errorCode != 0) {
+        printf("* Link: failed to bring up %s: %d\n", pBearer->pName, errorCode);
+        return NULL;
+    }
+    printf("Link: %s up in %u ms\n", pBearer->pName, upMs);
+    return devHandle;
+}
+
+static void closeBearer(linkBearer_t bearer, uDeviceHandle_t devHandle)
+{
+    uNetworkInterfaceDown(devHandle, gBearers[bearer].networkType);
+    // Power off, which also releases a shared uart
+    uDeviceClose(devHandle, true);
+    printf("Link: %s down\n", gBearers[bearer].pName);
+}
+
+// Make an opened bearer the link, call with gLinkLock held
+static void use(linkBearer_t bearer, uDeviceHandle_t devHandle)
+{
+    k_mutex_lock(&gStatsLock, K_FOREVER);
+    gUpSince = k_uptime_get();
+    gFailbackFrom = gUpSince;
+    gDevHandle = devHandle;
+    gCurrent = bearer;
+    gUp = true;
+    k_mutex_unlock(&gStatsLock);
+}
+
+static bool bringUp(linkBearer_t bearer)
+{
+    uDeviceHandle_t devHandle = openBearer(bearer);
+    if (devHandle != NULL) {
+        use(bearer, devHandle);
+    }
+    return devHandle != NULL;
+}
+
+static void bringDown()
+{
+    k_mutex_lock(&gStatsLock, K_FOREVER);
+    gUp = false;
+    gUptimeMs[gCurrent] += k_uptime_get() - gUpSince;
+    k_mutex_unlock(&gStatsLock);
+    closeBearer(gCurrent, gDevHandle);
+    gDevHandle = NULL;
+}
+
+// Connect to the check server, the connect time is roughly one round trip
+static bool check(linkBearer_t bearer, uDeviceHandle_t devHandle)
+{
+    int32_t errorCode = 0;
+    int64_t start = k_uptime_get();
+    if (bearer == LINK_CELL && !uCellNetIsRegistered(devHandle)) {
+        errorCode = -ENETDOWN;
+    } else if (gpCfg->pCheckHost == NULL) {
+        return true;
+    } else {
+        uSockAddress_t address;
+        errorCode = uSockGetHostByName(devHandle, gpCfg->pCheckHost, &address.ipAddress);
+        address.port = gpCfg->checkPort;
+        start = k_uptime_get();
+        if (errorCode == 0) {
+            int32_t sock = uSockCreate(devHandle, U_SOCK_TYPE_STREAM, U_SOCK_PROTOCOL_TCP);
+            errorCode = sock;
+            if (sock >= 0) {
+                errorCode = uSockConnect(sock, &address);
+                uSockClose(sock);
+            }
+        }
+    }
+    k_mutex_lock(&gStatsLock, K_FOREVER);
+    linkStats_t *pStats = &gStats[bearer];
+    pStats->checks++;
+    if (errorCode != 0) {
+        pStats->checkFailures++;
+    } else {
+        pStats->rttMs = k_uptime_get() - start;
+        gRttSumMs[bearer] += pStats->rttMs;
+        pStats->rttAvgMs = gRttSumMs[bearer] / (pStats->checks - pStats->checkFailures);
+    }
+    k_mutex_unlock(&gStatsLock);
+    return errorCode == 0;
+}
+
+static bool configured(linkBearer_t bearer)
+{
+    return gBearers[bearer].pNetworkCfg != NULL;
+}
+
+static linkBearer_t other(linkBearer_t bearer)
+{
+    return bearer == LINK_CELL ? LINK_WIFI : LINK_CELL;
+}
+
+// Bring up the given bearer or else the other one
+static bool bringUpAny(linkBearer_t first)
+{
+    bool up = configured(first) && bringUp(first);
+    if (!up && configured(other(first))) {
+        up = bringUp(other(first));
+    }
+    return up;
+}
+
+// Wait for a user holding the link to let go of it
+static void lockForChange()
+{
+    gReleaseWanted = true;
+    k_mutex_lock(&gLinkLock, K_FOREVER);
+    gReleaseWanted = false;
+}
+
+// Check the link until it fails, returns false when it is time
+// to fail back to the preferred bearer instead
+static bool monitor()
+{
+    int failures = 0;
+    while (failures < CHECK_FAILURES_DOWN) {
+        // Early on failures reported by the status callback or the users
+        k_sem_take(&gCheckSem, K_SECONDS(gpCfg->checkIntervalS));
+        if (gCurrent != gpCfg->preferred && gpCfg->failbackS > 0 &&
+            k_uptime_get() - gFailbackFrom > gpCfg->failbackS * 1000LL) {
+            return false;
+        }
+        // Checked also while a user holds the link, only this thread
+        // changes it. A failed check stops new users until it is ok.
+        failures = check(gCurrent, gDevHandle) ? 0 : failures + 1;
+        gSuspect = failures > 0;
+        if (failures > 0 && failures < CHECK_FAILURES_DOWN) {
+            printf("* Link: %s check failed\n", gBearers[gCurrent].pName);
+            // Confirm soon
+            k_sem_give(&gCheckSem);
+        }
+    }
+    return true;
+}
+
+// Switch to the preferred bearer once it has passed a health check.
+// With both devices open at once the current link is kept until then,
+// else it is brought down for the check and brought back up again if
+// the preferred bearer isn't healthy. gUp is false after this only if
+// neither could be brought up.
+static void failBack()
+{
+    linkBearer_t preferred = gpCfg->preferred;
+    linkBearer_t previous = gCurrent;
+    printf("Link: checking %s before failing back\n", gBearers[preferred].pName);
+    if (gpCfg->concurrentDevices) {
+        uDeviceHandle_t devHandle = openBearer(preferred);
+        if (devHandle != NULL && check(preferred, devHandle)) {
+            lockForChange();
+            bringDown();
+            use(preferred, devHandle);
+            gSuspect = false;
+            k_mutex_unlock(&gLinkLock);
+        } else {
+            if (devHandle != NULL) {
+                closeBearer(preferred, devHandle);
+            }
+            printf("Link: staying on %s\n", gBearers[previous].pName);
+            gFailbackFrom = k_uptime_get();
+        }
+        return;
+    }
+    lockForChange();
+    bringDown();
+    if (bringUp(preferred) && !check(preferred, gDevHandle)) {
+        bringDown();
+    }
+    if (!gUp) {
+        printf("Link: going back to %s\n", gBearers[previous].pName);
+        bringUp(previous);
+    }
+    gSuspect = false;
+    k_mutex_unlock(&gLinkLock);
+}
+
+static void linkThread(void *p1, void *p2, void *p3)
+{
+    uint32_t backoffMs = BACKOFF_MIN_MS;
+    linkBearer_t next = gpCfg->preferred;
+    while (true) {
+        if (!gUp) {
+            k_mutex_lock(&gLinkLock, K_FOREVER);
+            bool up = bringUpAny(next);
+            gSuspect = false;
+            k_mutex_unlock(&gLinkLock);
+            if (!up) {
+                // Random part to spread the retries of many devices at a site
+                uint32_t delay = backoffMs / 2 + jitter() % (backoffMs / 2);
+                printf("Link: retrying in %u s\n", delay / 1000);
+                k_sleep(K_MSEC(delay));
+                backoffMs = MIN(backoffMs * 2, BACKOFF_MAX_MS);
+                next = gpCfg->preferred;
+                continue;
+            }
+            backoffMs = BACKOFF_MIN_MS;
+        }
+        if (monitor()) {
+            lockForChange();
+            linkBearer_t previous = gCurrent;
+            k_mutex_lock(&gStatsLock, K_FOREVER);
+            gStats[previous].drops++;
+            k_mutex_unlock(&gStatsLock);
+            bringDown();
+            k_mutex_unlock(&gLinkLock);
+            // The other bearer first after a failure
+            next = other(previous);
+        } else {
+            failBack();
+            next = gpCfg->preferred;
+        }
+    }
+}
+
+int32_t linkMgrStart(const linkMgrCfg_t *pCfg)
+{
+    if ((pCfg->pCellCfg == NULL && pCfg->pWifiCfg == NULL) ||
+        pCfg->preferred >= LINK_BEARER_CNT || pCfg->checkIntervalS == 0) {
+        return -EINVAL;
+    }
+    if (gpCfg != NULL) {
+        return -EALREADY;
+    }
+    gpCfg = pCfg;
+    gBearers[LINK_CELL] = (bearer_t) {
+        U_DEVICE_TYPE_CELL, U_NETWORK_TYPE_CELL, pCfg->pCellCfg, "cellular"
+    };
+    gBearers[LINK_WIFI] = (bearer_t) {
+        U_DEVICE_TYPE_SHORT_RANGE, U_NETWORK_TYPE_WIFI, pCfg->pWifiCfg, "Wi-Fi"
+    };
+    gRandom = k_cycle_get_32() | 1;
+    k_tid_t tid = k_thread_create(&gThread, gStack, LINK_MGR_STACK_SIZE, linkThread,
+                                  NULL, NULL, NULL, 7, 0, K_NO_WAIT);
+    k_thread_name_set(tid, "link_mgr");
+    return 0;
+}
+
+uDeviceHandle_t linkMgrAcquire(uint32_t timeoutMs, linkBearer_t *pBearer)
+{
+    int64_t deadline = k_uptime_get() + timeoutMs;
+    do {
+        if (gUp && !gSuspect && k_mutex_lock(&gLinkLock, K_MSEC(100)) == 0) {
+            if (gUp && !gSuspect) {
+                if (pBearer != NULL) {
+                    *pBearer = gCurrent;
+                }
+                return gDevHandle;
+            }
+            k_mutex_unlock(&gLinkLock);
+        }
+        k_sleep(K_MSEC(100));
+    } while (k_uptime_get() < deadline);
+    return NULL;
+}
+
+void linkMgrRelease(bool ok)
+{
+    if (!ok) {
+        gSuspect = true;
+        k_sem_give(&gCheckSem);
+    }
+    k_mutex_unlock(&gLinkLock);
+}
+
+bool linkMgrReleaseWanted()
+{
+    return gReleaseWanted;
+}
+
+void linkMgrReportTransfer(uint32_t bytes, uint32_t ms)
+{
+    k_mutex_lock(&gStatsLock, K_FOREVER);
+    linkStats_t *pStats = &gStats[gCurrent];
+    pStats->bytes += bytes;
+    gTransferMs[gCurrent] += ms;
+    if (gTransferMs[gCurrent] > 0) {
+        pStats->throughputBps = pStats->bytes * 8000ULL / gTransferMs[gCurrent];
+    }
+    k_mutex_unlock(&gStatsLock);
+}
+
+void linkMgrGetStats(linkBearer_t bearer, linkStats_t *pStats)
+{
+    k_mutex_lock(&gStatsLock, K_FOREVER);
+    uint64_t uptimeMs = gUptimeMs[bearer];
+    if (gUp && bearer == gCurrent) {
+        uptimeMs += k_uptime_get() - gUpSince;
+    }
+    *pStats = gStats[bearer];
+    k_mutex_unlock(&gStatsLock);
+    pStats->uptimeS = uptimeMs / 1000;
+}
+
+void linkMgrPrintStats()
+{
+    printf("%-9s %4s %5s %5s %7s %8s %6s %6s %7s %9s\n", "Bearer", "ups", "fails", "drops",
+           "up ms", "uptime s", "rtt", "avg", "checks", "bit/s");
+    for (int i = 0; i < LINK_BEARER_CNT; i++) {
+        if (configured(i)) {
+            linkStats_t stats;
+            linkMgrGetStats(i, &stats);
+            printf("%-9s %4u %5u %5u %7u %8u %6u %6u %3u/%-3u %9u\n", gBearers[i].pName,
+                   stats.ups, stats.upFailures, stats.drops, stats.lastUpMs, stats.uptimeS,
+                   stats.rttMs, stats.rttAvgMs, stats.checks - stats.checkFailures,
+                   stats.checks, stats.throughputBps);
+        }
+    }
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Network link manager with failover between cellular and Wi-Fi.
+ *
+ * A thread brings up the preferred bearer and then checks its health,
+ * by the network status from ubxlib and by periodically connecting
+ * to a server. When the link fails the other bearer is brought up.
+ * If neither can be brought up, new attempts are made with an
+ * exponential backoff with random jitter. While on the other bearer
+ * the preferred one is tried again after a configurable time, and
+ * only switched to once it has passed a health check.
+ *
+ * The Sara and Nina modules share a uart on the XPLR-IOT-1 unless
+ * built with NO_SENSORS, so by default only one bearer at a time is
+ * used. The current device is closed before the other is opened, and
+ * when failing back it is opened again if the preferred bearer isn't
+ * healthy. With concurrentDevices set the preferred bearer is checked
+ * while the current link is still up.
+ *
+ * The link is used between linkMgrAcquire and linkMgrRelease, it is
+ * never switched in between. The health checks go on while the link
+ * is used, so a link held for a long session is still checked, but it
+ * is only brought down once released. Reporting a failure in
+ * linkMgrRelease makes the manager check the link at once. The link
+ * is held by a mutex, so it must be released by the thread which
+ * acquired it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ubxlib.h"
+
+typedef enum {
+    LINK_CELL,
+    LINK_WIFI,
+    LINK_BEARER_CNT
+} linkBearer_t;
+
+typedef struct {
+    const uNetworkCfgCell_t *pCellCfg;  // NULL if not used
+    const uNetworkCfgWifi_t *pWifiCfg;  // NULL if not used
+    linkBearer_t preferred;
+    const char *pCheckHost;             // TCP server for health checks, NULL for none
+    uint16_t checkPort;
+    uint32_t checkIntervalS;            // Must not be zero
+    uint32_t failbackS;                 // Time before trying the preferred bearer again,
+                                        // zero for never
+    bool concurrentDevices;             // Both modules can be open at once, e.g. with
+                                        // NO_SENSORS, so the link is kept while failing back
+} linkMgrCfg_t;
+
+typedef struct {
+    uint32_t ups;              // Successful bring ups
+    uint32_t upFailures;
+    uint32_t drops;            // Failures detected after being up
+    uint32_t lastUpMs;         // Time for the last bring up
+    uint32_t uptimeS;          // Total time up
+    uint32_t rttMs;            // Last health check connect time
+    uint32_t rttAvgMs;
+    uint32_t checks;
+    uint32_t checkFailures;
+    uint32_t bytes;            // Reported by linkMgrReportTransfer
+    uint32_t throughputBps;
+} linkStats_t;
+
+/**
+ * Start the link manager. Call uPortInit and uDeviceInit first.
+ * @param   pCfg     The configuration, must be kept.
+ * @return           Zero on success or negative error code, -EINVAL
+ *                   for an invalid configuration.
+ */
+int32_t linkMgrStart(const linkMgrCfg_t *pCfg);
+
+/**
+ * Wait for a link and reserve it for use by the calling thread.
+ * @param   timeoutMs  Maximum time to wait.
+ * @param   pBearer    Place to put the bearer used, can be NULL.
+ * @return             Handle of the device or NULL on timeout.
+ */
+uDeviceHandle_t linkMgrAcquire(uint32_t timeoutMs, linkBearer_t *pBearer);
+
+/**
+ * End use of the link. Must be called from the thread which acquired
+ * it.
+ * @param   ok       False if the link failed, e.g. on a connection or
+ *                   transfer error.
+ */
+void linkMgrRelease(bool ok);
+
+/**
+ * Check if the manager is waiting for the link to be released, to
+ * bring it down after a failure or to fail back to the preferred
+ * bearer. Users holding the link for long should poll this.
+ * @return           True if the link should be released.
+ */
+bool linkMgrReleaseWanted();
+
+/**
+ * Report a transfer for the throughput statistics. The link must be
+ * acquired.
+ * @param   bytes    Bytes sent and received.
+ * @param   ms       Time of the transfer.
+ */
+void linkMgrReportTransfer(uint32_t bytes, uint32_t ms);
+
+/**
+ * Get the statistics of a bearer.
+ * @param   bearer   The bearer.
+ * @param   pStats   Place to put the statistics.
+ */
+void linkMgrGetStats(linkBearer_t bearer, linkStats_t *pStats);
+
+/**
+ * Print the statistics of the configured bearers.
+ */
+void linkMgrPrintStats();
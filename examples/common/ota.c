@@ -0,0 +1,620 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <kernel.h>
+#include <storage/flash_map.h>
+#include <storage/stream_flash.h>
+#include <dfu/mcuboot.h>
+#include <sys/crc.h>
+
+#include "counters.h"
+#include "ota.h"
+
+#define WRITE_BLOCK_SIZE 4096
+#define SOURCE_BUFFER_SIZE 256
+#define IMAGE_MAGIC 0x96f3b83d
+
+#define DELTA_MAGIC "UDLT"
+#define DELTA_VERSION 1
+#define DELTA_HEADER_SIZE 20
+#define OP_COPY 0x01
+#define OP_ADD 0x02
+#define OP_INSERT 0x03
+#define OP_HEADER_MAX 9
+
+#define HTTP_RETRIES 10
+#define HTTP_BUFFER_SIZE 1024
+
+typedef enum {
+    STATE_START,         // Reading the delta header or start of a full image
+    STATE_RAW,           // Full image, the data is written as it is
+    STATE_OP,            // Reading an operation header
+    STATE_COPY,
+    STATE_ADD_RUN,       // Reading the counts of an add run
+    STATE_ADD,
+    STATE_INSERT,
+    STATE_DONE
+} state_t;
+
+// Everything needed to continue from a checkpoint
+typedef struct {
+    uint32_t imageId;
+    uint32_t inPos;          // Bytes of update data used
+    uint32_t outPos;         // Bytes written to the slot
+    uint32_t srcPos;         // Position in the running image
+    uint32_t remaining;      // Bytes left of the current operation
+    uint32_t size;           // Size of the new image, zero for full images
+    uint8_t state;
+    uint8_t zeros;           // Left of the current add run
+    uint8_t diffs;
+} checkpoint_t;
+
+// An application update waiting for the new image to run
+typedef struct {
+    uint32_t imageId;
+    uint32_t size;           // Signed part of the image
+    uint32_t crc;
+} pending_t;
+
+static checkpoint_t gCp;
+static uint8_t gHeader[DELTA_HEADER_SIZE];
+static size_t gHeaderLen;
+static bool gActive = false;
+static const struct flash_area *gpSlot;
+static const struct flash_area *gpSource;
+static struct stream_flash_ctx gStream;
+static uint8_t gWriteBuffer[WRITE_BLOCK_SIZE];
+static uint8_t gSourceBuffer[SOURCE_BUFFER_SIZE];
+static otaStats_t gStats;
+static uint32_t gStartTime;
+static otaProgressCb_t gProgressCb = NULL;
+
+static uint32_t getU32(const uint8_t *pBuf)
+{
+    return pBuf[0] | (pBuf[1] << 8) | (pBuf[2] << 16) | ((uint32_t)pBuf[3] << 24);
+}
+
+static void saveCheckpoint()
+{
+    // One record, so a reset never leaves positions from different
+    // checkpoints
+    counterBlobSet(COUNTER_OTA_CHECKPOINT, &gCp, sizeof(gCp));
+    gStats.checkpoints++;
+    if (gProgressCb != NULL) {
+        otaStats_t stats;
+        otaGetStats(&stats);
+        gProgressCb(&stats);
+    }
+}
+
+static void loadCheckpoint()
+{
+    if (counterBlobGet(COUNTER_OTA_CHECKPOINT, &gCp, sizeof(gCp)) != sizeof(gCp)) {
+        memset(&gCp, 0, sizeof(gCp));
+    }
+}
+
+// Room before the next block boundary, output is split there so that
+// the stream buffer is empty at each checkpoint
+static size_t room()
+{
+    return WRITE_BLOCK_SIZE - gCp.outPos % WRITE_BLOCK_SIZE;
+}
+
+static int32_t emit(const uint8_t *pData, size_t len)
+{
+    uint32_t start = k_cycle_get_32();
+    int32_t res = stream_flash_buffered_write(&gStream, pData, len, false);
+    gStats.flashUs += k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    if (res == 0) {
+        gCp.outPos += len;
+        gStats.written += len;
+        if (gCp.outPos % OTA_CHECKPOINT_SIZE == 0) {
+            saveCheckpoint();
+        }
+    }
+    return res;
+}
+
+static int32_t readSource(uint32_t len)
+{
+    if (gCp.srcPos + len > gpSource->fa_size) {
+        return -EINVAL;
+    }
+    int32_t res = flash_area_read(gpSource, gCp.srcPos, gSourceBuffer, len);
+    gCp.srcPos += len;
+    return res;
+}
+
+// Collect header bytes, returns true when there are want bytes
+static bool collect(const uint8_t **ppData, size_t *pLen, size_t want)
+{
+    size_t len = MIN(*pLen, want - gHeaderLen);
+    memcpy(&gHeader[gHeaderLen], *ppData, len);
+    gHeaderLen += len;
+    gCp.inPos += len;
+    *ppData += len;
+    *pLen -= len;
+    return gHeaderLen == want;
+}
+
+static int32_t areaCrc(const struct flash_area *pArea, uint32_t size, uint32_t *pCrc)
+{
+    uint32_t crc = 0;
+    for (uint32_t pos = 0; pos < size; pos += SOURCE_BUFFER_SIZE) {
+        uint32_t len = MIN(size - pos, SOURCE_BUFFER_SIZE);
+        int32_t res = flash_area_read(pArea, pos, gSourceBuffer, len);
+        if (res != 0) {
+            return res;
+        }
+        crc = crc32_ieee_update(crc, gSourceBuffer, len);
+    }
+    *pCrc = crc;
+    return 0;
+}
+
+// Size of the image header and body, which identify the image
+static int32_t imageSize(const struct flash_area *pArea, uint32_t *pSize)
+{
+    uint8_t header[16];
+    int32_t res = flash_area_read(pArea, 0, header, sizeof(header));
+    if (res == 0) {
+        *pSize = (header[8] | (header[9] << 8)) + getU32(&header[12]);
+        if (getU32(header) != IMAGE_MAGIC || *pSize > pArea->fa_size) {
+            res = -EBADMSG;
+        }
+    }
+    return res;
+}
+
+static int32_t checkSource(uint32_t size, uint32_t crc)
+{
+    if (size > gpSource->fa_size) {
+        return -EINVAL;
+    }
+    uint32_t start = k_uptime_get_32();
+    uint32_t sourceCrc;
+    int32_t res = areaCrc(gpSource, size, &sourceCrc);
+    gStats.verifyMs = k_uptime_get_32() - start;
+    if (res != 0) {
+        return res;
+    }
+    // Made for another version than the one running
+    return sourceCrc == crc ? 0 : -EBADMSG;
+}
+
+// Start the next operation, or finish when the image is complete
+static void nextOp()
+{
+    gCp.state = gCp.outPos == gCp.size ? STATE_DONE : STATE_OP;
+}
+
+static int32_t parseOp()
+{
+    uint8_t op = gHeader[0];
+    gCp.remaining = getU32(&gHeader[1]);
+    if (gCp.remaining == 0 || gCp.outPos + gCp.remaining > gCp.size) {
+        return -EBADMSG;
+    }
+    if (op == OP_COPY) {
+        gCp.srcPos = getU32(&gHeader[5]);
+        gCp.state = STATE_COPY;
+    } else if (op == OP_ADD) {
+        gCp.state = STATE_ADD_RUN;
+    } else if (op == OP_INSERT) {
+        gCp.state = STATE_INSERT;
+    } else {
+        return -EBADMSG;
+    }
+    return 0;
+}
+
+int32_t otaWrite(const uint8_t *pData, size_t len)
+{
+    if (!gActive) {
+        return -EINVAL;
+    }
+    int32_t res = 0;
+    gStats.downloaded += len;
+    bool progress = true;
+    while (res == 0 && progress) {
+        size_t n;
+        progress = len > 0;
+        switch (gCp.state) {
+            case STATE_START:
+                if (collect(&pData, &len, gHeaderLen < 4 ? 4 : DELTA_HEADER_SIZE)) {
+                    if (memcmp(gHeader, DELTA_MAGIC, 4) != 0) {
+                        gCp.state = STATE_RAW;
+                        gHeaderLen = 0;
+                        res = emit(gHeader, 4);
+                    } else if (gHeaderLen == DELTA_HEADER_SIZE) {
+                        gStats.delta = true;
+                        gCp.size = getU32(&gHeader[16]);
+                        gHeaderLen = 0;
+                        res = gHeader[4] == DELTA_VERSION ?
+                              checkSource(getU32(&gHeader[8]), getU32(&gHeader[12])) : -EBADMSG;
+                        gCp.state = STATE_OP;
+                    }
+                }
+                break;
+            case STATE_RAW:
+                n = MIN(len, room());
+                gCp.inPos += n;
+                res = emit(pData, n);
+                pData += n;
+                len -= n;
+                break;
+            case STATE_OP:
+                if (len > 0 && collect(&pData, &len,
+                                       gHeaderLen > 0 && gHeader[0] == OP_COPY ? 9 : 5)) {
+                    // A copy has a longer header, only known after the first byte
+                    if (gHeader[0] == OP_COPY && gHeaderLen < OP_HEADER_MAX) {
+                        break;
+                    }
+                    gHeaderLen = 0;
+                    res = parseOp();
+                }
+                break;
+            case STATE_COPY:
+                n = MIN(MIN(gCp.remaining, room()), SOURCE_BUFFER_SIZE);
+                res = readSource(n);
+                gCp.remaining -= n;
+                if (res == 0) {
+                    res = emit(gSourceBuffer, n);
+                }
+                if (gCp.remaining == 0) {
+                    nextOp();
+                }
+                progress = true;
+                break;
+            case STATE_ADD_RUN:
+                if (len > 0 && collect(&pData, &len, 2)) {
+                    gHeaderLen = 0;
+                    gCp.zeros = gHeader[0];
+                    gCp.diffs = gHeader[1];
+                    if (gCp.zeros + gCp.diffs == 0 || gCp.zeros + gCp.diffs > gCp.remaining) {
+                        res = -EBADMSG;
+                    }
+                    gCp.state = STATE_ADD;
+                }
+                break;
+            case STATE_ADD: {
+                bool diff = gCp.zeros == 0;
+                if (diff) {
+                    n = MIN(MIN(gCp.diffs, len), MIN(room(), SOURCE_BUFFER_SIZE));
+                    gCp.diffs -= n;
+                } else {
+                    // Unchanged bytes need no input
+                    n = MIN(MIN(gCp.zeros, room()), SOURCE_BUFFER_SIZE);
+                    gCp.zeros -= n;
+                    progress = true;
+                }
+                res = readSource(n);
+                if (diff) {
+                    for (size_t i = 0; i < n; i++) {
+                        gSourceBuffer[i] += pData[i];
+                    }
+                    gCp.inPos += n;
+                    pData += n;
+                    len -= n;
+                }
+                gCp.remaining -= n;
+                if (res == 0 && n > 0) {
+                    res = emit(gSourceBuffer, n);
+                }
+                if (gCp.zeros == 0 && gCp.diffs == 0) {
+                    if (gCp.remaining == 0) {
+                        nextOp();
+                    } else {
+                        gCp.state = STATE_ADD_RUN;
+                    }
+                }
+                break;
+            }
+            case STATE_INSERT:
+                n = MIN(MIN(gCp.remaining, len), room());
+                gCp.inPos += n;
+                gCp.remaining -= n;
+                res = emit(pData, n);
+                pData += n;
+                len -= n;
+                if (gCp.remaining == 0) {
+                    nextOp();
+                }
+                break;
+            case STATE_DONE:
+                // Trailing data after a delta
+                res = len > 0 ? -EBADMSG : 0;
+                progress = false;
+                break;
+        }
+    }
+    return res;
+}
+
+static int32_t openAreas()
+{
+#if defined(PM_MCUBOOT_SECONDARY_ID) && defined(PM_MCUBOOT_PRIMARY_ID)
+    int32_t res = flash_area_open(PM_MCUBOOT_SECONDARY_ID, &gpSlot);
+    if (res == 0) {
+        res = flash_area_open(PM_MCUBOOT_PRIMARY_ID, &gpSource);
+    }
+    return res;
+#else
+    // Only available when building with the bootloader
+    return -ENODEV;
+#endif
+}
+
+// Start from the last checkpoint if there is one for this image
+static int32_t resume(uint32_t imageId, uint32_t *pOffset)
+{
+    int32_t res = openAreas();
+    if (res != 0) {
+        return res;
+    }
+    gHeaderLen = 0;
+    loadCheckpoint();
+    if (gCp.imageId != imageId || gCp.outPos == 0 || gCp.state == STATE_DONE) {
+        memset(&gCp, 0, sizeof(gCp));
+        gCp.imageId = imageId;
+        gCp.state = STATE_START;
+        // Remove any earlier upgrade request in the trailer
+        res = flash_area_erase(gpSlot, gpSlot->fa_size - WRITE_BLOCK_SIZE, WRITE_BLOCK_SIZE);
+    } else {
+        gStats.resumedAt = gCp.inPos;
+        gStats.delta = gCp.size > 0;
+    }
+    if (res == 0) {
+        // Continue writing after the checkpoint, erasing as the stream goes
+        res = stream_flash_init(&gStream, gpSlot->fa_dev, gWriteBuffer, sizeof(gWriteBuffer),
+                                gpSlot->fa_off + gCp.outPos, gpSlot->fa_size - gCp.outPos, NULL);
+    }
+    gActive = res == 0;
+    *pOffset = gCp.inPos;
+    return res;
+}
+
+int32_t otaBegin(uint32_t imageId, uint32_t *pOffset)
+{
+    memset(&gStats, 0, sizeof(gStats));
+    gStartTime = k_uptime_get_32();
+    return resume(imageId, pOffset);
+}
+
+int32_t otaFinish(bool permanent)
+{
+    if (!gActive) {
+        return -EINVAL;
+    }
+    int32_t res = stream_flash_buffered_write(&gStream, NULL, 0, true);
+    if (res == 0 && (gCp.state == STATE_START ||
+                     (gCp.size > 0 && gCp.state != STATE_DONE))) {
+        // Incomplete
+        res = -EBADMSG;
+    }
+    pending_t pending = {.imageId = gCp.imageId};
+    if (res == 0) {
+        res = imageSize(gpSlot, &pending.size);
+    }
+    if (res == 0) {
+        // Recorded as installed by otaConfirm if MCUboot accepts it
+        res = areaCrc(gpSlot, pending.size, &pending.crc);
+        if (res == 0) {
+            res = counterBlobSet(COUNTER_OTA_PENDING, &pending, sizeof(pending));
+        }
+    }
+    if (res == 0) {
+        res = boot_request_upgrade(permanent ? BOOT_UPGRADE_PERMANENT : BOOT_UPGRADE_TEST);
+    }
+    gStats.timeMs += k_uptime_get_32() - gStartTime;
+    otaAbort();
+    if (res == 0 && gProgressCb != NULL) {
+        gProgressCb(&gStats);
+    }
+    return res;
+}
+
+int32_t otaConfirm()
+{
+    int32_t res = 0;
+    if (!boot_is_img_confirmed()) {
+        res = boot_write_img_confirmed();
+    }
+    pending_t pending;
+    if (res != 0 || counterBlobGet(COUNTER_OTA_PENDING, &pending, sizeof(pending)) !=
+        sizeof(pending) || pending.imageId == 0) {
+        return res;
+    }
+#ifdef PM_MCUBOOT_PRIMARY_ID
+    // The versions of the images may be the same, check the content
+    const struct flash_area *pArea;
+    uint32_t crc = 0;
+    res = flash_area_open(PM_MCUBOOT_PRIMARY_ID, &pArea);
+    if (res == 0) {
+        res = areaCrc(pArea, pending.size, &crc);
+        flash_area_close(pArea);
+    }
+    if (res == 0) {
+        static const pending_t none = {0};
+        counterBlobSet(COUNTER_OTA_PENDING, &none, sizeof(none));
+        if (crc == pending.crc) {
+            counterSet(COUNTER_OTA_INSTALLED, pending.imageId);
+        } else {
+            // Rejected or reverted by MCUboot
+            res = -ECANCELED;
+        }
+    }
+#endif
+    return res;
+}
+
+void otaAbort()
+{
+    static const checkpoint_t none = {0};
+    gActive = false;
+    counterBlobSet(COUNTER_OTA_CHECKPOINT, &none, sizeof(none));
+}
+
+void otaSetProgressCb(otaProgressCb_t cb)
+{
+    gProgressCb = cb;
+}
+
+void otaGetStats(otaStats_t *pStats)
+{
+    *pStats = gStats;
+    if (gActive) {
+        pStats->timeMs += k_uptime_get_32() - gStartTime;
+    }
+}
+
+static int32_t sockWriteAll(int32_t sock, const char *pData, size_t len)
+{
+    while (len > 0) {
+        int32_t res = uSockWrite(sock, pData, len);
+        if (res < 0) {
+            return res;
+        }
+        pData += res;
+        len -= res;
+    }
+    return 0;
+}
+
+// Read the response header, giving the status code and the
+// length of any body data read after it
+static int32_t readHttpHeader(int32_t sock, char *pBuf, size_t size,
+                              uint32_t *pContentLength, size_t *pBodyLen)
+{
+    size_t used = 0;
+    char *pEnd = NULL;
+    while (pEnd == NULL && used < size - 1) {
+        int32_t res = uSockRead(sock, &pBuf[used], size - 1 - used);
+        if (res <= 0) {
+            return res < 0 ? res : -EIO;
+        }
+        used += res;
+        pBuf[used] = 0;
+        pEnd = strstr(pBuf, "\r\n\r\n");
+    }
+    if (pEnd == NULL || strncmp(pBuf, "HTTP/1.", 7) != 0) {
+        return -EBADMSG;
+    }
+    *pEnd = 0;
+    int32_t status = atoi(&pBuf[9]);
+    const char *pLength = strstr(pBuf, "Content-Length:");
+    *pContentLength = pLength != NULL ? strtoul(pLength + 15, NULL, 10) : UINT32_MAX;
+    // Move any body data to the start of the buffer
+    size_t headerLen = pEnd + 4 - pBuf;
+    *pBodyLen = used - headerLen;
+    memmove(pBuf, pEnd + 4, *pBodyLen);
+    return status;
+}
+
+// One download attempt from the current offset
+static int32_t httpGet(uDeviceHandle_t devHandle, const uSockAddress_t *pAddress,
+                       const char *pHost, const char *pPath, uint32_t offset)
+{
+    static char buf[HTTP_BUFFER_SIZE];
+    int32_t sock = uSockCreate(devHandle, U_SOCK_TYPE_STREAM, U_SOCK_PROTOCOL_TCP);
+    if (sock < 0) {
+        return sock;
+    }
+    int32_t res = uSockConnect(sock, pAddress);
+    if (res == 0) {
+        int len = snprintf(buf, sizeof(buf),
+                           "GET %s HTTP/1.1\r\nHost: %s\r\nRange: bytes=%u-\r\n"
+                           "Connection: close\r\n\r\n", pPath, pHost, offset);
+        res = sockWriteAll(sock, buf, len);
+    }
+    uint32_t contentLength = 0;
+    size_t bodyLen = 0;
+    if (res == 0) {
+        res = readHttpHeader(sock, buf, sizeof(buf), &contentLength, &bodyLen);
+        // A server not supporting ranges sends all of it
+        uint32_t skip = res == 200 ? offset : 0;
+        if (contentLength != UINT32_MAX) {
+            gStats.total = contentLength + offset - skip;
+        }
+        if (res == 200 || res == 206) {
+            res = 0;
+        } else if (res > 0) {
+            printf("* HTTP status %d\n", res);
+            res = -EBADMSG;
+        }
+        uint32_t received = 0;
+        while (res == 0 && received < contentLength) {
+            if (bodyLen == 0) {
+                int32_t read = uSockRead(sock, buf, sizeof(buf));
+                if (read <= 0) {
+                    // Closed, fine if the length wasn't given
+                    res = read < 0 ? read : (contentLength == UINT32_MAX ? 1 : -EIO);
+                    break;
+                }
+                bodyLen = read;
+            }
+            received += bodyLen;
+            uint32_t skipped = MIN(skip, bodyLen);
+            skip -= skipped;
+            res = otaWrite((uint8_t *)buf + skipped, bodyLen - skipped);
+            bodyLen = 0;
+        }
+        res = res == 1 ? 0 : res;
+    }
+    uSockClose(sock);
+    return res;
+}
+
+int32_t otaHttpDownload(uDeviceHandle_t devHandle, const char *pHost, uint16_t port,
+                        const char *pPath, uint32_t imageId)
+{
+    uint32_t offset;
+    int32_t res = otaBegin(imageId, &offset);
+    if (res != 0) {
+        return res;
+    }
+    uSockAddress_t address;
+    res = uSockGetHostByName(devHandle, pHost, &address.ipAddress);
+    address.port = port;
+    if (res == 0) {
+        do {
+            // Continue from the last checkpoint, data received after it
+            // is downloaded again
+            if (gStats.connections > 0) {
+                res = resume(imageId, &offset);
+            }
+            gStats.connections++;
+            if (res == 0 && offset > 0) {
+                printf("Downloading from offset %u\n", offset);
+            }
+            if (res == 0) {
+                res = httpGet(devHandle, &address, pHost, pPath, offset);
+            }
+        } while (res != 0 && res != -EBADMSG && gStats.connections < HTTP_RETRIES);
+    }
+    if (res == 0) {
+        res = otaFinish(false);
+    } else {
+        gActive = false;
+    }
+    return res;
+}
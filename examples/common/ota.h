@@ -0,0 +1,148 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Firmware update over the network into the MCUboot secondary slot
+ * on the external flash.
+ *
+ * Only the application image can be updated, the network core is not.
+ *
+ * The update is streamed into the slot in 4 kB blocks as it arrives,
+ * from any source, e.g. HTTP or MQTT. A checkpoint is saved as one
+ * record in the persistent counter storage every OTA_CHECKPOINT_SIZE
+ * bytes, so an update interrupted by a lost connection or a reset
+ * continues from there.
+ *
+ * Either a complete signed MCUboot image or a delta against the image
+ * in the primary slot can be sent. A delta, made by make_delta.py in
+ * the ota example, has a header followed by operations, little endian:
+ *
+ *   header  "UDLT" (4), version (1), reserved (3),
+ *           source size (4), source crc32 (4), new size (4)
+ *   COPY    0x01, length (4), source offset (4)
+ *           Copy from the running image
+ *   ADD     0x02, length (4), runs
+ *           Copy from the running image, continuing after the last
+ *           COPY or ADD, adding differences. Each run is a zero
+ *           count (1), a difference count (1) and the differences.
+ *   INSERT  0x03, length (4), data
+ *           New data
+ *
+ * The result is a normal signed image which is verified by MCUboot
+ * before it is used.
+ *
+ * Requires set(OTA 1) in the CMakeLists.txt of the example and
+ * building with the bootloader.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ubxlib.h"
+
+// Data written to the slot between saved checkpoints
+#define OTA_CHECKPOINT_SIZE (32 * 1024)
+
+typedef struct {
+    uint32_t total;          // Size of the update data, zero if not known
+    uint32_t downloaded;     // Bytes received
+    uint32_t written;        // Bytes written to the slot
+    uint32_t resumedAt;      // Download offset at start, non zero if resumed
+    uint32_t connections;    // Download attempts
+    uint32_t checkpoints;
+    uint32_t timeMs;
+    uint32_t flashUs;        // Time spent erasing and writing the slot
+    uint32_t verifyMs;       // Time for checking the source of a delta
+    bool delta;
+} otaStats_t;
+
+/**
+ * Progress callback, called at each checkpoint and when complete.
+ * @param   pStats   Statistics of the update so far.
+ */
+typedef void (*otaProgressCb_t)(const otaStats_t *pStats);
+
+/**
+ * Start or resume an update.
+ * @param   imageId  Identity of the update, e.g. its version. An
+ *                   interrupted update is only resumed if the id
+ *                   is the same.
+ * @param   pOffset  Place to put the offset in the update data from
+ *                   where it should be sent.
+ * @return           Zero on success or negative error code.
+ */
+int32_t otaBegin(uint32_t imageId, uint32_t *pOffset);
+
+/**
+ * Write update data.
+ * @param   pData    The data.
+ * @param   len      Length of the data.
+ * @return           Zero on success or negative error code.
+ */
+int32_t otaWrite(const uint8_t *pData, size_t len);
+
+/**
+ * Complete an update, which is installed by MCUboot at the next reset.
+ * The image id is saved in COUNTER_OTA_INSTALLED by otaConfirm when
+ * the new image runs.
+ * @param   permanent  Install directly as confirmed, otherwise the
+ *                     new image must confirm itself with
+ *                     boot_write_img_confirmed or it is reverted
+ *                     at the following reset.
+ * @return             Zero on success or negative error code.
+ */
+int32_t otaFinish(bool permanent);
+
+/**
+ * Confirm the running image, if it is on test, and save the id of an
+ * update waiting to be installed in COUNTER_OTA_INSTALLED if it is the
+ * running image. Call at start once the image is known to work.
+ * @return           Zero on success, -ECANCELED if MCUboot didn't
+ *                   install or reverted the last update, so it can
+ *                   be tried again, or other negative error code.
+ */
+int32_t otaConfirm();
+
+/**
+ * Stop an update, the next otaBegin starts from the beginning.
+ */
+void otaAbort();
+
+/**
+ * Set a callback for progress reports.
+ * @param   cb       The callback, NULL for none.
+ */
+void otaSetProgressCb(otaProgressCb_t cb);
+
+/**
+ * Get statistics for the current or last update.
+ * @param   pStats   Place to put the statistics.
+ */
+void otaGetStats(otaStats_t *pStats);
+
+/**
+ * Download and install an update from a HTTP server. The download
+ * is resumed with range requests after connection errors.
+ * @param   devHandle  Handle of a device with the network up.
+ * @param   pHost      Server host name.
+ * @param   port       Server port.
+ * @param   pPath      Path of the update on the server.
+ * @param   imageId    Identity of the update, see otaBegin.
+ * @return             Zero on success or negative error code.
+ */
+int32_t otaHttpDownload(uDeviceHandle_t devHandle, const char *pHost, uint16_t port,
+                        const char *pPath, uint32_t imageId);
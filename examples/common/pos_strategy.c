@@ -0,0 +1,126 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "pos_strategy.h"
+
+// The ubxlib location callback has no user parameter so the
+// state of the ongoing request has to be global.
+static uPortMutexHandle_t gMutex = NULL;
+static uPortSemaphoreHandle_t gDoneSem = NULL;
+static const posSource_t *gpSources;
+static size_t gSourceCnt;
+static int32_t gAccuracyMm;
+static bool gActive = false;
+static int32_t gBestIndex;
+static uLocation_t gBestLocation;
+static size_t gPending;
+static int32_t gLastError;
+
+static void locationCallback(uDeviceHandle_t devHandle,
+                             int32_t errorCode,
+                             const uLocation_t *pLocation)
+{
+    uPortMutexLock(gMutex);
+    if (gActive) {
+        for (size_t i = 0; i < gSourceCnt; i++) {
+            if (gpSources[i].devHandle != devHandle) {
+                continue;
+            }
+            if (errorCode == 0 &&
+                (gBestIndex < 0 ||
+                 pLocation->radiusMillimetres < gBestLocation.radiusMillimetres)) {
+                gBestLocation = *pLocation;
+                gBestIndex = i;
+            } else if (errorCode != 0) {
+                gLastError = errorCode;
+            }
+            gPending--;
+            if ((gBestIndex >= 0 && gBestLocation.radiusMillimetres <= gAccuracyMm) ||
+                gPending == 0) {
+                gActive = false;
+                uPortSemaphoreGive(gDoneSem);
+            }
+            break;
+        }
+    }
+    uPortMutexUnlock(gMutex);
+}
+
+int32_t posStrategyGet(const posSource_t *pSources, size_t sourceCnt,
+                       int32_t accuracyMm, uint32_t deadlineMs,
+                       uLocation_t *pLocation)
+{
+    if (sourceCnt == 0 || sourceCnt > POS_STRATEGY_MAX_SOURCES) {
+        return U_ERROR_COMMON_INVALID_PARAMETER;
+    }
+    if (gMutex == NULL) {
+        if (uPortMutexCreate(&gMutex) != 0 ||
+            uPortSemaphoreCreate(&gDoneSem, 0, 1) != 0) {
+            return U_ERROR_COMMON_NO_MEMORY;
+        }
+    }
+    uPortMutexLock(gMutex);
+    gpSources = pSources;
+    gSourceCnt = sourceCnt;
+    gAccuracyMm = accuracyMm;
+    gBestIndex = -1;
+    gPending = 0;
+    gLastError = U_ERROR_COMMON_TIMEOUT;
+    gActive = true;
+    // Clear any stale completion from an earlier request
+    uPortSemaphoreTryTake(gDoneSem, 0);
+    bool started[POS_STRATEGY_MAX_SOURCES] = {false};
+    for (size_t i = 0; i < sourceCnt; i++) {
+        int32_t errorCode = uLocationGetStart(pSources[i].devHandle, pSources[i].type,
+                                              pSources[i].pLocationAssist,
+                                              pSources[i].pAuthenticationTokenStr,
+                                              locationCallback);
+        started[i] = errorCode == 0;
+        if (started[i]) {
+            gPending++;
+        } else {
+            gLastError = errorCode;
+        }
+    }
+    if (gPending == 0) {
+        gActive = false;
+    }
+    uPortMutexUnlock(gMutex);
+
+    if (gPending > 0) {
+        uPortSemaphoreTryTake(gDoneSem, deadlineMs);
+    }
+
+    uPortMutexLock(gMutex);
+    gActive = false;
+    int32_t result = gBestIndex;
+    if (result >= 0) {
+        *pLocation = gBestLocation;
+    } else if (gPending > 0) {
+        result = U_ERROR_COMMON_TIMEOUT;
+    } else {
+        // Every source has failed before the deadline
+        result = gLastError;
+    }
+    uPortMutexUnlock(gMutex);
+    // Stop the sources which are still running
+    for (size_t i = 0; i < sourceCnt; i++) {
+        if (started[i]) {
+            uLocationGetStop(pSources[i].devHandle);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Positioning strategy engine. Requests a position from several
+ * sources in parallel, e.g. GNSS and Cell Locate, and returns the
+ * first fix which is accurate enough.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ubxlib.h"
+
+#define POS_STRATEGY_MAX_SOURCES 3
+
+/** A position source. Each source must use its own device. */
+typedef struct {
+    const char *pName;
+    uDeviceHandle_t devHandle;
+    uLocationType_t type;
+    const uLocationAssist_t *pLocationAssist;  // Can be NULL
+    const char *pAuthenticationTokenStr;       // For cloud services, else NULL
+} posSource_t;
+
+/**
+ * Get a position from the first source delivering a fix with an
+ * accuracy radius within the threshold. The other sources are stopped
+ * as soon as a fix has been selected. If no fix is accurate enough
+ * when the deadline expires the most accurate fix received is returned.
+ * The network interfaces of the sources must be up before calling.
+ * @param   pSources     Array of sources.
+ * @param   sourceCnt    Number of sources, max POS_STRATEGY_MAX_SOURCES.
+ * @param   accuracyMm   Accuracy radius threshold in millimetres.
+ * @param   deadlineMs   Maximum time to wait.
+ * @param   pLocation    Place to put the location.
+ * @return               Index of the source used or negative error code,
+ *                       U_ERROR_COMMON_TIMEOUT if a source was still
+ *                       running at the deadline without a fix, else
+ *                       the error of the last source to fail.
+ */
+int32_t posStrategyGet(const posSource_t *pSources, size_t sourceCnt,
+                       int32_t accuracyMm, uint32_t deadlineMs,
+                       uLocation_t *pLocation);
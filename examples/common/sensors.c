@@ -21,11 +21,15 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <kernel.h>
 
+#include "sensors.h"
+
 const struct device *gpBme280Dev;
 const struct device *gpLis2dhDev;
 const struct device *gLtr303Dev;
+const struct device *gpBq274xxDev;
 
 #define INIT_SENSOR(sensor_name, p)                                                                           \
   {                                                                                                           \
@@ -125,4 +129,124 @@ void sensorsInit()
     INIT_SENSOR(bosch_bme280, gpBme280Dev);
     INIT_SENSOR(st_lis2dh, gpLis2dhDev);
     INIT_SENSOR(ltr_303als, gLtr303Dev);
+    INIT_SENSOR(ti_bq274xx, gpBq274xxDev);
+}
+
+bool getTemperature(int16_t *pDeciC)
+{
+    struct sensor_value temp;
+    bool ok = gpBme280Dev && sensor_sample_fetch(gpBme280Dev) == 0 &&
+              sensor_channel_get(gpBme280Dev, SENSOR_CHAN_AMBIENT_TEMP, &temp) == 0;
+    if (ok) {
+        *pDeciC = temp.val1 * 10 + temp.val2 / 100000;
+    }
+    return ok;
+}
+
+bool getBatteryLevel(uint8_t *pPercent)
+{
+    struct sensor_value soc;
+    bool ok = gpBq274xxDev && sensor_sample_fetch(gpBq274xxDev) == 0 &&
+              sensor_channel_get(gpBq274xxDev, SENSOR_CHAN_GAUGE_STATE_OF_CHARGE, &soc) == 0;
+    if (ok) {
+        *pPercent = soc.val1;
+    }
+    return ok;
+}
+
+// Motion detection. The interrupt pins of the LIS2DH are not in the
+// device tree and the driver is built without trigger support, so
+// the accelerometer is polled. Each poll is a short I2C read.
+#define MOTION_STACK_SIZE 1024
+#define STANDARD_GRAVITY 9.80665
+
+static struct k_thread motionThreadData;
+K_THREAD_STACK_DEFINE(motionStack, MOTION_STACK_SIZE);
+static motion_cb_t motion_cb = NULL;
+static bool gMotionRunning = false;
+static uint16_t motionThresholdMg;
+static uint32_t motionStillMs;
+static volatile bool gIsMoving = false;
+static volatile uint32_t gMotionPollUs = 0;
+
+// Get the acceleration in milli g for all axes
+static bool getAccelerationMg(int32_t *pMg)
+{
+    struct sensor_value accel[3];
+    bool ok = sensor_sample_fetch(gpLis2dhDev) >= 0 &&
+              sensor_channel_get(gpLis2dhDev, SENSOR_CHAN_ACCEL_XYZ, accel) == 0;
+    for (int i = 0; ok && i < 3; i++) {
+        pMg[i] = (int32_t)(decodeVal(&accel[i]) * 1000 / STANDARD_GRAVITY);
+    }
+    return ok;
+}
+
+static void setMoving(bool moving)
+{
+    if (moving != gIsMoving) {
+        gIsMoving = moving;
+        if (motion_cb) {
+            motion_cb(moving);
+        }
+    }
+}
+
+// Compare consecutive samples
+static void motionThread(void *p1, void *p2, void *p3)
+{
+    int32_t prevMg[3] = {0};
+    int32_t currMg[3];
+    bool hasPrev = false;
+    uint32_t lastMotion = k_uptime_get_32();
+    uint32_t polls = 0;
+    uint64_t pollCycles = 0;
+    while (true) {
+        uint32_t start = k_cycle_get_32();
+        bool ok = getAccelerationMg(currMg);
+        pollCycles += k_cycle_get_32() - start;
+        polls++;
+        gMotionPollUs = k_cyc_to_us_floor32(pollCycles / polls);
+        if (ok) {
+            if (hasPrev) {
+                for (int i = 0; i < 3; i++) {
+                    if (abs(currMg[i] - prevMg[i]) > motionThresholdMg) {
+                        lastMotion = k_uptime_get_32();
+                        setMoving(true);
+                        break;
+                    }
+                }
+            }
+            memcpy(prevMg, currMg, sizeof(prevMg));
+            hasPrev = true;
+        }
+        if (gIsMoving && (k_uptime_get_32() - lastMotion) > motionStillMs) {
+            setMoving(false);
+        }
+        k_msleep(SENSORS_MOTION_POLL_MS);
+    }
+}
+
+bool sensorsMotionStart(uint16_t thresholdMg, uint32_t stillMs, motion_cb_t cb)
+{
+    // The callback can be NULL, so the thread is only started once
+    bool ok = gpLis2dhDev && device_is_ready(gpLis2dhDev) && !gMotionRunning;
+    if (ok) {
+        gMotionRunning = true;
+        motionThresholdMg = thresholdMg;
+        motionStillMs = stillMs;
+        motion_cb = cb;
+        k_thread_create(&motionThreadData, motionStack, MOTION_STACK_SIZE, motionThread,
+                        NULL, NULL, NULL, 7, 0, K_NO_WAIT);
+    }
+    return ok;
+}
+
+uint32_t sensorsMotionPollUs()
+{
+    return gMotionPollUs;
+}
+
+bool sensorsIsMoving()
+{
+    return gIsMoving;
 }
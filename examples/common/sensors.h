@@ -14,6 +14,18 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SENSORS_MOTION_POLL_MS 100
+
+/**
+ * Motion callback function.
+ * @param   moving True when motion has started, false when the
+ *                 device has been still for the configured time.
+ */
+typedef void (*motion_cb_t)(bool moving);
+
 /**
  * Initiate environment sensor and accelerometer
  */
@@ -37,4 +49,44 @@ const char *pollLightSensor();
 /**
  * Get light sensor value in lux
  */
-int32_t getLightSensor();
\ No newline at end of file
+int32_t getLightSensor();
+
+/**
+ * Get the ambient temperature.
+ * @param   pDeciC Place to put the temperature in units of 0.1 degrees C.
+ * @return         Success or failure.
+ */
+bool getTemperature(int16_t *pDeciC);
+
+/**
+ * Get the battery state of charge from the fuel gauge.
+ * @param   pPercent Place to put the state of charge in percent.
+ * @return           Success or failure.
+ */
+bool getBatteryLevel(uint8_t *pPercent);
+
+/**
+ * Start motion detection using the LIS2DH accelerometer.
+ * The accelerometer is polled every SENSORS_MOTION_POLL_MS from a
+ * thread, since its interrupt is not available. That keeps the I2C
+ * bus and the cpu waking up also while the device is still.
+ * @param   thresholdMg Change in acceleration, in milli g, regarded as motion.
+ * @param   stillMs     Time without motion before the device is reported still.
+ * @param   cb          Callback to be called when the motion state changes,
+ *                      can be NULL when sensorsIsMoving is used instead.
+ * @return              Success or failure, failure also if already started.
+ */
+bool sensorsMotionStart(uint16_t thresholdMg, uint32_t stillMs, motion_cb_t cb);
+
+/**
+ * Get the average time of one accelerometer poll. A poll is made
+ * every SENSORS_MOTION_POLL_MS while motion detection is running.
+ * @return  Time in micro seconds, 0 before the first poll.
+ */
+uint32_t sensorsMotionPollUs();
+
+/**
+ * Get the current motion state.
+ * @return  True if the device is moving.
+ */
+bool sensorsIsMoving();
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <kernel.h>
+
+#include "startup.h"
+
+typedef struct {
+    uint32_t startMs;
+    uint32_t endMs;
+    int32_t result;
+    volatile bool done;
+} timing_t;
+
+typedef struct {
+    const char *pName;
+    uint32_t ms;
+} mark_t;
+
+static const startupStage_t *gpStages;
+static size_t gCnt = 0;
+static uint32_t gRunMs;
+static timing_t gTimings[STARTUP_MAX_STAGES];
+static struct k_sem gDoneSem[STARTUP_MAX_STAGES];
+static struct k_thread gThreads[STARTUP_MAX_STAGES];
+K_THREAD_STACK_ARRAY_DEFINE(gStacks, STARTUP_MAX_STAGES, STARTUP_STACK_SIZE);
+static mark_t gMarks[STARTUP_MAX_MARKS];
+static size_t gMarkCnt = 0;
+K_MUTEX_DEFINE(gMarkLock);
+
+static void stageThread(void *p1, void *p2, void *p3)
+{
+    size_t stage = (size_t)p1;
+    const startupStage_t *pStage = &gpStages[stage];
+    timing_t *pTiming = &gTimings[stage];
+    for (size_t i = 0; i < gCnt; i++) {
+        if (pStage->after & BIT(i)) {
+            startupWait(i, UINT32_MAX);
+        }
+    }
+    pTiming->startMs = k_uptime_get_32();
+    pTiming->result = pStage->fn(pStage->pParam);
+    pTiming->endMs = k_uptime_get_32();
+    pTiming->done = true;
+    k_sem_give(&gDoneSem[stage]);
+}
+
+int32_t startupRun(const startupStage_t *pStages, size_t cnt)
+{
+    if (cnt > STARTUP_MAX_STAGES || gCnt > 0) {
+        return -EINVAL;
+    }
+    gpStages = pStages;
+    gCnt = cnt;
+    gRunMs = k_uptime_get_32();
+    for (size_t i = 0; i < cnt; i++) {
+        memset(&gTimings[i], 0, sizeof(timing_t));
+        k_sem_init(&gDoneSem[i], 0, 1);
+    }
+    // Create all first so that the semaphores are ready when waited for
+    for (size_t i = 0; i < cnt; i++) {
+        k_tid_t tid = k_thread_create(&gThreads[i], gStacks[i], STARTUP_STACK_SIZE,
+                                      stageThread, (void *)i, NULL, NULL, 7, 0, K_NO_WAIT);
+        k_thread_name_set(tid, pStages[i].pName);
+    }
+    return 0;
+}
+
+int32_t startupWait(size_t stage, uint32_t timeoutMs)
+{
+    if (stage >= gCnt) {
+        return -EINVAL;
+    }
+    k_timeout_t timeout = timeoutMs == UINT32_MAX ? K_FOREVER : K_MSEC(timeoutMs);
+    if (k_sem_take(&gDoneSem[stage], timeout) != 0) {
+        return -EAGAIN;
+    }
+    // Let the other waiters through too
+    k_sem_give(&gDoneSem[stage]);
+    return gTimings[stage].result;
+}
+
+bool startupOk(size_t stage)
+{
+    return stage < gCnt && gTimings[stage].done && gTimings[stage].result == 0;
+}
+
+void startupMark(const char *pName)
+{
+    uint32_t now = k_uptime_get_32();
+    k_mutex_lock(&gMarkLock, K_FOREVER);
+    bool found = false;
+    for (size_t i = 0; i < gMarkCnt && !found; i++) {
+        found = strcmp(gMarks[i].pName, pName) == 0;
+    }
+    if (!found && gMarkCnt < STARTUP_MAX_MARKS) {
+        gMarks[gMarkCnt].pName = pName;
+        gMarks[gMarkCnt].ms = now;
+        gMarkCnt++;
+    }
+    k_mutex_unlock(&gMarkLock);
+}
+
+void startupPrintTimes()
+{
+    printf("Startup times in ms since boot, stages started at %u:\n", gRunMs);
+    printf("%-14s %8s %8s %8s %7s\n", "Stage", "start", "end", "time", "result");
+    for (size_t i = 0; i < gCnt; i++) {
+        const timing_t *pTiming = &gTimings[i];
+        if (pTiming->done) {
+            printf("%-14s %8u %8u %8u %7d\n", gpStages[i].pName, pTiming->startMs,
+                   pTiming->endMs, pTiming->endMs - pTiming->startMs, pTiming->result);
+        } else {
+            printf("%-14s %8s\n", gpStages[i].pName, "running");
+        }
+    }
+    k_mutex_lock(&gMarkLock, K_FOREVER);
+    for (size_t i = 0; i < gMarkCnt; i++) {
+        printf("%-14s %8u\n", gMarks[i].pName, gMarks[i].ms);
+    }
+    k_mutex_unlock(&gMarkLock);
+}
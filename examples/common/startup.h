@@ -0,0 +1,85 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Start up orchestration. Independent start up stages, e.g. opening
+ * and bringing up the GNSS, cellular and BLE modules, are run in
+ * parallel, each in its own thread, so that slow ones like cellular
+ * registration don't delay the others.
+ *
+ * A stage can be ordered after other stages, it is then started when
+ * those are complete, whatever their result. Use startupOk to check
+ * the result of a dependency.
+ *
+ * The start and end of each stage, and milestones like the first
+ * sensor sample, are recorded as times since boot.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define STARTUP_MAX_STAGES 4
+#define STARTUP_STACK_SIZE 4096
+#define STARTUP_MAX_MARKS 6
+
+/**
+ * A start up stage function.
+ * @param   pParam   Parameter of the stage.
+ * @return           Zero on success or negative error code.
+ */
+typedef int32_t (*startupFn_t)(void *pParam);
+
+typedef struct {
+    const char *pName;
+    startupFn_t fn;
+    void *pParam;
+    uint32_t after;     // Bit mask of stages which must be complete first
+} startupStage_t;
+
+/**
+ * Start the stages. Returns at once.
+ * @param   pStages  The stages, must be kept.
+ * @param   cnt      Number of stages, max STARTUP_MAX_STAGES.
+ * @return           Zero on success or negative error code.
+ */
+int32_t startupRun(const startupStage_t *pStages, size_t cnt);
+
+/**
+ * Wait for a stage to complete.
+ * @param   stage      Index of the stage.
+ * @param   timeoutMs  Maximum time to wait.
+ * @return             The result of the stage or -EAGAIN on timeout.
+ */
+int32_t startupWait(size_t stage, uint32_t timeoutMs);
+
+/**
+ * Check if a stage has completed successfully.
+ * @param   stage    Index of the stage.
+ * @return           True if done.
+ */
+bool startupOk(size_t stage);
+
+/**
+ * Record a milestone, only the first time for each name.
+ * @param   pName    Name of the milestone, must be kept.
+ */
+void startupMark(const char *pName);
+
+/**
+ * Print the stage and milestone times.
+ */
+void startupPrintTimes();
@@ -0,0 +1,419 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include "ts_store.h"
+
+#define BLOCK_MAGIC 0x5354
+// Largest encoded sample, varint time delta and value delta
+#define MAX_SAMPLE_SIZE (5 + 5)
+
+// Block header, little endian as the targets
+typedef struct {
+    uint16_t magic;
+    uint16_t count;
+    uint32_t seq;
+    uint32_t tFirst;
+    uint32_t tLast;
+    int32_t vFirst;
+    int32_t vMin;
+    int32_t vMax;
+    uint16_t used;           // Bytes of samples after the header
+    uint16_t reserved;
+    int64_t vSum;
+} blockHeader_t;
+
+#define PAYLOAD_SIZE (TS_STORE_BLOCK_SIZE - (int)sizeof(blockHeader_t))
+
+static size_t putVarint(uint8_t *pBuf, uint32_t value)
+{
+    size_t len = 0;
+    while (value >= 0x80) {
+        pBuf[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    pBuf[len++] = (uint8_t)value;
+    return len;
+}
+
+static size_t getVarint(const uint8_t *pBuf, size_t size, uint32_t *pValue)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < size && i < 5; i++) {
+        value |= (uint32_t)(pBuf[i] & 0x7F) << (7 * i);
+        if ((pBuf[i] & 0x80) == 0) {
+            *pValue = value;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Value deltas are taken modulo 2^32, so they always fit 32 bits
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)((value >> 1) ^ (~(value & 1) + 1));
+}
+
+static blockHeader_t *header(tsStore_t *pStore)
+{
+    return (blockHeader_t *)pStore->block;
+}
+
+static uint32_t blockNumber(tsStore_t *pStore, uint32_t i)
+{
+    return (pStore->first + i) % pStore->maxBlocks;
+}
+
+static uint32_t newestBlock(tsStore_t *pStore)
+{
+    return blockNumber(pStore, pStore->cnt - 1);
+}
+
+static int32_t writeNewest(tsStore_t *pStore)
+{
+    int32_t res = pStore->pIo->write(pStore->pIo->pCtx,
+                                     newestBlock(pStore) * TS_STORE_BLOCK_SIZE,
+                                     pStore->block, TS_STORE_BLOCK_SIZE);
+    if (res == 0) {
+        pStore->dirty = false;
+        pStore->blockWrites++;
+    }
+    return res;
+}
+
+// Read a block, taking the newest from RAM
+static int32_t readBlock(tsStore_t *pStore, uint32_t number, bool headerOnly,
+                         const uint8_t **ppBlock)
+{
+    if (number == newestBlock(pStore)) {
+        *ppBlock = (const uint8_t *)pStore->block;
+        return 0;
+    }
+    size_t len = headerOnly ? sizeof(blockHeader_t) : TS_STORE_BLOCK_SIZE;
+    int32_t res = pStore->pIo->read(pStore->pIo->pCtx, number * TS_STORE_BLOCK_SIZE,
+                                    pStore->readBuffer, len);
+    if (res == 0) {
+        *ppBlock = (const uint8_t *)pStore->readBuffer;
+        if (headerOnly) {
+            pStore->headerReads++;
+        } else {
+            pStore->blockReads++;
+        }
+    }
+    return res;
+}
+
+// Decode the samples of a block, giving the number of samples or error
+static int32_t decodeBlock(const uint8_t *pBlock, uint32_t tStart, uint32_t tEnd,
+                           tsStoreSampleCb_t cb, void *pParam, bool *pStop)
+{
+    blockHeader_t head;
+    memcpy(&head, pBlock, sizeof(head));
+    const uint8_t *pData = pBlock + sizeof(head);
+    size_t used = head.used <= PAYLOAD_SIZE ? head.used : 0;
+    uint32_t time = head.tFirst;
+    int32_t value = head.vFirst;
+    int32_t cnt = 0;
+    size_t pos = 0;
+    for (uint32_t i = 0; i < head.count && !*pStop; i++) {
+        if (i > 0) {
+            uint32_t dt, dv;
+            size_t len = getVarint(&pData[pos], used - pos, &dt);
+            pos += len;
+            size_t len2 = len > 0 ? getVarint(&pData[pos], used - pos, &dv) : 0;
+            pos += len2;
+            if (len2 == 0) {
+                return -EBADMSG;
+            }
+            time += dt;
+            value = (int32_t)((uint32_t)value + (uint32_t)unzigzag(dv));
+        }
+        if (time > tEnd) {
+            *pStop = true;
+        } else if (time >= tStart) {
+            cnt++;
+            if (cb != NULL && !cb(time, value, pParam)) {
+                *pStop = true;
+            }
+        }
+    }
+    return cnt;
+}
+
+// Index of the first block that may have samples at or after a time
+static uint32_t findBlock(tsStore_t *pStore, uint32_t time)
+{
+    uint32_t low = 0;
+    uint32_t high = pStore->cnt;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        if (pStore->pRanges[blockNumber(pStore, mid)].tLast < time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static bool lastSampleCb(uint32_t time, int32_t value, void *pParam)
+{
+    tsStore_t *pStore = (tsStore_t *)pParam;
+    pStore->lastTime = time;
+    pStore->lastValue = value;
+    return true;
+}
+
+int32_t tsStoreOpen(tsStore_t *pStore, const tsStoreIo_t *pIo,
+                    tsStoreRange_t *pRanges, uint32_t maxBlocks)
+{
+    memset(pStore, 0, sizeof(*pStore));
+    pStore->pIo = pIo;
+    pStore->pRanges = pRanges;
+    pStore->maxBlocks = maxBlocks;
+    if (maxBlocks < 2) {
+        return -EINVAL;
+    }
+    // Blocks are written in sequence as a ring, so the valid ones are
+    // a run ending with the highest sequence number
+    uint32_t newest = 0;
+    uint32_t newestSeq = 0;
+    uint32_t validCnt = 0;
+    for (uint32_t i = 0; i < maxBlocks; i++) {
+        blockHeader_t head;
+        int32_t res = pIo->read(pIo->pCtx, i * TS_STORE_BLOCK_SIZE, &head, sizeof(head));
+        if (res != 0) {
+            return res;
+        }
+        if (head.magic == BLOCK_MAGIC && head.count > 0) {
+            pRanges[i].tFirst = head.tFirst;
+            pRanges[i].tLast = head.tLast;
+            if (validCnt == 0 || head.seq > newestSeq) {
+                newest = i;
+                newestSeq = head.seq;
+            }
+            validCnt++;
+        } else {
+            pRanges[i].tFirst = UINT32_MAX;
+            pRanges[i].tLast = 0;
+        }
+    }
+    if (validCnt == 0) {
+        return 0;
+    }
+    // Step back from the newest while the blocks are valid and in order
+    uint32_t seq = newestSeq;
+    pStore->cnt = 1;
+    pStore->first = newest;
+    while (pStore->cnt < maxBlocks) {
+        uint32_t number = (pStore->first + maxBlocks - 1) % maxBlocks;
+        blockHeader_t head;
+        int32_t res = pIo->read(pIo->pCtx, number * TS_STORE_BLOCK_SIZE, &head, sizeof(head));
+        if (res != 0) {
+            return res;
+        }
+        if (head.magic != BLOCK_MAGIC || head.count == 0 || head.seq != seq - 1) {
+            break;
+        }
+        seq--;
+        pStore->first = number;
+        pStore->cnt++;
+    }
+    pStore->nextSeq = newestSeq + 1;
+    // Continue appending to the newest block
+    int32_t res = pIo->read(pIo->pCtx, newest * TS_STORE_BLOCK_SIZE,
+                            pStore->block, TS_STORE_BLOCK_SIZE);
+    if (res == 0) {
+        bool stop = false;
+        int32_t cnt = decodeBlock((uint8_t *)pStore->block, 0, UINT32_MAX, lastSampleCb,
+                                  pStore, &stop);
+        res = cnt == header(pStore)->count ? 0 : -EBADMSG;
+    }
+    return res;
+}
+
+static bool blockFull(tsStore_t *pStore)
+{
+    return header(pStore)->used + MAX_SAMPLE_SIZE > PAYLOAD_SIZE;
+}
+
+static void startBlock(tsStore_t *pStore, uint32_t time, int32_t value)
+{
+    if (pStore->cnt == pStore->maxBlocks) {
+        // Drop the oldest block
+        pStore->first = (pStore->first + 1) % pStore->maxBlocks;
+        pStore->cnt--;
+    }
+    pStore->cnt++;
+    memset(pStore->block, 0, sizeof(pStore->block));
+    blockHeader_t *pHead = header(pStore);
+    pHead->magic = BLOCK_MAGIC;
+    pHead->count = 1;
+    pHead->seq = pStore->nextSeq++;
+    pHead->tFirst = time;
+    pHead->tLast = time;
+    pHead->vFirst = value;
+    pHead->vMin = value;
+    pHead->vMax = value;
+    pHead->vSum = value;
+    pStore->pRanges[newestBlock(pStore)].tFirst = time;
+    pStore->pRanges[newestBlock(pStore)].tLast = time;
+}
+
+int32_t tsStoreAppend(tsStore_t *pStore, uint32_t time, int32_t value)
+{
+    if (pStore->cnt > 0 && time < pStore->lastTime) {
+        return -EINVAL;
+    }
+    int32_t res = 0;
+    blockHeader_t *pHead = header(pStore);
+    if (pStore->cnt == 0 || blockFull(pStore)) {
+        if (pStore->dirty) {
+            res = writeNewest(pStore);
+        }
+        if (res == 0) {
+            startBlock(pStore, time, value);
+        }
+    } else {
+        uint8_t *pData = (uint8_t *)pStore->block + sizeof(blockHeader_t);
+        pHead->used += putVarint(&pData[pHead->used], time - pStore->lastTime);
+        pHead->used += putVarint(&pData[pHead->used],
+                                 zigzag((int32_t)((uint32_t)value - (uint32_t)pStore->lastValue)));
+        pHead->count++;
+        pHead->tLast = time;
+        pHead->vMin = value < pHead->vMin ? value : pHead->vMin;
+        pHead->vMax = value > pHead->vMax ? value : pHead->vMax;
+        pHead->vSum += value;
+        pStore->pRanges[newestBlock(pStore)].tLast = time;
+    }
+    if (res == 0) {
+        pStore->lastTime = time;
+        pStore->lastValue = value;
+        pStore->dirty = true;
+        if (blockFull(pStore)) {
+            // Full, write it now rather than at the next append
+            res = writeNewest(pStore);
+        }
+    }
+    return res;
+}
+
+int32_t tsStoreFlush(tsStore_t *pStore)
+{
+    int32_t res = 0;
+    if (pStore->dirty) {
+        res = writeNewest(pStore);
+    }
+    if (res == 0 && pStore->pIo->sync != NULL) {
+        res = pStore->pIo->sync(pStore->pIo->pCtx);
+    }
+    return res;
+}
+
+int32_t tsStoreQuery(tsStore_t *pStore, uint32_t tStart, uint32_t tEnd,
+                     tsStoreSampleCb_t cb, void *pParam)
+{
+    int32_t cnt = 0;
+    bool stop = false;
+    for (uint32_t i = findBlock(pStore, tStart); i < pStore->cnt && !stop; i++) {
+        uint32_t number = blockNumber(pStore, i);
+        if (pStore->pRanges[number].tFirst > tEnd) {
+            break;
+        }
+        const uint8_t *pBlock;
+        int32_t res = readBlock(pStore, number, false, &pBlock);
+        if (res == 0) {
+            res = decodeBlock(pBlock, tStart, tEnd, cb, pParam, &stop);
+        }
+        if (res < 0) {
+            return res;
+        }
+        cnt += res;
+    }
+    return cnt;
+}
+
+static bool aggregateCb(uint32_t time, int32_t value, void *pParam)
+{
+    tsStoreAggregate_t *pAgg = (tsStoreAggregate_t *)pParam;
+    if (pAgg->count == 0) {
+        pAgg->tFirst = time;
+        pAgg->min = value;
+        pAgg->max = value;
+    }
+    pAgg->count++;
+    pAgg->tLast = time;
+    pAgg->min = value < pAgg->min ? value : pAgg->min;
+    pAgg->max = value > pAgg->max ? value : pAgg->max;
+    pAgg->sum += value;
+    return true;
+}
+
+int32_t tsStoreAggregate(tsStore_t *pStore, uint32_t tStart, uint32_t tEnd,
+                         tsStoreAggregate_t *pAgg)
+{
+    memset(pAgg, 0, sizeof(*pAgg));
+    bool stop = false;
+    for (uint32_t i = findBlock(pStore, tStart); i < pStore->cnt && !stop; i++) {
+        uint32_t number = blockNumber(pStore, i);
+        tsStoreRange_t *pRange = &pStore->pRanges[number];
+        if (pRange->tFirst > tEnd) {
+            break;
+        }
+        bool inside = pRange->tFirst >= tStart && pRange->tLast <= tEnd;
+        const uint8_t *pBlock;
+        int32_t res = readBlock(pStore, number, inside, &pBlock);
+        if (res == 0 && inside) {
+            // Whole block in the range, the header has it all
+            blockHeader_t head;
+            memcpy(&head, pBlock, sizeof(head));
+            if (pAgg->count == 0) {
+                pAgg->tFirst = head.tFirst;
+                pAgg->min = head.vMin;
+                pAgg->max = head.vMax;
+            }
+            pAgg->count += head.count;
+            pAgg->tLast = head.tLast;
+            pAgg->min = head.vMin < pAgg->min ? head.vMin : pAgg->min;
+            pAgg->max = head.vMax > pAgg->max ? head.vMax : pAgg->max;
+            pAgg->sum += head.vSum;
+        } else if (res == 0) {
+            res = decodeBlock(pBlock, tStart, tEnd, aggregateCb, pAgg, &stop);
+        }
+        if (res < 0) {
+            return res;
+        }
+    }
+    return 0;
+}
+
+bool tsStoreRange(tsStore_t *pStore, tsStoreRange_t *pRange)
+{
+    if (pStore->cnt == 0) {
+        return false;
+    }
+    pRange->tFirst = pStore->pRanges[pStore->first].tFirst;
+    pRange->tLast = pStore->pRanges[newestBlock(pStore)].tLast;
+    return true;
+}
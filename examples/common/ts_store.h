@@ -0,0 +1,182 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compact append only storage of a time series, e.g. the readings
+ * of one sensor.
+ *
+ * Samples, a time in seconds and a 32 bit value, are stored in fixed
+ * size blocks. Each block has a header with its time range, sample
+ * count, min, max and sum, followed by the samples as zigzag varint
+ * deltas to the previous sample. Slowly changing readings at a steady
+ * rate take about two bytes each.
+ *
+ * The blocks are used as a ring, so when the store is full the oldest
+ * block is overwritten. The time range of each block is kept in RAM,
+ * so queries only read the blocks in the requested range. Aggregates
+ * over blocks completely within the range are taken from the headers
+ * without reading the samples.
+ *
+ * The storage is accessed through tsStoreIo_t. This file and ts_store.c
+ * have no Zephyr dependencies so they can also be built on a host
+ * with e.g. a stdio file as the flash image, as the host test does.
+ * ts_store_fs.h provides the storage in a file on the external flash
+ * file system.
+ *
+ * A store must only be used by one thread at a time.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TS_STORE_BLOCK_SIZE 512
+
+/**
+ * Storage of the blocks. Reads of never written blocks must
+ * succeed and give zeros.
+ */
+typedef struct {
+    /**
+     * Read data.
+     * @param   pCtx    The context below.
+     * @param   offset  Offset in the storage.
+     * @param   pData   Place to put the data.
+     * @param   len     Length to read.
+     * @return          Zero on success or negative error code.
+     */
+    int32_t (*read)(void *pCtx, uint32_t offset, void *pData, size_t len);
+    /**
+     * Write data.
+     * @param   pCtx    The context below.
+     * @param   offset  Offset in the storage.
+     * @param   pData   Data to write.
+     * @param   len     Length of the data.
+     * @return          Zero on success or negative error code.
+     */
+    int32_t (*write)(void *pCtx, uint32_t offset, const void *pData, size_t len);
+    /**
+     * Commit written data, can be NULL.
+     * @param   pCtx    The context below.
+     * @return          Zero on success or negative error code.
+     */
+    int32_t (*sync)(void *pCtx);
+    void *pCtx;
+} tsStoreIo_t;
+
+// Time range of a block, one per block in RAM
+typedef struct {
+    uint32_t tFirst;
+    uint32_t tLast;
+} tsStoreRange_t;
+
+typedef struct {
+    const tsStoreIo_t *pIo;
+    tsStoreRange_t *pRanges;   // Indexed by block number
+    uint32_t maxBlocks;
+    uint32_t first;            // Block number of the oldest block
+    uint32_t cnt;              // Blocks in use, the newest is being appended to
+    uint32_t nextSeq;
+    uint32_t lastTime;
+    int32_t lastValue;
+    bool dirty;                // Newest block changed since written
+    // The newest block and a block read by a query, aligned for the header
+    uint64_t block[TS_STORE_BLOCK_SIZE / sizeof(uint64_t)];
+    uint64_t readBuffer[TS_STORE_BLOCK_SIZE / sizeof(uint64_t)];
+    // Statistics
+    uint32_t blockWrites;
+    uint32_t blockReads;       // Complete blocks read by queries
+    uint32_t headerReads;      // Headers only read by aggregates
+} tsStore_t;
+
+typedef struct {
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint32_t tFirst;
+    uint32_t tLast;
+} tsStoreAggregate_t;
+
+/**
+ * Sample callback for queries.
+ * @param   time    Time of the sample.
+ * @param   value   Value of the sample.
+ * @param   pParam  Parameter given to the query.
+ * @return          False to stop the query.
+ */
+typedef bool (*tsStoreSampleCb_t)(uint32_t time, int32_t value, void *pParam);
+
+/**
+ * Open a store, reading the block headers to find the stored range.
+ * @param   pStore     The store.
+ * @param   pIo        The storage, must be kept.
+ * @param   pRanges    Space for the time range of each block.
+ * @param   maxBlocks  Size of the store in blocks, must not be changed
+ *                     once data has been stored.
+ * @return             Zero on success or negative error code.
+ */
+int32_t tsStoreOpen(tsStore_t *pStore, const tsStoreIo_t *pIo,
+                    tsStoreRange_t *pRanges, uint32_t maxBlocks);
+
+/**
+ * Append a sample. Full blocks are written at once, the newest block
+ * is written by tsStoreFlush.
+ * @param   pStore  The store.
+ * @param   time    Time of the sample, not before the previous sample.
+ * @param   value   Value of the sample.
+ * @return          Zero on success or negative error code.
+ */
+int32_t tsStoreAppend(tsStore_t *pStore, uint32_t time, int32_t value);
+
+/**
+ * Write the newest block if changed and sync the storage.
+ * @param   pStore  The store.
+ * @return          Zero on success or negative error code.
+ */
+int32_t tsStoreFlush(tsStore_t *pStore);
+
+/**
+ * Get the samples within a time range, oldest first.
+ * @param   pStore  The store.
+ * @param   tStart  Start of the range.
+ * @param   tEnd    End of the range, inclusive.
+ * @param   cb      Called for each sample.
+ * @param   pParam  Parameter for the callback.
+ * @return          Number of samples or negative error code.
+ */
+int32_t tsStoreQuery(tsStore_t *pStore, uint32_t tStart, uint32_t tEnd,
+                     tsStoreSampleCb_t cb, void *pParam);
+
+/**
+ * Get count, min, max and sum of the samples within a time range.
+ * @param   pStore  The store.
+ * @param   tStart  Start of the range.
+ * @param   tEnd    End of the range, inclusive.
+ * @param   pAgg    Place to put the result, count is zero if
+ *                  there are no samples in the range.
+ * @return          Zero on success or negative error code.
+ */
+int32_t tsStoreAggregate(tsStore_t *pStore, uint32_t tStart, uint32_t tEnd,
+                         tsStoreAggregate_t *pAgg);
+
+/**
+ * Get the time range of the stored samples.
+ * @param   pStore  The store.
+ * @param   pRange  Place to put the range.
+ * @return          False if the store is empty.
+ */
+bool tsStoreRange(tsStore_t *pStore, tsStoreRange_t *pRange);
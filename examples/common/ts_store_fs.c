@@ -0,0 +1,78 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include "ext_fs.h"
+#include "ts_store_fs.h"
+
+static int32_t fileRead(void *pCtx, uint32_t offset, void *pData, size_t len)
+{
+    struct fs_file_t *pFile = (struct fs_file_t *)pCtx;
+    int32_t res = fs_seek(pFile, offset, FS_SEEK_SET);
+    if (res == 0) {
+        ssize_t read = fs_read(pFile, pData, len);
+        if (read < 0) {
+            res = read;
+        } else {
+            // Beyond the end of the file reads as never written
+            memset((uint8_t *)pData + read, 0, len - read);
+        }
+    }
+    return res;
+}
+
+static int32_t fileWrite(void *pCtx, uint32_t offset, const void *pData, size_t len)
+{
+    struct fs_file_t *pFile = (struct fs_file_t *)pCtx;
+    int32_t res = fs_seek(pFile, 0, FS_SEEK_END);
+    off_t end = fs_tell(pFile);
+    if (res == 0 && end >= 0 && offset + len > (uint32_t)end) {
+        // The file grows
+        extFsFreeAdjust(-(int32_t)(offset + len - end));
+    }
+    if (res == 0) {
+        res = fs_seek(pFile, offset, FS_SEEK_SET);
+    }
+    if (res == 0) {
+        res = fs_write(pFile, pData, len) == (ssize_t)len ? 0 : -EIO;
+    }
+    return res;
+}
+
+static int32_t fileSync(void *pCtx)
+{
+    return fs_sync((struct fs_file_t *)pCtx);
+}
+
+const tsStoreIo_t *tsStoreFileOpen(tsStoreFile_t *pFile, const char *filePath)
+{
+    fs_file_t_init(&pFile->file);
+    if (fs_open(&pFile->file, filePath, FS_O_CREATE | FS_O_RDWR) != 0) {
+        return NULL;
+    }
+    pFile->io.read = fileRead;
+    pFile->io.write = fileWrite;
+    pFile->io.sync = fileSync;
+    pFile->io.pCtx = &pFile->file;
+    return &pFile->io;
+}
+
+void tsStoreFileClose(tsStoreFile_t *pFile)
+{
+    fs_close(&pFile->file);
+}
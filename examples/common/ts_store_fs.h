@@ -0,0 +1,44 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Storage of a time series store in a file on the external flash
+ * file system.
+ */
+
+#include <fs/fs.h>
+
+#include "ts_store.h"
+
+typedef struct {
+    struct fs_file_t file;
+    tsStoreIo_t io;
+} tsStoreFile_t;
+
+/**
+ * Open or create the file of a store.
+ * @param   pFile     The file.
+ * @param   filePath  Complete file name path.
+ * @return            The storage to give to tsStoreOpen or NULL
+ *                    if the file could not be opened.
+ */
+const tsStoreIo_t *tsStoreFileOpen(tsStoreFile_t *pFile, const char *filePath);
+
+/**
+ * Close the file of a store. The store should be flushed first.
+ * @param   pFile     The file.
+ */
+void tsStoreFileClose(tsStoreFile_t *pFile);
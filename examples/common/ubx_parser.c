@@ -0,0 +1,174 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "ubx_parser.h"
+
+#define UBX_SYNC1 0xB5
+#define UBX_SYNC2 0x62
+
+// Scratch area used for frames which can't be stored
+static uint8_t gDiscard[UBX_HEADER_SIZE];
+
+static size_t nextIndex(const ubxParser_t *pParser, size_t index)
+{
+    return (index + 1) < pParser->frameCnt ? index + 1 : 0;
+}
+
+static bool checksumOk(const uint8_t *pFrame, size_t len)
+{
+    uint8_t ckA = 0;
+    uint8_t ckB = 0;
+    // Checksum covers class, id, length and payload
+    for (size_t i = 2; i < len - UBX_CHECKSUM_SIZE; i++) {
+        ckA += pFrame[i];
+        ckB += ckA;
+    }
+    return ckA == pFrame[len - 2] && ckB == pFrame[len - 1];
+}
+
+void ubxParserInit(ubxParser_t *pParser, ubxFrame_t *pFrames, size_t frameCnt)
+{
+    memset(pParser, 0, sizeof(*pParser));
+    pParser->pFrames = pFrames;
+    pParser->frameCnt = frameCnt;
+}
+
+uint8_t *ubxParserReserve(ubxParser_t *pParser)
+{
+    if (nextIndex(pParser, pParser->head) == pParser->tail) {
+        return NULL;
+    }
+    return pParser->pFrames[pParser->head].data;
+}
+
+bool ubxParserCommit(ubxParser_t *pParser, size_t len, uint32_t timestampMs)
+{
+    ubxFrame_t *pFrame = &pParser->pFrames[pParser->head];
+    bool ok = len >= UBX_HEADER_SIZE + UBX_CHECKSUM_SIZE &&
+              len <= sizeof(pFrame->data) &&
+              pFrame->data[0] == UBX_SYNC1 && pFrame->data[1] == UBX_SYNC2 &&
+              (size_t)(pFrame->data[4] | (pFrame->data[5] << 8)) ==
+              len - UBX_HEADER_SIZE - UBX_CHECKSUM_SIZE;
+    if (!ok) {
+        // Not a frame, or one cut short or overflowing the slot
+        pParser->stats.rejected++;
+    } else if (checksumOk(pFrame->data, len)) {
+        pFrame->length = len;
+        pFrame->timestampMs = timestampMs;
+        pParser->head = nextIndex(pParser, pParser->head);
+        pParser->stats.frames++;
+    } else {
+        pParser->stats.checksumErrors++;
+        ok = false;
+    }
+    return ok;
+}
+
+size_t ubxParserFeed(ubxParser_t *pParser, const uint8_t *pData, size_t len,
+                     uint32_t timestampMs)
+{
+    size_t completed = 0;
+    pParser->stats.bytes += len;
+    while (len > 0) {
+        if (pParser->pos < 2) {
+            // Hunt for the sync characters
+            uint8_t sync = pParser->pos == 0 ? UBX_SYNC1 : UBX_SYNC2;
+            if (*pData == sync) {
+                pParser->pos++;
+            } else {
+                pParser->pos = *pData == UBX_SYNC1 ? 1 : 0;
+            }
+            pData++;
+            len--;
+            continue;
+        }
+        if (pParser->pos < UBX_HEADER_SIZE) {
+            // Buffer the header in the next slot if there is room,
+            // otherwise in the discard area just to get the length
+            if (pParser->pos == 2) {
+                pParser->storing = ubxParserReserve(pParser) != NULL;
+            }
+            uint8_t *pHeader = pParser->storing ?
+                               pParser->pFrames[pParser->head].data : gDiscard;
+            pHeader[0] = UBX_SYNC1;
+            pHeader[1] = UBX_SYNC2;
+            pHeader[pParser->pos++] = *pData++;
+            len--;
+            if (pParser->pos == UBX_HEADER_SIZE) {
+                size_t payloadLen = pHeader[4] | (pHeader[5] << 8);
+                pParser->expected = UBX_HEADER_SIZE + payloadLen + UBX_CHECKSUM_SIZE;
+                if (payloadLen > UBX_MAX_PAYLOAD) {
+                    // Most likely a false sync, start hunting again
+                    pParser->stats.oversize++;
+                    pParser->pos = 0;
+                } else if (!pParser->storing) {
+                    pParser->stats.dropped++;
+                }
+            }
+            continue;
+        }
+        // Payload and checksum, copy as much as possible in one go
+        size_t cnt = pParser->expected - pParser->pos;
+        if (cnt > len) {
+            cnt = len;
+        }
+        if (pParser->storing) {
+            memcpy(&pParser->pFrames[pParser->head].data[pParser->pos], pData, cnt);
+        }
+        pParser->pos += cnt;
+        pData += cnt;
+        len -= cnt;
+        if (pParser->pos == pParser->expected) {
+            if (pParser->storing &&
+                ubxParserCommit(pParser, pParser->expected, timestampMs)) {
+                completed++;
+            }
+            pParser->pos = 0;
+            pParser->storing = false;
+        }
+    }
+    return completed;
+}
+
+const ubxFrame_t *ubxParserPeek(ubxParser_t *pParser)
+{
+    if (pParser->tail == pParser->head) {
+        return NULL;
+    }
+    return &pParser->pFrames[pParser->tail];
+}
+
+void ubxParserRelease(ubxParser_t *pParser)
+{
+    if (pParser->tail != pParser->head) {
+        pParser->tail = nextIndex(pParser, pParser->tail);
+    }
+}
+
+bool ubxFrameIs(const ubxFrame_t *pFrame, uint8_t msgClass, uint8_t msgId)
+{
+    return pFrame->data[2] == msgClass && pFrame->data[3] == msgId;
+}
+
+const uint8_t *ubxFramePayload(const ubxFrame_t *pFrame, size_t *pLen)
+{
+    if (pLen) {
+        *pLen = pFrame->length - UBX_HEADER_SIZE - UBX_CHECKSUM_SIZE;
+    }
+    return &pFrame->data[UBX_HEADER_SIZE];
+}
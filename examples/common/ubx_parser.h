@@ -0,0 +1,201 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Streaming parser for binary UBX messages. Messages are parsed
+ * straight into the slots of a ring buffer which are then read in
+ * place by the consumer. The module has no dependencies to Zephyr
+ * or ubxlib and can be built on a host for testing against
+ * recorded UBX captures.
+ *
+ * The ring has a single producer and a single consumer which may
+ * be in different threads.
+ *
+ * Frames are put into the ring in one of two ways. ubxParserFeed
+ * finds the frames in a raw byte stream, e.g. when reading the UART
+ * directly or a recorded capture, as the host test does. When the
+ * frames are already separated, as by the ubxlib message receive
+ * callback in the ubx_stream example, each one is read into a slot
+ * from ubxParserReserve and checked by ubxParserCommit.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define UBX_CLASS_NAV    0x01
+#define UBX_ID_NAV_PVT   0x07
+#define UBX_ID_NAV_SAT   0x35
+
+#define UBX_HEADER_SIZE   6
+#define UBX_CHECKSUM_SIZE 2
+// Room for a NAV-SAT message with the most satellites numSvs can
+// give, a receiver tracking all constellations can list over 64
+#define UBX_NAV_SAT_HEADER_SIZE 8
+#define UBX_NAV_SAT_SV_SIZE 12
+#define UBX_MAX_PAYLOAD  (UBX_NAV_SAT_HEADER_SIZE + 255 * UBX_NAV_SAT_SV_SIZE)
+
+/** UBX-NAV-PVT payload, little endian as received. */
+typedef struct __attribute__((packed)) {
+    uint32_t iTOW;
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t min;
+    uint8_t sec;
+    uint8_t valid;
+    uint32_t tAcc;
+    int32_t nano;
+    uint8_t fixType;
+    uint8_t flags;
+    uint8_t flags2;
+    uint8_t numSV;
+    int32_t lon;
+    int32_t lat;
+    int32_t height;
+    int32_t hMSL;
+    uint32_t hAcc;
+    uint32_t vAcc;
+    int32_t velN;
+    int32_t velE;
+    int32_t velD;
+    int32_t gSpeed;
+    int32_t headMot;
+    uint32_t sAcc;
+    uint32_t headAcc;
+    uint16_t pDOP;
+    uint16_t flags3;
+    uint8_t reserved0[4];
+    int32_t headVeh;
+    int16_t magDec;
+    uint16_t magAcc;
+} ubxNavPvt_t;
+
+/** One satellite in a UBX-NAV-SAT message. */
+typedef struct __attribute__((packed)) {
+    uint8_t gnssId;
+    uint8_t svId;
+    uint8_t cno;
+    int8_t elev;
+    int16_t azim;
+    int16_t prRes;
+    uint32_t flags;
+} ubxNavSatSv_t;
+
+/** UBX-NAV-SAT payload. */
+typedef struct __attribute__((packed)) {
+    uint32_t iTOW;
+    uint8_t version;
+    uint8_t numSvs;
+    uint8_t reserved0[2];
+    ubxNavSatSv_t sv[];
+} ubxNavSat_t;
+
+/** A complete UBX message including header and checksum. */
+typedef struct {
+    uint32_t timestampMs;
+    uint16_t length;  // Total length of data below
+    uint8_t data[UBX_HEADER_SIZE + UBX_MAX_PAYLOAD + UBX_CHECKSUM_SIZE];
+} ubxFrame_t;
+
+typedef struct {
+    uint32_t bytes;           // Total bytes fed
+    uint32_t frames;          // Valid frames put into the ring
+    uint32_t checksumErrors;  // Frames with bad checksum
+    uint32_t rejected;        // Committed frames with bad sync or length
+    uint32_t oversize;        // Frames too large for a ring slot
+    uint32_t dropped;         // Frames lost due to a full ring
+} ubxStats_t;
+
+typedef struct {
+    ubxFrame_t *pFrames;
+    size_t frameCnt;
+    volatile size_t head;  // Written by the producer only
+    volatile size_t tail;  // Written by the consumer only
+    // Stream parser state
+    uint16_t pos;
+    uint16_t expected;
+    bool storing;
+    ubxStats_t stats;
+} ubxParser_t;
+
+/**
+ * Initiate a parser.
+ * @param   pParser   The parser.
+ * @param   pFrames   Ring buffer slots.
+ * @param   frameCnt  Number of slots, one is always kept free.
+ */
+void ubxParserInit(ubxParser_t *pParser, ubxFrame_t *pFrames, size_t frameCnt);
+
+/**
+ * Feed raw bytes from the receiver, e.g. the UART stream.
+ * Bytes outside of UBX frames, like NMEA, are skipped.
+ * @param   pParser      The parser.
+ * @param   pData        Received data.
+ * @param   len          Length of the data.
+ * @param   timestampMs  Time stamp to set on completed frames.
+ * @return               Number of frames put into the ring.
+ */
+size_t ubxParserFeed(ubxParser_t *pParser, const uint8_t *pData, size_t len,
+                     uint32_t timestampMs);
+
+/**
+ * Reserve the next free ring slot for a reader which already
+ * delivers complete frames. Fill the data and then call ubxParserCommit().
+ * @param   pParser  The parser.
+ * @return           Pointer to the slot data or NULL if the ring is full.
+ */
+uint8_t *ubxParserReserve(ubxParser_t *pParser);
+
+/**
+ * Validate and commit a complete frame written to the reserved slot.
+ * @param   pParser      The parser.
+ * @param   len          Length of the frame.
+ * @param   timestampMs  Time stamp of the frame.
+ * @return               True if the frame was valid and committed.
+ */
+bool ubxParserCommit(ubxParser_t *pParser, size_t len, uint32_t timestampMs);
+
+/**
+ * Get the oldest frame in the ring without removing it.
+ * @param   pParser  The parser.
+ * @return           Pointer to the frame or NULL if empty.
+ */
+const ubxFrame_t *ubxParserPeek(ubxParser_t *pParser);
+
+/**
+ * Remove the oldest frame from the ring.
+ * @param   pParser  The parser.
+ */
+void ubxParserRelease(ubxParser_t *pParser);
+
+/**
+ * Check the message type of a frame.
+ * @param   pFrame    The frame.
+ * @param   msgClass  UBX message class.
+ * @param   msgId     UBX message id.
+ * @return            True if matching.
+ */
+bool ubxFrameIs(const ubxFrame_t *pFrame, uint8_t msgClass, uint8_t msgId);
+
+/**
+ * Get the payload of a frame.
+ * @param   pFrame  The frame.
+ * @param   pLen    Place to put the payload length, can be NULL.
+ * @return          Pointer to the payload within the frame.
+ */
+const uint8_t *ubxFramePayload(const ubxFrame_t *pFrame, size_t *pLen);
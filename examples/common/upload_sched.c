@@ -0,0 +1,214 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include <kernel.h>
+
+#include "upload_sched.h"
+
+static uDeviceHandle_t gDevHandle;
+static const uploadSchedCfg_t *gpCfg;
+static char gBatch[UPLOAD_SCHED_BATCH_SIZE];
+static size_t gLen = 0;
+static uint32_t gCnt = 0;
+static size_t gLastSampleLen = 0;
+static uploadSchedStats_t gStats;
+// Times in ms since boot
+static int64_t gInitTime;
+static int64_t gLastEnd;         // End of the last upload
+static int64_t gAccounted;       // Energy estimated up to here
+static int64_t gUploadStart;
+// Estimated energy in nJ
+static uint64_t gEnergyNj;
+static uint64_t gConnectedMs;
+static uint64_t gIdleMs;
+static uint64_t gSleepMs;
+
+static uint64_t nJ(uint32_t uA, uint64_t ms)
+{
+    return uA * UPLOAD_SCHED_VOLTAGE_MV * ms / 1000;
+}
+
+// Length of the part of [start, end) within [from, to)
+static uint64_t overlap(int64_t start, int64_t end, int64_t from, int64_t to)
+{
+    int64_t s = MAX(start, from);
+    int64_t e = MIN(end, to);
+    return e > s ? e - s : 0;
+}
+
+// Estimate the energy since the last estimate. After an upload the
+// modem stays connected until released by the network, then idle for
+// the active time and then sleeps until the next upload.
+static void account(int64_t now)
+{
+    int64_t released = gLastEnd + UPLOAD_SCHED_RELEASE_MS;
+    int64_t asleep = gStats.psm ? released + gStats.activeTimeS * 1000LL : INT64_MAX;
+    uint64_t connected = overlap(gAccounted, now, gLastEnd, released);
+    uint64_t idle = overlap(gAccounted, now, released, asleep);
+    uint64_t sleep = overlap(gAccounted, now, asleep, INT64_MAX);
+    gConnectedMs += connected;
+    gIdleMs += idle;
+    gSleepMs += sleep;
+    gEnergyNj += nJ(UPLOAD_SCHED_CONNECTED_UA, connected) +
+                 nJ(gStats.eDrx ? UPLOAD_SCHED_IDLE_EDRX_UA : UPLOAD_SCHED_IDLE_UA, idle) +
+                 nJ(UPLOAD_SCHED_SLEEP_UA, sleep);
+    gAccounted = now;
+}
+
+// Get the power saving values assigned by the network
+static void readAssigned()
+{
+    int32_t active = -1;
+    int32_t periodic = -1;
+    if (uCellPwrGet3gppPowerSaving(gDevHandle, &gStats.psm, &active, &periodic) == 0) {
+        gStats.activeTimeS = active;
+        gStats.periodicWakeupS = periodic;
+    } else {
+        gStats.psm = false;
+    }
+    int32_t requested;
+    int32_t eDrx = -1;
+    int32_t pagingWindow = -1;
+    if (uCellPwrGetEDrx(gDevHandle, U_CELL_NET_RAT_CATM1, &gStats.eDrx,
+                        &requested, &eDrx, &pagingWindow) == 0) {
+        gStats.eDrxS = eDrx;
+        gStats.pagingWindowS = pagingWindow;
+    } else {
+        gStats.eDrx = false;
+    }
+    uint32_t period = gpCfg->uploadPeriodS;
+    if (gStats.psm && gStats.periodicWakeupS > 0 && (uint32_t)gStats.periodicWakeupS < period) {
+        // The modem wakes up anyway, send a batch each time
+        period = gStats.periodicWakeupS;
+    }
+    gStats.uploadPeriodS = period;
+}
+
+int32_t uploadSchedInit(uDeviceHandle_t devHandle, const uploadSchedCfg_t *pCfg)
+{
+    gDevHandle = devHandle;
+    gpCfg = pCfg;
+    gLen = 0;
+    gCnt = 0;
+    memset(&gStats, 0, sizeof(gStats));
+    gStats.uploadPeriodS = pCfg->uploadPeriodS;
+    gInitTime = k_uptime_get();
+    gLastEnd = gInitTime;
+    gAccounted = gInitTime;
+    gEnergyNj = 0;
+    gConnectedMs = 0;
+    gIdleMs = 0;
+    gSleepMs = 0;
+    bool psm = pCfg->activeTimeS >= 0;
+    // Twice the upload period so the modem doesn't wake up in between
+    int32_t errorCode = uCellPwrSetRequested3gppPowerSaving(devHandle, U_CELL_NET_RAT_CATM1, psm,
+                                                            psm ? pCfg->activeTimeS : 0,
+                                                            psm ? pCfg->uploadPeriodS * 2 : 0);
+    if (errorCode == 0) {
+        // Network default paging window
+        errorCode = uCellPwrSetRequestedEDrx(devHandle, U_CELL_NET_RAT_CATM1, pCfg->eDrxS > 0,
+                                             pCfg->eDrxS, -1);
+    }
+    if (errorCode == 0 && uCellPwrRebootIsRequired(devHandle)) {
+        errorCode = uCellPwrReboot(devHandle, NULL);
+    }
+    return errorCode;
+}
+
+bool uploadSchedAdd(const char *pSample)
+{
+    size_t len = strlen(pSample);
+    // Separator or brackets, and the terminator
+    if (gLen + len + 3 > sizeof(gBatch)) {
+        return false;
+    }
+    gBatch[gLen++] = gCnt == 0 ? '[' : ',';
+    memcpy(&gBatch[gLen], pSample, len);
+    gLen += len;
+    gCnt++;
+    gLastSampleLen = len;
+    return true;
+}
+
+uint32_t uploadSchedDueMs(uint32_t nextSampleMs)
+{
+    int64_t due = gLastEnd + gStats.uploadPeriodS * 1000LL;
+    int64_t left = MAX(due - k_uptime_get(), 0);
+    if (gCnt == 0) {
+        // Nothing to send
+        return MAX(left, nextSampleMs);
+    }
+    if ((left <= nextSampleMs || gLen + gLastSampleLen + 3 > sizeof(gBatch))) {
+        // Send now rather than waking up the modem between samples
+        return 0;
+    }
+    return left;
+}
+
+int32_t uploadSchedBegin(const char **ppData, size_t *pLen)
+{
+    if (gCnt == 0) {
+        return -ENODATA;
+    }
+    gUploadStart = k_uptime_get();
+    account(gUploadStart);
+    gBatch[gLen] = ']';
+    gBatch[gLen + 1] = 0;
+    *ppData = gBatch;
+    *pLen = gLen + 1;
+    // Any request to the module wakes it up from deep sleep
+    return 0;
+}
+
+void uploadSchedEnd(bool success)
+{
+    int64_t now = k_uptime_get();
+    uint64_t connected = now - gUploadStart;
+    gConnectedMs += connected;
+    gEnergyNj += nJ(UPLOAD_SCHED_CONNECTED_UA, connected);
+    gStats.lastUploadMs = connected;
+    gLastEnd = now;
+    gAccounted = now;
+    gStats.uploads++;
+    if (success) {
+        gStats.samples += gCnt;
+        gLen = 0;
+        gCnt = 0;
+        // The network can change the values at any update
+        readAssigned();
+    } else {
+        gStats.failed++;
+    }
+}
+
+void uploadSchedGetStats(uploadSchedStats_t *pStats)
+{
+    int64_t now = k_uptime_get();
+    account(now);
+    gStats.connectedS = gConnectedMs / 1000;
+    gStats.idleS = gIdleMs / 1000;
+    gStats.sleepS = gSleepMs / 1000;
+    gStats.energyMj = gEnergyNj / 1000000;
+    if (gStats.samples > 0) {
+        gStats.uJPerSample = gEnergyNj / 1000 / gStats.samples;
+        gStats.alwaysOnUjPerSample = nJ(UPLOAD_SCHED_CONNECTED_UA, now - gInitTime) / 1000 /
+                                     gStats.samples;
+    }
+    *pStats = gStats;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Scheduling of batched uploads over cellular with 3GPP power saving.
+ *
+ * Samples are collected in a batch in RAM while the modem sleeps in
+ * PSM. The modem is only woken for uploading a batch, after which it
+ * stays reachable for the active time (T3324), optionally with eDRX,
+ * and then goes back to sleep.
+ *
+ * The periodic wake up (T3412) is requested longer than the upload
+ * period, so the modem normally never wakes just for a tracking area
+ * update. If the network assigns a shorter periodic wake up the
+ * upload period is shortened to it, so each wake up carries a batch.
+ * The network may change the assigned values, they are read again
+ * after each upload.
+ *
+ * The energy used by the modem is estimated from the time spent
+ * connected, idle and sleeping, with the typical currents below.
+ * Replace them with measured values for battery sizing.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ubxlib.h"
+
+// Must fit in one MQTT message
+#define UPLOAD_SCHED_BATCH_SIZE 1024
+
+// Estimated SARA-R5 supply currents at 3.8 V, LTE-M
+#define UPLOAD_SCHED_VOLTAGE_MV 3800
+#define UPLOAD_SCHED_SLEEP_UA 2          // PSM deep sleep
+#define UPLOAD_SCHED_IDLE_UA 1000        // Idle with normal paging
+#define UPLOAD_SCHED_IDLE_EDRX_UA 200    // Idle with eDRX
+#define UPLOAD_SCHED_CONNECTED_UA 90000  // Connected, including transmission
+// Time connected after the last data, until the network releases the connection
+#define UPLOAD_SCHED_RELEASE_MS 10000
+
+typedef struct {
+    uint32_t uploadPeriodS;    // Longest time between uploads
+    int32_t activeTimeS;       // Requested active time after an upload, -1 for no PSM
+    int32_t eDrxS;             // Requested eDRX cycle, zero for none
+} uploadSchedCfg_t;
+
+typedef struct {
+    // Power saving assigned by the network
+    bool psm;
+    int32_t activeTimeS;
+    int32_t periodicWakeupS;
+    bool eDrx;
+    int32_t eDrxS;
+    int32_t pagingWindowS;
+    uint32_t uploadPeriodS;    // Used, aligned to the periodic wake up
+    // Uploads
+    uint32_t uploads;
+    uint32_t failed;
+    uint32_t samples;          // Uploaded
+    uint32_t lastUploadMs;     // Duration of the last upload including wake up
+    // Estimated modem state times and energy since uploadSchedInit
+    uint32_t connectedS;
+    uint32_t idleS;
+    uint32_t sleepS;
+    uint32_t energyMj;
+    uint32_t uJPerSample;
+    // Energy per sample if the modem was kept connected, for comparison
+    uint32_t alwaysOnUjPerSample;
+} uploadSchedStats_t;
+
+/**
+ * Request the power saving settings. Must be called before the
+ * network is brought up, as the module is restarted if needed
+ * for the settings to take effect.
+ * @param   devHandle  Handle of an opened cellular device.
+ * @param   pCfg       The configuration, must be kept.
+ * @return             Zero on success or negative error code.
+ */
+int32_t uploadSchedInit(uDeviceHandle_t devHandle, const uploadSchedCfg_t *pCfg);
+
+/**
+ * Add a sample to the batch.
+ * @param   pSample  The sample, e.g. a JSON value. Samples are
+ *                   separated by commas within brackets.
+ * @return           False if there was no room, upload first.
+ */
+bool uploadSchedAdd(const char *pSample);
+
+/**
+ * Get the time until the next upload.
+ * @param   nextSampleMs  Time until the next sample will be added. An
+ *                        upload is due now if that sample wouldn't fit
+ *                        or the upload period would pass before it.
+ * @return                Milliseconds until the next upload, zero when
+ *                        it is due.
+ */
+uint32_t uploadSchedDueMs(uint32_t nextSampleMs);
+
+/**
+ * Start an upload, waking the modem if needed.
+ * @param   ppData   Place to put a pointer to the batch.
+ * @param   pLen     Place to put the length of the batch.
+ * @return           Zero on success or negative error code.
+ */
+int32_t uploadSchedBegin(const char **ppData, size_t *pLen);
+
+/**
+ * Complete an upload. The batch is emptied if it succeeded, else
+ * it is kept for the next try.
+ * @param   success  True if the batch was delivered.
+ */
+void uploadSchedEnd(bool success);
+
+/**
+ * Get the statistics and energy estimate.
+ * @param   pStats   Place to put the statistics.
+ */
+void uploadSchedGetStats(uploadSchedStats_t *pStats);
@@ -26,23 +26,16 @@
 #include <stdio.h>
 
 #include "ext_fs.h"
+#include "counters.h"
 
 void showBootCount(void)
 {
-    const char *path = extFsPath("boot_count");
-    struct fs_file_t file;
-    fs_file_t_init(&file);
-    if (fs_open(&file, path, FS_O_CREATE | FS_O_RDWR) < 0) {
-        printf("Failed to open boot count file\n");
+    int32_t errorCode = countersInit();
+    if (errorCode != 0) {
+        printf("Failed to initiate the counters: %d\n", errorCode);
         return;
     }
-    uint32_t bootCnt = 0;
-    fs_read(&file, &bootCnt, sizeof(bootCnt));
-    printf("Boot count: %u\n", bootCnt);
-    fs_seek(&file, 0, FS_SEEK_SET);
-    bootCnt++;
-    fs_write(&file, &bootCnt, sizeof(bootCnt));
-    fs_close(&file);
+    printf("Boot count: %u\n", counterAdd(COUNTER_BOOT, 1));
 }
 
 void creatOneFile()
@@ -57,10 +50,71 @@ void creatOneFile()
     }
 }
 
+// Log many small records, as a typical logging application
+void writeLog()
+{
+    static extFsWriter_t writer;
+    const char *path = extFsPath("log.txt");
+    if (!extFsWriterOpen(&writer, path, true)) {
+        printf("Failed to open log file\n");
+        return;
+    }
+    char record[32];
+    uint32_t start = k_uptime_get_32();
+    for (int i = 0; i < 1000; i++) {
+        int len = snprintf(record, sizeof(record), "%08u %6d\n", k_uptime_get_32(), i);
+        extFsWriterAppend(&writer, record, len);
+    }
+    extFsWriterClose(&writer);
+    printf("Log: %u appends of %u bytes in %u ms\n", writer.appends,
+           writer.appendedBytes, k_uptime_get_32() - start);
+    printf("     %u file system writes of %u bytes, %u syncs\n", writer.writes,
+           writer.writtenBytes, writer.syncs);
+}
+
+// Rotated log segments, the oldest are removed when there are too many
+#define LOG_SEGMENTS_MAX 16
+#define LOG_SEGMENTS_PER_BOOT 3
+
+void rotateLogs()
+{
+    static extFsIndexEntry_t entries[LOG_SEGMENTS_MAX + 1];
+    static extFsIndex_t index;
+    uint32_t start = k_uptime_get_32();
+    if (!extFsIndexInit(&index, "logs", "seg_", ".txt", entries, ARRAY_SIZE(entries))) {
+        printf("Failed to index the log directory\n");
+        return;
+    }
+    printf("Indexed %u log segments, %u bytes, in %u ms\n", index.cnt,
+           index.totalSize, k_uptime_get_32() - start);
+    extFsIndexEntry_t entry;
+    uint32_t seq = extFsIndexNewest(&index, &entry) ? entry.seq + 1 : 0;
+    extFsPath_t path;
+    for (int i = 0; i < LOG_SEGMENTS_PER_BOOT; i++, seq++) {
+        static extFsWriter_t writer;
+        if (extFsWriterOpen(&writer, extFsIndexPath(&index, seq, path), true)) {
+            char record[32];
+            int len = snprintf(record, sizeof(record), "Segment %u\n", seq);
+            extFsWriterAppend(&writer, record, len);
+            extFsWriterClose(&writer);
+        }
+        while (index.cnt > LOG_SEGMENTS_MAX && extFsIndexOldest(&index, &entry)) {
+            extFsDelete(extFsIndexPath(&index, entry.seq, path));
+        }
+    }
+    extFsIndexEntry_t oldest;
+    if (extFsIndexOldest(&index, &oldest) && extFsIndexNewest(&index, &entry)) {
+        printf("Log segments %u to %u\n", oldest.seq, entry.seq);
+    }
+    extFsIndexDeinit(&index);
+}
+
 void main()
 {
     if (extFsInit()) {
         creatOneFile();
+        writeLog();
+        rotateLogs();
         extFSList();
         showBootCount();
     } else {
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *
+ * Benchmark of LittleFS on the external flash of the XPLR-IOT-1.
+ *
+ * The file system is mounted with a number of different cache,
+ * prog size and lookahead settings. For each the mount time,
+ * sequential write and read throughput, small record append rate
+ * and exact free space query time are measured.
+ *
+ * The profiles in the config directory are unmeasured starting
+ * points. Run this on the device to check them, or to choose other
+ * settings, before relying on one. A profile is selected by adding
+ * this to the CMakeLists.txt of an example using the file system:
+ *
+ * set(EXT_FS_PROFILE throughput)
+ *
+ * Block cycles are not benchmarked. They only affect how metadata
+ * blocks are moved after many erase cycles, which a single 256 kB
+ * pass doesn't reach.
+ *
+ * The file system contents are kept, only a benchmark file is
+ * created and removed.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <fs/littlefs.h>
+
+#include "ext_fs.h"
+
+#define BENCH_FILE "/lfs/bench.bin"
+#define SEQ_SIZE (256 * 1024)
+#define SEQ_CHUNK 4096
+#define RECORD_CNT 1000
+#define RECORD_SIZE 16
+// Sync after this many records, as a logger would
+#define RECORDS_PER_SYNC 50
+
+// Read size, prog size, cache size and lookahead size in bytes.
+// The buffers are static so each combination needs its own.
+FS_LITTLEFS_DECLARE_CUSTOM_CONFIG(gLfsDefault, 16, 16, 64, 32);
+FS_LITTLEFS_DECLARE_CUSTOM_CONFIG(gLfsCache512, 16, 16, 512, 32);
+FS_LITTLEFS_DECLARE_CUSTOM_CONFIG(gLfsProg256, 16, 256, 1024, 256);
+FS_LITTLEFS_DECLARE_CUSTOM_CONFIG(gLfsCache4k, 16, 256, 4096, 256);
+
+typedef struct {
+    const char *pName;
+    struct fs_littlefs *pLfs;
+} benchConfig_t;
+
+static const benchConfig_t gConfigs[] = {
+    {"cache 64, prog 16, la 32", &gLfsDefault},
+    {"cache 512, prog 16, la 32", &gLfsCache512},
+    {"cache 1k, prog 256, la 256", &gLfsProg256},
+    {"cache 4k, prog 256, la 256", &gLfsCache4k},
+};
+
+typedef struct {
+    uint32_t mountUs;
+    uint32_t writeKBs;
+    uint32_t readKBs;
+    uint32_t appendsPerS;
+    uint32_t freeUs;
+    int32_t freeKb;
+} benchResult_t;
+
+static struct fs_mount_t gBenchMount = {
+    .type = FS_LITTLEFS,
+    .mnt_point = "/lfs",
+};
+
+static uint8_t gBuffer[SEQ_CHUNK];
+
+static uint32_t usSince(uint32_t startCycles)
+{
+    return k_cyc_to_us_floor32(k_cycle_get_32() - startCycles);
+}
+
+static uint32_t kBs(uint32_t bytes, uint32_t ms)
+{
+    return ms > 0 ? bytes / ms : 0;
+}
+
+static bool seqWrite(benchResult_t *pResult)
+{
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    if (fs_open(&file, BENCH_FILE, FS_O_CREATE | FS_O_WRITE) != 0) {
+        return false;
+    }
+    bool ok = true;
+    uint32_t start = k_uptime_get_32();
+    for (uint32_t i = 0; ok && i < SEQ_SIZE / SEQ_CHUNK; i++) {
+        memset(gBuffer, i, sizeof(gBuffer));
+        ok = fs_write(&file, gBuffer, sizeof(gBuffer)) == sizeof(gBuffer);
+    }
+    ok = fs_close(&file) == 0 && ok;
+    pResult->writeKBs = kBs(SEQ_SIZE, k_uptime_get_32() - start);
+    return ok;
+}
+
+static bool seqRead(benchResult_t *pResult)
+{
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    if (fs_open(&file, BENCH_FILE, FS_O_READ) != 0) {
+        return false;
+    }
+    bool ok = true;
+    uint32_t start = k_uptime_get_32();
+    for (uint32_t i = 0; ok && i < SEQ_SIZE / SEQ_CHUNK; i++) {
+        ok = fs_read(&file, gBuffer, sizeof(gBuffer)) == sizeof(gBuffer) &&
+             gBuffer[0] == (uint8_t)i;
+    }
+    fs_close(&file);
+    pResult->readKBs = kBs(SEQ_SIZE, k_uptime_get_32() - start);
+    return ok;
+}
+
+static bool appendRecords(benchResult_t *pResult)
+{
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    fs_unlink(BENCH_FILE);
+    if (fs_open(&file, BENCH_FILE, FS_O_CREATE | FS_O_WRITE | FS_O_APPEND) != 0) {
+        return false;
+    }
+    bool ok = true;
+    char record[RECORD_SIZE + 1];
+    uint32_t start = k_uptime_get_32();
+    for (int i = 0; ok && i < RECORD_CNT; i++) {
+        snprintf(record, sizeof(record), "%015d", i);
+        ok = fs_write(&file, record, RECORD_SIZE) == RECORD_SIZE;
+        if (ok && (i + 1) % RECORDS_PER_SYNC == 0) {
+            ok = fs_sync(&file) == 0;
+        }
+    }
+    ok = fs_close(&file) == 0 && ok;
+    uint32_t time = MAX(k_uptime_get_32() - start, 1);
+    pResult->appendsPerS = RECORD_CNT * 1000 / time;
+    return ok;
+}
+
+static bool runConfig(const benchConfig_t *pConfig, benchResult_t *pResult)
+{
+    gBenchMount.fs_data = pConfig->pLfs;
+    uint32_t start = k_cycle_get_32();
+    int err = fs_mount(&gBenchMount);
+    pResult->mountUs = usSince(start);
+    if (err != 0) {
+        printf("* Failed to mount: %d\n", err);
+        return false;
+    }
+    fs_unlink(BENCH_FILE);
+    bool ok = seqWrite(pResult) && seqRead(pResult) && appendRecords(pResult);
+    fs_unlink(BENCH_FILE);
+    // The benchmark file is written around ext_fs, the exact query also
+    // sets the free space estimate again now it's removed
+    start = k_cycle_get_32();
+    pResult->freeKb = extFsFreeExact();
+    pResult->freeUs = usSince(start);
+    fs_unmount(&gBenchMount);
+    return ok;
+}
+
+void main()
+{
+    // Mount once the normal way to get the storage device
+    if (!extFsInit()) {
+        printf("* Failed to mount the file system\n");
+        return;
+    }
+    extFsStats_t stats;
+    extFsFree();
+    extFsGetStats(&stats);
+    printf("Default mount %u us, first free space query %u us\n",
+           stats.mountUs, stats.statvfsUs);
+    gBenchMount.storage_dev = extFsMountPoint()->storage_dev;
+    fs_unmount(extFsMountPoint());
+
+    printf("\n%-27s %8s %8s %8s %9s %8s %8s\n", "Configuration",
+           "mount", "write", "read", "appends", "free", "free");
+    printf("%-27s %8s %8s %8s %9s %8s %8s\n", "",
+           "us", "kB/s", "kB/s", "/s", "us", "kB");
+    for (size_t i = 0; i < ARRAY_SIZE(gConfigs); i++) {
+        benchResult_t result = {0};
+        bool ok = runConfig(&gConfigs[i], &result);
+        printf("%-27s %8u %8u %8u %9u %8u %8d%s\n", gConfigs[i].pName,
+               result.mountUs, result.writeKBs,
+               result.readKBs, result.appendsPerS, result.freeUs,
+               result.freeKb, ok ? "" : " *failed");
+    }
+    printf("\n== All done ==\n");
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *
+ * A demo application for an asset tracker which only uses
+ * the GNSS when the device is moving. The accelerometer is used
+ * to detect motion and the GNSS is powered on only then. Positions
+ * are evaluated against geofences on the device and a mqtt message
+ * is published only when a fence is entered or exited.
+ *
+ * The accelerometer is polled at 10 Hz since its interrupt is not
+ * available, so the host cpu doesn't sleep as deeply while still as
+ * it would with an activity interrupt. The GNSS, which is turned
+ * off meanwhile, is by far the larger saving.
+ *
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "ubxlib.h"
+
+#include "sensors.h"
+#include "leds.h"
+#include "geofence.h"
+
+#define BROKER_NAME "test.mosquitto.org"
+
+// Change in acceleration regarded as motion
+#define MOTION_THRESHOLD_MG 100
+// Time without motion before the GNSS is turned off
+#define STILL_TIME_MS 60000
+// Time between position fixes while moving
+#define FIX_INTERVAL_MS 10000
+// Maximum time to wait for a single fix
+#define FIX_TIMEOUT_MS 120000
+
+// Replace with your own fences
+static const geoPoint_t gYard[] = {
+    { 472855000, 85630000 },
+    { 472855000, 85650000 },
+    { 472866000, 85650000 },
+    { 472866000, 85630000 },
+};
+
+static geofence_t gFences[] = {
+    GEOFENCE_CIRCLE_INIT("office", 472860000, 85638000, 150),
+    GEOFENCE_POLYGON_INIT("yard", gYard),
+};
+
+static const uNetworkCfgCell_t gCellNetworkCfg = {
+    .type = U_NETWORK_TYPE_CELL,
+    .pApn = "tsiot",       // Thingstream SIM, use NULL for default
+    .timeoutSeconds = 240  // Connection timeout in seconds
+};
+
+static const uNetworkCfgGnss_t gGnssNetworkCfg = {
+    .type = U_NETWORK_TYPE_GNSS
+};
+
+uDeviceCfg_t gDeviceCfg;
+
+static uPortSemaphoreHandle_t gMotionSem;
+static uMqttClientContext_t *gpMqttContext = NULL;
+static char gTopic[32];
+static uLocation_t gLocation;
+static int64_t gFixDeadline;
+
+// Return longitude/latitude value as string
+static char *locStr(int32_t loc, char *str, size_t size)
+{
+    const char *sign = "";
+    if (loc < 0) {
+        loc = -loc;
+        sign = "-";
+    }
+    snprintf(str, size, "%s%d.%07d",
+             sign, loc / 10000000, loc % 10000000);
+    return str;
+}
+
+// Called from the motion detection thread
+static void motionCallback(bool moving)
+{
+    printf("Device is %s\n", moving ? "moving" : "still");
+    if (moving) {
+        uPortSemaphoreGive(gMotionSem);
+    }
+}
+
+// Stop waiting for a fix when the device has stopped
+static bool keepGoing(uDeviceHandle_t devHandle)
+{
+    (void)devHandle;
+    return sensorsIsMoving() && uPortGetTickTimeMs() < gFixDeadline;
+}
+
+static void fenceTransition(const geofence_t *pFence, bool inside)
+{
+    char message[100];
+    char lat[16];
+    char lon[16];
+    snprintf(message, sizeof(message),
+             "{\"fence\":\"%s\",\"event\":\"%s\",\"lat\":%s,\"lon\":%s}",
+             pFence->pName, inside ? "enter" : "exit",
+             locStr(gLocation.latitudeX1e7, lat, sizeof(lat)),
+             locStr(gLocation.longitudeX1e7, lon, sizeof(lon)));
+    printf("Fence transition: %s\n", message);
+    if (gpMqttContext != NULL) {
+        uMqttClientPublish(gpMqttContext, gTopic, message, strlen(message),
+                           U_MQTT_QOS_EXACTLY_ONCE, false);
+    }
+}
+
+// Connect to the mqtt broker, publishing is optional for the demo
+static void mqttConnect(uDeviceHandle_t cellHandle)
+{
+    gpMqttContext = pUMqttClientOpen(cellHandle, NULL);
+    if (gpMqttContext != NULL) {
+        uMqttClientConnection_t connection = U_MQTT_CLIENT_CONNECTION_DEFAULT;
+        connection.pBrokerNameStr = BROKER_NAME;
+        if (uMqttClientConnect(gpMqttContext, &connection) == 0) {
+            // Get a unique topic name for this device
+            uSecurityGetSerialNumber(cellHandle, gTopic);
+            if (gTopic[0] == '"') {
+                // Remove quotes
+                size_t len = strlen(gTopic);
+                memmove(gTopic, gTopic + 1, len);
+                gTopic[len - 2] = 0;
+            }
+            printf("To view the fence transitions use:\n");
+            printf("mosquitto_sub -h %s -t %s -v\n", BROKER_NAME, gTopic);
+        } else {
+            printf("* Failed to connect to the mqtt broker\n");
+            uMqttClientClose(gpMqttContext);
+            gpMqttContext = NULL;
+        }
+    } else {
+        printf("* Failed to create mqtt instance\n");
+    }
+}
+
+// Track the position until the device has been still for a while
+static void trackWhileMoving(uDeviceHandle_t gnssHandle)
+{
+    int64_t startTime = uPortGetTickTimeMs();
+    int32_t errorCode = uNetworkInterfaceUp(gnssHandle, U_NETWORK_TYPE_GNSS,
+                                            &gGnssNetworkCfg);
+    if (errorCode != 0) {
+        printf("* Failed to bring up the GNSS: %d\n", errorCode);
+        return;
+    }
+    ledSet(BLUE_LED, true);
+    while (sensorsIsMoving()) {
+        gFixDeadline = uPortGetTickTimeMs() + FIX_TIMEOUT_MS;
+        errorCode = uLocationGet(gnssHandle, U_LOCATION_TYPE_GNSS,
+                                 NULL, NULL, &gLocation, keepGoing);
+        if (errorCode == 0) {
+            geoPoint_t pos = {
+                .latitudeX1e7 = gLocation.latitudeX1e7,
+                .longitudeX1e7 = gLocation.longitudeX1e7
+            };
+            geofenceUpdate(gFences, sizeof(gFences) / sizeof(gFences[0]),
+                           &pos, gLocation.radiusMillimetres / 1000,
+                           fenceTransition);
+            uPortTaskBlock(FIX_INTERVAL_MS);
+        }
+    }
+    uNetworkInterfaceDown(gnssHandle, U_NETWORK_TYPE_GNSS);
+    ledSet(BLUE_LED, false);
+    printf("GNSS was on for %lld s\n", (uPortGetTickTimeMs() - startTime) / 1000);
+}
+
+void main()
+{
+    ledsInit();
+    sensorsInit();
+    // Remove the line below if you want the log printouts from ubxlib
+    uPortLogOff();
+    // Initiate ubxlib
+    uPortInit();
+    uDeviceInit();
+    uPortSemaphoreCreate(&gMotionSem, 0, 1);
+    int32_t errorCode;
+    uDeviceHandle_t cellHandle;
+    uDeviceHandle_t gnssHandle;
+    printf("\nInitiating the modules...\n");
+    uDeviceGetDefaults(U_DEVICE_TYPE_CELL, &gDeviceCfg);
+    errorCode = uDeviceOpen(&gDeviceCfg, &cellHandle);
+    if (errorCode == 0) {
+        printf("Bringing up the network...\n");
+        if (uNetworkInterfaceUp(cellHandle, U_NETWORK_TYPE_CELL, &gCellNetworkCfg) == 0) {
+            mqttConnect(cellHandle);
+        } else {
+            printf("* Failed to bring up the network, transitions will only be printed\n");
+        }
+    } else {
+        printf("* Failed to initiate the cellular module: %d\n", errorCode);
+    }
+    uDeviceGetDefaults(U_DEVICE_TYPE_GNSS, &gDeviceCfg);
+    errorCode = uDeviceOpen(&gDeviceCfg, &gnssHandle);
+    if (errorCode == 0) {
+        if (sensorsMotionStart(MOTION_THRESHOLD_MG, STILL_TIME_MS, motionCallback)) {
+            printf("Waiting for motion...\n");
+            int64_t bootTime = uPortGetTickTimeMs();
+            while (true) {
+                uPortSemaphoreTake(gMotionSem);
+                trackWhileMoving(gnssHandle);
+                printf("Uptime %lld s, waiting for motion...\n",
+                       (uPortGetTickTimeMs() - bootTime) / 1000);
+            }
+        } else {
+            printf("* Failed to start motion detection\n");
+        }
+        uDeviceClose(gnssHandle, true);
+    } else {
+        printf("* Failed to initiate the GNSS module: %d\n", errorCode);
+    }
+
+    printf("\n== All done ==\n");
+}
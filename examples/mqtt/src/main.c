@@ -19,36 +19,40 @@
  * A simple demo application showing how to set up
  * mqtt communication using ubxlib.
  *
+ * The network is kept up by the link manager, which
+ * switches between cellular and Wi-Fi on failures.
+ *
 */
 
 #include <string.h>
 #include <stdio.h>
 
 #include "ubxlib.h"
+#include "link_mgr.h"
 
 #define BROKER_NAME "test.mosquitto.org"
 
-// Change the line below based on which type of module you want to use
-#if 1
-static uDeviceType_t gDeviceType = U_DEVICE_TYPE_CELL;
-static const uNetworkCfgCell_t gNetworkCfg = {
+// Remove the bearer you don't want to use from gLinkCfg below
+static const uNetworkCfgCell_t gCellCfg = {
     .type = U_NETWORK_TYPE_CELL,
     .pApn = "tsiot",       // Thingstream SIM, use NULL for default
     .timeoutSeconds = 240  // Connection timeout in seconds
 };
-static const uNetworkType_t gNetworkType = U_NETWORK_TYPE_CELL;
-#else
-static uDeviceType_t gDeviceType = U_DEVICE_TYPE_SHORT_RANGE;
-static const uNetworkCfgWifi_t gNetworkCfg = {
+static const uNetworkCfgWifi_t gWifiCfg = {
     .type = U_NETWORK_TYPE_WIFI,
     .pSsid = "SSID",      // Wifi SSID - replace with your SSID
     .authentication = 2,  // WPA/WPA2/WPA3
     .pPassPhrase = "???"  // WPA passphrase - replace with yours
 };
-static const uNetworkType_t gNetworkType = U_NETWORK_TYPE_WIFI;
-#endif
-
-uDeviceCfg_t gDeviceCfg;
+static const linkMgrCfg_t gLinkCfg = {
+    .pCellCfg = &gCellCfg,
+    .pWifiCfg = &gWifiCfg,
+    .preferred = LINK_CELL,
+    .pCheckHost = BROKER_NAME,
+    .checkPort = 1883,
+    .checkIntervalS = 60,
+    .failbackS = 30 * 60
+};
 
 // Callback for unread message indications.
 static void messageIndicationCallback(int32_t numUnread, void *pParam)
@@ -57,97 +61,111 @@ static void messageIndicationCallback(int32_t numUnread, void *pParam)
     *pMessagesAvailable = true;
 }
 
-void main()
+// Publish and receive messages until "exit" is received, the
+// connection fails or the link manager wants the link back.
+// Returns false on failure.
+static bool mqttSession(uDeviceHandle_t deviceHandle, bool *pDone)
 {
-    // Remove the line below if you want the log printouts from ubxlib
-    uPortLogOff();
-    // Initiate ubxlib
-    uPortInit();
-    uDeviceInit();
-    // And the U-blox module
-    int32_t errorCode;
-    uDeviceHandle_t deviceHandle;
-    uDeviceGetDefaults(gDeviceType, &gDeviceCfg);
-    printf("\nInitiating the module...\n");
-    errorCode = uDeviceOpen(&gDeviceCfg, &deviceHandle);
-    if (errorCode == 0) {
-        printf("Bringing up the network...\n");
-        errorCode = uNetworkInterfaceUp(deviceHandle, gNetworkType, &gNetworkCfg);
-        if (errorCode == 0) {
-            uMqttClientContext_t *pContext = pUMqttClientOpen(deviceHandle, NULL);
-            if (pContext != NULL) {
-                uMqttClientConnection_t connection = U_MQTT_CLIENT_CONNECTION_DEFAULT;
-                volatile bool messagesAvailable = false;
-                char topic[32];
+    bool ok = false;
+    uMqttClientContext_t *pContext = pUMqttClientOpen(deviceHandle, NULL);
+    if (pContext != NULL) {
+        uMqttClientConnection_t connection = U_MQTT_CLIENT_CONNECTION_DEFAULT;
+        volatile bool messagesAvailable = false;
+        char topic[32];
 
-                connection.pBrokerNameStr = BROKER_NAME;
-                if (uMqttClientConnect(pContext, &connection) == 0) {
-                    uMqttClientSetMessageCallback(pContext,
-                                                  messageIndicationCallback,
-                                                  (void *)&messagesAvailable);
-                    // Get a unique topic name for this test
-                    uSecurityGetSerialNumber(deviceHandle, topic);
-                    if (topic[0] == '"') {
-                        // Remove quotes
-                        size_t len = strlen(topic);
-                        memmove(topic, topic + 1, len);
-                        topic[len - 2] = 0;
-                    }
-                    if (uMqttClientSubscribe(pContext, topic,
-                                             U_MQTT_QOS_EXACTLY_ONCE)) {
-                        printf("----------------------------------------------\n");
-                        printf("To view the mqtt messages from this device use:\n");
-                        printf("mosquitto_sub -h %s -t %s -v\n", BROKER_NAME, topic);
-                        printf("To send mqtt messages to this device use:\n");
-                        printf("mosquitto_pub -h %s -t %s -m message\n", BROKER_NAME, topic);
-                        printf("Send message \"exit\" to disconnect\n");
-                        bool done = false;
-                        int i = 0;
-                        while (!done) {
-                            char buffer[25];
-                            if (messagesAvailable) {
-                                char buffer[25];
-                                while (uMqttClientGetUnread(pContext) > 0) {
-                                    size_t cnt = sizeof(buffer) - 1;
-                                    if (uMqttClientMessageRead(pContext, topic,
-                                                               sizeof(topic),
-                                                               buffer, &cnt,
-                                                               NULL) == 0) {
-                                        buffer[cnt] = 0;
-                                        printf("Received message: %s\n", buffer);
-                                        done = strstr(buffer, "exit");
-                                    }
-                                }
-                                messagesAvailable = false;
-                            } else {
-                                snprintf(buffer, sizeof(buffer), "Hello #%d", ++i);
-                                uMqttClientPublish(pContext, topic, buffer,
-                                                   strlen(buffer),
-                                                   U_MQTT_QOS_EXACTLY_ONCE,
-                                                   false);
+        connection.pBrokerNameStr = BROKER_NAME;
+        if (uMqttClientConnect(pContext, &connection) == 0) {
+            uMqttClientSetMessageCallback(pContext,
+                                          messageIndicationCallback,
+                                          (void *)&messagesAvailable);
+            // Get a unique topic name for this test
+            uSecurityGetSerialNumber(deviceHandle, topic);
+            if (topic[0] == '"') {
+                // Remove quotes
+                size_t len = strlen(topic);
+                memmove(topic, topic + 1, len);
+                topic[len - 2] = 0;
+            }
+            if (uMqttClientSubscribe(pContext, topic,
+                                     U_MQTT_QOS_EXACTLY_ONCE)) {
+                printf("----------------------------------------------\n");
+                printf("To view the mqtt messages from this device use:\n");
+                printf("mosquitto_sub -h %s -t %s -v\n", BROKER_NAME, topic);
+                printf("To send mqtt messages to this device use:\n");
+                printf("mosquitto_pub -h %s -t %s -m message\n", BROKER_NAME, topic);
+                printf("Send message \"exit\" to disconnect\n");
+                int i = 0;
+                ok = true;
+                while (ok && !*pDone && !linkMgrReleaseWanted()) {
+                    char buffer[25];
+                    if (messagesAvailable) {
+                        while (uMqttClientGetUnread(pContext) > 0) {
+                            size_t cnt = sizeof(buffer) - 1;
+                            if (uMqttClientMessageRead(pContext, topic,
+                                                       sizeof(topic),
+                                                       buffer, &cnt,
+                                                       NULL) == 0) {
+                                buffer[cnt] = 0;
+                                printf("Received message: %s\n", buffer);
+                                *pDone = strstr(buffer, "exit");
                             }
-                            uPortTaskBlock(1000);
                         }
+                        messagesAvailable = false;
                     } else {
-                        printf("* Failed to subscribe to topic: %s\n", topic);
+                        snprintf(buffer, sizeof(buffer), "Hello #%d", ++i);
+                        int64_t start = uPortGetTickTimeMs();
+                        ok = uMqttClientPublish(pContext, topic, buffer,
+                                                strlen(buffer),
+                                                U_MQTT_QOS_EXACTLY_ONCE,
+                                                false) == 0;
+                        if (ok) {
+                            linkMgrReportTransfer(strlen(buffer),
+                                                  uPortGetTickTimeMs() - start);
+                        } else {
+                            printf("* Failed to publish\n");
+                        }
                     }
-                    uMqttClientDisconnect(pContext);
-                } else {
-                    printf("* Failed to connect to the mqtt broker\n");
+                    uPortTaskBlock(1000);
                 }
-
             } else {
-                printf("* Failed to create mqtt instance !\n ");
+                printf("* Failed to subscribe to topic: %s\n", topic);
             }
-
-            printf("Closing down the network...\n");
-            uNetworkInterfaceDown(deviceHandle, gNetworkType);
+            uMqttClientDisconnect(pContext);
         } else {
-            printf("* Failed to bring up the network: %d\n", errorCode);
+            printf("* Failed to connect to the mqtt broker\n");
         }
-        uDeviceClose(deviceHandle, true);
+        uMqttClientClose(pContext);
     } else {
-        printf("* Failed to initiate the module: %d\n", errorCode);
+        printf("* Failed to create mqtt instance !\n ");
+    }
+    return ok;
+}
+
+void main()
+{
+    // Remove the line below if you want the log printouts from ubxlib
+    uPortLogOff();
+    // Initiate ubxlib
+    uPortInit();
+    uDeviceInit();
+    // The link manager brings up the network and keeps it up
+    printf("\nBringing up the network...\n");
+    int32_t errorCode = linkMgrStart(&gLinkCfg);
+    if (errorCode != 0) {
+        printf("* Failed to start the link manager: %d\n", errorCode);
+    }
+    bool done = errorCode != 0;
+    while (!done) {
+        linkBearer_t bearer;
+        uDeviceHandle_t deviceHandle = linkMgrAcquire(60 * 1000, &bearer);
+        if (deviceHandle != NULL) {
+            printf("Connecting over %s\n", bearer == LINK_CELL ? "cellular" : "Wi-Fi");
+            // Reconnects, possibly over the other bearer, after a failure
+            linkMgrRelease(mqttSession(deviceHandle, &done));
+            linkMgrPrintStats();
+        } else {
+            printf("* No network yet\n");
+        }
     }
 
     printf("\n== All done ==\n");
@@ -20,15 +20,23 @@
  * mqtt communication using ubxlib and then publish
  * the values of some of the XPLR-IOT-1 sensors
  *
+ * The sensors, the GNSS and the network module are started in
+ * parallel, so the sensors are sampled and the GNSS acquires
+ * satellites while the network module registers. The boot time
+ * of each stage and the time to the first sample are printed.
+ *
 */
 
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 
+#include <kernel.h>
 #include <device.h>
 #include <drivers/sensor.h>
 
 #include "sensors.h"
+#include "startup.h"
 #include "ubxlib.h"
 
 #define BROKER_NAME "test.mosquitto.org"
@@ -53,107 +61,267 @@ static const uNetworkCfgWifi_t gNetworkCfg = {
 static const uNetworkType_t gNetworkType = U_NETWORK_TYPE_WIFI;
 #endif
 
-uDeviceCfg_t gDeviceCfg;
+static const uNetworkCfgGnss_t gGnssNetworkCfg = {
+    .type = U_NETWORK_TYPE_GNSS
+};
+
+enum {
+    STAGE_SENSORS,
+    STAGE_GNSS,
+    STAGE_NETWORK
+};
+
+static uDeviceHandle_t gDeviceHandle = NULL;
+static uDeviceHandle_t gGnssHandle = NULL;
+static uMqttClientContext_t *gpContext = NULL;
+static char gTopic[32];
+static volatile bool gMessagesAvailable = false;
+static volatile bool gLocationBusy = false;
+static volatile bool gLocationValid = false;
+static uLocation_t gLocation;
 
 // Callback for unread message indications.
 static void messageIndicationCallback(int32_t numUnread, void *pParam)
 {
-    bool *pMessagesAvailable = (bool *)pParam;
-    *pMessagesAvailable = true;
+    (void)numUnread;
+    (void)pParam;
+    gMessagesAvailable = true;
 }
 
-void main()
+static void locationCallback(uDeviceHandle_t devHandle, int32_t errorCode,
+                             const uLocation_t *pLocation)
+{
+    (void)devHandle;
+    if (errorCode == 0) {
+        gLocation = *pLocation;
+        gLocationValid = true;
+        startupMark("first fix");
+    }
+    gLocationBusy = false;
+}
+
+// Return longitude/latitude value as string
+static char *locStr(int32_t loc, char *str, size_t size)
+{
+    const char *sign = "";
+    if (loc < 0) {
+        loc = -loc;
+        sign = "-";
+    }
+    snprintf(str, size, "%s%d.%07d",
+             sign, loc / 10000000, loc % 10000000);
+    return str;
+}
+
+static void startLocation()
+{
+    gLocationBusy = true;
+    if (uLocationGetStart(gGnssHandle, U_LOCATION_TYPE_GNSS, NULL, NULL,
+                          locationCallback) != 0) {
+        gLocationBusy = false;
+    }
+}
+
+static int32_t startSensors(void *pParam)
 {
+    (void)pParam;
     sensorsInit();
+    return 0;
+}
+
+static int32_t startGnss(void *pParam)
+{
+    (void)pParam;
+    uDeviceCfg_t deviceCfg;
+    uDeviceGetDefaults(U_DEVICE_TYPE_GNSS, &deviceCfg);
+    int32_t errorCode = uDeviceOpen(&deviceCfg, &gGnssHandle);
+    if (errorCode == 0) {
+        // Acquires satellites from here on
+        errorCode = uNetworkInterfaceUp(gGnssHandle, U_NETWORK_TYPE_GNSS, &gGnssNetworkCfg);
+        if (errorCode == 0) {
+            startLocation();
+        } else {
+            printf("* Failed to bring up the GNSS: %d\n", errorCode);
+            uDeviceClose(gGnssHandle, true);
+            gGnssHandle = NULL;
+        }
+    } else {
+        printf("* Failed to initiate the GNSS module: %d\n", errorCode);
+        gGnssHandle = NULL;
+    }
+    return errorCode;
+}
+
+static void getTopic()
+{
+    // Get a unique topic name for this test
+    uSecurityGetSerialNumber(gDeviceHandle, gTopic);
+    if (gTopic[0] == '"') {
+        // Remove quotes
+        size_t len = strlen(gTopic);
+        memmove(gTopic, gTopic + 1, len);
+        gTopic[len - 2] = 0;
+    }
+    gTopic[4] = 0; // Truncate
+}
+
+static int32_t startNetwork(void *pParam)
+{
+    (void)pParam;
+    uDeviceCfg_t deviceCfg;
+    uDeviceGetDefaults(gDeviceType, &deviceCfg);
+    printf("Initiating the module...\n");
+    int32_t errorCode = uDeviceOpen(&deviceCfg, &gDeviceHandle);
+    if (errorCode != 0) {
+        printf("* Failed to initiate the module: %d\n", errorCode);
+        gDeviceHandle = NULL;
+        return errorCode;
+    }
+    printf("Bringing up the network...\n");
+    errorCode = uNetworkInterfaceUp(gDeviceHandle, gNetworkType, &gNetworkCfg);
+    if (errorCode != 0) {
+        printf("* Failed to bring up the network: %d\n", errorCode);
+        return errorCode;
+    }
+    uMqttClientContext_t *pContext = pUMqttClientOpen(gDeviceHandle, NULL);
+    if (pContext == NULL) {
+        printf("* Failed to create mqtt instance !\n ");
+        return -1;
+    }
+    uMqttClientConnection_t connection = U_MQTT_CLIENT_CONNECTION_DEFAULT;
+    connection.pBrokerNameStr = BROKER_NAME;
+    errorCode = uMqttClientConnect(pContext, &connection);
+    if (errorCode == 0) {
+        uMqttClientSetMessageCallback(pContext, messageIndicationCallback, NULL);
+        getTopic();
+        errorCode = uMqttClientSubscribe(pContext, gTopic, U_MQTT_QOS_EXACTLY_ONCE);
+        if (errorCode >= 0) {
+            gpContext = pContext;
+            return 0;
+        }
+        printf("* Failed to subscribe to topic: %s\n", gTopic);
+        uMqttClientDisconnect(pContext);
+    } else {
+        printf("* Failed to connect to the mqtt broker\n");
+    }
+    uMqttClientClose(pContext);
+    return errorCode;
+}
+
+// The GNSS doesn't depend on the network module, but ubxlib runs one
+// device call at a time. Opening the GNSS first only takes a moment
+// and would otherwise wait for the whole registration.
+static const startupStage_t gStages[] = {
+    [STAGE_SENSORS] = {"sensors", startSensors, NULL, 0},
+    [STAGE_GNSS] = {"gnss", startGnss, NULL, 0},
+    [STAGE_NETWORK] = {"network", startNetwork, NULL, BIT(STAGE_GNSS)}
+};
+
+static void publish(const char *pInfo)
+{
+    if (gpContext != NULL) {
+        uMqttClientPublish(gpContext, gTopic, pInfo, strlen(pInfo),
+                           U_MQTT_QOS_EXACTLY_ONCE, false);
+    } else {
+        printf("%s\n", pInfo);
+    }
+}
+
+static void sample()
+{
+    publish(pollTempSensor());
+    publish(pollAccelerometer());
+    startupMark("first sample");
+    if (gLocationValid) {
+        char info[64];
+        char lat[16];
+        char lon[16];
+        snprintf(info, sizeof(info), "Position: %s,%s",
+                 locStr(gLocation.latitudeX1e7, lat, sizeof(lat)),
+                 locStr(gLocation.longitudeX1e7, lon, sizeof(lon)));
+        publish(info);
+        gLocationValid = false;
+    }
+    // The network module is started after the GNSS, ubxlib is free
+    // for a new position request once the network stage is done
+    if (gGnssHandle != NULL && !gLocationBusy && startupWait(STAGE_NETWORK, 0) != -EAGAIN) {
+        startLocation();
+    }
+}
+
+// Returns true when an exit message was received
+static bool readMessages()
+{
+    bool done = false;
+    char buffer[100];
+    gMessagesAvailable = false;
+    while (uMqttClientGetUnread(gpContext) > 0) {
+        size_t cnt = sizeof(buffer) - 1;
+        if (uMqttClientMessageRead(gpContext, gTopic, sizeof(gTopic),
+                                   buffer, &cnt, NULL) == 0) {
+            buffer[cnt] = 0;
+            printf("Received message: %s\n", buffer);
+            done = done || strstr(buffer, "exit");
+        }
+    }
+    return done;
+}
+
+void main()
+{
     // Remove the line below if you want the log printouts from ubxlib
     uPortLogOff();
     // Initiate ubxlib
     uPortInit();
     uDeviceInit();
-    // And the U-blox module
-    int32_t errorCode;
-    uDeviceHandle_t deviceHandle;
-    uDeviceGetDefaults(gDeviceType, &gDeviceCfg);
-    printf("\nInitiating the module...\n");
-    errorCode = uDeviceOpen(&gDeviceCfg, &deviceHandle);
-    if (errorCode == 0) {
-        printf("Bringing up the network...\n");
-        errorCode = uNetworkInterfaceUp(deviceHandle, gNetworkType, &gNetworkCfg);
-        if (errorCode == 0) {
-            uMqttClientContext_t *pContext = pUMqttClientOpen(deviceHandle, NULL);
-            if (pContext != NULL) {
-                uMqttClientConnection_t connection = U_MQTT_CLIENT_CONNECTION_DEFAULT;
-                volatile bool messagesAvailable = false;
-                char topic[32];
-
-                connection.pBrokerNameStr = BROKER_NAME;
-                if (uMqttClientConnect(pContext, &connection) == 0) {
-                    uMqttClientSetMessageCallback(pContext,
-                                                  messageIndicationCallback,
-                                                  (void *)&messagesAvailable);
-                    // Get a unique topic name for this test
-                    uSecurityGetSerialNumber(deviceHandle, topic);
-                    if (topic[0] == '"') {
-                        // Remove quotes
-                        size_t len = strlen(topic);
-                        memmove(topic, topic + 1, len);
-                        topic[len - 2] = 0;
-                    }
-                    topic[4] = 0; // Truncate
-                    if (uMqttClientSubscribe(pContext, topic,
-                                             U_MQTT_QOS_EXACTLY_ONCE)) {
-                        printf("----------------------------------------------\n");
-                        printf("To view the mqtt messages from this device use:\n");
-                        printf("mosquitto_sub -h %s -t %s -v\n", BROKER_NAME, topic);
-                        printf("To send mqtt messages to this device use:\n");
-                        printf("mosquitto_pub -h %s -t %s -m message\n", BROKER_NAME, topic);
-                        printf("Send message \"exit\" to disconnect\n");
-                        bool done = false;
-                        while (!done) {
-                            if (messagesAvailable) {
-                                char buffer[100];
-                                while (uMqttClientGetUnread(pContext) > 0) {
-                                    size_t cnt = sizeof(buffer) - 1;
-                                    if (uMqttClientMessageRead(pContext, topic,
-                                                               sizeof(topic),
-                                                               buffer, &cnt,
-                                                               NULL) == 0) {
-                                        buffer[cnt] = 0;
-                                        printf("Received message: %s\n", buffer);
-                                        done = strstr(buffer, "exit");
-                                    }
-                                }
-                                messagesAvailable = false;
-                            } else {
-                                const char *info = pollTempSensor();
-                                uMqttClientPublish(pContext, topic, info, strlen(info),
-                                                   U_MQTT_QOS_EXACTLY_ONCE, false);
-                                info = pollAccelerometer();
-                                uMqttClientPublish(pContext, topic, info, strlen(info),
-                                                   U_MQTT_QOS_EXACTLY_ONCE, false);
-                                uPortTaskBlock(1000);
-                            }
-                        }
-                    } else {
-                        printf("* Failed to subscribe to topic: %s\n", topic);
-                    }
-                    uMqttClientDisconnect(pContext);
-                } else {
-                    printf("* Failed to connect to the mqtt broker\n");
-                }
-
-            } else {
-                printf("* Failed to create mqtt instance !\n ");
+    printf("\nStarting the sensors, the GNSS and the network module...\n");
+    startupRun(gStages, ARRAY_SIZE(gStages));
+    startupWait(STAGE_SENSORS, UINT32_MAX);
+    bool connected = false;
+    bool timesPrinted = false;
+    bool done = false;
+    while (!done) {
+        if (!connected && startupWait(STAGE_NETWORK, 0) != -EAGAIN) {
+            connected = true;
+            if (!startupOk(STAGE_NETWORK)) {
+                break;
             }
-
-            printf("Closing down the network...\n");
-            uNetworkInterfaceDown(deviceHandle, gNetworkType);
+            printf("----------------------------------------------\n");
+            printf("To view the mqtt messages from this device use:\n");
+            printf("mosquitto_sub -h %s -t %s -v\n", BROKER_NAME, gTopic);
+            printf("To send mqtt messages to this device use:\n");
+            printf("mosquitto_pub -h %s -t %s -m message\n", BROKER_NAME, gTopic);
+            printf("Send message \"exit\" to disconnect\n");
+        }
+        if (gMessagesAvailable) {
+            done = readMessages();
         } else {
-            printf("* Failed to bring up the network: %d\n", errorCode);
+            sample();
+            if (gpContext != NULL && !timesPrinted) {
+                startupMark("first publish");
+                startupPrintTimes();
+                timesPrinted = true;
+            }
+            uPortTaskBlock(1000);
         }
-        uDeviceClose(deviceHandle, true);
-    } else {
-        printf("* Failed to initiate the module: %d\n", errorCode);
+    }
+    if (!timesPrinted) {
+        startupPrintTimes();
+    }
+
+    if (gGnssHandle != NULL) {
+        uLocationGetStop(gGnssHandle);
+        uNetworkInterfaceDown(gGnssHandle, U_NETWORK_TYPE_GNSS);
+        uDeviceClose(gGnssHandle, true);
+    }
+    if (gpContext != NULL) {
+        uMqttClientDisconnect(gpContext);
+        uMqttClientClose(gpContext);
+    }
+    if (gDeviceHandle != NULL) {
+        printf("Closing down the network...\n");
+        uNetworkInterfaceDown(gDeviceHandle, gNetworkType);
+        uDeviceClose(gDeviceHandle, true);
     }
 
     printf("\n== All done ==\n");
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *
+ * Battery friendly version of the mqtt_sensors example. The sensors
+ * are sampled once a minute and the samples are published in batches,
+ * letting the cellular module sleep in 3GPP power saving mode (PSM)
+ * in between. eDRX is used in the short time the module is reachable
+ * after each upload.
+ *
+ * Each batch is a JSON array of [uptime s, temperature 0.1 C, light lux,
+ * battery %] samples. After each upload the estimated energy used by
+ * the module per sample is printed, together with the estimate for
+ * keeping the module connected as mqtt_sensors does.
+ *
+ * The network decides the power saving values actually used, they
+ * are printed after each upload.
+ *
+*/
+
+#include <string.h>
+#include <stdio.h>
+
+#include <kernel.h>
+
+#include "sensors.h"
+#include "upload_sched.h"
+#include "ubxlib.h"
+
+#define BROKER_NAME "test.mosquitto.org"
+#define SAMPLE_PERIOD_MS (60 * 1000)
+
+static const uNetworkCfgCell_t gNetworkCfg = {
+    .type = U_NETWORK_TYPE_CELL,
+    .pApn = "tsiot",       // Thingstream SIM, use NULL for default
+    .timeoutSeconds = 240  // Connection timeout in seconds
+};
+
+static const uploadSchedCfg_t gSchedCfg = {
+    .uploadPeriodS = 15 * 60,
+    .activeTimeS = 20,
+    .eDrxS = 82            // 81.92 s, a valid LTE-M eDRX cycle
+};
+
+uDeviceCfg_t gDeviceCfg;
+static char gTopic[32];
+
+static void getTopic(uDeviceHandle_t deviceHandle)
+{
+    // A unique topic name for this device
+    uSecurityGetSerialNumber(deviceHandle, gTopic);
+    if (gTopic[0] == '"') {
+        // Remove quotes
+        size_t len = strlen(gTopic);
+        memmove(gTopic, gTopic + 1, len);
+        gTopic[len - 2] = 0;
+    }
+    gTopic[4] = 0; // Truncate
+    printf("To view the mqtt messages from this device use:\n");
+    printf("mosquitto_sub -h %s -t %s -v\n", BROKER_NAME, gTopic);
+}
+
+static void sample()
+{
+    int16_t deciC = 0;
+    uint8_t battery = 0;
+    getTemperature(&deciC);
+    getBatteryLevel(&battery);
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "[%u,%d,%d,%u]", k_uptime_get_32() / 1000,
+             deciC, getLightSensor(), battery);
+    if (!uploadSchedAdd(buffer)) {
+        printf("* Batch full, sample dropped\n");
+    }
+}
+
+// Connect, publish the batch and disconnect, so that the module
+// can go back to sleep as soon as possible
+static bool upload(uDeviceHandle_t deviceHandle)
+{
+    const char *pData;
+    size_t len;
+    if (uploadSchedBegin(&pData, &len) != 0) {
+        return false;
+    }
+    bool success = false;
+    uMqttClientContext_t *pContext = pUMqttClientOpen(deviceHandle, NULL);
+    if (pContext != NULL) {
+        uMqttClientConnection_t connection = U_MQTT_CLIENT_CONNECTION_DEFAULT;
+        connection.pBrokerNameStr = BROKER_NAME;
+        if (uMqttClientConnect(pContext, &connection) == 0) {
+            success = uMqttClientPublish(pContext, gTopic, pData, len,
+                                         U_MQTT_QOS_AT_LEAST_ONCE, false) == 0;
+            uMqttClientDisconnect(pContext);
+        }
+        uMqttClientClose(pContext);
+    }
+    uploadSchedEnd(success);
+    return success;
+}
+
+static void printStats()
+{
+    uploadSchedStats_t stats;
+    uploadSchedGetStats(&stats);
+    printf("%u uploads, %u failed, %u samples, last upload %u ms\n",
+           stats.uploads, stats.failed, stats.samples, stats.lastUploadMs);
+    printf("PSM %s, active time %d s, periodic wake up %d s, upload period %u s\n",
+           stats.psm ? "on" : "off", stats.activeTimeS, stats.periodicWakeupS,
+           stats.uploadPeriodS);
+    printf("eDRX %s, cycle %d s, paging window %d s\n",
+           stats.eDrx ? "on" : "off", stats.eDrxS, stats.pagingWindowS);
+    printf("Modem connected %u s, idle %u s, sleeping %u s, %u mJ\n",
+           stats.connectedS, stats.idleS, stats.sleepS, stats.energyMj);
+    printf("Energy per sample %u uJ, %u uJ if always connected\n",
+           stats.uJPerSample, stats.alwaysOnUjPerSample);
+}
+
+void main()
+{
+    sensorsInit();
+    // Remove the line below if you want the log printouts from ubxlib
+    uPortLogOff();
+    // Initiate ubxlib
+    uPortInit();
+    uDeviceInit();
+    // And the U-blox module
+    int32_t errorCode;
+    uDeviceHandle_t deviceHandle;
+    uDeviceGetDefaults(U_DEVICE_TYPE_CELL, &gDeviceCfg);
+    printf("\nInitiating the module...\n");
+    errorCode = uDeviceOpen(&gDeviceCfg, &deviceHandle);
+    if (errorCode == 0) {
+        // Must be requested before registration
+        errorCode = uploadSchedInit(deviceHandle, &gSchedCfg);
+        if (errorCode != 0) {
+            printf("* Failed to request power saving: %d\n", errorCode);
+        }
+        printf("Bringing up the network...\n");
+        errorCode = uNetworkInterfaceUp(deviceHandle, U_NETWORK_TYPE_CELL, &gNetworkCfg);
+        if (errorCode == 0) {
+            getTopic(deviceHandle);
+            while (1) {
+                sample();
+                if (uploadSchedDueMs(SAMPLE_PERIOD_MS) == 0) {
+                    if (upload(deviceHandle)) {
+                        printStats();
+                    } else {
+                        printf("* Failed to upload, trying again with the next batch\n");
+                    }
+                }
+                uPortTaskBlock(SAMPLE_PERIOD_MS);
+            }
+        } else {
+            printf("* Failed to bring up the network: %d\n", errorCode);
+        }
+        uDeviceClose(deviceHandle, true);
+    } else {
+        printf("* Failed to initiate the module: %d\n", errorCode);
+    }
+
+    printf("\n== All done ==\n");
+
+    while (1) {
+        uPortTaskBlock(1000);
+    }
+}
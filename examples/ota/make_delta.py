@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+
+# Copyright 2023 u-blox
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#  http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# make_delta.py
+#
+# Creates a delta update, see examples/common/ota.h, from the signed
+# image running on the device to a new signed image. The images are
+# normally zephyr/zephyr_signed.bin in the build directories of the
+# two builds.
+#
+# Usage: make_delta.py old_image new_image delta_file
+
+import sys
+import struct
+import zlib
+
+KEY_LEN = 8
+MIN_MATCH = 24
+# An approximate match continues while this many of the next
+# WINDOW bytes are equal
+WINDOW = 16
+MIN_EQUAL = 8
+
+OP_COPY = 1
+OP_ADD = 2
+OP_INSERT = 3
+
+
+def index_source(old):
+    index = {}
+    for i in range(len(old) - KEY_LEN + 1):
+        index.setdefault(old[i:i + KEY_LEN], i)
+    return index
+
+
+def exact_len(old, new, src, dst):
+    n = 0
+    while src + n < len(old) and dst + n < len(new) and old[src + n] == new[dst + n]:
+        n += 1
+    return n
+
+
+def approx_len(old, new, src, dst):
+    n = 0
+    while src + n + WINDOW <= len(old) and dst + n + WINDOW <= len(new):
+        equal = sum(1 for i in range(WINDOW) if old[src + n + i] == new[dst + n + i])
+        if equal < MIN_EQUAL:
+            break
+        n += WINDOW
+    return n
+
+
+def add_runs(old, new, src, dst, length):
+    out = bytearray()
+    i = 0
+    while i < length:
+        zeros = 0
+        while i < length and zeros < 255 and old[src + i] == new[dst + i]:
+            zeros += 1
+            i += 1
+        diffs = bytearray()
+        while i < length and len(diffs) < 255 and old[src + i] != new[dst + i]:
+            diffs.append((new[dst + i] - old[src + i]) & 0xFF)
+            i += 1
+        out += bytes([zeros, len(diffs)]) + diffs
+    return out
+
+
+def make_delta(old, new):
+    index = index_source(old)
+    out = bytearray(b'UDLT' + struct.pack('<B3xIII', 1, len(old), zlib.crc32(old), len(new)))
+    insert = bytearray()
+
+    def flush_insert():
+        if insert:
+            out.extend(struct.pack('<BI', OP_INSERT, len(insert)) + insert)
+            insert.clear()
+
+    pos = 0
+    while pos < len(new):
+        src = index.get(new[pos:pos + KEY_LEN])
+        length = exact_len(old, new, src, pos) if src is not None else 0
+        if length < MIN_MATCH:
+            insert.append(new[pos])
+            pos += 1
+            continue
+        flush_insert()
+        out += struct.pack('<BII', OP_COPY, length, src)
+        approx = approx_len(old, new, src + length, pos + length)
+        if approx > 0:
+            out += struct.pack('<BI', OP_ADD, approx)
+            out += add_runs(old, new, src + length, pos + length, approx)
+        pos += length + approx
+    flush_insert()
+    return out
+
+
+def main():
+    if len(sys.argv) != 4:
+        print("Usage: make_delta.py old_image new_image delta_file")
+        sys.exit(1)
+    with open(sys.argv[1], 'rb') as f:
+        old = f.read()
+    with open(sys.argv[2], 'rb') as f:
+        new = f.read()
+    delta = make_delta(old, new)
+    with open(sys.argv[3], 'wb') as f:
+        f.write(delta)
+    print(f"{len(new)} byte image, {len(delta)} byte delta ({100 * len(delta) // len(new)}%)")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *
+ * Firmware update over the network from a HTTP server.
+ *
+ * The application update is either a signed image, zephyr/zephyr_signed.bin
+ * in the build directory, or a delta from the running image created
+ * with make_delta.py:
+ *
+ * make_delta.py old/zephyr/zephyr_signed.bin new/zephyr/zephyr_signed.bin delta.bin
+ *
+ * A delta is normally a small part of the full image, which saves
+ * both transfer time and energy over cellular. The download is
+ * resumed after connection errors and resets, from the last
+ * checkpoint in the internal flash.
+ *
+ * The new image is installed by the bootloader at the next reset
+ * and confirms itself when it has brought up the network. If it
+ * doesn't, the bootloader reverts to the previous image.
+ *
+ * Change the server settings below. A new image id must be used
+ * for each new update, an id of zero disables the update.
+ *
+ */
+
+#include <stdio.h>
+#include <errno.h>
+
+#include <kernel.h>
+#include <sys/reboot.h>
+#include <dfu/mcuboot.h>
+
+#include "ubxlib.h"
+#include "counters.h"
+#include "ota.h"
+
+#define UPDATE_HOST "update.example.com"
+#define UPDATE_PORT 80
+#define UPDATE_PATH "/xplriot1/delta.bin"
+#define UPDATE_ID 2
+
+// Change the line below based on which type of module you want to use
+#if 1
+// Cellular network
+static uDeviceType_t gDeviceType = U_DEVICE_TYPE_CELL;
+static const uNetworkCfgCell_t gNetworkCfg = {
+    .type = U_NETWORK_TYPE_CELL,
+    .pApn = "tsiot",       // Thingstream SIM, use NULL for default
+    .timeoutSeconds = 240  // Connection timeout in seconds
+};
+static const uNetworkType_t gNetworkType = U_NETWORK_TYPE_CELL;
+#else
+// WiFi network
+static uDeviceType_t gDeviceType = U_DEVICE_TYPE_SHORT_RANGE;
+static const uNetworkCfgWifi_t gNetworkCfg = {
+    .type = U_NETWORK_TYPE_WIFI,
+    .pSsid = "SSID",      // Wifi SSID - replace with your SSID
+    .authentication = 2,  // WPA/WPA2/WPA3
+    .pPassPhrase = "???"  // WPA passphrase - replace with yours
+};
+static const uNetworkType_t gNetworkType = U_NETWORK_TYPE_WIFI;
+#endif
+
+uDeviceCfg_t gDeviceCfg;
+
+static void progress(const otaStats_t *pStats)
+{
+    uint32_t done = pStats->resumedAt + pStats->downloaded;
+    printf("  %u kB", done / 1024);
+    if (pStats->total > 0) {
+        printf(" of %u kB", pStats->total / 1024);
+    }
+    printf(", %u kB written, %u kB/s\n", pStats->written / 1024,
+           pStats->timeMs > 0 ? pStats->downloaded / pStats->timeMs : 0);
+}
+
+static void update(uDeviceHandle_t deviceHandle)
+{
+    printf("Downloading update %d from %s%s\n", UPDATE_ID, UPDATE_HOST, UPDATE_PATH);
+    int32_t errorCode = otaHttpDownload(deviceHandle, UPDATE_HOST, UPDATE_PORT,
+                                       UPDATE_PATH, UPDATE_ID);
+    otaStats_t stats;
+    otaGetStats(&stats);
+    printf("%s update, %u bytes downloaded, %u bytes written in %u ms\n",
+           stats.delta ? "Delta" : "Full", stats.downloaded, stats.written, stats.timeMs);
+    printf("Flash %u ms, source check %u ms\n", stats.flashUs / 1000, stats.verifyMs);
+    printf("Resumed at %u, %u connections, %u checkpoints\n",
+           stats.resumedAt, stats.connections, stats.checkpoints);
+    if (errorCode == 0) {
+        printf("Update complete, restarting\n");
+        uPortTaskBlock(1000);
+        sys_reboot(SYS_REBOOT_COLD);
+    } else {
+        printf("* Failed to update: %d\n", errorCode);
+    }
+}
+
+void main()
+{
+    // Remove the line below if you want the log printouts from ubxlib
+    uPortLogOff();
+    countersInit();
+    otaSetProgressCb(progress);
+    bool confirmed = boot_is_img_confirmed();
+    printf("\nRunning image is %s\n", confirmed ? "confirmed" : "on test");
+    // Initiate ubxlib
+    uPortInit();
+    uDeviceInit();
+    // And the U-blox module
+    int32_t errorCode;
+    uDeviceHandle_t deviceHandle;
+    uDeviceGetDefaults(gDeviceType, &gDeviceCfg);
+    printf("Initiating the module...\n");
+    errorCode = uDeviceOpen(&gDeviceCfg, &deviceHandle);
+    if (errorCode == 0) {
+        printf("Bringing up the network...\n");
+        errorCode = uNetworkInterfaceUp(deviceHandle, gNetworkType, &gNetworkCfg);
+        if (errorCode == 0) {
+            // A new image which works well enough to update again
+            errorCode = otaConfirm();
+            if (errorCode == -ECANCELED) {
+                printf("* The last update was not installed\n");
+            } else if (errorCode != 0) {
+                printf("* Failed to confirm the image: %d\n", errorCode);
+            }
+            if (!confirmed) {
+                printf("Image confirmed\n");
+            } else if (UPDATE_ID != 0 && counterGet(COUNTER_OTA_INSTALLED) != UPDATE_ID) {
+                update(deviceHandle);
+            } else {
+                printf("Update %d already installed\n", UPDATE_ID);
+            }
+            printf("Closing down the network...\n");
+            uNetworkInterfaceDown(deviceHandle, gNetworkType);
+        } else {
+            printf("* Failed to bring up the network: %d\n", errorCode);
+        }
+        uDeviceClose(deviceHandle, true);
+    } else {
+        printf("* Failed to initiate the module: %d\n", errorCode);
+    }
+
+    printf("\n== All done ==\n");
+
+    while (1) {
+        uPortTaskBlock(1000);
+    }
+}
@@ -18,6 +18,8 @@
  *
  * A simple demo application showing how to set up
  * and use a u-blox GNSS module using ubxlib.
+ * Cell Locate can be used in parallel with the GNSS
+ * and the first position which is accurate enough is used.
  *
  */
 
@@ -28,6 +30,20 @@
 #include "ubxlib.h"
 
 #include "leds.h"
+#include "pos_strategy.h"
+
+// Time to wait for a position, counted from when the GNSS is started
+// and including the cellular bring up for Cell Locate. A cold start
+// of the GNSS can take many minutes, this is the same budget as the
+// five tries of uLocationGet() used before.
+#define POSITION_DEADLINE_MS (20 * 60 * 1000)
+// Accept the first fix with an accuracy better than this
+#define ACCURACY_THRESHOLD_MM (50 * 1000)
+
+// Set to 1 to also use Cell Locate. It requires a token from the
+// u-blox Thingstream portal, put it below.
+#define USE_CELL_LOCATE 0
+#define CELL_LOCATE_TOKEN "<your Cell Locate token>"
 
 uDeviceCfg_t gDeviceCfg;
 
@@ -35,6 +51,24 @@ uNetworkCfgGnss_t gNetworkCfg = {
     .type = U_NETWORK_TYPE_GNSS
 };
 
+#if USE_CELL_LOCATE
+static const uNetworkCfgCell_t gCellNetworkCfg = {
+    .type = U_NETWORK_TYPE_CELL,
+    .pApn = "tsiot",       // Thingstream SIM, use NULL for default
+    // Don't wait too long, the GNSS is acquiring meanwhile
+    .timeoutSeconds = 30
+};
+
+static const uLocationAssist_t gCellLocateAssist = {
+    .desiredAccuracyMillimetres = ACCURACY_THRESHOLD_MM,
+    .desiredTimeoutSeconds = 60,
+    .disableGnss = true  // The GNSS is used directly by the strategy
+};
+#endif
+
+static posSource_t gSources[2];
+static size_t gSourceCnt = 0;
+
 // Return longitude/latitude value as string
 static char *locStr(int32_t loc)
 {
@@ -49,6 +83,40 @@ static char *locStr(int32_t loc)
     return str;
 }
 
+static void addSource(const char *pName, uDeviceHandle_t devHandle,
+                      uLocationType_t type, const uLocationAssist_t *pAssist,
+                      const char *pToken)
+{
+    posSource_t *pSource = &gSources[gSourceCnt++];
+    pSource->pName = pName;
+    pSource->devHandle = devHandle;
+    pSource->type = type;
+    pSource->pLocationAssist = pAssist;
+    pSource->pAuthenticationTokenStr = pToken;
+}
+
+#if USE_CELL_LOCATE
+// Bring up the cellular module for Cell Locate as a second source
+static uDeviceHandle_t startCellLocate()
+{
+    uDeviceHandle_t cellHandle = NULL;
+    uDeviceCfg_t cellDeviceCfg;
+    uDeviceGetDefaults(U_DEVICE_TYPE_CELL, &cellDeviceCfg);
+    printf("Bringing up the cellular network for Cell Locate...\n");
+    if (uDeviceOpen(&cellDeviceCfg, &cellHandle) == 0) {
+        if (uNetworkInterfaceUp(cellHandle, U_NETWORK_TYPE_CELL, &gCellNetworkCfg) == 0) {
+            addSource("Cell Locate", cellHandle, U_LOCATION_TYPE_CLOUD_CELL_LOCATE,
+                      &gCellLocateAssist, CELL_LOCATE_TOKEN);
+        } else {
+            printf("- No cellular network, using GNSS only\n");
+            uDeviceClose(cellHandle, true);
+            cellHandle = NULL;
+        }
+    }
+    return cellHandle;
+}
+#endif
+
 void main()
 {
     ledsInit();
@@ -64,23 +132,28 @@ void main()
     printf("\nInitiating the module...\n");
     errorCode = uDeviceOpen(&gDeviceCfg, &deviceHandle);
     if (errorCode == 0) {
-        // Bring up the GNSS
+        // Bring up the GNSS, it starts to acquire satellites directly
+        int64_t startTime = uPortGetTickTimeMs();
         errorCode = uNetworkInterfaceUp(deviceHandle, U_NETWORK_TYPE_GNSS, &gNetworkCfg);
         if (errorCode == 0) {
-            printf("Waiting for position.");
-            uLocation_t location;
-            int tries = 0;
-            int64_t startTime = uPortGetTickTimeMs();
             ledBlink(RED_LED, 250, 250);
-            do {
-                printf(".");
-                errorCode = uLocationGet(deviceHandle, U_LOCATION_TYPE_GNSS,
-                                         NULL, NULL, &location, NULL);
-            } while (errorCode == U_ERROR_COMMON_TIMEOUT && tries++ < 4);
+            addSource("GNSS", deviceHandle, U_LOCATION_TYPE_GNSS, NULL, NULL);
+#if USE_CELL_LOCATE
+            uDeviceHandle_t cellHandle = startCellLocate();
+#endif
+            printf("Waiting for position...\n");
+            // The time of the cellular bring up is taken from the deadline
+            int64_t elapsed = uPortGetTickTimeMs() - startTime;
+            uint32_t remaining = elapsed < POSITION_DEADLINE_MS ? POSITION_DEADLINE_MS - elapsed : 0;
+            uLocation_t location;
+            int32_t source = posStrategyGet(gSources, gSourceCnt,
+                                            ACCURACY_THRESHOLD_MM,
+                                            remaining, &location);
             ledBlink(RED_LED, 0, 0);
-            printf("\nWaited: %lld s\n", (uPortGetTickTimeMs() - startTime) / 1000);
-            if (errorCode == 0) {
+            printf("Waited: %lld ms\n", uPortGetTickTimeMs() - startTime);
+            if (source >= 0) {
                 ledSet(GREEN_LED, true);
+                printf("Source: %s\n", gSources[source].pName);
                 printf("Position: https://maps.google.com/?q=");
                 printf("%s,", locStr(location.latitudeX1e7));
                 printf("%s\n", locStr(location.longitudeX1e7));
@@ -89,12 +162,18 @@ void main()
                 printf("UTC Time: %4d-%02d-%02d %02d:%02d:%02d\n",
                        t->tm_year + 1900, t->tm_mon, t->tm_mday,
                        t->tm_hour, t->tm_min, t->tm_sec);
-            } else if (errorCode == U_ERROR_COMMON_TIMEOUT) {
+            } else if (source == U_ERROR_COMMON_TIMEOUT) {
                 printf("* Timeout\n");
                 ledSet(RED_LED, true);
             } else {
-                printf("* Failed to get position: %d\n", errorCode);
+                printf("* Failed to get position: %d\n", source);
+            }
+#if USE_CELL_LOCATE
+            if (cellHandle != NULL) {
+                uNetworkInterfaceDown(cellHandle, U_NETWORK_TYPE_CELL);
+                uDeviceClose(cellHandle, true);
             }
+#endif
             uNetworkInterfaceDown(deviceHandle, U_NETWORK_TYPE_GNSS);
         } else {
             printf("* Failed to bring up the GNSS: %d", errorCode);
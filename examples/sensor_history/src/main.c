@@ -0,0 +1,155 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *
+ * Temperature history kept on the external flash using the time
+ * series store in common/ts_store.h.
+ *
+ * At start a short benchmark of the store is run. Then the temperature
+ * is sampled periodically and the min, max and average of the last
+ * hour and day are printed, as could be served over e.g. BLE.
+ *
+ * There is no real time clock so the time is seconds of uptime,
+ * continuing from the last stored sample after a restart.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "ext_fs.h"
+#include "sensors.h"
+#include "ts_store.h"
+#include "ts_store_fs.h"
+
+#define HISTORY_FILE "temp.ts"
+#define BENCH_FILE "bench.ts"
+// 512 blocks of 512 bytes, about 236 samples each, hold about 14 days
+// at this interval
+#define HISTORY_BLOCKS 512
+#define SAMPLE_INTERVAL_S 10
+#define SAMPLES_PER_FLUSH 6
+#define REPORT_INTERVAL_S 60
+#define BENCH_SAMPLES 20000
+#define FREE_REFRESH_MS (10 * 60 * 1000)
+
+static tsStoreRange_t gRanges[HISTORY_BLOCKS];
+static tsStore_t gStore;
+static tsStoreFile_t gFile;
+
+static void printAggregate(const char *pName, uint32_t now, uint32_t seconds)
+{
+    tsStoreAggregate_t agg;
+    uint32_t start = now > seconds ? now - seconds : 0;
+    if (tsStoreAggregate(&gStore, start, now, &agg) == 0 && agg.count > 0) {
+        int32_t avg = (int32_t)(agg.sum / agg.count);
+        printf("%-9s min %3d.%d max %3d.%d avg %3d.%d C (%u samples)\n", pName,
+               agg.min / 10, abs(agg.min % 10), agg.max / 10, abs(agg.max % 10),
+               avg / 10, abs(avg % 10), agg.count);
+    }
+}
+
+static void benchmark()
+{
+    static tsStoreRange_t ranges[64];
+    const char *path = extFsPath(BENCH_FILE);
+    extFsDelete(path);
+    const tsStoreIo_t *pIo = tsStoreFileOpen(&gFile, path);
+    if (pIo == NULL || tsStoreOpen(&gStore, pIo, ranges, ARRAY_SIZE(ranges)) != 0) {
+        printf("* Failed to open the benchmark store\n");
+        return;
+    }
+    // A slowly varying temperature in 0.1 C, sampled every minute
+    uint32_t start = k_uptime_get_32();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        tsStoreAppend(&gStore, i * 60, 200 + (i / 30) % 50);
+    }
+    tsStoreFlush(&gStore);
+    uint32_t appendMs = k_uptime_get_32() - start;
+    tsStoreRange_t range;
+    tsStoreRange(&gStore, &range);
+    uint32_t stored = (range.tLast - range.tFirst) / 60 + 1;
+    printf("Benchmark: %u samples in %u ms, %u block writes\n", BENCH_SAMPLES, appendMs,
+           gStore.blockWrites);
+    printf("           %u samples kept in %u blocks, %u bytes per sample\n", stored,
+           gStore.cnt, gStore.cnt * TS_STORE_BLOCK_SIZE / stored);
+
+    tsStoreAggregate_t agg;
+    start = k_cycle_get_32();
+    tsStoreAggregate(&gStore, range.tLast - 24 * 3600, range.tLast, &agg);
+    uint32_t aggUs = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    printf("           24 h aggregate in %u us, %u headers and %u blocks read\n", aggUs,
+           gStore.headerReads, gStore.blockReads);
+    start = k_cycle_get_32();
+    int32_t cnt = tsStoreQuery(&gStore, range.tLast - 3600, range.tLast, NULL, NULL);
+    uint32_t queryUs = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    printf("           1 h query of %d samples in %u us\n", cnt, queryUs);
+    tsStoreFileClose(&gFile);
+    extFsDelete(path);
+}
+
+void main()
+{
+    if (!extFsInit()) {
+        printf("* Failed to mount the file system\n");
+        return;
+    }
+    sensorsInit();
+    benchmark();
+
+    const tsStoreIo_t *pIo = tsStoreFileOpen(&gFile, extFsPath(HISTORY_FILE));
+    int32_t errorCode = pIo != NULL ? tsStoreOpen(&gStore, pIo, gRanges, HISTORY_BLOCKS) : -ENOENT;
+    if (errorCode != 0) {
+        printf("* Failed to open the history: %d\n", errorCode);
+        return;
+    }
+    tsStoreRange_t range;
+    uint32_t timeBase = 0;
+    if (tsStoreRange(&gStore, &range)) {
+        printf("History from %u to %u s\n", range.tFirst, range.tLast);
+        timeBase = range.tLast + SAMPLE_INTERVAL_S;
+    }
+    // Keeps the free space estimate from drifting without a slow
+    // fs_statvfs in the sample loop
+    extFsFreeRefreshStart(FREE_REFRESH_MS);
+    int cnt = 0;
+    while (true) {
+        uint32_t now = timeBase + k_uptime_get_32() / 1000;
+        int16_t temperature;
+        if (getTemperature(&temperature)) {
+            errorCode = tsStoreAppend(&gStore, now, temperature);
+            if (errorCode == 0) {
+                cnt++;
+                if (cnt % SAMPLES_PER_FLUSH == 0) {
+                    errorCode = tsStoreFlush(&gStore);
+                }
+                // Only once per stored sample, not again while the
+                // sensor or the store fails
+                if (cnt % (REPORT_INTERVAL_S / SAMPLE_INTERVAL_S) == 0) {
+                    printAggregate("Last hour", now, 3600);
+                    printAggregate("Last day", now, 24 * 3600);
+                    printf("Free space %d kB\n", extFsFree());
+                }
+            }
+            if (errorCode != 0) {
+                printf("* Failed to store the temperature: %d\n", errorCode);
+            }
+        }
+        k_sleep(K_SECONDS(SAMPLE_INTERVAL_S));
+    }
+}
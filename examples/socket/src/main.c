@@ -21,36 +21,88 @@
  * network communication using ubxlib. Uses sockets
  * for sending and receiving data.
  *
+ * The network is kept up by the link manager, which
+ * switches between cellular and Wi-Fi on failures.
+ *
  */
 
 #include <string.h>
 #include <stdio.h>
 
 #include "ubxlib.h"
+#include "link_mgr.h"
+
+#define ECHO_PERIOD_MS (30 * 1000)
 
-// Change the line below based on which type of module you want to use
-#if 1
-// Cellular network
-static uDeviceType_t gDeviceType = U_DEVICE_TYPE_CELL;
-static const uNetworkCfgCell_t gNetworkCfg = {
+// Remove the bearer you don't want to use from gLinkCfg below
+static const uNetworkCfgCell_t gCellCfg = {
     .type = U_NETWORK_TYPE_CELL,
     .pApn = "tsiot",       // Thingstream SIM, use NULL for default
     .timeoutSeconds = 240  // Connection timeout in seconds
 };
-static const uNetworkType_t gNetworkType = U_NETWORK_TYPE_CELL;
-#else
-// WiFi network
-static uDeviceType_t gDeviceType = U_DEVICE_TYPE_SHORT_RANGE;
-static const uNetworkCfgWifi_t gNetworkCfg = {
+static const uNetworkCfgWifi_t gWifiCfg = {
     .type = U_NETWORK_TYPE_WIFI,
     .pSsid = "SSID",      // Wifi SSID - replace with your SSID
     .authentication = 2,  // WPA/WPA2/WPA3
     .pPassPhrase = "???"  // WPA passphrase - replace with yours
 };
-static const uNetworkType_t gNetworkType = U_NETWORK_TYPE_WIFI;
-#endif
+static const linkMgrCfg_t gLinkCfg = {
+    .pCellCfg = &gCellCfg,
+    .pWifiCfg = &gWifiCfg,
+    .preferred = LINK_CELL,
+    .pCheckHost = "ubxlib.redirectme.net",
+    .checkPort = 5055,
+    .checkIntervalS = 60,
+    .failbackS = 30 * 60
+};
 
-uDeviceCfg_t gDeviceCfg;
+// Send to and read back data from an echo server using ubxlib sockets
+static bool echo(uDeviceHandle_t deviceHandle)
+{
+    uSockAddress_t address;
+    if (uSockGetHostByName(deviceHandle, "ubxlib.redirectme.net",
+                           &(address.ipAddress)) != 0) {
+        printf("* Failed to look up the echo server\n");
+        return false;
+    }
+    address.port = 5055;
+    int32_t sock = uSockCreate(deviceHandle,
+                               U_SOCK_TYPE_STREAM,
+                               U_SOCK_PROTOCOL_TCP);
+    int32_t errorCode = uSockConnect(sock, &address);
+    if (errorCode == 0) {
+        // Send data over the socket
+        const char message[] = "The quick brown fox jumps over the lazy dog.";
+        size_t size = strlen(message);
+        size_t sentSize = 0;
+        int32_t res = 0;
+        int64_t start = uPortGetTickTimeMs();
+        while (res >= 0 && sentSize < size) {
+            res = uSockWrite(sock, (void *)(message + sentSize),
+                             size - sentSize);
+            if (res > 0) {
+                sentSize += res;
+            }
+        }
+        // And read it back
+        char buffer[64];
+        size_t rxSize = 0;
+        while ((res >= 0) && (rxSize < sizeof(message) - 1)) {
+            res = uSockRead(sock, buffer + rxSize, sizeof(buffer) - rxSize);
+            if (res > 0) {
+                rxSize += res;
+            }
+        }
+        buffer[rxSize] = 0;
+        printf("Received: %s\n", buffer);
+        linkMgrReportTransfer(sentSize + rxSize, uPortGetTickTimeMs() - start);
+        errorCode = res < 0 ? res : 0;
+    } else {
+        printf("* Failed to connect: %d\n", errorCode);
+    }
+    uSockClose(sock);
+    return errorCode == 0;
+}
 
 void main()
 {
@@ -59,62 +111,23 @@ void main()
     // Initiate ubxlib
     uPortInit();
     uDeviceInit();
-    // And the U-blox module
-    int32_t errorCode;
-    uDeviceHandle_t deviceHandle;
-    uDeviceGetDefaults(gDeviceType, &gDeviceCfg);
-    printf("\nInitiating the module...\n");
-    errorCode = uDeviceOpen(&gDeviceCfg, &deviceHandle);
-    if (errorCode == 0) {
-        printf("Bringing up the network...\n");
-        errorCode = uNetworkInterfaceUp(deviceHandle, gNetworkType, &gNetworkCfg);
-        if (errorCode == 0) {
-            // Send to and read back data from an echo server using ubxlib sockets
-            uSockAddress_t address;
-            uSockGetHostByName(deviceHandle, "ubxlib.redirectme.net",
-                               &(address.ipAddress));
-            address.port = 5055;
-            int32_t sock = uSockCreate(deviceHandle,
-                                       U_SOCK_TYPE_STREAM,
-                                       U_SOCK_PROTOCOL_TCP);
-            errorCode = uSockConnect(sock, &address);
-            if (errorCode == 0) {
-                // Send data over the socket
-                const char message[] = "The quick brown fox jumps over the lazy dog.";
-                size_t size = strlen(message);
-                size_t sentSize = 0;
-                int32_t res = 0;
-                while (res >= 0 && sentSize < size) {
-                    int32_t res = uSockWrite(sock, (void *)(message + sentSize),
-                                             size - sentSize);
-                    if (res > 0) {
-                        sentSize += res;
-                    }
-                }
-                // And read it back
-                char buffer[64];
-                size_t rxSize = 0;
-                res = 0;
-                while ((res >= 0) && (rxSize < sizeof(message) - 1)) {
-                    res = uSockRead(sock, buffer + rxSize, sizeof(buffer) - rxSize);
-                    if (res > 0) {
-                        rxSize += res;
-                    }
-                }
-                buffer[rxSize] = 0;
-                printf("Received: %s\n", buffer);
-                uSockClose(sock);
-            } else {
-                printf("* Failed to connect: %d", errorCode);
-            }
-            printf("Closing down the network...\n");
-            uNetworkInterfaceDown(deviceHandle, gNetworkType);
+    // The link manager brings up the network and keeps it up
+    printf("\nBringing up the network...\n");
+    int32_t errorCode = linkMgrStart(&gLinkCfg);
+    if (errorCode != 0) {
+        printf("* Failed to start the link manager: %d\n", errorCode);
+    }
+    while (errorCode == 0) {
+        linkBearer_t bearer;
+        uDeviceHandle_t deviceHandle = linkMgrAcquire(ECHO_PERIOD_MS, &bearer);
+        if (deviceHandle != NULL) {
+            printf("Echo over %s\n", bearer == LINK_CELL ? "cellular" : "Wi-Fi");
+            linkMgrRelease(echo(deviceHandle));
+            linkMgrPrintStats();
+            uPortTaskBlock(ECHO_PERIOD_MS);
         } else {
-            printf("* Failed to bring up the network: %d\n", errorCode);
+            printf("* No network yet\n");
         }
-        uDeviceClose(deviceHandle, true);
-    } else {
-        printf("* Failed to initiate the module: %d\n", errorCode);
     }
 
     printf("\n== All done ==\n");
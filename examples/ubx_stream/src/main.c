@@ -0,0 +1,213 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ *
+ * A demo application showing how to receive raw binary UBX
+ * messages at high rate from the GNSS module, instead of using
+ * the one-shot location api. UBX-NAV-PVT is received at 10 Hz
+ * and UBX-NAV-SAT at 1 Hz. The messages are read straight into
+ * a ring buffer of fixed layout frames and then decoded in place.
+ * Throughput and drop counters are printed every second.
+ *
+ * IMPORTANT! ubxlib version 1.3 or later is required.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <kernel.h>
+
+#include "ubxlib.h"
+
+#include "ubx_parser.h"
+
+#define MEASUREMENT_PERIOD_MS 100
+// NAV-SAT once every 10 navigation solutions
+#define NAV_SAT_RATE 10
+#define HIGH_BAUD_RATE 115200
+// Each slot holds the largest NAV-SAT, about 3 kB
+#define RING_SLOTS 8
+#define REPORT_INTERVAL_MS 1000
+
+uDeviceCfg_t gDeviceCfg;
+
+static ubxFrame_t gFrames[RING_SLOTS];
+static ubxParser_t gParser;
+static volatile uint32_t gParseCycles = 0;
+
+// Called from the ubxlib message receive task. The message is read
+// directly into the next free ring slot.
+static void messageCallback(uDeviceHandle_t gnssHandle,
+                            const uGnssMessageId_t *pMessageId,
+                            int32_t errorCodeOrLength,
+                            void *pCallbackParam)
+{
+    (void)pMessageId;
+    (void)pCallbackParam;
+    if (errorCodeOrLength <= 0) {
+        return;
+    }
+    uint8_t *pSlot = ubxParserReserve(&gParser);
+    if (pSlot == NULL) {
+        gParser.stats.dropped++;
+    } else if (errorCodeOrLength > sizeof(gFrames[0].data)) {
+        gParser.stats.oversize++;
+    } else {
+        int32_t len = uGnssMsgReceiveCallbackRead(gnssHandle, (char *)pSlot,
+                                                  errorCodeOrLength);
+        uint32_t start = k_cycle_get_32();
+        if (len > 0) {
+            gParser.stats.bytes += len;
+            ubxParserCommit(&gParser, len, uPortGetTickTimeMs());
+        }
+        gParseCycles += k_cycle_get_32() - start;
+    }
+}
+
+// The GNSS starts at the default baud rate which is too slow
+// for 10 Hz output. Switch both ends to a higher rate.
+static int32_t openAtHighBaudRate(uDeviceHandle_t *pGnssHandle)
+{
+    int32_t errorCode = uDeviceOpen(&gDeviceCfg, pGnssHandle);
+    if (errorCode == 0) {
+        // No acknowledge will be received at the old baud rate
+        uGnssCfgValSet(*pGnssHandle, U_GNSS_CFG_VAL_KEY_ID_UART1_BAUDRATE_U4,
+                       HIGH_BAUD_RATE, U_GNSS_CFG_VAL_TRANSACTION_NONE,
+                       U_GNSS_CFG_VAL_LAYER_RAM);
+        uDeviceClose(*pGnssHandle, false);
+        uPortTaskBlock(100);
+    }
+    // Open at the new rate. Also works when the module is
+    // already at the higher rate from an earlier run.
+    gDeviceCfg.transportCfg.cfgUart.baudRate = HIGH_BAUD_RATE;
+    return uDeviceOpen(&gDeviceCfg, pGnssHandle);
+}
+
+static bool configureOutput(uDeviceHandle_t gnssHandle)
+{
+    uGnssMessageId_t pvtId = {
+        .type = U_GNSS_PROTOCOL_UBX,
+        .id.ubx = (UBX_CLASS_NAV << 8) | UBX_ID_NAV_PVT
+    };
+    uGnssMessageId_t satId = {
+        .type = U_GNSS_PROTOCOL_UBX,
+        .id.ubx = (UBX_CLASS_NAV << 8) | UBX_ID_NAV_SAT
+    };
+    // NMEA is not needed, save the bandwidth
+    uGnssCfgValSet(gnssHandle, U_GNSS_CFG_VAL_KEY_ID_UART1OUTPROT_NMEA_L, 0,
+                   U_GNSS_CFG_VAL_TRANSACTION_NONE, U_GNSS_CFG_VAL_LAYER_RAM);
+    return uGnssCfgSetRate(gnssHandle, MEASUREMENT_PERIOD_MS, 1, -1) == 0 &&
+           uGnssCfgSetMsgRate(gnssHandle, &pvtId, 1) == 0 &&
+           uGnssCfgSetMsgRate(gnssHandle, &satId, NAV_SAT_RATE) == 0 &&
+           uGnssMsgReceiveStart(gnssHandle, &pvtId, messageCallback, NULL) >= 0 &&
+           uGnssMsgReceiveStart(gnssHandle, &satId, messageCallback, NULL) >= 0;
+}
+
+static void report(const ubxNavPvt_t *pPvt, const ubxNavSat_t *pSat, size_t satLen,
+                   ubxStats_t *pPrevStats, uint32_t pvtCnt)
+{
+    ubxStats_t *pStats = &gParser.stats;
+    uint32_t frames = pStats->frames - pPrevStats->frames;
+    printf("%u frames/s, %u bytes/s, %u PVT/s, parse %u us/frame,"
+           " dropped %u, checksum errors %u, rejected %u, oversize %u\n",
+           frames, pStats->bytes - pPrevStats->bytes, pvtCnt,
+           frames ? k_cyc_to_us_floor32(gParseCycles) / frames : 0,
+           pStats->dropped, pStats->checksumErrors, pStats->rejected,
+           pStats->oversize);
+    gParseCycles = 0;
+    *pPrevStats = *pStats;
+    if (pPvt) {
+        printf("  Fix type %d, %d satellites, lat %d lon %d (1e-7 deg),"
+               " speed %d mm/s, hAcc %u mm\n",
+               pPvt->fixType, pPvt->numSV, pPvt->lat, pPvt->lon,
+               pPvt->gSpeed, pPvt->hAcc);
+    }
+    if (pSat) {
+        int used = 0;
+        // Don't trust numSvs beyond what was received
+        int svCnt = MIN(pSat->numSvs, (satLen - UBX_NAV_SAT_HEADER_SIZE) / UBX_NAV_SAT_SV_SIZE);
+        for (int i = 0; i < svCnt; i++) {
+            // Bit 3 of flags: used for navigation
+            used += (pSat->sv[i].flags >> 3) & 1;
+        }
+        printf("  %d satellites visible, %d used\n", pSat->numSvs, used);
+    }
+}
+
+void main()
+{
+    // Remove the line below if you want the log printouts from ubxlib
+    uPortLogOff();
+    // Initiate ubxlib
+    uPortInit();
+    uDeviceInit();
+    ubxParserInit(&gParser, gFrames, RING_SLOTS);
+    int32_t errorCode;
+    uDeviceHandle_t gnssHandle;
+    uDeviceGetDefaults(U_DEVICE_TYPE_GNSS, &gDeviceCfg);
+    printf("\nInitiating the module...\n");
+    errorCode = openAtHighBaudRate(&gnssHandle);
+    if (errorCode == 0) {
+        if (configureOutput(gnssHandle)) {
+            printf("Receiving UBX messages...\n");
+            ubxStats_t prevStats = gParser.stats;
+            ubxNavPvt_t pvt;
+            ubxNavSat_t *pSat = NULL;
+            static uint8_t satBuffer[UBX_MAX_PAYLOAD];
+            size_t satLen = 0;
+            bool hasPvt = false;
+            uint32_t pvtCnt = 0;
+            int64_t nextReport = uPortGetTickTimeMs() + REPORT_INTERVAL_MS;
+            while (true) {
+                const ubxFrame_t *pFrame;
+                while ((pFrame = ubxParserPeek(&gParser)) != NULL) {
+                    size_t len;
+                    const uint8_t *pPayload = ubxFramePayload(pFrame, &len);
+                    if (ubxFrameIs(pFrame, UBX_CLASS_NAV, UBX_ID_NAV_PVT) &&
+                        len == sizeof(ubxNavPvt_t)) {
+                        // A real application would do its dead reckoning
+                        // directly on the frame here. Keep the latest
+                        // for the printout only.
+                        pvt = *(const ubxNavPvt_t *)pPayload;
+                        hasPvt = true;
+                        pvtCnt++;
+                    } else if (ubxFrameIs(pFrame, UBX_CLASS_NAV, UBX_ID_NAV_SAT) &&
+                               len >= UBX_NAV_SAT_HEADER_SIZE && len <= sizeof(satBuffer)) {
+                        memcpy(satBuffer, pPayload, len);
+                        satLen = len;
+                        pSat = (ubxNavSat_t *)satBuffer;
+                    }
+                    ubxParserRelease(&gParser);
+                }
+                if (uPortGetTickTimeMs() >= nextReport) {
+                    report(hasPvt ? &pvt : NULL, pSat, satLen, &prevStats, pvtCnt);
+                    pvtCnt = 0;
+                    nextReport += REPORT_INTERVAL_MS;
+                }
+                uPortTaskBlock(MEASUREMENT_PERIOD_MS / 2);
+            }
+        } else {
+            printf("* Failed to configure the message output\n");
+        }
+        uDeviceClose(gnssHandle, true);
+    } else {
+        printf("* Failed to initiate the module: %d\n", errorCode);
+    }
+
+    printf("\n== All done ==\n");
+}
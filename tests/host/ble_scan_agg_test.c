@@ -0,0 +1,204 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of common/ble_scan_agg. A storm of adverts from more
+ * devices than there are slots is checked against a simple model of
+ * the expected contents, with snapshots of random sizes in between.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "ble_scan_agg.h"
+#include "test.h"
+
+#define CAPACITY 256
+#define DEVICES 400
+#define STORM_ADVERTS 1000000
+#define CHECK_EVERY 1000
+
+BLE_SCAN_AGG_DEFINE(gAgg, CAPACITY);
+
+typedef struct {
+    bool present;
+    uint32_t lastSeenMs;
+    uint32_t count;
+    uint32_t windowCount;
+} model_t;
+
+static model_t gModel[DEVICES];
+static size_t gPresent = 0;
+static bleScanAggEntry_t gOut[CAPACITY];
+
+static void makeAddr(int device, uint8_t *pAddr)
+{
+    memset(pAddr, 0, BLE_SCAN_AGG_ADDR_SIZE);
+    pAddr[1] = device & 0xFF;
+    pAddr[2] = device >> 8;
+    pAddr[6] = 0xC0;
+}
+
+static int deviceOf(const uint8_t *pAddr)
+{
+    return pAddr[1] | (pAddr[2] << 8);
+}
+
+static void modelAdd(int device, uint32_t nowMs)
+{
+    model_t *pDevice = &gModel[device];
+    if (!pDevice->present) {
+        if (gPresent == CAPACITY) {
+            // Evict the least recently seen
+            int oldest = -1;
+            for (int i = 0; i < DEVICES; i++) {
+                if (gModel[i].present &&
+                    (oldest < 0 || gModel[i].lastSeenMs < gModel[oldest].lastSeenMs)) {
+                    oldest = i;
+                }
+            }
+            gModel[oldest].present = false;
+            gPresent--;
+        }
+        memset(pDevice, 0, sizeof(model_t));
+        pDevice->present = true;
+        gPresent++;
+    }
+    pDevice->lastSeenMs = nowMs;
+    pDevice->count++;
+    pDevice->windowCount++;
+}
+
+static size_t modelWindowCnt()
+{
+    size_t cnt = 0;
+    for (int i = 0; i < DEVICES; i++) {
+        cnt += gModel[i].present && gModel[i].windowCount > 0;
+    }
+    return cnt;
+}
+
+// Every device in the model must be found with the same counts
+static void checkContents()
+{
+    CHECK(gAgg.used == gPresent);
+    CHECK(gAgg.windowCnt == modelWindowCnt());
+    uint8_t addr[BLE_SCAN_AGG_ADDR_SIZE];
+    for (int i = 0; i < DEVICES; i++) {
+        makeAddr(i, addr);
+        const bleScanAggEntry_t *pEntry = bleScanAggFind(&gAgg, addr);
+        CHECK((pEntry != NULL) == gModel[i].present);
+        if (pEntry != NULL && gModel[i].present) {
+            CHECK(pEntry->count == gModel[i].count);
+            CHECK(pEntry->windowCount == gModel[i].windowCount);
+            CHECK(pEntry->lastSeenMs == gModel[i].lastSeenMs);
+        }
+    }
+}
+
+// Most recently seen first, only the ones in the window
+static void checkSnapshot(size_t maxCnt, uint32_t nowMs)
+{
+    size_t expected = modelWindowCnt();
+    if (expected > maxCnt) {
+        expected = maxCnt;
+    }
+    size_t cnt = bleScanAggSnapshot(&gAgg, gOut, maxCnt, nowMs);
+    CHECK(cnt == expected);
+    for (size_t i = 0; i < cnt; i++) {
+        int device = deviceOf(gOut[i].addr);
+        CHECK(device < DEVICES && gModel[device].present);
+        CHECK(gOut[i].windowCount == gModel[device].windowCount);
+        CHECK(gOut[i].windowCount > 0);
+        if (i > 0) {
+            CHECK(gOut[i].lastSeenMs < gOut[i - 1].lastSeenMs);
+        }
+        gModel[device].windowCount = 0;
+    }
+    // No device in the window may be more recent than the last copied
+    if (cnt > 0) {
+        for (int i = 0; i < DEVICES; i++) {
+            if (gModel[i].present && gModel[i].windowCount > 0) {
+                CHECK(gModel[i].lastSeenMs < gOut[cnt - 1].lastSeenMs);
+            }
+        }
+    }
+}
+
+static void add(int device, uint32_t nowMs)
+{
+    uint8_t addr[BLE_SCAN_AGG_ADDR_SIZE];
+    uint8_t data[4] = {device, nowMs, nowMs >> 8, nowMs >> 16};
+    makeAddr(device, addr);
+    int8_t rssi = -40 - (int8_t)(testRand() % 60);
+    const bleScanAggEntry_t *pEntry = bleScanAggAdd(&gAgg, addr, rssi, data,
+                                                    sizeof(data), nowMs);
+    modelAdd(device, nowMs);
+    CHECK(pEntry->lastSeenMs == nowMs);
+    CHECK(pEntry->rssiMin <= rssi && pEntry->rssiMax >= rssi);
+    CHECK(pEntry->payloadHash == bleScanAggHash(data, sizeof(data)));
+}
+
+// A truncated snapshot leaves the rest for the next one
+static void testTruncated()
+{
+    bleScanAggInit(&gAgg);
+    memset(gModel, 0, sizeof(gModel));
+    gPresent = 0;
+    uint32_t nowMs = 1;
+    for (int i = 0; i < 6; i++) {
+        add(i, nowMs++);
+    }
+    add(0, nowMs++);
+    checkSnapshot(3, nowMs++);
+    CHECK(gAgg.windowCnt == 3);
+    add(7, nowMs++);
+    add(5, nowMs++);
+    checkSnapshot(CAPACITY, nowMs++);
+    CHECK(gAgg.windowCnt == 0);
+    checkSnapshot(CAPACITY, nowMs++);
+    checkContents();
+}
+
+static void testStorm()
+{
+    bleScanAggInit(&gAgg);
+    memset(gModel, 0, sizeof(gModel));
+    gPresent = 0;
+    testSeed(29);
+    clock_t start = clock();
+    for (uint32_t nowMs = 1; nowMs <= STORM_ADVERTS; nowMs++) {
+        // Some devices much more often than others
+        int device = testRand() % (testRand() % 2 ? DEVICES : 64);
+        add(device, nowMs);
+        if (nowMs % CHECK_EVERY == 0) {
+            checkContents();
+            checkSnapshot(1 + testRand() % CAPACITY, nowMs);
+        }
+    }
+    double s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("%u adverts, %u evictions, %.1f s including the checks\n",
+           gAgg.adverts, gAgg.evictions, s);
+    CHECK(gAgg.adverts == STORM_ADVERTS);
+    CHECK(gAgg.evictions > 0);
+}
+
+int main()
+{
+    testTruncated();
+    testStorm();
+    return TEST_RESULT();
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the path helpers and the handle cache in common/ext_fs.
+ * Several threads open, read and release files at the same time, and
+ * a file held by one of them must not be deleted or renamed.
+ */
+
+#include <string.h>
+
+#include "ext_fs.h"
+#include "test.h"
+
+#define FILE_CNT 6
+#define THREAD_CNT 3
+#define ROUNDS 20000
+
+static struct k_thread gThreads[THREAD_CNT];
+K_THREAD_STACK_DEFINE(gStack, 1);
+static volatile int gDone = 0;
+static K_MUTEX_DEFINE(gDoneLock);
+
+static void makeFiles()
+{
+    for (int i = 0; i < FILE_CNT; i++) {
+        char name[16];
+        extFsPath_t path;
+        snprintf(name, sizeof(name), "f%d.txt", i);
+        struct fs_file_t file;
+        fs_file_t_init(&file);
+        CHECK(fs_open(&file, extFsPathMake(name, path), FS_O_CREATE | FS_O_WRITE) == 0);
+        CHECK(fs_write(&file, name, strlen(name)) == (ssize_t)strlen(name));
+        fs_close(&file);
+    }
+}
+
+static void worker(void *p1, void *p2, void *p3)
+{
+    long id = (long)p1;
+    for (int i = 0; i < ROUNDS; i++) {
+        char name[16];
+        extFsPath_t path;
+        snprintf(name, sizeof(name), "f%ld.txt", (id + i) % FILE_CNT);
+        extFsPathMake(name, path);
+        CHECK(strstr(path, name) != NULL);
+        struct fs_file_t *pFile = extFsHandleOpen(path, FS_O_READ);
+        if (pFile != NULL) {
+            // Given at the start of the file
+            char data[16] = {0};
+            CHECK(fs_read(pFile, data, sizeof(data) - 1) == (ssize_t)strlen(name));
+            CHECK(strcmp(data, name) == 0);
+            extFsHandleRelease(pFile);
+        }
+        size_t size;
+        CHECK(extFsFileSize(path, &size) && size == strlen(name));
+    }
+    k_mutex_lock(&gDoneLock, K_FOREVER);
+    gDone++;
+    k_mutex_unlock(&gDoneLock);
+}
+
+int main()
+{
+    stubFsClear(&stubFstab_lfs);
+    CHECK(extFsInit());
+    makeFiles();
+
+    for (long i = 0; i < THREAD_CNT; i++) {
+        k_thread_create(&gThreads[i], gStack, K_THREAD_STACK_SIZEOF(gStack), worker,
+                        (void *)i, NULL, NULL, 7, 0, K_NO_WAIT);
+    }
+    while (gDone < THREAD_CNT) {
+        k_msleep(10);
+    }
+    printf("%u opens for %d reads, at most %u files open\n", gStubFsStats.opens,
+           THREAD_CNT * ROUNDS, gStubFsStats.maxOpenFiles);
+    CHECK(gStubFsStats.maxOpenFiles <= EXT_FS_HANDLE_CACHE_SIZE);
+    CHECK(gStubFsStats.opens < THREAD_CNT * ROUNDS);
+
+    // Reused while cached
+    extFsPath_t path;
+    extFsPath_t toPath;
+    extFsPathMake("f1.txt", path);
+    extFsPathMake("g1.txt", toPath);
+    uint32_t opens = gStubFsStats.opens;
+    struct fs_file_t *pFile;
+    for (int i = 0; i < 100; i++) {
+        pFile = extFsHandleOpen(path, FS_O_READ);
+        CHECK(pFile != NULL);
+        extFsHandleRelease(pFile);
+    }
+    CHECK(gStubFsStats.opens - opens <= 1);
+
+    // A held file is neither deleted nor renamed
+    pFile = extFsHandleOpen(path, FS_O_READ);
+    CHECK(pFile != NULL);
+    CHECK(!extFsDelete(path));
+    CHECK(!extFsRename(path, toPath));
+    CHECK(!extFsRename(toPath, path));
+    CHECK(extFsFileExists(path));
+    extFsHandleRelease(pFile);
+    // Once released the cached handle is closed first
+    CHECK(extFsRename(path, toPath));
+    CHECK(!extFsFileExists(path));
+    CHECK(extFsDelete(toPath));
+    CHECK(!extFsFileExists(toPath));
+
+    CHECK(extFsHandleDrop(NULL));
+    CHECK(gStubFsStats.openFiles == 0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the directory index in common/ext_fs. The index is
+ * checked against the directory after each change made through
+ * ext_fs, including when there are more files than entries.
+ */
+
+#include <string.h>
+
+#include "ext_fs.h"
+#include "test.h"
+
+#define MAX_CNT 8
+#define DIR_NAME "logs"
+#define PREFIX "seg_"
+#define SUFFIX ".txt"
+
+static extFsIndexEntry_t gEntries[MAX_CNT];
+static extFsIndex_t gIndex;
+
+static void writeFile(const char *pName, size_t size)
+{
+    extFsPath_t path;
+    char name[64];
+    snprintf(name, sizeof(name), DIR_NAME "/%s", pName);
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    CHECK(fs_open(&file, extFsPathMake(name, path), FS_O_CREATE | FS_O_WRITE) == 0);
+    static const char data[100] = {0};
+    CHECK(fs_write(&file, data, size) == (ssize_t)size);
+    fs_close(&file);
+}
+
+static void writeSeq(uint32_t seq, size_t size)
+{
+    static extFsWriter_t writer;
+    extFsPath_t path;
+    CHECK(extFsWriterOpen(&writer, extFsIndexPath(&gIndex, seq, path), true));
+    static const char data[100] = {0};
+    CHECK(extFsWriterAppend(&writer, data, size));
+    CHECK(extFsWriterClose(&writer));
+}
+
+// The entries in order, and the total size, must be as expected
+static void checkIndex(const uint32_t *pSeqs, const uint32_t *pSizes, size_t cnt)
+{
+    CHECK(gIndex.cnt == cnt);
+    uint32_t total = 0;
+    extFsIndexEntry_t entry;
+    for (size_t i = 0; i < cnt; i++) {
+        CHECK(extFsIndexFind(&gIndex, pSeqs[i], &entry));
+        CHECK(entry.seq == pSeqs[i] && entry.size == pSizes[i]);
+        total += pSizes[i];
+    }
+    CHECK(gIndex.totalSize == total);
+    if (cnt > 0) {
+        CHECK(extFsIndexOldest(&gIndex, &entry) && entry.seq == pSeqs[0]);
+        CHECK(extFsIndexNewest(&gIndex, &entry) && entry.seq == pSeqs[cnt - 1]);
+    } else {
+        CHECK(!extFsIndexOldest(&gIndex, &entry));
+        CHECK(!extFsIndexNewest(&gIndex, &entry));
+    }
+}
+
+int main()
+{
+    stubFsClear(&stubFstab_lfs);
+    CHECK(extFsInit());
+    extFsPath_t path;
+    extFsPath_t toPath;
+    fs_mkdir(extFsPathMake(DIR_NAME, path));
+    // Out of order, and names which are not part of the index
+    writeFile("seg_00000007.txt", 2);
+    writeFile("seg_00000003.txt", 1);
+    writeFile("other.txt", 5);
+    writeFile("seg_123.txt", 5);
+    writeFile("seg_00000009.bin", 5);
+
+    CHECK(extFsIndexInit(&gIndex, DIR_NAME, PREFIX, SUFFIX, gEntries, MAX_CNT));
+    CHECK(!gIndex.overflow);
+    checkIndex((uint32_t[]) {3, 7}, (uint32_t[]) {1, 2}, 2);
+    extFsIndexEntry_t entry;
+    CHECK(!extFsIndexFind(&gIndex, 5, &entry));
+    CHECK(strcmp(extFsIndexPath(&gIndex, 5, path) + strlen(path) - 16, "seg_00000005.txt") == 0);
+
+    // Appended by the writer and by create
+    for (uint32_t seq = 8; seq < 11; seq++) {
+        writeSeq(seq, 10 * seq);
+    }
+    CHECK(extFsCreate(extFsIndexPath(&gIndex, 20, path)));
+    checkIndex((uint32_t[]) {3, 7, 8, 9, 10, 20}, (uint32_t[]) {1, 2, 80, 90, 100, 0}, 6);
+
+    // Deleting the oldest and one in the middle
+    CHECK(extFsDelete(extFsIndexPath(&gIndex, 3, path)));
+    CHECK(extFsDelete(extFsIndexPath(&gIndex, 9, path)));
+    checkIndex((uint32_t[]) {7, 8, 10, 20}, (uint32_t[]) {2, 80, 100, 0}, 4);
+
+    // Renamed to before the oldest, and out of the index
+    CHECK(extFsRename(extFsIndexPath(&gIndex, 10, path), extFsIndexPath(&gIndex, 5, toPath)));
+    checkIndex((uint32_t[]) {5, 7, 8, 20}, (uint32_t[]) {100, 2, 80, 0}, 4);
+    CHECK(extFsRename(extFsIndexPath(&gIndex, 8, path), extFsPathMake(DIR_NAME "/old.txt", toPath)));
+    checkIndex((uint32_t[]) {5, 7, 20}, (uint32_t[]) {100, 2, 0}, 3);
+    // Replacing an indexed file
+    CHECK(extFsRename(extFsIndexPath(&gIndex, 5, path), extFsIndexPath(&gIndex, 7, toPath)));
+    checkIndex((uint32_t[]) {7, 20}, (uint32_t[]) {100, 0}, 2);
+
+    // Changed without ext_fs
+    writeFile("seg_00000021.txt", 21);
+    extFsIndexUpdate(extFsIndexPath(&gIndex, 21, path));
+    checkIndex((uint32_t[]) {7, 20, 21}, (uint32_t[]) {100, 0, 21}, 3);
+
+    // More files than entries, the oldest are left out
+    for (uint32_t seq = 30; seq < 37; seq++) {
+        writeSeq(seq, 1);
+    }
+    CHECK(gIndex.overflow);
+    checkIndex((uint32_t[]) {21, 30, 31, 32, 33, 34, 35, 36},
+               (uint32_t[]) {21, 1, 1, 1, 1, 1, 1, 1}, MAX_CNT);
+    // A file older than everything indexed is not taken in
+    writeSeq(1, 1);
+    checkIndex((uint32_t[]) {21, 30, 31, 32, 33, 34, 35, 36},
+               (uint32_t[]) {21, 1, 1, 1, 1, 1, 1, 1}, MAX_CNT);
+
+    // Reading the directory again, it doesn't fit
+    extFsIndexDeinit(&gIndex);
+    CHECK(!extFsIndexInit(&gIndex, DIR_NAME, PREFIX, SUFFIX, gEntries, MAX_CNT));
+    CHECK(gIndex.overflow);
+    // Not kept up to date
+    size_t cnt = gIndex.cnt;
+    writeSeq(40, 1);
+    CHECK(gIndex.cnt == cnt);
+    return TEST_RESULT();
+}
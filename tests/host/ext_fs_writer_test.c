@@ -0,0 +1,125 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of the streaming writer in common/ext_fs. Small and large
+ * appends to an existing file must give the same content as writing
+ * it directly, with every file system write but the last ending at a
+ * multiple of EXT_FS_WRITER_BUFFER_SIZE in the file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ext_fs.h"
+#include "test.h"
+
+#define EXISTING_SIZE 100
+#define RECORD_SIZE 12
+#define RECORD_CNT 3000
+#define LARGE_SIZE 10000
+#define TOTAL_SIZE (EXISTING_SIZE + RECORD_CNT * RECORD_SIZE + LARGE_SIZE)
+
+static uint8_t gExpected[TOTAL_SIZE];
+static uint8_t gRead[TOTAL_SIZE + 1];
+static uint32_t gWriteCnt = 0;
+static uint32_t gUnaligned = 0;
+static uint32_t gLastEnd = 0;
+
+static void writeCb(off_t offset, size_t size)
+{
+    // Only the last write may end elsewhere
+    if (gLastEnd % EXT_FS_WRITER_BUFFER_SIZE != 0 && gWriteCnt > 0) {
+        gUnaligned++;
+    }
+    CHECK(offset == gLastEnd || gWriteCnt == 0);
+    gLastEnd = offset + size;
+    gWriteCnt++;
+}
+
+static size_t readAll(const char *pPath)
+{
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    if (fs_open(&file, pPath, FS_O_READ) != 0) {
+        return 0;
+    }
+    ssize_t len = fs_read(&file, gRead, sizeof(gRead));
+    fs_close(&file);
+    return len > 0 ? len : 0;
+}
+
+int main()
+{
+    stubFsClear(&stubFstab_lfs);
+    CHECK(extFsInit());
+    testSeed(39);
+    for (size_t i = 0; i < sizeof(gExpected); i++) {
+        gExpected[i] = testRand();
+    }
+    extFsPath_t path;
+    extFsPathMake("log.bin", path);
+
+    // An existing file of a size which is not a multiple of the buffer
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    CHECK(fs_open(&file, path, FS_O_CREATE | FS_O_WRITE) == 0);
+    CHECK(fs_write(&file, gExpected, EXISTING_SIZE) == EXISTING_SIZE);
+    fs_close(&file);
+
+    static extFsWriter_t writer;
+    int32_t freeBefore = extFsFree();
+    gpStubFsWriteCb = writeCb;
+    gLastEnd = EXISTING_SIZE;
+    CHECK(extFsWriterOpen(&writer, path, false));
+    CHECK(writer.position == EXISTING_SIZE);
+    const uint8_t *pData = &gExpected[EXISTING_SIZE];
+    for (int i = 0; i < RECORD_CNT; i++) {
+        CHECK(extFsWriterAppend(&writer, pData, RECORD_SIZE));
+        pData += RECORD_SIZE;
+    }
+    // Larger than the buffer, partly written straight from the caller
+    CHECK(extFsWriterAppend(&writer, pData, LARGE_SIZE));
+    CHECK(extFsWriterClose(&writer));
+    gpStubFsWriteCb = NULL;
+
+    printf("%u appends of %u bytes, %u writes of %u bytes, %u syncs\n",
+           writer.appends, writer.appendedBytes, writer.writes,
+           writer.writtenBytes, writer.syncs);
+    CHECK(writer.appends == RECORD_CNT + 1);
+    CHECK(writer.appendedBytes == TOTAL_SIZE - EXISTING_SIZE);
+    CHECK(writer.writtenBytes == TOTAL_SIZE - EXISTING_SIZE);
+    CHECK(writer.writes == gWriteCnt);
+    CHECK(writer.writes <= (TOTAL_SIZE / EXT_FS_WRITER_BUFFER_SIZE) + 2);
+    CHECK(gUnaligned == 0);
+    CHECK(gLastEnd == TOTAL_SIZE);
+    CHECK(readAll(path) == TOTAL_SIZE);
+    CHECK(memcmp(gRead, gExpected, TOTAL_SIZE) == 0);
+    // The estimate follows the writes
+    CHECK(freeBefore - extFsFree() == (TOTAL_SIZE - EXISTING_SIZE) / 1024 ||
+          freeBefore - extFsFree() == (TOTAL_SIZE - EXISTING_SIZE) / 1024 + 1);
+
+    // Truncating starts from an empty file
+    CHECK(extFsWriterOpen(&writer, path, true));
+    CHECK(writer.position == 0);
+    CHECK(extFsWriterAppend(&writer, gExpected, RECORD_SIZE));
+    CHECK(extFsWriterSync(&writer));
+    CHECK(writer.syncs == 1);
+    CHECK(extFsWriterClose(&writer));
+    CHECK(readAll(path) == RECORD_SIZE);
+    CHECK(memcmp(gRead, gExpected, RECORD_SIZE) == 0);
+    return TEST_RESULT();
+}
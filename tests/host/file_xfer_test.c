@@ -0,0 +1,156 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of common/file_xfer over its loopback connection. A file
+ * is listed and downloaded, with frames corrupted in both directions,
+ * resuming after failures until it is complete. The result must be
+ * the same bytes as the file.
+ */
+
+#include <string.h>
+
+#include "ext_fs.h"
+#include "file_xfer.h"
+#include "test.h"
+
+#define FILE_NAME "log.bin"
+#define FILE_SIZE 200003
+#define MAX_TRIES 50
+
+static uint8_t gExpected[FILE_SIZE];
+static uint8_t gReceived[FILE_SIZE];
+static uint32_t gListed;
+static uint32_t gListedSize;
+
+static fileXferLoopback_t gLoop;
+static fileXferTransport_t gServer;
+static fileXferTransport_t gClient;
+static fileXferStats_t gServerStats;
+static struct k_thread gThread;
+K_THREAD_STACK_DEFINE(gStack, 1);
+static atomic_t gStop = ATOMIC_INIT(0);
+static atomic_t gStopped = ATOMIC_INIT(0);
+
+static void serverTask(void *p1, void *p2, void *p3)
+{
+    while (!atomic_get(&gStop)) {
+        fileXferServe(&gServer, 100, &gServerStats);
+    }
+    atomic_set(&gStopped, 1);
+}
+
+static void listCb(const char *pName, uint32_t size, void *pParam)
+{
+    gListed++;
+    if (strcmp(pName, FILE_NAME) == 0) {
+        gListedSize = size;
+    }
+}
+
+static bool dataCb(uint32_t offset, const uint8_t *pData, size_t len, void *pParam)
+{
+    // Must be given in order, without gaps
+    uint32_t *pNext = pParam;
+    CHECK(offset == *pNext && offset + len <= FILE_SIZE);
+    if (offset != *pNext || offset + len > FILE_SIZE) {
+        return false;
+    }
+    memcpy(&gReceived[offset], pData, len);
+    *pNext += len;
+    return true;
+}
+
+static void makeFiles()
+{
+    testSeed(38);
+    for (size_t i = 0; i < sizeof(gExpected); i++) {
+        gExpected[i] = testRand();
+    }
+    extFsPath_t path;
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    CHECK(fs_open(&file, extFsPathMake(FILE_NAME, path), FS_O_CREATE | FS_O_WRITE) == 0);
+    CHECK(fs_write(&file, gExpected, FILE_SIZE) == FILE_SIZE);
+    fs_close(&file);
+    CHECK(extFsCreate(extFsPathMake("empty.txt", path)));
+}
+
+static void testDownload(uint32_t corruptEvery)
+{
+    fileXferLoopbackInit(&gLoop, &gServer, &gClient, corruptEvery);
+    memset(&gServerStats, 0, sizeof(gServerStats));
+    atomic_set(&gStop, 0);
+    atomic_set(&gStopped, 0);
+    k_thread_create(&gThread, gStack, K_THREAD_STACK_SIZEOF(gStack), serverTask,
+                    NULL, NULL, NULL, 7, 0, K_NO_WAIT);
+
+    // The list may fail when corrupted, it is only checked without
+    gListed = 0;
+    gListedSize = 0;
+    int32_t res = fileXferList(&gClient, listCb, NULL);
+    if (corruptEvery == 0) {
+        CHECK(res == 2 && gListed == 2);
+        CHECK(gListedSize == FILE_SIZE);
+    }
+
+    memset(gReceived, 0, sizeof(gReceived));
+    fileXferStats_t stats = {0};
+    uint32_t offset = 0;
+    uint32_t next = 0;
+    int tries = 0;
+    do {
+        res = fileXferGet(&gClient, FILE_NAME, &offset, FILE_XFER_MAX_WINDOW,
+                          dataCb, &next, &stats);
+        tries++;
+        CHECK(offset == next);
+    } while (res != 0 && tries < MAX_TRIES);
+    printf("Corrupting every %u: %d tries, %u frames, %u crc errors, %u resends\n",
+           corruptEvery, tries, stats.frames, stats.crcErrors + gServerStats.crcErrors,
+           gServerStats.resends);
+    CHECK(res == 0);
+    CHECK(offset == FILE_SIZE);
+    CHECK(memcmp(gReceived, gExpected, FILE_SIZE) == 0);
+    if (corruptEvery == 0) {
+        CHECK(tries == 1);
+        CHECK(stats.crcErrors == 0 && gServerStats.crcErrors == 0);
+        CHECK(gServerStats.resends == 0);
+    } else {
+        CHECK(stats.crcErrors + gServerStats.crcErrors > 0);
+    }
+
+    // A file which doesn't exist
+    offset = 0;
+    if (corruptEvery == 0) {
+        CHECK(fileXferGet(&gClient, "none.bin", &offset, 1, dataCb, &next, NULL) < 0);
+    }
+
+    atomic_set(&gStop, 1);
+    while (!atomic_get(&gStopped)) {
+        k_msleep(10);
+    }
+}
+
+int main()
+{
+    stubFsClear(&stubFstab_lfs);
+    CHECK(extFsInit());
+    makeFiles();
+    testDownload(0);
+    testDownload(3);
+    testDownload(7);
+    return TEST_RESULT();
+}
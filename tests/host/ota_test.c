@@ -0,0 +1,407 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of common/ota against a simulated flash with the primary
+ * slot as area 0 and the secondary slot as area 1. A delta is applied
+ * with resets at random points, a full image is downloaded over HTTP
+ * from a server which drops the connection, and the installed id is
+ * only saved when the image MCUboot swapped in is the update. The
+ * counters and sockets are simulated here.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <kernel.h>
+#include <storage/flash_map.h>
+#include <dfu/mcuboot.h>
+#include <sys/crc.h>
+
+#include "counters.h"
+#include "ota.h"
+#include "test.h"
+
+#define OLD_SIZE 150000
+#define NEW_SIZE 135000
+// The new image: the start of the old one with changes, new data, and
+// a later part of the old one
+#define ADD_LEN 40000
+#define INSERT_LEN 5000
+#define COPY_FROM 60000
+#define COPY_LEN (NEW_SIZE - ADD_LEN - INSERT_LEN)
+#define IMAGE_MAGIC 0x96f3b83d
+#define IMAGE_HEADER_SIZE 32
+
+#define DELTA_ID 6
+#define HTTP_ID 7
+#define HTTP_DROP_AFTER 50000
+
+static uint8_t gOld[OLD_SIZE];
+static uint8_t gNew[NEW_SIZE];
+static uint8_t gDelta[NEW_SIZE];
+static size_t gDeltaLen = 0;
+static uint32_t gProgressCnt = 0;
+
+/* ----------------------------------------------------------------
+ * Counters, kept over a simulated reset
+ * -------------------------------------------------------------- */
+
+static uint32_t gCounters[32];
+static uint8_t gBlobs[32][64];
+static size_t gBlobLens[32];
+
+uint32_t counterGet(uint16_t id)
+{
+    return gCounters[id];
+}
+
+int32_t counterSet(uint16_t id, uint32_t value)
+{
+    gCounters[id] = value;
+    return 0;
+}
+
+int32_t counterBlobSet(uint16_t id, const void *pData, size_t len)
+{
+    if (len > sizeof(gBlobs[id])) {
+        return -EINVAL;
+    }
+    memcpy(gBlobs[id], pData, len);
+    gBlobLens[id] = len;
+    return 0;
+}
+
+int32_t counterBlobGet(uint16_t id, void *pData, size_t len)
+{
+    memcpy(pData, gBlobs[id], MIN(len, gBlobLens[id]));
+    return gBlobLens[id];
+}
+
+/* ----------------------------------------------------------------
+ * A HTTP server which supports ranges and drops each connection
+ * after HTTP_DROP_AFTER bytes of the body
+ * -------------------------------------------------------------- */
+
+static const uint8_t *gpServed;
+static size_t gServedLen;
+static char gRequest[256];
+static size_t gRequestLen;
+static char gResponseHeader[128];
+static size_t gHeaderLen;
+static size_t gHeaderSent;
+static size_t gBodyPos;
+static size_t gBodyEnd;
+static uint32_t gRanges[32];
+static uint32_t gRangeCnt = 0;
+
+int32_t uSockGetHostByName(uDeviceHandle_t devHandle, const char *pHostName,
+                           uSockIpAddress_t *pHostIpAddress)
+{
+    pHostIpAddress->ipv4 = 0x7F000001;
+    return 0;
+}
+
+int32_t uSockCreate(uDeviceHandle_t devHandle, uSockType_t type, uSockProtocol_t protocol)
+{
+    gRequestLen = 0;
+    gHeaderLen = 0;
+    return 1;
+}
+
+int32_t uSockConnect(int32_t descriptor, const uSockAddress_t *pRemoteAddress)
+{
+    return 0;
+}
+
+int32_t uSockWrite(int32_t descriptor, const void *pData, size_t dataSizeBytes)
+{
+    // Only a few bytes at a time
+    size_t len = 1 + testRand() % 20;
+    len = MIN(len, dataSizeBytes);
+    if (gRequestLen + len >= sizeof(gRequest)) {
+        return -ENOMEM;
+    }
+    memcpy(&gRequest[gRequestLen], pData, len);
+    gRequestLen += len;
+    gRequest[gRequestLen] = 0;
+    if (strstr(gRequest, "\r\n\r\n") != NULL) {
+        const char *pRange = strstr(gRequest, "Range: bytes=");
+        CHECK(strncmp(gRequest, "GET /update.bin HTTP/1.1\r\n", 26) == 0);
+        CHECK(pRange != NULL);
+        gBodyPos = pRange != NULL ? strtoul(pRange + 13, NULL, 10) : 0;
+        gBodyEnd = MIN(gServedLen, gBodyPos + HTTP_DROP_AFTER);
+        if (gRangeCnt < (uint32_t)ARRAY_SIZE(gRanges)) {
+            gRanges[gRangeCnt++] = gBodyPos;
+        }
+        gHeaderLen = snprintf(gResponseHeader, sizeof(gResponseHeader),
+                              "HTTP/1.1 206 Partial Content\r\nContent-Length: %u\r\n\r\n",
+                              (unsigned)(gServedLen - gBodyPos));
+        gHeaderSent = 0;
+    }
+    return len;
+}
+
+int32_t uSockRead(int32_t descriptor, void *pData, size_t dataSizeBytes)
+{
+    uint8_t *pOut = pData;
+    size_t len = 1 + testRand() % 1400;
+    len = MIN(len, dataSizeBytes);
+    size_t n = MIN(len, gHeaderLen - gHeaderSent);
+    memcpy(pOut, &gResponseHeader[gHeaderSent], n);
+    gHeaderSent += n;
+    if (n < len && gBodyPos == gBodyEnd && gBodyEnd < gServedLen) {
+        // Dropped
+        return n > 0 ? (int32_t)n : -ECONNRESET;
+    }
+    size_t body = MIN(len - n, gBodyEnd - gBodyPos);
+    memcpy(&pOut[n], &gpServed[gBodyPos], body);
+    gBodyPos += body;
+    return n + body;
+}
+
+int32_t uSockClose(int32_t descriptor)
+{
+    return 0;
+}
+
+/* ----------------------------------------------------------------
+ * Images and the delta
+ * -------------------------------------------------------------- */
+
+static void putU32(uint8_t *pBuf, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        pBuf[i] = value >> (8 * i);
+    }
+}
+
+static void setImageHeader(uint8_t *pImage, size_t size)
+{
+    putU32(pImage, IMAGE_MAGIC);
+    pImage[8] = IMAGE_HEADER_SIZE;
+    pImage[9] = 0;
+    putU32(&pImage[12], size - IMAGE_HEADER_SIZE);
+}
+
+static void deltaAdd(const void *pData, size_t len)
+{
+    memcpy(&gDelta[gDeltaLen], pData, len);
+    gDeltaLen += len;
+}
+
+static void deltaOp(uint8_t op, uint32_t len)
+{
+    uint8_t header[5] = {op};
+    putU32(&header[1], len);
+    deltaAdd(header, sizeof(header));
+}
+
+static void makeImages()
+{
+    testSeed(47);
+    for (size_t i = 0; i < OLD_SIZE; i++) {
+        gOld[i] = testRand();
+    }
+    setImageHeader(gOld, OLD_SIZE);
+    // Scattered changes, as from a few changed functions
+    memcpy(gNew, gOld, ADD_LEN);
+    for (int i = 0; i < 2000; i++) {
+        gNew[testRand() % ADD_LEN] = testRand();
+    }
+    memset(&gNew[1000], 0x55, 600);
+    for (size_t i = ADD_LEN; i < ADD_LEN + INSERT_LEN; i++) {
+        gNew[i] = testRand();
+    }
+    memcpy(&gNew[ADD_LEN + INSERT_LEN], &gOld[COPY_FROM], COPY_LEN);
+    setImageHeader(gNew, NEW_SIZE);
+
+    deltaAdd("UDLT\x01\0\0\0", 8);
+    uint8_t values[12];
+    putU32(values, OLD_SIZE);
+    putU32(&values[4], crc32_ieee_update(0, gOld, OLD_SIZE));
+    putU32(&values[8], NEW_SIZE);
+    deltaAdd(values, sizeof(values));
+
+    // Runs of unchanged bytes and of differences, at most 255 each
+    deltaOp(0x02, ADD_LEN);
+    for (size_t pos = 0; pos < ADD_LEN;) {
+        uint8_t run[2] = {0, 0};
+        while (pos < ADD_LEN && run[0] < 255 && gNew[pos] == gOld[pos]) {
+            run[0]++;
+            pos++;
+        }
+        size_t start = pos;
+        while (pos < ADD_LEN && run[1] < 255 && gNew[pos] != gOld[pos]) {
+            run[1]++;
+            pos++;
+        }
+        deltaAdd(run, sizeof(run));
+        for (size_t i = start; i < pos; i++) {
+            uint8_t diff = gNew[i] - gOld[i];
+            deltaAdd(&diff, 1);
+        }
+    }
+    deltaOp(0x03, INSERT_LEN);
+    deltaAdd(&gNew[ADD_LEN], INSERT_LEN);
+    uint8_t copy[4];
+    deltaOp(0x01, COPY_LEN);
+    putU32(copy, COPY_FROM);
+    deltaAdd(copy, sizeof(copy));
+}
+
+static const uint8_t *slot(int area)
+{
+    return &gStubFlash[area * STUB_FLASH_AREA_SIZE];
+}
+
+// What MCUboot does when it accepts the update
+static void swap()
+{
+    static uint8_t primary[STUB_FLASH_AREA_SIZE];
+    memcpy(primary, slot(0), STUB_FLASH_AREA_SIZE);
+    memcpy(&gStubFlash[0], slot(1), STUB_FLASH_AREA_SIZE);
+    memcpy(&gStubFlash[STUB_FLASH_AREA_SIZE], primary, STUB_FLASH_AREA_SIZE);
+    gStubBootConfirmed = false;
+}
+
+static void progressCb(const otaStats_t *pStats)
+{
+    gProgressCnt++;
+    CHECK(pStats->total == NEW_SIZE);
+}
+
+/* ----------------------------------------------------------------
+ * Tests
+ * -------------------------------------------------------------- */
+
+// A delta made for another image is rejected before anything is used
+static void testWrongSource()
+{
+    uint32_t offset;
+    gStubFlash[100] ^= 1;
+    CHECK(otaBegin(DELTA_ID, &offset) == 0 && offset == 0);
+    CHECK(otaWrite(gDelta, 100) == -EBADMSG);
+    otaAbort();
+    gStubFlash[100] ^= 1;
+}
+
+// Resets at random points continue from the last checkpoint
+static void testDeltaResets()
+{
+    uint32_t offset;
+    uint32_t resets = 0;
+    uint32_t nextReset = 2000;
+    // Left over from an earlier update
+    memset(&gStubFlash[STUB_FLASH_AREA_SIZE], 0xA5, STUB_FLASH_AREA_SIZE);
+    gStubBootUpgrade = -1;
+    CHECK(otaBegin(DELTA_ID, &offset) == 0 && offset == 0);
+    int32_t res = 0;
+    uint32_t pos = 0;
+    while (res == 0 && pos < gDeltaLen) {
+        size_t len = 1 + testRand() % 1000;
+        len = MIN(len, gDeltaLen - pos);
+        res = otaWrite(&gDelta[pos], len);
+        pos += len;
+        if (pos > nextReset) {
+            // Anything not at a checkpoint is lost
+            nextReset = pos + 1000 + testRand() % 4000;
+            resets++;
+            uint32_t before = pos;
+            CHECK(otaBegin(DELTA_ID, &offset) == 0);
+            CHECK(offset <= before);
+            otaStats_t stats;
+            otaGetStats(&stats);
+            CHECK(stats.resumedAt == offset && stats.delta == (offset > 0));
+            pos = offset;
+        }
+    }
+    CHECK(res == 0);
+    otaStats_t stats;
+    otaGetStats(&stats);
+    CHECK(stats.delta);
+    CHECK(otaFinish(false) == 0);
+    printf("Delta of %u bytes with %u resets, resumed at %u, %u checkpoints\n",
+           (unsigned)gDeltaLen, resets, stats.resumedAt, stats.checkpoints);
+    CHECK(resets > 2 && stats.resumedAt > 0);
+    CHECK(memcmp(slot(1), gNew, NEW_SIZE) == 0);
+    CHECK(gStubBootUpgrade == BOOT_UPGRADE_TEST);
+    // An interrupted update is not resumed after it is done
+    CHECK(otaBegin(DELTA_ID, &offset) == 0 && offset == 0);
+    otaAbort();
+}
+
+// MCUboot reverted, or never swapped in, the update
+static void testReverted()
+{
+    gStubBootConfirmed = false;
+    CHECK(otaConfirm() == -ECANCELED);
+    CHECK(gStubBootConfirmed);
+    CHECK(counterGet(COUNTER_OTA_INSTALLED) == 0);
+    // Only reported once
+    CHECK(otaConfirm() == 0);
+}
+
+static void testHttp()
+{
+    // The new image in full, to replace the old one
+    memcpy(&gStubFlash[0], gOld, OLD_SIZE);
+    gpServed = gNew;
+    gServedLen = NEW_SIZE;
+    gRangeCnt = 0;
+    gProgressCnt = 0;
+    gStubBootUpgrade = -1;
+    uint32_t writes = gStubFlashWrites;
+    otaSetProgressCb(progressCb);
+    CHECK(otaHttpDownload(NULL, "example.com", 80, "/update.bin", HTTP_ID) == 0);
+    otaSetProgressCb(NULL);
+    otaStats_t stats;
+    otaGetStats(&stats);
+    printf("%u connections, %u of %u bytes downloaded, %u flash writes\n",
+           stats.connections, stats.downloaded, stats.total,
+           gStubFlashWrites - writes);
+    CHECK(memcmp(slot(1), gNew, NEW_SIZE) == 0);
+    CHECK(!stats.delta);
+    // Data after the last checkpoint is written again
+    CHECK(stats.total == NEW_SIZE && stats.written > NEW_SIZE);
+    CHECK(stats.connections == gRangeCnt && gRangeCnt > NEW_SIZE / HTTP_DROP_AFTER);
+    // Each retry from a checkpoint
+    for (uint32_t i = 0; i < gRangeCnt; i++) {
+        CHECK(gRanges[i] % OTA_CHECKPOINT_SIZE == 0);
+        CHECK(i == 0 || gRanges[i] > gRanges[i - 1]);
+    }
+    CHECK(gProgressCnt == NEW_SIZE / OTA_CHECKPOINT_SIZE + 1);
+    CHECK(gStubBootUpgrade == BOOT_UPGRADE_TEST);
+
+    // Installed and running
+    swap();
+    CHECK(otaConfirm() == 0);
+    CHECK(gStubBootConfirmed);
+    CHECK(counterGet(COUNTER_OTA_INSTALLED) == HTTP_ID);
+}
+
+int main()
+{
+    makeImages();
+    memset(gStubFlash, 0xFF, sizeof(gStubFlash));
+    memcpy(&gStubFlash[0], gOld, OLD_SIZE);
+    testWrongSource();
+    testDeltaResets();
+    testReverted();
+    testHttp();
+    return TEST_RESULT();
+}
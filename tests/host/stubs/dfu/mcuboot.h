@@ -0,0 +1,38 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stand-in for the MCUboot image state API. The requests are only
+ * recorded, a test does the swap itself.
+ */
+
+#ifndef STUB_MCUBOOT_H
+#define STUB_MCUBOOT_H
+
+#include <stdbool.h>
+
+#define BOOT_UPGRADE_TEST 0
+#define BOOT_UPGRADE_PERMANENT 1
+
+// The last upgrade requested, -1 for none
+extern int gStubBootUpgrade;
+extern bool gStubBootConfirmed;
+
+int boot_request_upgrade(int permanent);
+bool boot_is_img_confirmed(void);
+int boot_write_img_confirmed(void);
+
+#endif
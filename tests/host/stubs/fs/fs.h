@@ -0,0 +1,129 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stand-in for the Zephyr file system API, on top of a directory of
+ * the host. The mount point is a path relative to the directory the
+ * test runs in. The calls are counted so that tests can check how
+ * the file system is used.
+ */
+
+#ifndef STUB_FS_H
+#define STUB_FS_H
+
+#include <stdint.h>
+#include <dirent.h>
+#include <sys/types.h>
+
+typedef uint8_t fs_mode_t;
+#define FS_O_READ 0x01
+#define FS_O_WRITE 0x02
+#define FS_O_RDWR (FS_O_READ | FS_O_WRITE)
+#define FS_O_CREATE 0x10
+#define FS_O_APPEND 0x20
+
+#define FS_SEEK_SET 0
+#define FS_SEEK_CUR 1
+#define FS_SEEK_END 2
+
+enum fs_dir_entry_type {
+    FS_DIR_ENTRY_FILE = 0,
+    FS_DIR_ENTRY_DIR
+};
+
+struct fs_file_t {
+    int fd;
+    fs_mode_t flags;
+};
+
+struct fs_dir_t {
+    DIR *pDir;
+    char path[256];
+};
+
+struct fs_dirent {
+    enum fs_dir_entry_type type;
+    char name[256];
+    size_t size;
+};
+
+struct fs_mount_t {
+    const char *mnt_point;
+    uintptr_t storage_dev;
+};
+
+struct fs_statvfs {
+    unsigned long f_bsize;
+    unsigned long f_frsize;
+    unsigned long f_blocks;
+    unsigned long f_bfree;
+};
+
+typedef struct {
+    uint32_t opens;
+    uint32_t openFiles;      // Currently open
+    uint32_t maxOpenFiles;
+    uint32_t writes;
+    uint32_t writtenBytes;
+    uint32_t syncs;
+    uint32_t statvfsCnt;
+} stubFsStats_t;
+
+// The mount of the lfs node label, see FS_FSTAB_ENTRY in kernel.h
+extern struct fs_mount_t stubFstab_lfs;
+extern stubFsStats_t gStubFsStats;
+// Called for every fs_write with the file offset of the write, if set
+extern void (*gpStubFsWriteCb)(off_t offset, size_t size);
+// Size and free blocks reported by fs_statvfs, 4 kB blocks
+extern unsigned long gStubFsBlocks;
+extern unsigned long gStubFsFreeBlocks;
+
+/**
+ * Remove all files below the mount point, call before mounting.
+ * @param   pMount  The mount point.
+ */
+void stubFsClear(struct fs_mount_t *pMount);
+
+static inline void fs_file_t_init(struct fs_file_t *pFile)
+{
+    pFile->fd = -1;
+}
+
+static inline void fs_dir_t_init(struct fs_dir_t *pDir)
+{
+    pDir->pDir = NULL;
+}
+
+int fs_mount(struct fs_mount_t *pMount);
+int fs_unmount(struct fs_mount_t *pMount);
+int fs_statvfs(const char *pPath, struct fs_statvfs *pStat);
+int fs_stat(const char *pPath, struct fs_dirent *pEntry);
+int fs_unlink(const char *pPath);
+int fs_rename(const char *pFrom, const char *pTo);
+int fs_mkdir(const char *pPath);
+int fs_open(struct fs_file_t *pFile, const char *pPath, fs_mode_t flags);
+int fs_close(struct fs_file_t *pFile);
+int fs_seek(struct fs_file_t *pFile, off_t offset, int whence);
+off_t fs_tell(struct fs_file_t *pFile);
+ssize_t fs_read(struct fs_file_t *pFile, void *pData, size_t size);
+ssize_t fs_write(struct fs_file_t *pFile, const void *pData, size_t size);
+int fs_sync(struct fs_file_t *pFile);
+int fs_truncate(struct fs_file_t *pFile, off_t length);
+int fs_opendir(struct fs_dir_t *pDir, const char *pPath);
+int fs_readdir(struct fs_dir_t *pDir, struct fs_dirent *pEntry);
+int fs_closedir(struct fs_dir_t *pDir);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stand-in for the parts of the Zephyr kernel API used by the common
+ * modules under test, on top of POSIX threads. Only what the tests
+ * need is here, with the same names and behavior as in Zephyr.
+ */
+
+#ifndef STUB_KERNEL_H
+#define STUB_KERNEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define BIT(n) (1UL << (n))
+#define CONTAINER_OF(ptr, type, field) ((type *)(((char *)(ptr)) - offsetof(type, field)))
+
+typedef struct {
+    int32_t ms;   // Negative for forever
+} k_timeout_t;
+
+#define K_MSEC(ms) ((k_timeout_t){(ms)})
+#define K_SECONDS(s) K_MSEC((s) * 1000)
+#define K_FOREVER ((k_timeout_t){-1})
+#define K_NO_WAIT ((k_timeout_t){0})
+
+uint32_t k_uptime_get_32(void);
+// The cycle counter counts microseconds
+uint32_t k_cycle_get_32(void);
+static inline uint32_t k_cyc_to_us_floor32(uint32_t cycles)
+{
+    return cycles;
+}
+void k_msleep(int32_t ms);
+
+typedef long atomic_t;
+#define ATOMIC_INIT(i) (i)
+static inline long atomic_get(atomic_t *pTarget)
+{
+    return __atomic_load_n(pTarget, __ATOMIC_SEQ_CST);
+}
+static inline void atomic_set(atomic_t *pTarget, long value)
+{
+    __atomic_store_n(pTarget, value, __ATOMIC_SEQ_CST);
+}
+static inline long atomic_add(atomic_t *pTarget, long value)
+{
+    return __atomic_fetch_add(pTarget, value, __ATOMIC_SEQ_CST);
+}
+
+// Zephyr mutexes can be locked again by the owner
+struct k_mutex {
+    pthread_mutex_t mutex;
+};
+#define K_MUTEX_DEFINE(name) \
+    struct k_mutex name = {PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP}
+int k_mutex_init(struct k_mutex *pMutex);
+int k_mutex_lock(struct k_mutex *pMutex, k_timeout_t timeout);
+int k_mutex_unlock(struct k_mutex *pMutex);
+
+typedef void (*k_thread_entry_t)(void *p1, void *p2, void *p3);
+struct k_thread {
+    pthread_t thread;
+    k_thread_entry_t entry;
+    void *p1;
+    void *p2;
+    void *p3;
+};
+typedef struct k_thread *k_tid_t;
+#define K_THREAD_STACK_DEFINE(sym, size) char sym[size]
+#define K_THREAD_STACK_SIZEOF(sym) sizeof(sym)
+k_tid_t k_thread_create(struct k_thread *pThread, char *pStack, size_t stackSize,
+                        k_thread_entry_t entry, void *p1, void *p2, void *p3,
+                        int prio, uint32_t options, k_timeout_t delay);
+static inline int k_thread_name_set(k_tid_t thread, const char *pName)
+{
+    return 0;
+}
+
+// A byte pipe, with the same partial transfer rules as in Zephyr
+struct k_pipe {
+    unsigned char *pBuffer;
+    size_t size;
+    size_t head;
+    size_t cnt;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+void k_pipe_init(struct k_pipe *pPipe, unsigned char *pBuffer, size_t size);
+int k_pipe_put(struct k_pipe *pPipe, void *pData, size_t bytesToWrite,
+               size_t *pBytesWritten, size_t minXfer, k_timeout_t timeout);
+int k_pipe_get(struct k_pipe *pPipe, void *pData, size_t bytesToRead,
+               size_t *pBytesRead, size_t minXfer, k_timeout_t timeout);
+
+// Devicetree, the file system mount of a node label is stubFstab_<label>
+#define DT_NODELABEL(label) label
+#define STUB_FSTAB(node) stubFstab_##node
+#define FS_FSTAB_DECLARE_ENTRY(node) extern struct fs_mount_t STUB_FSTAB(node)
+#define FS_FSTAB_ENTRY(node) STUB_FSTAB(node)
+
+#endif
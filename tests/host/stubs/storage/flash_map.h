@@ -0,0 +1,56 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stand-in for the Zephyr flash map, with STUB_FLASH_AREA_CNT areas
+ * after each other in one simulated flash. Like a real flash, writing
+ * can only clear bits, so anything written without an erase first
+ * ends up wrong.
+ */
+
+#ifndef STUB_FLASH_MAP_H
+#define STUB_FLASH_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define STUB_FLASH_AREA_CNT 2
+#define STUB_FLASH_AREA_SIZE (256 * 1024)
+#define STUB_FLASH_PAGE_SIZE 4096
+
+struct device;
+
+struct flash_area {
+    uint8_t fa_id;
+    off_t fa_off;
+    size_t fa_size;
+    const struct device *fa_dev;
+};
+
+extern uint8_t gStubFlash[STUB_FLASH_AREA_CNT * STUB_FLASH_AREA_SIZE];
+extern uint32_t gStubFlashWrites;
+extern uint32_t gStubFlashErases;
+
+int flash_area_open(uint8_t id, const struct flash_area **ppArea);
+void flash_area_close(const struct flash_area *pArea);
+int flash_area_read(const struct flash_area *pArea, off_t offset, void *pData, size_t len);
+int flash_area_erase(const struct flash_area *pArea, off_t offset, size_t len);
+
+// Program the simulated flash, only clearing bits
+void stubFlashProgram(off_t offset, const uint8_t *pData, size_t len);
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stand-in for the Zephyr stream flash, erasing each page of the
+ * simulated flash before writing to it, as with
+ * CONFIG_STREAM_FLASH_ERASE.
+ */
+
+#ifndef STUB_STREAM_FLASH_H
+#define STUB_STREAM_FLASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+struct device;
+
+typedef int (*stream_flash_callback_t)(uint8_t *pBuf, size_t len, size_t offset);
+
+struct stream_flash_ctx {
+    uint8_t *buf;
+    size_t buf_len;
+    size_t buf_bytes;
+    off_t offset;
+    size_t available;
+    size_t bytes_written;
+    off_t last_erased_page_start_offset;
+};
+
+int stream_flash_init(struct stream_flash_ctx *pCtx, const struct device *pDevice,
+                      uint8_t *pBuf, size_t bufLen, size_t offset, size_t size,
+                      stream_flash_callback_t cb);
+int stream_flash_buffered_write(struct stream_flash_ctx *pCtx, const uint8_t *pData,
+                                size_t len, bool flush);
+
+#endif
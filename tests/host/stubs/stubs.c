@@ -0,0 +1,545 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <kernel.h>
+#include <fs/fs.h>
+#include <storage/flash_map.h>
+#include <storage/stream_flash.h>
+#include <dfu/mcuboot.h>
+#include <sys/crc.h>
+
+/* ----------------------------------------------------------------
+ * Kernel
+ * -------------------------------------------------------------- */
+
+static uint64_t nowUs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint32_t k_uptime_get_32(void)
+{
+    return nowUs() / 1000;
+}
+
+uint32_t k_cycle_get_32(void)
+{
+    return nowUs();
+}
+
+void k_msleep(int32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+int k_mutex_init(struct k_mutex *pMutex)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    return pthread_mutex_init(&pMutex->mutex, &attr);
+}
+
+int k_mutex_lock(struct k_mutex *pMutex, k_timeout_t timeout)
+{
+    if (timeout.ms == 0) {
+        return pthread_mutex_trylock(&pMutex->mutex) == 0 ? 0 : -EBUSY;
+    }
+    return pthread_mutex_lock(&pMutex->mutex) == 0 ? 0 : -EINVAL;
+}
+
+int k_mutex_unlock(struct k_mutex *pMutex)
+{
+    return pthread_mutex_unlock(&pMutex->mutex) == 0 ? 0 : -EPERM;
+}
+
+static void *threadEntry(void *pParam)
+{
+    struct k_thread *pThread = pParam;
+    pThread->entry(pThread->p1, pThread->p2, pThread->p3);
+    return NULL;
+}
+
+k_tid_t k_thread_create(struct k_thread *pThread, char *pStack, size_t stackSize,
+                        k_thread_entry_t entry, void *p1, void *p2, void *p3,
+                        int prio, uint32_t options, k_timeout_t delay)
+{
+    pThread->entry = entry;
+    pThread->p1 = p1;
+    pThread->p2 = p2;
+    pThread->p3 = p3;
+    if (pthread_create(&pThread->thread, NULL, threadEntry, pThread) != 0) {
+        return NULL;
+    }
+    pthread_detach(pThread->thread);
+    return pThread;
+}
+
+void k_pipe_init(struct k_pipe *pPipe, unsigned char *pBuffer, size_t size)
+{
+    pPipe->pBuffer = pBuffer;
+    pPipe->size = size;
+    pPipe->head = 0;
+    pPipe->cnt = 0;
+    pthread_mutex_init(&pPipe->mutex, NULL);
+    pthread_cond_init(&pPipe->cond, NULL);
+}
+
+// Wait for a change with the pipe locked, non-zero on timeout
+static int pipeWait(struct k_pipe *pPipe, const struct timespec *pDeadline)
+{
+    if (pDeadline == NULL) {
+        return pthread_cond_wait(&pPipe->cond, &pPipe->mutex);
+    }
+    return pthread_cond_timedwait(&pPipe->cond, &pPipe->mutex, pDeadline);
+}
+
+static struct timespec *pipeDeadline(k_timeout_t timeout, struct timespec *pDeadline)
+{
+    if (timeout.ms < 0) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_REALTIME, pDeadline);
+    pDeadline->tv_sec += timeout.ms / 1000;
+    pDeadline->tv_nsec += (timeout.ms % 1000) * 1000000L;
+    if (pDeadline->tv_nsec >= 1000000000L) {
+        pDeadline->tv_sec++;
+        pDeadline->tv_nsec -= 1000000000L;
+    }
+    return pDeadline;
+}
+
+int k_pipe_put(struct k_pipe *pPipe, void *pData, size_t bytesToWrite,
+               size_t *pBytesWritten, size_t minXfer, k_timeout_t timeout)
+{
+    struct timespec deadline;
+    struct timespec *pDeadline = pipeDeadline(timeout, &deadline);
+    const unsigned char *pBytes = pData;
+    pthread_mutex_lock(&pPipe->mutex);
+    *pBytesWritten = 0;
+    while (*pBytesWritten < bytesToWrite) {
+        if (pPipe->cnt < pPipe->size) {
+            pPipe->pBuffer[(pPipe->head + pPipe->cnt) % pPipe->size] = pBytes[*pBytesWritten];
+            pPipe->cnt++;
+            (*pBytesWritten)++;
+            pthread_cond_broadcast(&pPipe->cond);
+        } else if (timeout.ms == 0 || pipeWait(pPipe, pDeadline) != 0) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pPipe->mutex);
+    return *pBytesWritten >= minXfer ? 0 : -EAGAIN;
+}
+
+int k_pipe_get(struct k_pipe *pPipe, void *pData, size_t bytesToRead,
+               size_t *pBytesRead, size_t minXfer, k_timeout_t timeout)
+{
+    struct timespec deadline;
+    struct timespec *pDeadline = pipeDeadline(timeout, &deadline);
+    unsigned char *pBytes = pData;
+    pthread_mutex_lock(&pPipe->mutex);
+    *pBytesRead = 0;
+    while (pPipe->cnt < minXfer && timeout.ms != 0) {
+        if (pipeWait(pPipe, pDeadline) != 0) {
+            break;
+        }
+    }
+    while (*pBytesRead < bytesToRead && pPipe->cnt > 0) {
+        pBytes[(*pBytesRead)++] = pPipe->pBuffer[pPipe->head];
+        pPipe->head = (pPipe->head + 1) % pPipe->size;
+        pPipe->cnt--;
+    }
+    pthread_cond_broadcast(&pPipe->cond);
+    pthread_mutex_unlock(&pPipe->mutex);
+    return *pBytesRead >= minXfer ? 0 : -EAGAIN;
+}
+
+/* ----------------------------------------------------------------
+ * File system
+ * -------------------------------------------------------------- */
+
+struct fs_mount_t stubFstab_lfs = {.mnt_point = "lfs_host"};
+stubFsStats_t gStubFsStats;
+void (*gpStubFsWriteCb)(off_t offset, size_t size) = NULL;
+unsigned long gStubFsBlocks = 2048;
+unsigned long gStubFsFreeBlocks = 2048;
+static pthread_mutex_t gStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+void stubFsClear(struct fs_mount_t *pMount)
+{
+    char command[300];
+    snprintf(command, sizeof(command), "rm -rf '%s'", pMount->mnt_point);
+    if (system(command) != 0) {
+        printf("* Failed to clear %s\n", pMount->mnt_point);
+    }
+}
+
+int fs_mount(struct fs_mount_t *pMount)
+{
+    if (mkdir(pMount->mnt_point, 0755) != 0 && errno != EEXIST) {
+        return -errno;
+    }
+    return 0;
+}
+
+int fs_unmount(struct fs_mount_t *pMount)
+{
+    return 0;
+}
+
+int fs_statvfs(const char *pPath, struct fs_statvfs *pStat)
+{
+    pthread_mutex_lock(&gStatsLock);
+    gStubFsStats.statvfsCnt++;
+    pthread_mutex_unlock(&gStatsLock);
+    pStat->f_bsize = 4096;
+    pStat->f_frsize = 4096;
+    pStat->f_blocks = gStubFsBlocks;
+    pStat->f_bfree = gStubFsFreeBlocks;
+    return 0;
+}
+
+static void setEntry(struct fs_dirent *pEntry, const char *pName, const struct stat *pStat)
+{
+    pEntry->type = S_ISDIR(pStat->st_mode) ? FS_DIR_ENTRY_DIR : FS_DIR_ENTRY_FILE;
+    snprintf(pEntry->name, sizeof(pEntry->name), "%s", pName);
+    pEntry->size = S_ISDIR(pStat->st_mode) ? 0 : pStat->st_size;
+}
+
+int fs_stat(const char *pPath, struct fs_dirent *pEntry)
+{
+    struct stat st;
+    if (stat(pPath, &st) != 0) {
+        return -ENOENT;
+    }
+    const char *pName = strrchr(pPath, '/');
+    setEntry(pEntry, pName != NULL ? pName + 1 : pPath, &st);
+    return 0;
+}
+
+int fs_unlink(const char *pPath)
+{
+    return remove(pPath) == 0 ? 0 : -errno;
+}
+
+int fs_rename(const char *pFrom, const char *pTo)
+{
+    return rename(pFrom, pTo) == 0 ? 0 : -errno;
+}
+
+int fs_mkdir(const char *pPath)
+{
+    return mkdir(pPath, 0755) == 0 ? 0 : -errno;
+}
+
+int fs_open(struct fs_file_t *pFile, const char *pPath, fs_mode_t flags)
+{
+    int oflags = (flags & FS_O_WRITE) ? ((flags & FS_O_READ) ? O_RDWR : O_WRONLY) : O_RDONLY;
+    if (flags & FS_O_CREATE) {
+        oflags |= O_CREAT;
+    }
+    if (flags & FS_O_APPEND) {
+        oflags |= O_APPEND;
+    }
+    pFile->fd = open(pPath, oflags, 0644);
+    if (pFile->fd < 0) {
+        return -errno;
+    }
+    pFile->flags = flags;
+    pthread_mutex_lock(&gStatsLock);
+    gStubFsStats.opens++;
+    gStubFsStats.openFiles++;
+    gStubFsStats.maxOpenFiles = MAX(gStubFsStats.maxOpenFiles, gStubFsStats.openFiles);
+    pthread_mutex_unlock(&gStatsLock);
+    return 0;
+}
+
+int fs_close(struct fs_file_t *pFile)
+{
+    if (pFile->fd < 0) {
+        return -EBADF;
+    }
+    close(pFile->fd);
+    pFile->fd = -1;
+    pthread_mutex_lock(&gStatsLock);
+    gStubFsStats.openFiles--;
+    pthread_mutex_unlock(&gStatsLock);
+    return 0;
+}
+
+int fs_seek(struct fs_file_t *pFile, off_t offset, int whence)
+{
+    int how = whence == FS_SEEK_END ? SEEK_END : whence == FS_SEEK_CUR ? SEEK_CUR : SEEK_SET;
+    return lseek(pFile->fd, offset, how) >= 0 ? 0 : -errno;
+}
+
+off_t fs_tell(struct fs_file_t *pFile)
+{
+    return lseek(pFile->fd, 0, SEEK_CUR);
+}
+
+ssize_t fs_read(struct fs_file_t *pFile, void *pData, size_t size)
+{
+    ssize_t res = read(pFile->fd, pData, size);
+    return res >= 0 ? res : -errno;
+}
+
+ssize_t fs_write(struct fs_file_t *pFile, const void *pData, size_t size)
+{
+    off_t offset = lseek(pFile->fd, 0, SEEK_CUR);
+    ssize_t res = write(pFile->fd, pData, size);
+    if (res < 0) {
+        return -errno;
+    }
+    if (gpStubFsWriteCb != NULL) {
+        // With append the write went to the end
+        if (pFile->flags & FS_O_APPEND) {
+            offset = lseek(pFile->fd, 0, SEEK_CUR) - res;
+        }
+        gpStubFsWriteCb(offset, res);
+    }
+    pthread_mutex_lock(&gStatsLock);
+    gStubFsStats.writes++;
+    gStubFsStats.writtenBytes += res;
+    pthread_mutex_unlock(&gStatsLock);
+    return res;
+}
+
+int fs_sync(struct fs_file_t *pFile)
+{
+    pthread_mutex_lock(&gStatsLock);
+    gStubFsStats.syncs++;
+    pthread_mutex_unlock(&gStatsLock);
+    return 0;
+}
+
+int fs_truncate(struct fs_file_t *pFile, off_t length)
+{
+    return ftruncate(pFile->fd, length) == 0 ? 0 : -errno;
+}
+
+int fs_opendir(struct fs_dir_t *pDir, const char *pPath)
+{
+    pDir->pDir = opendir(pPath);
+    if (pDir->pDir == NULL) {
+        return -ENOENT;
+    }
+    snprintf(pDir->path, sizeof(pDir->path), "%s", pPath);
+    return 0;
+}
+
+// Like Zephyr, the end is an entry with an empty name
+int fs_readdir(struct fs_dir_t *pDir, struct fs_dirent *pEntry)
+{
+    struct dirent *pDirent;
+    do {
+        pDirent = readdir(pDir->pDir);
+    } while (pDirent != NULL && (strcmp(pDirent->d_name, ".") == 0 ||
+                                 strcmp(pDirent->d_name, "..") == 0));
+    if (pDirent == NULL) {
+        pEntry->name[0] = 0;
+        return 0;
+    }
+    char path[600];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", pDir->path, pDirent->d_name);
+    if (stat(path, &st) != 0) {
+        return -errno;
+    }
+    setEntry(pEntry, pDirent->d_name, &st);
+    return 0;
+}
+
+int fs_closedir(struct fs_dir_t *pDir)
+{
+    closedir(pDir->pDir);
+    pDir->pDir = NULL;
+    return 0;
+}
+
+/* ----------------------------------------------------------------
+ * Flash
+ * -------------------------------------------------------------- */
+
+uint8_t gStubFlash[STUB_FLASH_AREA_CNT * STUB_FLASH_AREA_SIZE];
+uint32_t gStubFlashWrites = 0;
+uint32_t gStubFlashErases = 0;
+
+static const struct flash_area gAreas[STUB_FLASH_AREA_CNT] = {
+    {.fa_id = 0, .fa_off = 0, .fa_size = STUB_FLASH_AREA_SIZE},
+    {.fa_id = 1, .fa_off = STUB_FLASH_AREA_SIZE, .fa_size = STUB_FLASH_AREA_SIZE}
+};
+
+int flash_area_open(uint8_t id, const struct flash_area **ppArea)
+{
+    if (id >= STUB_FLASH_AREA_CNT) {
+        return -ENOENT;
+    }
+    *ppArea = &gAreas[id];
+    return 0;
+}
+
+void flash_area_close(const struct flash_area *pArea)
+{
+}
+
+int flash_area_read(const struct flash_area *pArea, off_t offset, void *pData, size_t len)
+{
+    if (offset < 0 || offset + len > pArea->fa_size) {
+        return -EINVAL;
+    }
+    memcpy(pData, &gStubFlash[pArea->fa_off + offset], len);
+    return 0;
+}
+
+static int flashErase(off_t offset, size_t len)
+{
+    if (offset % STUB_FLASH_PAGE_SIZE != 0 || len % STUB_FLASH_PAGE_SIZE != 0 ||
+        offset + len > sizeof(gStubFlash)) {
+        return -EINVAL;
+    }
+    memset(&gStubFlash[offset], 0xFF, len);
+    gStubFlashErases += len / STUB_FLASH_PAGE_SIZE;
+    return 0;
+}
+
+int flash_area_erase(const struct flash_area *pArea, off_t offset, size_t len)
+{
+    if (offset < 0 || offset + len > pArea->fa_size) {
+        return -EINVAL;
+    }
+    return flashErase(pArea->fa_off + offset, len);
+}
+
+void stubFlashProgram(off_t offset, const uint8_t *pData, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        gStubFlash[offset + i] &= pData[i];
+    }
+    gStubFlashWrites++;
+}
+
+int stream_flash_init(struct stream_flash_ctx *pCtx, const struct device *pDevice,
+                      uint8_t *pBuf, size_t bufLen, size_t offset, size_t size,
+                      stream_flash_callback_t cb)
+{
+    if (offset + size > sizeof(gStubFlash) || bufLen == 0) {
+        return -EFAULT;
+    }
+    pCtx->buf = pBuf;
+    pCtx->buf_len = bufLen;
+    pCtx->buf_bytes = 0;
+    pCtx->offset = offset;
+    pCtx->available = size;
+    pCtx->bytes_written = 0;
+    pCtx->last_erased_page_start_offset = -1;
+    return 0;
+}
+
+// Write the buffer, erasing the pages it goes into first
+static int streamFlush(struct stream_flash_ctx *pCtx)
+{
+    off_t start = pCtx->offset + pCtx->bytes_written;
+    off_t end = start + pCtx->buf_bytes;
+    for (off_t page = start - start % STUB_FLASH_PAGE_SIZE; page < end;
+         page += STUB_FLASH_PAGE_SIZE) {
+        if (page > pCtx->last_erased_page_start_offset) {
+            int res = flashErase(page, STUB_FLASH_PAGE_SIZE);
+            if (res != 0) {
+                return res;
+            }
+            pCtx->last_erased_page_start_offset = page;
+        }
+    }
+    stubFlashProgram(start, pCtx->buf, pCtx->buf_bytes);
+    pCtx->bytes_written += pCtx->buf_bytes;
+    pCtx->buf_bytes = 0;
+    return 0;
+}
+
+int stream_flash_buffered_write(struct stream_flash_ctx *pCtx, const uint8_t *pData,
+                                size_t len, bool flush)
+{
+    if (pCtx->bytes_written + pCtx->buf_bytes + len > pCtx->available) {
+        return -ENOMEM;
+    }
+    int res = 0;
+    while (res == 0 && len > 0) {
+        size_t n = MIN(len, pCtx->buf_len - pCtx->buf_bytes);
+        memcpy(&pCtx->buf[pCtx->buf_bytes], pData, n);
+        pCtx->buf_bytes += n;
+        pData += n;
+        len -= n;
+        if (pCtx->buf_bytes == pCtx->buf_len) {
+            res = streamFlush(pCtx);
+        }
+    }
+    if (res == 0 && flush && pCtx->buf_bytes > 0) {
+        res = streamFlush(pCtx);
+    }
+    return res;
+}
+
+/* ----------------------------------------------------------------
+ * MCUboot
+ * -------------------------------------------------------------- */
+
+int gStubBootUpgrade = -1;
+bool gStubBootConfirmed = true;
+
+int boot_request_upgrade(int permanent)
+{
+    gStubBootUpgrade = permanent;
+    return 0;
+}
+
+bool boot_is_img_confirmed(void)
+{
+    return gStubBootConfirmed;
+}
+
+int boot_write_img_confirmed(void)
+{
+    gStubBootConfirmed = true;
+    return 0;
+}
+
+/* ----------------------------------------------------------------
+ * Crc
+ * -------------------------------------------------------------- */
+
+uint32_t crc32_ieee_update(uint32_t crc, const uint8_t *pData, size_t len)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= pData[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
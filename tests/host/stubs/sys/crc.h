@@ -0,0 +1,29 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stand-in for the Zephyr crc functions.
+ */
+
+#ifndef STUB_CRC_H
+#define STUB_CRC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+uint32_t crc32_ieee_update(uint32_t crc, const uint8_t *pData, size_t len);
+
+#endif
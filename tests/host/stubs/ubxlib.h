@@ -0,0 +1,57 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Stand-in for the parts of the ubxlib socket API used by the common
+ * modules under test. The functions are given by the tests.
+ */
+
+#ifndef STUB_UBXLIB_H
+#define STUB_UBXLIB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef void *uDeviceHandle_t;
+
+typedef enum {
+    U_SOCK_TYPE_STREAM = 1,
+    U_SOCK_TYPE_DGRAM = 2
+} uSockType_t;
+
+typedef enum {
+    U_SOCK_PROTOCOL_TCP = 6,
+    U_SOCK_PROTOCOL_UDP = 17
+} uSockProtocol_t;
+
+typedef struct {
+    uint32_t ipv4;
+} uSockIpAddress_t;
+
+typedef struct {
+    uSockIpAddress_t ipAddress;
+    uint16_t port;
+} uSockAddress_t;
+
+int32_t uSockCreate(uDeviceHandle_t devHandle, uSockType_t type, uSockProtocol_t protocol);
+int32_t uSockConnect(int32_t descriptor, const uSockAddress_t *pRemoteAddress);
+int32_t uSockWrite(int32_t descriptor, const void *pData, size_t dataSizeBytes);
+int32_t uSockRead(int32_t descriptor, void *pData, size_t dataSizeBytes);
+int32_t uSockClose(int32_t descriptor);
+int32_t uSockGetHostByName(uDeviceHandle_t devHandle, const char *pHostName,
+                           uSockIpAddress_t *pHostIpAddress);
+
+#endif
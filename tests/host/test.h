@@ -0,0 +1,53 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks shared by the host tests. A failed check is printed and
+ * counted, the test returns non zero if any check failed.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+static int gFailures = 0;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("* Check failed at %s:%d: %s\n", __FILE__, __LINE__, \
+                   #cond);                                              \
+            gFailures++;                                                \
+        }                                                               \
+    } while (0)
+
+#define TEST_RESULT() (gFailures == 0 ? 0 : 1)
+
+// Deterministic pseudo random numbers, so that a failure can be repeated
+static uint32_t gRandState = 1;
+
+static inline void testSeed(uint32_t seed)
+{
+    gRandState = seed != 0 ? seed : 1;
+}
+
+static inline uint32_t testRand()
+{
+    // xorshift32
+    gRandState ^= gRandState << 13;
+    gRandState ^= gRandState >> 17;
+    gRandState ^= gRandState << 5;
+    return gRandState;
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of common/ts_store with a stdio file as the storage.
+ * Samples are appended until the ring has wrapped, the store is
+ * reopened, also without a flush of the newest block, and random
+ * queries and aggregates are checked against a brute force search
+ * of all samples appended.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ts_store.h"
+#include "test.h"
+
+#define IMAGE_FILE "ts_store.img"
+#define MAX_BLOCKS 64
+#define SAMPLE_CNT 20000
+#define EXTRA_CNT 3000
+#define LAST_CNT 100
+#define QUERY_CNT 300
+
+typedef struct {
+    uint32_t time;
+    int32_t value;
+} sample_t;
+
+static FILE *gpImage;
+static tsStore_t gStore;
+static tsStoreRange_t gRanges[MAX_BLOCKS];
+static sample_t gSamples[SAMPLE_CNT + EXTRA_CNT + LAST_CNT];
+static size_t gSampleCnt = 0;
+
+static int32_t imageRead(void *pCtx, uint32_t offset, void *pData, size_t len)
+{
+    // Never written parts read as zeros
+    memset(pData, 0, len);
+    if (fseek(gpImage, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    long end = ftell(gpImage);
+    if (offset < end) {
+        fseek(gpImage, offset, SEEK_SET);
+        if (fread(pData, 1, len, gpImage) == 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int32_t imageWrite(void *pCtx, uint32_t offset, const void *pData, size_t len)
+{
+    fseek(gpImage, offset, SEEK_SET);
+    return fwrite(pData, 1, len, gpImage) == len ? 0 : -1;
+}
+
+static int32_t imageSync(void *pCtx)
+{
+    return fflush(gpImage) == 0 ? 0 : -1;
+}
+
+static const tsStoreIo_t gIo = {imageRead, imageWrite, imageSync, NULL};
+
+static void reopen()
+{
+    if (gpImage != NULL) {
+        fclose(gpImage);
+    }
+    gpImage = fopen(IMAGE_FILE, "r+b");
+    CHECK(gpImage != NULL);
+    CHECK(tsStoreOpen(&gStore, &gIo, gRanges, MAX_BLOCKS) == 0);
+}
+
+// Mostly slow changes, some steps and outliers in both directions
+static void append(size_t cnt)
+{
+    uint32_t time = gSampleCnt > 0 ? gSamples[gSampleCnt - 1].time : 1000;
+    int32_t value = gSampleCnt > 0 ? gSamples[gSampleCnt - 1].value : 2000;
+    for (size_t i = 0; i < cnt; i++) {
+        time += 1 + (testRand() % 8 == 0 ? testRand() % 1000 : 9);
+        value += (int32_t)(testRand() % 21) - 10;
+        int32_t sample = value;
+        if (testRand() % 500 == 0) {
+            sample = testRand() % 2 ? INT32_MAX - (int32_t)(testRand() % 10) :
+                     INT32_MIN + (int32_t)(testRand() % 10);
+        }
+        CHECK(tsStoreAppend(&gStore, time, sample) == 0);
+        gSamples[gSampleCnt].time = time;
+        gSamples[gSampleCnt].value = sample;
+        gSampleCnt++;
+        if (testRand() % 100 == 0) {
+            CHECK(tsStoreFlush(&gStore) == 0);
+        }
+    }
+}
+
+typedef struct {
+    size_t index;      // Next expected in gSamples
+    uint32_t errors;
+} queryCheck_t;
+
+static bool queryCb(uint32_t time, int32_t value, void *pParam)
+{
+    queryCheck_t *pCheck = pParam;
+    const sample_t *pExpected = &gSamples[pCheck->index++];
+    if (pExpected->time != time || pExpected->value != value) {
+        pCheck->errors++;
+    }
+    return true;
+}
+
+// Index of the first sample at or after a time
+static size_t firstFrom(uint32_t time)
+{
+    size_t i = 0;
+    while (i < gSampleCnt && gSamples[i].time < time) {
+        i++;
+    }
+    return i;
+}
+
+static void checkRange(uint32_t tStart, uint32_t tEnd)
+{
+    tsStoreRange_t range;
+    CHECK(tsStoreRange(&gStore, &range));
+    // What the store still has
+    size_t start = firstFrom(tStart > range.tFirst ? tStart : range.tFirst);
+    size_t end = start;
+    tsStoreAggregate_t expected = {0};
+    while (end < gSampleCnt && gSamples[end].time <= tEnd) {
+        int32_t value = gSamples[end].value;
+        if (expected.count == 0) {
+            expected.tFirst = gSamples[end].time;
+            expected.min = value;
+            expected.max = value;
+        }
+        expected.count++;
+        expected.tLast = gSamples[end].time;
+        expected.min = value < expected.min ? value : expected.min;
+        expected.max = value > expected.max ? value : expected.max;
+        expected.sum += value;
+        end++;
+    }
+
+    queryCheck_t check = {start, 0};
+    CHECK(tsStoreQuery(&gStore, tStart, tEnd, queryCb, &check) == (int32_t)(end - start));
+    CHECK(check.errors == 0 && check.index == end);
+
+    tsStoreAggregate_t agg;
+    CHECK(tsStoreAggregate(&gStore, tStart, tEnd, &agg) == 0);
+    CHECK(agg.count == expected.count);
+    if (agg.count > 0) {
+        CHECK(agg.min == expected.min && agg.max == expected.max);
+        CHECK(agg.sum == expected.sum);
+        CHECK(agg.tFirst == expected.tFirst && agg.tLast == expected.tLast);
+    }
+}
+
+static void checkRandomRanges()
+{
+    tsStoreRange_t range;
+    CHECK(tsStoreRange(&gStore, &range));
+    uint32_t span = range.tLast - range.tFirst;
+    for (int i = 0; i < QUERY_CNT; i++) {
+        // Also starting before and ending after what is stored
+        uint32_t tStart = range.tFirst - 100 + testRand() % (span + 200);
+        uint32_t tEnd = tStart + testRand() % (i % 2 ? span / 20 + 1 : span + 200);
+        checkRange(tStart, tEnd);
+    }
+    checkRange(0, UINT32_MAX);
+    checkRange(range.tLast, range.tLast);
+}
+
+int main()
+{
+    testSeed(44);
+    gpImage = fopen(IMAGE_FILE, "w+b");
+    CHECK(gpImage != NULL);
+    CHECK(tsStoreOpen(&gStore, &gIo, gRanges, MAX_BLOCKS) == 0);
+    CHECK(!tsStoreRange(&gStore, &(tsStoreRange_t) {0}));
+
+    clock_t start = clock();
+    append(SAMPLE_CNT);
+    double s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    CHECK(tsStoreFlush(&gStore) == 0);
+    tsStoreRange_t range;
+    CHECK(tsStoreRange(&gStore, &range));
+    size_t stored = gSampleCnt - firstFrom(range.tFirst);
+    printf("%u samples appended in %.1f ms, %u kept in %u blocks, %.2f bytes each,"
+           " %u block writes\n", SAMPLE_CNT, s * 1000, (unsigned)stored, gStore.cnt,
+           (double)gStore.cnt * TS_STORE_BLOCK_SIZE / stored, gStore.blockWrites);
+    // Wrapped, the oldest samples are gone
+    CHECK(gStore.cnt == MAX_BLOCKS);
+    CHECK(range.tFirst > gSamples[0].time);
+    CHECK(range.tLast == gSamples[gSampleCnt - 1].time);
+    checkRandomRanges();
+
+    // Aggregates over whole blocks only read the headers
+    gStore.blockReads = 0;
+    gStore.headerReads = 0;
+    tsStoreAggregate_t agg;
+    CHECK(tsStoreAggregate(&gStore, 0, UINT32_MAX, &agg) == 0);
+    CHECK(agg.count == stored);
+    CHECK(gStore.blockReads == 0 && gStore.headerReads > 0);
+
+    // Reopened after a flush, everything is there
+    reopen();
+    tsStoreRange_t reopened;
+    CHECK(tsStoreRange(&gStore, &reopened));
+    CHECK(reopened.tFirst == range.tFirst && reopened.tLast == range.tLast);
+    append(EXTRA_CNT);
+    checkRandomRanges();
+
+    // Reopened without a flush, the samples after the last write are
+    // lost, so the appended list is cut there
+    reopen();
+    CHECK(tsStoreRange(&gStore, &reopened));
+    while (gSampleCnt > 0 && gSamples[gSampleCnt - 1].time > reopened.tLast) {
+        gSampleCnt--;
+    }
+    CHECK(gSamples[gSampleCnt - 1].time == reopened.tLast);
+    checkRandomRanges();
+    // Continues after the last sample kept
+    CHECK(tsStoreAppend(&gStore, reopened.tLast - 1, 0) < 0);
+    append(LAST_CNT);
+    checkRange(0, UINT32_MAX);
+
+    fclose(gpImage);
+    return TEST_RESULT();
+}
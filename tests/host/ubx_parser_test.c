@@ -0,0 +1,258 @@
+/*
+ * Copyright 2023 u-blox
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of common/ubx_parser. Frames mixed with NMEA are fed in
+ * pieces of random size, then random bytes with corrupt and truncated
+ * frames, where only frames which were sent intact may come out.
+ * Frames committed directly are checked for each kind of failure,
+ * and the feed throughput is measured.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "ubx_parser.h"
+#include "test.h"
+
+// Room for all frames in the largest piece fed
+#define RING_SLOTS 64
+#define FRAME_CNT 20000
+#define FUZZ_ROUNDS 200000
+#define THROUGHPUT_BYTES (64 * 1024 * 1024)
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+static ubxFrame_t gFrames[RING_SLOTS];
+static ubxParser_t gParser;
+static uint8_t gStream[64 * 1024];
+
+// A frame with its sequence number first in the payload
+static size_t makeFrame(uint8_t *pBuf, uint32_t seq, size_t payloadLen)
+{
+    pBuf[0] = 0xB5;
+    pBuf[1] = 0x62;
+    pBuf[2] = UBX_CLASS_NAV;
+    pBuf[3] = seq % 2 ? UBX_ID_NAV_PVT : UBX_ID_NAV_SAT;
+    pBuf[4] = payloadLen & 0xFF;
+    pBuf[5] = payloadLen >> 8;
+    for (size_t i = 0; i < payloadLen; i++) {
+        pBuf[UBX_HEADER_SIZE + i] = i < 4 ? seq >> (8 * i) : testRand();
+    }
+    uint8_t ckA = 0;
+    uint8_t ckB = 0;
+    for (size_t i = 2; i < UBX_HEADER_SIZE + payloadLen; i++) {
+        ckA += pBuf[i];
+        ckB += ckA;
+    }
+    pBuf[UBX_HEADER_SIZE + payloadLen] = ckA;
+    pBuf[UBX_HEADER_SIZE + payloadLen + 1] = ckB;
+    return UBX_HEADER_SIZE + payloadLen + UBX_CHECKSUM_SIZE;
+}
+
+static uint32_t seqOf(const ubxFrame_t *pFrame)
+{
+    const uint8_t *pPayload = ubxFramePayload(pFrame, NULL);
+    return pPayload[0] | (pPayload[1] << 8) | (pPayload[2] << 16) |
+           ((uint32_t)pPayload[3] << 24);
+}
+
+// Feed in pieces of random size, taking out the frames as they come
+static size_t feed(const uint8_t *pData, size_t len, uint32_t *pNextSeq, bool exact)
+{
+    size_t cnt = 0;
+    while (len > 0) {
+        size_t n = 1 + testRand() % 700;
+        n = MIN(n, len);
+        ubxParserFeed(&gParser, pData, n, 1234);
+        pData += n;
+        len -= n;
+        const ubxFrame_t *pFrame;
+        while ((pFrame = ubxParserPeek(&gParser)) != NULL) {
+            size_t payloadLen;
+            ubxFramePayload(pFrame, &payloadLen);
+            CHECK(pFrame->length == UBX_HEADER_SIZE + payloadLen + UBX_CHECKSUM_SIZE);
+            CHECK(pFrame->timestampMs == 1234);
+            // In order, and without gaps when nothing was lost
+            uint32_t seq = seqOf(pFrame);
+            CHECK(exact ? seq == *pNextSeq : seq >= *pNextSeq);
+            *pNextSeq = seq + 1;
+            ubxParserRelease(&gParser);
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+// Frames between NMEA sentences, all of them must come out
+static void testClean()
+{
+    ubxParserInit(&gParser, gFrames, RING_SLOTS);
+    static const char nmea[] = "$GNGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,"
+                               "499.6,M,48.0,M,,*5B\r\n";
+    uint32_t nextSeq = 0;
+    size_t received = 0;
+    for (uint32_t seq = 0; seq < FRAME_CNT;) {
+        size_t len = 0;
+        while (len < sizeof(gStream) - sizeof(gFrames[0].data) - sizeof(nmea) &&
+               seq < FRAME_CNT) {
+            if (testRand() % 4 == 0) {
+                memcpy(&gStream[len], nmea, sizeof(nmea) - 1);
+                len += sizeof(nmea) - 1;
+            }
+            // Mostly PVT sized, some of the largest size
+            size_t payloadLen = testRand() % 50 == 0 ? UBX_MAX_PAYLOAD : testRand() % 200 + 4;
+            len += makeFrame(&gStream[len], seq++, payloadLen);
+        }
+        received += feed(gStream, len, &nextSeq, true);
+    }
+    CHECK(received == FRAME_CNT);
+    CHECK(gParser.stats.frames == FRAME_CNT);
+    CHECK(gParser.stats.checksumErrors == 0 && gParser.stats.rejected == 0);
+    CHECK(gParser.stats.oversize == 0 && gParser.stats.dropped == 0);
+}
+
+// Random bytes, with frames which are corrupt, truncated or intact
+static void testFuzz()
+{
+    ubxParserInit(&gParser, gFrames, RING_SLOTS);
+    uint32_t nextSeq = 0;
+    size_t received = 0;
+    uint32_t intact = 0;
+    uint32_t seq = 0;
+    for (int round = 0; round < FUZZ_ROUNDS / 100; round++) {
+        size_t len = 0;
+        for (int i = 0; i < 100; i++) {
+            size_t garbage = testRand() % 64;
+            for (size_t j = 0; j < garbage; j++) {
+                gStream[len++] = testRand();
+            }
+            size_t frameLen = makeFrame(&gStream[len], seq++, testRand() % 300 + 4);
+            switch (testRand() % 4) {
+                case 0:
+                    // Truncated, takes bytes from what follows
+                    frameLen = testRand() % frameLen;
+                    break;
+                case 1:
+                    gStream[len + testRand() % frameLen] ^= 1 << (testRand() % 8);
+                    break;
+                default:
+                    intact++;
+                    break;
+            }
+            len += frameLen;
+        }
+        received += feed(gStream, len, &nextSeq, false);
+    }
+    printf("Fuzz: %u of %u frames intact, %u received, %u checksum errors, %u oversize\n",
+           intact, seq, (unsigned)received, gParser.stats.checksumErrors,
+           gParser.stats.oversize);
+    // Frames after a truncated one may be lost, but most must arrive
+    CHECK(received <= intact);
+    CHECK(received > intact / 2);
+    CHECK(gParser.stats.checksumErrors > 0 && gParser.stats.oversize > 0);
+    CHECK(gParser.stats.rejected == 0);
+}
+
+// A slow consumer, and lengths which can't be stored
+static void testFullAndOversize()
+{
+    ubxParserInit(&gParser, gFrames, RING_SLOTS);
+    size_t len = 0;
+    for (uint32_t seq = 0; seq < RING_SLOTS + 5; seq++) {
+        len += makeFrame(&gStream[len], seq, 100);
+    }
+    // A header with a length beyond any NAV-SAT
+    uint8_t oversize[] = {0xB5, 0x62, 0x01, 0x35, 0xFF, 0xFF};
+    memcpy(&gStream[len], oversize, sizeof(oversize));
+    len += sizeof(oversize);
+    CHECK(ubxParserFeed(&gParser, gStream, len, 0) == RING_SLOTS - 1);
+    CHECK(gParser.stats.dropped == 6);
+    CHECK(gParser.stats.oversize == 1);
+    for (uint32_t seq = 0; seq < RING_SLOTS - 1; seq++) {
+        const ubxFrame_t *pFrame = ubxParserPeek(&gParser);
+        CHECK(pFrame != NULL && seqOf(pFrame) == seq);
+        ubxParserRelease(&gParser);
+    }
+    CHECK(ubxParserPeek(&gParser) == NULL);
+}
+
+// Frames written to a reserved slot, as from ubxlib
+static void testCommit()
+{
+    ubxParserInit(&gParser, gFrames, RING_SLOTS);
+    uint8_t *pSlot = ubxParserReserve(&gParser);
+    size_t len = makeFrame(pSlot, 1, 92);
+    CHECK(ubxParserCommit(&gParser, len, 5));
+    // Cut short by the reader
+    pSlot = ubxParserReserve(&gParser);
+    len = makeFrame(pSlot, 2, 92);
+    CHECK(!ubxParserCommit(&gParser, len - 1, 5));
+    CHECK(!ubxParserCommit(&gParser, 3, 5));
+    // More than a slot holds
+    CHECK(!ubxParserCommit(&gParser, sizeof(gFrames[0].data) + 1, 5));
+    // Not a UBX frame
+    pSlot[0] = '$';
+    CHECK(!ubxParserCommit(&gParser, len, 5));
+    CHECK(gParser.stats.rejected == 4);
+    CHECK(gParser.stats.checksumErrors == 0);
+    // Corrupt
+    len = makeFrame(pSlot, 3, 92);
+    pSlot[20] ^= 0x10;
+    CHECK(!ubxParserCommit(&gParser, len, 5));
+    CHECK(gParser.stats.checksumErrors == 1 && gParser.stats.rejected == 4);
+    CHECK(gParser.stats.frames == 1);
+    const ubxFrame_t *pFrame = ubxParserPeek(&gParser);
+    CHECK(pFrame != NULL && seqOf(pFrame) == 1 && pFrame->timestampMs == 5);
+    CHECK(ubxFrameIs(pFrame, UBX_CLASS_NAV, UBX_ID_NAV_PVT));
+}
+
+static void testThroughput()
+{
+    ubxParserInit(&gParser, gFrames, RING_SLOTS);
+    size_t len = 0;
+    uint32_t seq = 0;
+    while (len < sizeof(gStream) - 200) {
+        len += makeFrame(&gStream[len], seq++, sizeof(ubxNavPvt_t));
+    }
+    uint32_t frames = 0;
+    clock_t start = clock();
+    for (size_t fed = 0; fed < THROUGHPUT_BYTES; fed += len) {
+        for (size_t pos = 0; pos < len; pos += 256) {
+            ubxParserFeed(&gParser, &gStream[pos], MIN(256, len - pos), 0);
+            while (ubxParserPeek(&gParser) != NULL) {
+                ubxParserRelease(&gParser);
+                frames++;
+            }
+        }
+    }
+    double s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("Throughput: %u PVT frames, %.0f MB/s\n", frames,
+           THROUGHPUT_BYTES / (s > 0 ? s : 1e-6) / 1e6);
+    CHECK(frames == gParser.stats.frames);
+    CHECK(gParser.stats.checksumErrors == 0 && gParser.stats.dropped == 0);
+}
+
+int main()
+{
+    testSeed(27);
+    testClean();
+    testFuzz();
+    testFullAndOversize();
+    testCommit();
+    testThroughput();
+    return TEST_RESULT();
+}